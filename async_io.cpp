@@ -0,0 +1,907 @@
+#include"async_io.h"
+#include<errno.h>
+#include<stdint.h>
+#include<stdio.h>
+#include<string.h>
+#include<chrono>
+#include<mutex>
+
+#if !defined(_WIN32)
+#include<fcntl.h>
+#include<unistd.h>
+#include<sys/stat.h>
+#endif
+
+#ifdef USE_IO_URING
+#include<linux/io_uring.h>
+#include<sched.h>
+#include<sys/mman.h>
+#include<sys/syscall.h>
+#include<sys/uio.h>
+
+// ==================================================================================================
+// io_uring instance, mapped from the kernel
+// ==================================================================================================
+struct io_uring_ring_tag
+{
+    int fd;
+    unsigned entries;
+
+    void *sqRing;                   // Submission queue ring mapping
+    size_t sqRingSize;
+    unsigned *sqHead;
+    unsigned *sqTail;
+    unsigned *sqMask;
+    unsigned *sqArray;
+    struct io_uring_sqe *sqes;
+    size_t sqesSize;
+    unsigned sqeTail;               // Entries prepared but not yet published to the kernel
+
+    void *cqRing;                   // Completion queue ring mapping (may be the same as sqRing)
+    size_t cqRingSize;
+    unsigned *cqHead;
+    unsigned *cqTail;
+    unsigned *cqMask;
+    struct io_uring_cqe *cqes;
+};
+
+//******************************************************************************************
+// @name                    : RingSetup
+//
+// @description             : This is a static function. Creates an io_uring and maps its
+//                            queues.
+//
+// @param entries           : Submission queue size
+//
+// @returns                 : Ring, nullptr if io_uring is not available (old kernel,
+//                            seccomp, disabled by sysctl)
+//********************************************************************************************
+static struct io_uring_ring_tag* RingSetup(unsigned entries)
+{
+    struct io_uring_params params;
+    memset(&params, 0, sizeof(params));
+
+    int fd = (int)syscall(__NR_io_uring_setup, entries, &params);
+    if (fd < 0)
+    {
+        return nullptr;
+    }
+
+    struct io_uring_ring_tag *ring = new struct io_uring_ring_tag;
+    memset(ring, 0, sizeof(*ring));
+    ring->fd = fd;
+    ring->entries = params.sq_entries;
+    ring->sqRingSize = params.sq_off.array + params.sq_entries * sizeof(unsigned);
+    ring->cqRingSize = params.cq_off.cqes + params.cq_entries * sizeof(struct io_uring_cqe);
+    ring->sqesSize = params.sq_entries * sizeof(struct io_uring_sqe);
+
+    bool singleMap = (params.features & IORING_FEAT_SINGLE_MMAP) != 0;
+    if (singleMap && ring->cqRingSize > ring->sqRingSize)
+    {
+        ring->sqRingSize = ring->cqRingSize;
+    }
+
+    ring->sqRing = mmap(nullptr, ring->sqRingSize, PROT_READ | PROT_WRITE, MAP_SHARED | MAP_POPULATE, fd, IORING_OFF_SQ_RING);
+    ring->cqRing = singleMap ? ring->sqRing :
+                   mmap(nullptr, ring->cqRingSize, PROT_READ | PROT_WRITE, MAP_SHARED | MAP_POPULATE, fd, IORING_OFF_CQ_RING);
+    ring->sqes = (struct io_uring_sqe *)mmap(nullptr, ring->sqesSize, PROT_READ | PROT_WRITE, MAP_SHARED | MAP_POPULATE,
+                                             fd, IORING_OFF_SQES);
+    if (ring->sqRing == MAP_FAILED || ring->cqRing == MAP_FAILED || ring->sqes == MAP_FAILED)
+    {
+        if (ring->sqes != MAP_FAILED)
+            munmap(ring->sqes, ring->sqesSize);
+        if (!singleMap && ring->cqRing != MAP_FAILED)
+            munmap(ring->cqRing, ring->cqRingSize);
+        if (ring->sqRing != MAP_FAILED)
+            munmap(ring->sqRing, ring->sqRingSize);
+        close(fd);
+        delete ring;
+        return nullptr;
+    }
+
+    unsigned char *sq = (unsigned char *)ring->sqRing;
+    ring->sqHead = (unsigned *)(sq + params.sq_off.head);
+    ring->sqTail = (unsigned *)(sq + params.sq_off.tail);
+    ring->sqMask = (unsigned *)(sq + params.sq_off.ring_mask);
+    ring->sqArray = (unsigned *)(sq + params.sq_off.array);
+    ring->sqeTail = *ring->sqTail;
+
+    unsigned char *cq = (unsigned char *)ring->cqRing;
+    ring->cqHead = (unsigned *)(cq + params.cq_off.head);
+    ring->cqTail = (unsigned *)(cq + params.cq_off.tail);
+    ring->cqMask = (unsigned *)(cq + params.cq_off.ring_mask);
+    ring->cqes = (struct io_uring_cqe *)(cq + params.cq_off.cqes);
+
+    return ring;
+}
+
+//******************************************************************************************
+// @name                    : RingDestroy
+//
+// @description             : This is a static function. Unmaps and closes an io_uring.
+//
+// @returns                 : Nothing
+//********************************************************************************************
+static void RingDestroy(struct io_uring_ring_tag *ring)
+{
+    munmap(ring->sqes, ring->sqesSize);
+    if (ring->cqRing != ring->sqRing)
+    {
+        munmap(ring->cqRing, ring->cqRingSize);
+    }
+    munmap(ring->sqRing, ring->sqRingSize);
+    close(ring->fd);
+    delete ring;
+}
+
+//******************************************************************************************
+// @name                    : RingQueue
+//
+// @description             : This is a static function. Prepares a vectored read or write.
+//                            It is handed to the kernel by the next RingSubmitAndWait. The
+//                            caller never has more operations outstanding than entries.
+//
+// @param opcode            : IORING_OP_READV or IORING_OP_WRITEV
+// @param iov               : Buffer, valid until the operation completes
+// @param userData          : Returned with the completion
+//
+// @returns                 : Nothing
+//********************************************************************************************
+static void RingQueue(struct io_uring_ring_tag *ring, int opcode, int fd, const struct iovec *iov, off_t offset,
+                      unsigned long long userData)
+{
+    unsigned index = ring->sqeTail & *ring->sqMask;
+    struct io_uring_sqe *sqe = &ring->sqes[index];
+
+    memset(sqe, 0, sizeof(*sqe));
+    sqe->opcode = (unsigned char)opcode;
+    sqe->fd = fd;
+    sqe->addr = (unsigned long long)(uintptr_t)iov;
+    sqe->len = 1;
+    sqe->off = (unsigned long long)offset;
+    sqe->user_data = userData;
+
+    ring->sqArray[index] = index;
+    ring->sqeTail++;
+}
+
+//******************************************************************************************
+// @name                    : RingSubmitAndWait
+//
+// @description             : This is a static function. Publishes the prepared operations
+//                            and waits until at least waitCount completions are available.
+//
+// @returns                 : 0 if SUCCESS, -1 if the kernel refused the ring
+//********************************************************************************************
+static int RingSubmitAndWait(struct io_uring_ring_tag *ring, unsigned waitCount)
+{
+    unsigned toSubmit = ring->sqeTail - *ring->sqTail;
+    __atomic_store_n(ring->sqTail, ring->sqeTail, __ATOMIC_RELEASE);
+
+    while (toSubmit > 0 || waitCount > 0)
+    {
+        int submitted = (int)syscall(__NR_io_uring_enter, ring->fd, toSubmit, waitCount,
+                                     waitCount > 0 ? IORING_ENTER_GETEVENTS : 0, nullptr, 0);
+        if (submitted < 0)
+        {
+            if (errno == EINTR)
+            {
+                continue;
+            }
+
+            printf("ERROR: io_uring_enter failed (%s)!\n", strerror(errno));
+            return -1;
+        }
+
+        toSubmit -= (unsigned)submitted;
+        waitCount = 0;
+    }
+
+    return 0;
+}
+
+//******************************************************************************************
+// @name                    : RingNextCompletion
+//
+// @description             : This is a static function. Takes the oldest completion.
+//
+// @returns                 : false if there is none
+//********************************************************************************************
+static bool RingNextCompletion(struct io_uring_ring_tag *ring, unsigned long long *userData, int *result)
+{
+    unsigned head = *ring->cqHead;
+    if (head == __atomic_load_n(ring->cqTail, __ATOMIC_ACQUIRE))
+    {
+        return false;
+    }
+
+    struct io_uring_cqe *cqe = &ring->cqes[head & *ring->cqMask];
+    *userData = cqe->user_data;
+    *result = cqe->res;
+    __atomic_store_n(ring->cqHead, head + 1, __ATOMIC_RELEASE);
+
+    return true;
+}
+#else
+struct io_uring_ring_tag
+{
+    int unused;
+};
+#endif
+
+// One file being read or written by the io_uring backend
+typedef struct async_io_slot_tag
+{
+    int index;                      // Index of the file in the batch
+    int fd;
+    unsigned char *buffer;
+    size_t size;                    // Bytes to transfer
+    size_t done;                    // Bytes transferred so far
+    std::vector<unsigned char> data;    // Buffer of a read
+}async_io_slot_t;
+
+//******************************************************************************************
+// @name                    : ReadWholeFile
+//
+// @description             : This is a static function. Blocking read of a file, for the
+//                            thread pool backend.
+//
+// @returns                 : 0 if SUCCESS
+//********************************************************************************************
+static int ReadWholeFile(const char *path, std::vector<unsigned char> &data)
+{
+#if defined(_WIN32)
+    FILE *fp = fopen(path, "rb");
+    if (fp == nullptr)
+    {
+        return -1;
+    }
+
+    fseek(fp, 0, SEEK_END);
+    long size = ftell(fp);
+    fseek(fp, 0, SEEK_SET);
+    data.resize(size > 0 ? size : 0);
+    size_t bytesRead = data.empty() ? 0 : fread(&data[0], 1, data.size(), fp);
+    fclose(fp);
+
+    return (bytesRead == data.size()) ? 0 : -1;
+#else
+    int fd = open(path, O_RDONLY);
+    if (fd < 0)
+    {
+        return -1;
+    }
+
+    struct stat status;
+    if (fstat(fd, &status) != 0)
+    {
+        close(fd);
+        return -1;
+    }
+
+    data.resize((size_t)status.st_size);
+    size_t done = 0;
+    while (done < data.size())
+    {
+        ssize_t bytesRead = pread(fd, &data[done], data.size() - done, (off_t)done);
+        if (bytesRead < 0 && errno == EINTR)
+        {
+            continue;
+        }
+
+        if (bytesRead <= 0)
+        {
+            close(fd);
+            return -1;
+        }
+
+        done += (size_t)bytesRead;
+    }
+
+    close(fd);
+    return 0;
+#endif
+}
+
+//******************************************************************************************
+// @name                    : WriteWholeFile
+//
+// @description             : This is a static function. Blocking write of a file, for the
+//                            thread pool backend.
+//
+// @returns                 : 0 if SUCCESS
+//********************************************************************************************
+static int WriteWholeFile(const char *path, const unsigned char *data, size_t size)
+{
+#if defined(_WIN32)
+    FILE *fp = fopen(path, "wb");
+    if (fp == nullptr)
+    {
+        return -1;
+    }
+
+    size_t written = (size > 0) ? fwrite(data, 1, size, fp) : 0;
+    int closed = fclose(fp);
+
+    return (written == size && closed == 0) ? 0 : -1;
+#else
+    int fd = open(path, O_WRONLY | O_CREAT | O_TRUNC, 0644);
+    if (fd < 0)
+    {
+        return -1;
+    }
+
+    size_t done = 0;
+    while (done < size)
+    {
+        ssize_t written = pwrite(fd, data + done, size - done, (off_t)done);
+        if (written < 0 && errno == EINTR)
+        {
+            continue;
+        }
+
+        if (written <= 0)
+        {
+            close(fd);
+            return -1;
+        }
+
+        done += (size_t)written;
+    }
+
+    return (close(fd) == 0) ? 0 : -1;
+#endif
+}
+
+//******************************************************************************************
+// @name                    : AsyncFileIO
+//
+// @description             : Constructor. Sets up io_uring, or the fallback threads if
+//                            io_uring is not wanted or not available.
+//
+// @param backend           : Backend to use. ASYNC_IO_URING still falls back if the kernel
+//                            refuses io_uring.
+// @param queueDepth        : Files in flight at once
+//
+// @returns                 : Nothing
+//********************************************************************************************
+AsyncFileIO::AsyncFileIO(async_io_backend_t backend, int queueDepth)
+{
+    m_queueDepth = (queueDepth > 0) ? queueDepth : ASYNC_IO_QUEUE_DEPTH;
+    m_ring = nullptr;
+    m_pool = nullptr;
+
+#ifdef USE_IO_URING
+    if (backend != ASYNC_IO_THREAD_POOL)
+    {
+        m_ring = RingSetup((unsigned)m_queueDepth);
+        if (m_ring != nullptr && (int)m_ring->entries < m_queueDepth)
+        {
+            m_queueDepth = (int)m_ring->entries;
+        }
+    }
+#endif
+
+    if (m_ring != nullptr)
+    {
+        m_backend = ASYNC_IO_URING;
+    }
+    else
+    {
+        if (backend == ASYNC_IO_URING)
+        {
+            printf("INFO: io_uring is not available, using the thread pool for file I/O\n");
+        }
+
+        this->fallBackToThreadPool();
+    }
+}
+
+//******************************************************************************************
+// @name                    : ~AsyncFileIO
+//
+// @description             : Destructor
+//
+// @returns                 : Nothing
+//********************************************************************************************
+AsyncFileIO::~AsyncFileIO()
+{
+#ifdef USE_IO_URING
+    if (m_ring != nullptr)
+    {
+        RingDestroy(m_ring);
+    }
+#endif
+
+    delete m_pool;
+}
+
+//******************************************************************************************
+// @name                    : fallBackToThreadPool
+//
+// @description             : Switches to the thread pool backend, for good. Used when
+//                            io_uring is not available and when the kernel stops taking
+//                            operations from the ring.
+//
+// @returns                 : Nothing
+//********************************************************************************************
+void AsyncFileIO::fallBackToThreadPool()
+{
+#ifdef USE_IO_URING
+    if (m_ring != nullptr)
+    {
+        RingDestroy(m_ring);
+        m_ring = nullptr;
+    }
+#endif
+
+    m_backend = ASYNC_IO_THREAD_POOL;
+    if (m_pool == nullptr)
+    {
+        m_pool = new ThreadPool((m_queueDepth < ASYNC_IO_FALLBACK_THREADS ? m_queueDepth : ASYNC_IO_FALLBACK_THREADS) - 1);
+    }
+}
+
+//******************************************************************************************
+// @name                    : getBackend
+//
+// @description             : Backend in use, ASYNC_IO_URING or ASYNC_IO_THREAD_POOL
+//
+// @returns                 : Backend
+//********************************************************************************************
+async_io_backend_t AsyncFileIO::getBackend()
+{
+    return m_backend;
+}
+
+//******************************************************************************************
+// @name                    : readFiles
+//
+// @description             : Reads whole files, keeping up to the queue depth in flight.
+//                            onRead is called on the calling thread (io_uring) or on a
+//                            fallback thread, once per file, in completion order.
+//
+// @param paths             : Files to read
+// @param onRead            : Called with the index of the file in paths and its contents
+//
+// @returns                 : Number of files which could not be read
+//********************************************************************************************
+int AsyncFileIO::readFiles(const std::vector<std::string> &paths, const async_read_callback_t &onRead)
+{
+    if (m_backend == ASYNC_IO_URING)
+    {
+        return this->readFilesUring(paths, onRead);
+    }
+
+    return this->readFilesThreadPool(paths, onRead);
+}
+
+//******************************************************************************************
+// @name                    : writeFiles
+//
+// @description             : Writes whole files, replacing existing ones, keeping up to the
+//                            queue depth in flight. onWritten is called like onRead.
+//
+// @param requests          : Files to write
+// @param onWritten         : Called with the index of the request once its file is closed.
+//                            May be empty.
+//
+// @returns                 : Number of files which could not be written
+//********************************************************************************************
+int AsyncFileIO::writeFiles(const std::vector<async_write_request_t> &requests, const async_write_callback_t &onWritten)
+{
+    if (m_backend == ASYNC_IO_URING)
+    {
+        return this->writeFilesUring(requests, onWritten);
+    }
+
+    return this->writeFilesThreadPool(requests, onWritten);
+}
+
+//******************************************************************************************
+// @name                    : readFilesThreadPool
+//
+// @description             : readFiles with blocking reads on the fallback threads
+//
+// @returns                 : Number of files which could not be read
+//********************************************************************************************
+int AsyncFileIO::readFilesThreadPool(const std::vector<std::string> &paths, const async_read_callback_t &onRead)
+{
+    std::mutex callbackMutex;
+    int failures = 0;
+
+    m_pool->parallelFor((int)paths.size(), 1, [&](int begin, int end)
+    {
+        for (int i = begin; i < end; i++)
+        {
+            std::vector<unsigned char> data;
+            int status = ReadWholeFile(paths[i].c_str(), data);
+
+            std::unique_lock<std::mutex> lock(callbackMutex);
+            if (status != 0)
+            {
+                printf("ERROR: Could not read [%s]!\n", paths[i].c_str());
+                data.clear();
+                failures++;
+            }
+            onRead(i, status, data);
+        }
+    });
+
+    return failures;
+}
+
+//******************************************************************************************
+// @name                    : writeFilesThreadPool
+//
+// @description             : writeFiles with blocking writes on the fallback threads
+//
+// @returns                 : Number of files which could not be written
+//********************************************************************************************
+int AsyncFileIO::writeFilesThreadPool(const std::vector<async_write_request_t> &requests,
+                                      const async_write_callback_t &onWritten)
+{
+    std::mutex callbackMutex;
+    int failures = 0;
+
+    m_pool->parallelFor((int)requests.size(), 1, [&](int begin, int end)
+    {
+        for (int i = begin; i < end; i++)
+        {
+            int status = WriteWholeFile(requests[i].path.c_str(), requests[i].data, requests[i].size);
+
+            std::unique_lock<std::mutex> lock(callbackMutex);
+            if (status != 0)
+            {
+                printf("ERROR: Could not write [%s]!\n", requests[i].path.c_str());
+                failures++;
+            }
+            if (onWritten)
+            {
+                onWritten(i, status);
+            }
+        }
+    });
+
+    return failures;
+}
+
+#ifdef USE_IO_URING
+//******************************************************************************************
+// @name                    : AbandonRingBatch
+//
+// @description             : This is a static function. Gives up a batch whose ring can no
+//                            longer be entered. Operations still in the submission queue
+//                            never reach the kernel. Those the kernel took still use their
+//                            slot buffers, so their completions are awaited. A file whose
+//                            last byte comes through is finished; every other file of the
+//                            batch is closed and listed for the caller to redo.
+//
+// @param busy              : Slots with a file in flight
+// @param next              : First file of the batch not started yet
+// @param finishSlot        : Finishes a slot with a status, returns 1 if it failed
+// @param unfinished        : Indices of the files to redo on return
+//
+// @returns                 : Number of files which failed
+//********************************************************************************************
+template<typename FinishSlot>
+static int AbandonRingBatch(struct io_uring_ring_tag *ring, std::vector<async_io_slot_t> &slots,
+                            std::vector<char> &busy, int next, int count, FinishSlot &&finishSlot,
+                            std::vector<int> &unfinished)
+{
+    std::vector<char> inKernel(busy);
+    for (unsigned p = __atomic_load_n(ring->sqHead, __ATOMIC_ACQUIRE); p != ring->sqeTail; p++)
+    {
+        inKernel[ring->sqes[ring->sqArray[p & *ring->sqMask]].user_data] = 0;
+    }
+
+    int waiting = 0;
+    for (size_t s = 0; s < inKernel.size(); s++)
+    {
+        waiting += inKernel[s];
+    }
+
+    // Completions of requests handed to kernel workers need no system call to arrive, the
+    // others are completed when this thread returns from one
+    int failures = 0;
+    auto deadline = std::chrono::steady_clock::now() + std::chrono::milliseconds(ASYNC_IO_DRAIN_TIMEOUT_MS);
+    while (waiting > 0 && std::chrono::steady_clock::now() < deadline)
+    {
+        unsigned long long userData = 0;
+        int result = 0;
+        while (RingNextCompletion(ring, &userData, &result))
+        {
+            int s = (int)userData;
+            inKernel[s] = 0;
+            waiting--;
+
+            async_io_slot_t &slot = slots[s];
+            if (result > 0 && slot.done + (size_t)result == slot.size)
+            {
+                slot.done = slot.size;
+                failures += finishSlot(s, 0);
+            }
+        }
+
+        sched_yield();
+    }
+
+    for (size_t s = 0; s < slots.size(); s++)
+    {
+        if (!busy[s])
+        {
+            continue;
+        }
+
+        // The kernel may still fill a read buffer that did not complete in time, so it is
+        // left allocated
+        if (inKernel[s])
+        {
+            printf("WARNING: io_uring operation did not complete, leaking its buffer\n");
+            (new std::vector<unsigned char>())->swap(slots[s].data);
+        }
+
+        close(slots[s].fd);
+        slots[s].fd = -1;
+        busy[s] = 0;
+        unfinished.push_back(slots[s].index);
+    }
+
+    for (int i = next; i < count; i++)
+    {
+        unfinished.push_back(i);
+    }
+
+    return failures;
+}
+
+//******************************************************************************************
+// @name                    : RunRingBatch
+//
+// @description             : This is a static function. Drives a batch of whole-file
+//                            transfers through the ring. Files are opened as slots free up,
+//                            short transfers are resubmitted for the remainder, and every
+//                            file is handed to finish as soon as its last byte is through.
+//
+// @param count             : Number of files
+// @param opcode            : IORING_OP_READV or IORING_OP_WRITEV
+// @param start             : Opens file index into the slot and sets buffer and size.
+//                            Returns false if the file cannot be opened.
+// @param finish            : Called with the slot and the status of the file
+// @param unfinished        : Files left to the caller if the kernel stops taking
+//                            operations, empty otherwise
+//
+// @returns                 : Number of files which failed
+//********************************************************************************************
+template<typename Start, typename Finish>
+static int RunRingBatch(struct io_uring_ring_tag *ring, int queueDepth, int count, int opcode,
+                        Start &&start, Finish &&finish, std::vector<int> &unfinished)
+{
+    std::vector<async_io_slot_t> slots(queueDepth);
+    std::vector<struct iovec> iovs(queueDepth);
+    std::vector<char> busy(queueDepth, 0);
+    std::vector<int> freeSlots;
+    for (int s = queueDepth - 1; s >= 0; s--)
+    {
+        freeSlots.push_back(s);
+    }
+
+    auto queueSlot = [&](int s)
+    {
+        async_io_slot_t &slot = slots[s];
+        iovs[s].iov_base = slot.buffer + slot.done;
+        iovs[s].iov_len = slot.size - slot.done;
+        RingQueue(ring, opcode, slot.fd, &iovs[s], (off_t)slot.done, (unsigned long long)s);
+    };
+
+    auto finishSlot = [&](int s, int status)
+    {
+        async_io_slot_t &slot = slots[s];
+        if (slot.fd >= 0 && close(slot.fd) != 0 && status == 0)
+        {
+            status = -1;
+        }
+
+        slot.fd = -1;
+        busy[s] = 0;
+        freeSlots.push_back(s);
+        finish(slot, status);
+        return (status != 0) ? 1 : 0;
+    };
+
+    int failures = 0;
+    int inFlight = 0;
+    int next = 0;
+    while (next < count || inFlight > 0)
+    {
+        while (!freeSlots.empty() && next < count)
+        {
+            int s = freeSlots.back();
+            freeSlots.pop_back();
+
+            async_io_slot_t &slot = slots[s];
+            slot.index = next++;
+            slot.fd = -1;
+            slot.done = 0;
+            busy[s] = 1;
+            if (!start(slot))
+            {
+                failures += finishSlot(s, -1);
+            }
+            else if (slot.size == 0)
+            {
+                failures += finishSlot(s, 0);
+            }
+            else
+            {
+                queueSlot(s);
+                inFlight++;
+            }
+        }
+
+        if (inFlight == 0)
+        {
+            continue;
+        }
+
+        if (RingSubmitAndWait(ring, 1) != 0)
+        {
+            return failures + AbandonRingBatch(ring, slots, busy, next, count, finishSlot, unfinished);
+        }
+
+        unsigned long long userData = 0;
+        int result = 0;
+        while (RingNextCompletion(ring, &userData, &result))
+        {
+            int s = (int)userData;
+            async_io_slot_t &slot = slots[s];
+
+            if (result == -EINTR || result == -EAGAIN)
+            {
+                queueSlot(s);
+                continue;
+            }
+
+            // An error, or the file ended before its size
+            if (result <= 0)
+            {
+                inFlight--;
+                failures += finishSlot(s, -1);
+                continue;
+            }
+
+            slot.done += (size_t)result;
+            if (slot.done < slot.size)
+            {
+                queueSlot(s);
+                continue;
+            }
+
+            inFlight--;
+            failures += finishSlot(s, 0);
+        }
+    }
+
+    return failures;
+}
+#endif
+
+//******************************************************************************************
+// @name                    : readFilesUring
+//
+// @description             : readFiles on io_uring
+//
+// @returns                 : Number of files which could not be read
+//********************************************************************************************
+int AsyncFileIO::readFilesUring(const std::vector<std::string> &paths, const async_read_callback_t &onRead)
+{
+#ifdef USE_IO_URING
+    auto start = [&](async_io_slot_t &slot)
+    {
+        slot.fd = open(paths[slot.index].c_str(), O_RDONLY);
+        struct stat status;
+        if (slot.fd < 0 || fstat(slot.fd, &status) != 0)
+        {
+            return false;
+        }
+
+        slot.data.resize((size_t)status.st_size);
+        slot.buffer = slot.data.empty() ? nullptr : &slot.data[0];
+        slot.size = slot.data.size();
+        return true;
+    };
+
+    auto finish = [&](async_io_slot_t &slot, int status)
+    {
+        if (status != 0)
+        {
+            printf("ERROR: Could not read [%s]!\n", paths[slot.index].c_str());
+            slot.data.clear();
+        }
+        onRead(slot.index, status, slot.data);
+    };
+
+    std::vector<int> unfinished;
+    int failures = RunRingBatch(m_ring, m_queueDepth, (int)paths.size(), IORING_OP_READV, start, finish, unfinished);
+    if (unfinished.empty())
+    {
+        return failures;
+    }
+
+    printf("WARNING: io_uring failed, reading the remaining %d files on threads\n", (int)unfinished.size());
+    this->fallBackToThreadPool();
+
+    std::vector<std::string> remaining;
+    for (size_t i = 0; i < unfinished.size(); i++)
+    {
+        remaining.push_back(paths[unfinished[i]]);
+    }
+
+    return failures + this->readFilesThreadPool(remaining, [&](int index, int status, std::vector<unsigned char> &data)
+    {
+        onRead(unfinished[index], status, data);
+    });
+#else
+    return this->readFilesThreadPool(paths, onRead);
+#endif
+}
+
+//******************************************************************************************
+// @name                    : writeFilesUring
+//
+// @description             : writeFiles on io_uring
+//
+// @returns                 : Number of files which could not be written
+//********************************************************************************************
+int AsyncFileIO::writeFilesUring(const std::vector<async_write_request_t> &requests,
+                                 const async_write_callback_t &onWritten)
+{
+#ifdef USE_IO_URING
+    auto start = [&](async_io_slot_t &slot)
+    {
+        const async_write_request_t &request = requests[slot.index];
+        slot.fd = open(request.path.c_str(), O_WRONLY | O_CREAT | O_TRUNC, 0644);
+        slot.buffer = (unsigned char *)request.data;
+        slot.size = request.size;
+        return slot.fd >= 0;
+    };
+
+    auto finish = [&](async_io_slot_t &slot, int status)
+    {
+        if (status != 0)
+        {
+            printf("ERROR: Could not write [%s]!\n", requests[slot.index].path.c_str());
+        }
+        if (onWritten)
+        {
+            onWritten(slot.index, status);
+        }
+    };
+
+    std::vector<int> unfinished;
+    int failures = RunRingBatch(m_ring, m_queueDepth, (int)requests.size(), IORING_OP_WRITEV, start, finish, unfinished);
+    if (unfinished.empty())
+    {
+        return failures;
+    }
+
+    printf("WARNING: io_uring failed, writing the remaining %d files on threads\n", (int)unfinished.size());
+    this->fallBackToThreadPool();
+
+    std::vector<async_write_request_t> remaining;
+    for (size_t i = 0; i < unfinished.size(); i++)
+    {
+        remaining.push_back(requests[unfinished[i]]);
+    }
+
+    return failures + this->writeFilesThreadPool(remaining, [&](int index, int status)
+    {
+        if (onWritten)
+        {
+            onWritten(unfinished[index], status);
+        }
+    });
+#else
+    return this->writeFilesThreadPool(requests, onWritten);
+#endif
+}
@@ -0,0 +1,75 @@
+#ifndef _ASYNC_IO_H_
+#define _ASYNC_IO_H_
+#include<functional>
+#include<string>
+#include<vector>
+#include"thread_pool.h"
+
+// io_uring is used where the kernel headers have it. The ring is driven with raw system
+// calls, so liburing is not needed. Other systems use the thread pool backend.
+#if defined(__linux__) && defined(__has_include)
+#if __has_include(<linux/io_uring.h>)
+#define USE_IO_URING
+#endif
+#endif
+
+// ==================================================================================================
+// Constants
+// ==================================================================================================
+const int ASYNC_IO_QUEUE_DEPTH = 64;            // Files in flight at once
+const int ASYNC_IO_FALLBACK_THREADS = 16;       // Threads blocked in pread/pwrite for the fallback
+const int ASYNC_IO_DRAIN_TIMEOUT_MS = 1000;     // Wait for operations in flight when the ring fails
+
+// ==================================================================================================
+// Enums and structures
+// ==================================================================================================
+typedef enum async_io_backend_tag
+{
+    ASYNC_IO_AUTO = 0,              // io_uring if the kernel allows it, else the thread pool
+    ASYNC_IO_URING,
+    ASYNC_IO_THREAD_POOL
+}async_io_backend_t;
+
+// A file to be written. data must stay valid until writeFiles returns.
+typedef struct async_write_request_tag
+{
+    std::string path;
+    const unsigned char *data;
+    size_t size;
+}async_write_request_t;
+
+// Called once per file as it completes, never concurrently with itself. status is 0 on
+// success. A read callback may take the buffer with swap().
+typedef std::function<void(int index, int status, std::vector<unsigned char> &data)> async_read_callback_t;
+typedef std::function<void(int index, int status)> async_write_callback_t;
+
+struct io_uring_ring_tag;
+
+// ==================================================================================================
+// AsyncFileIO class definition
+// ==================================================================================================
+// Reads and writes batches of whole files with many of them in flight, handing every file
+// to a callback as soon as it is done, so processing overlaps the I/O still in flight.
+class AsyncFileIO
+{
+private:
+    async_io_backend_t m_backend;                     // Backend in use
+    int m_queueDepth;                                 // Files in flight at once
+    struct io_uring_ring_tag *m_ring;                 // io_uring instance, nullptr for the fallback
+    ThreadPool *m_pool;                               // Threads of the fallback, nullptr for io_uring
+
+    void fallBackToThreadPool();
+    int readFilesUring(const std::vector<std::string> &paths, const async_read_callback_t &onRead);
+    int writeFilesUring(const std::vector<async_write_request_t> &requests, const async_write_callback_t &onWritten);
+    int readFilesThreadPool(const std::vector<std::string> &paths, const async_read_callback_t &onRead);
+    int writeFilesThreadPool(const std::vector<async_write_request_t> &requests, const async_write_callback_t &onWritten);
+
+public:
+    AsyncFileIO(async_io_backend_t backend = ASYNC_IO_AUTO, int queueDepth = ASYNC_IO_QUEUE_DEPTH);
+    ~AsyncFileIO();
+    async_io_backend_t getBackend();
+    int readFiles(const std::vector<std::string> &paths, const async_read_callback_t &onRead);
+    int writeFiles(const std::vector<async_write_request_t> &requests, const async_write_callback_t &onWritten);
+};
+
+#endif
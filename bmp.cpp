@@ -1,9 +1,17 @@
 #include"bmp.h"
+#include"numa_memory.h"
+#include"pixel_kernels.h"
+#include"thread_pool.h"
 #include<assert.h>
-
-//#define USE_BRIGHTNESS_LEVEL_FOR_HISTOGRAM_EQUALIZATION
-//#define USE_BRIGHTNESS_LEVEL_FOR_BLURRING
-#define USE_ITU_CONVERSION_FOR_YCBCR
+#include<errno.h>
+#include<math.h>
+#include<string.h>
+#include<algorithm>
+#include<mutex>
+
+#if !defined(_WIN32)
+#include<unistd.h>
+#endif
 
 //******************************************************************************************
 // @name                    : CloseFile
@@ -56,15 +64,17 @@ static void FreeMemory(void *ptr)
 //                            information image pixels.
 //
 // @param imagePath         : Path of image that will be loaded
+// @param loadOptions       : Region of interest and shrink factor. nullptr loads the
+//                            whole image at full resolution.
 //
 // @returns                 : Nothing
 //********************************************************************************************
-BitmapImage::BitmapImage(const char *imagePath)
+BitmapImage::BitmapImage(const char *imagePath, const bitmap_load_options_t *loadOptions)
 {
     if (!imagePath)
     {
         printf("Image file not specified!\n");
-        assert(0);
+        throw "Exception: File not specified!";
     }
 
     m_inputFilePointer = fopen(imagePath, "rb");   //read the file//
@@ -74,8 +84,99 @@ BitmapImage::BitmapImage(const char *imagePath)
         throw "Exception: File not found!";
     }
 
+    m_inputData = nullptr;
+    m_inputDataSize = 0;
     m_imagePath = imagePath;
 
+    try
+    {
+        this->loadImage(loadOptions);
+    }
+    catch (...)
+    {
+        // The destructor does not run for an object whose constructor throws
+        this->releaseImage();
+        throw;
+    }
+}
+
+//******************************************************************************************
+// @name                    : BitmapImage
+//
+// @description             : Constructor. Decodes an image file already read into memory,
+//                            for example by AsyncFileIO. fileData is only used during the
+//                            constructor.
+//
+// @param fileData          : Contents of the image file
+// @param fileSize          : Size of fileData in bytes
+// @param imagePath         : Path the contents were read from, for messages
+// @param loadOptions       : Region of interest and shrink factor. nullptr loads the
+//                            whole image at full resolution.
+//
+// @returns                 : Nothing
+//********************************************************************************************
+BitmapImage::BitmapImage(const unsigned char *fileData, size_t fileSize, const char *imagePath,
+                         const bitmap_load_options_t *loadOptions)
+{
+    if (fileData == nullptr || fileSize < (size_t)BITMAP_HEADER_SIZE)
+    {
+        printf("File [%s] is too short to be a bitmap!\n", imagePath ? imagePath : "");
+        throw "Exception: Invalid bitmap data!";
+    }
+
+    m_inputFilePointer = nullptr;
+    m_inputData = fileData;
+    m_inputDataSize = fileSize;
+    m_imagePath = imagePath ? imagePath : "";
+
+    try
+    {
+        this->loadImage(loadOptions);
+    }
+    catch (...)
+    {
+        this->releaseImage();
+        throw;
+    }
+
+    m_inputData = nullptr;
+    m_inputDataSize = 0;
+}
+
+//******************************************************************************************
+// @name                    : loadImage
+//
+// @description             : Extracts and stores header information and image pixels from
+//                            the input, which both constructors have opened.
+//
+// @param loadOptions       : Region of interest and shrink factor, or nullptr
+//
+// @returns                 : Nothing
+//********************************************************************************************
+void BitmapImage::loadImage(const bitmap_load_options_t *loadOptions)
+{
+    memset(&m_loadOptions, 0, sizeof(m_loadOptions));
+    m_loadOptions.shrinkFactor = 1;
+    if (loadOptions != nullptr)
+    {
+        m_loadOptions = *loadOptions;
+    }
+
+    // Sampled histograms count at least the fraction of the pixels asked for
+    m_histogramSampleStep = 1;
+    if (m_loadOptions.histogramSampling > 0.0 && m_loadOptions.histogramSampling < 1.0)
+    {
+        m_histogramSampleStep = std::max(1, (int)(1.0 / sqrt(m_loadOptions.histogramSampling)));
+    }
+
+    // Nothing is owned yet, so a failed load can release whatever it got to
+    m_bitmapHeaderChar = nullptr;
+    m_bitmapFileHeader = nullptr;
+    m_bitmapInfoHeader = nullptr;
+    m_bitmapImageChar = nullptr;
+    m_modifiedBitmapHeaderChar = nullptr;
+    m_modifiedBitmapImageChar = nullptr;
+
     m_bitmapHeaderChar = LoadBitmapHeader();
     m_bitmapFileHeader = LoadBitmapFileImageHeader();
 
@@ -83,22 +184,47 @@ BitmapImage::BitmapImage(const char *imagePath)
     if ("BM" != getSignatureString())
     {
         printf("ERROR: Cannot process non-bitmap image files!\n");
-        assert(0);
+        throw "Exception: Not a bitmap!";
     }
 
     m_bitmapInfoHeader = LoadBitmapInfoImageHeader();
-    m_bitmapImageChar = LoadBitmapImagePixels();
+    histogram_table_t histogram;
+    m_bitmapImageChar = LoadBitmapImagePixels(histogram);
 
     // Modified buffers. To be used if required
-    m_modifiedBitmapHeaderChar = nullptr;
-    m_modifiedBitmapImageChar = nullptr;
     m_modifiedImageSize = 0;
-
-    // Prepare histogram from fetched data
-    this->prepareHistogram();
-
-    assert(m_bitmapFileHeader);
-    assert(m_bitmapInfoHeader);
+    m_modifiedWidth = 0;
+    m_modifiedHeight = 0;
+    m_modifiedPaddedWidth = 0;
+    m_modifiedPaddedImageSize = 0;
+    m_modifiedBitsPerPixel = 0;
+    m_modifiedTopDown = false;
+
+    // No edits and no incremental result yet
+    m_dirtyTileColumns = 0;
+    m_dirtyTileRows = 0;
+    m_dirtyTileCount = 0;
+    m_lastOperation = OPERATION_NONE;
+    m_lastOperationMode = PROCESS_PER_CHANNEL;
+
+    // Not prepared as an overlay
+    m_overlayBitsPerPixel = 0;
+    m_overlayOpacity = 0;
+    memset(&m_overlayMaskColor, 0, sizeof(m_overlayMaskColor));
+
+    // Summed-area tables are built on first use
+    this->invalidateIntegralImages();
+
+    // Prepare histogram from the counts taken while loading
+    this->prepareHistogram(histogram);
+
+    // An image smaller than a sampling block may have no pixel in the sample
+    if (m_histogramSampleCount == 0 && m_histogramSampleStep > 1)
+    {
+        m_histogramSampleStep = 1;
+        this->countHistogram(this->getOriginalPixelBuffer(), histogram);
+        this->prepareHistogram(histogram);
+    }
 }
 
 //******************************************************************************************
@@ -109,17 +235,163 @@ BitmapImage::BitmapImage(const char *imagePath)
 // @returns                 : Nothing
 //********************************************************************************************
 BitmapImage::~BitmapImage()
+{
+    this->releaseImage();
+}
+
+//******************************************************************************************
+// @name                    : releaseImage
+//
+// @description             : Frees the buffers of the image and closes the input file. Also
+//                            used when loading fails part way.
+//
+// @returns                 : Nothing
+//********************************************************************************************
+void BitmapImage::releaseImage()
 {
     // Free memory
     FreeMemory(m_bitmapHeaderChar);
-    FreeMemory(m_bitmapImageChar);
+    FreePixelMemory(m_bitmapImageChar);
     FreeMemory(m_modifiedBitmapHeaderChar);
-    FreeMemory(m_modifiedBitmapImageChar);
+    FreePixelMemory(m_modifiedBitmapImageChar);
     FreeMemory(m_bitmapFileHeader);
     FreeMemory(m_bitmapInfoHeader);
 
     // Close files
     CloseFile(m_inputFilePointer);
+
+    m_bitmapHeaderChar = nullptr;
+    m_bitmapImageChar = nullptr;
+    m_modifiedBitmapHeaderChar = nullptr;
+    m_modifiedBitmapImageChar = nullptr;
+    m_bitmapFileHeader = nullptr;
+    m_bitmapInfoHeader = nullptr;
+    m_inputFilePointer = nullptr;
+}
+
+//******************************************************************************************
+// @name                    : ReverseRows
+//
+// @description             : This is a static function. Reverses the order of rows in place.
+//
+// @param stride            : Bytes from one row to the next
+//
+// @returns                 : Nothing
+//********************************************************************************************
+static void ReverseRows(unsigned char *rows, int stride, int count)
+{
+    vector<unsigned char> swapRow(stride);
+    for (int i = 0; i < count / 2; i++)
+    {
+        unsigned char *top = rows + (size_t)stride * i;
+        unsigned char *bottom = rows + (size_t)stride * (count - 1 - i);
+        memcpy(&swapRow[0], top, stride);
+        memcpy(top, bottom, stride);
+        memcpy(bottom, &swapRow[0], stride);
+    }
+}
+
+//******************************************************************************************
+// @name                    : readInput
+//
+// @description             : Reads bytes of the input image, from the file or from the
+//                            in-memory copy.
+//
+// @param offset            : Offset from the start of the file
+// @param buffer            : Destination
+// @param count             : Number of bytes to read
+//
+// @returns                 : Number of bytes read
+//********************************************************************************************
+size_t BitmapImage::readInput(long offset, void *buffer, size_t count)
+{
+    if (m_inputData != nullptr)
+    {
+        if (offset < 0 || (size_t)offset >= m_inputDataSize)
+        {
+            return 0;
+        }
+
+        size_t available = m_inputDataSize - (size_t)offset;
+        if (count > available)
+        {
+            count = available;
+        }
+
+        memcpy(buffer, m_inputData + offset, count);
+        return count;
+    }
+
+    if (fseek(m_inputFilePointer, offset, SEEK_SET) != 0)
+    {
+        return 0;
+    }
+
+    return fread(buffer, sizeof(unsigned char), count, m_inputFilePointer);
+}
+
+//******************************************************************************************
+// @name                    : readInputAt
+//
+// @description             : Reads bytes of the input image without moving the file
+//                            position, so that several threads can read at once.
+//
+// @param offset            : Offset from the start of the file
+// @param buffer            : Destination
+// @param count             : Number of bytes to read
+//
+// @returns                 : Number of bytes read
+//********************************************************************************************
+size_t BitmapImage::readInputAt(long long offset, void *buffer, size_t count)
+{
+    if (m_inputData != nullptr)
+    {
+        if (offset < 0 || (unsigned long long)offset >= m_inputDataSize)
+        {
+            return 0;
+        }
+
+        size_t available = m_inputDataSize - (size_t)offset;
+        if (count > available)
+        {
+            count = available;
+        }
+
+        memcpy(buffer, m_inputData + offset, count);
+        return count;
+    }
+
+#if defined(_WIN32)
+    // No positional reads on the stdio file. Readers take turns.
+    static mutex readMutex;
+    lock_guard<mutex> lock(readMutex);
+    if (_fseeki64(m_inputFilePointer, offset, SEEK_SET) != 0)
+    {
+        return 0;
+    }
+
+    return fread(buffer, sizeof(unsigned char), count, m_inputFilePointer);
+#else
+    int fd = fileno(m_inputFilePointer);
+    size_t done = 0;
+    while (done < count)
+    {
+        ssize_t bytes = pread(fd, (unsigned char *)buffer + done, count - done, (off_t)(offset + done));
+        if (bytes < 0 && errno == EINTR)
+        {
+            continue;
+        }
+
+        if (bytes <= 0)
+        {
+            break;
+        }
+
+        done += (size_t)bytes;
+    }
+
+    return done;
+#endif
 }
 
 //******************************************************************************************
@@ -139,11 +411,16 @@ char* BitmapImage::LoadBitmapHeader()
     if (!bitmap_header)
     {
         printf("ERROR: Malloc Failure!\n");
-        assert(0);
+        throw "Exception: Out of memory!";
     }
 
-    memset(bitmap_header, 0, sizeof(bitmap_header));
-    fread(bitmap_header, sizeof(char), BITMAP_HEADER_SIZE, m_inputFilePointer);
+    memset(bitmap_header, 0, BITMAP_HEADER_SIZE + 1);
+    if (this->readInput(0, bitmap_header, BITMAP_HEADER_SIZE) != BITMAP_HEADER_SIZE)
+    {
+        printf("ERROR: File is too short to be a bitmap!\n");
+        FreeMemory(bitmap_header);
+        throw "Exception: Invalid bitmap data!";
+    }
 
     return bitmap_header;
 }
@@ -163,19 +440,35 @@ bitmap_file_header_t* BitmapImage::LoadBitmapFileImageHeader()
     if (!file_header)
     {
         printf("ERROR: Malloc Failure!\n");
-        assert(0);
+        throw "Exception: Out of memory!";
     }
 
-    memset(file_header, 0, sizeof(file_header));
-
-    // Populate the file header structure
-    file_header->signature = *(short*)&m_bitmapHeaderChar[SIGNATURE];
-    file_header->fileSize = *(int*)&m_bitmapHeaderChar[FILE_SIZE];
-    file_header->dataOffset = *(int*)&m_bitmapHeaderChar[DATA_OFFSET];
+    parseFileHeader(m_bitmapHeaderChar, file_header);
 
     return file_header;
 }
 
+//******************************************************************************************
+// @name                    : parseFileHeader
+//
+// @description             : This is a static function. Populates the FileHeader structure
+//                            from the raw header bytes.
+//
+// @param headerChar        : BITMAP_HEADER_SIZE bytes read from the start of the file
+// @param fileHeader        : Structure to populate
+//
+// @returns                 : Nothing
+//********************************************************************************************
+void BitmapImage::parseFileHeader(const char *headerChar, bitmap_file_header_t *fileHeader)
+{
+    memset(fileHeader, 0, sizeof(bitmap_file_header_t));
+
+    fileHeader->signature = *(short*)&headerChar[SIGNATURE];
+    fileHeader->fileSize = *(int*)&headerChar[FILE_SIZE];
+    fileHeader->reserved = *(int*)&headerChar[FILE_HEADER_RESERVED];
+    fileHeader->dataOffset = *(int*)&headerChar[DATA_OFFSET];
+}
+
 //******************************************************************************************
 // @name                    : LoadBitmapInfoImageHeader
 //
@@ -191,81 +484,589 @@ bitmap_info_header_t* BitmapImage::LoadBitmapInfoImageHeader()
     if (!info_header)
     {
         printf("ERROR: Malloc Failure!\n");
-        assert(0);
+        throw "Exception: Out of memory!";
     }
 
-    memset(info_header, 0, sizeof(info_header));
-
-    // Populate the info header structure
-    info_header->infoHeaderSize = *(int*)&m_bitmapHeaderChar[INFO_HEADER_SIZE];
-    info_header->width = *(int*)&m_bitmapHeaderChar[WIDTH];
-    info_header->height = *(int*)&m_bitmapHeaderChar[HEIGHT];
-    info_header->planes = *(short*)&m_bitmapHeaderChar[PLANES];
-    info_header->bitsPerPixel = *(short*)&m_bitmapHeaderChar[BITS_PER_PIXEL];
-    info_header->compressionType = *(int*)&m_bitmapHeaderChar[COMPRESSION_TYPE];
-    info_header->compressedImageSize = *(int*)&m_bitmapHeaderChar[COMPRESSED_IMAGE_SIZE];
-    info_header->xPixelsPerMeter = *(int*)&m_bitmapHeaderChar[X_PIXELS_PER_METER];
-    info_header->yPixelsPerMeter = *(int*)&m_bitmapHeaderChar[Y_PIXELS_PER_METER];
-    info_header->colorsUsed = *(int*)&m_bitmapHeaderChar[COLORS_USED];
-    info_header->importantColors = *(int*)&m_bitmapHeaderChar[IMPORTANT_COLORS];
+    parseInfoHeader(m_bitmapHeaderChar, info_header);
+    if (!isValidHeader(m_bitmapFileHeader, info_header))
+    {
+        printf("ERROR: Invalid or unsupported bitmap header!\n");
+        FreeMemory(info_header);
+        throw "Exception: Invalid bitmap header!";
+    }
 
-    // ColorTable
-    info_header->redIntensity = *(char*)&m_bitmapHeaderChar[RED_INTENSITY];
-    info_header->greenIntensity = *(char*)&m_bitmapHeaderChar[GREEN_INTENSITY];
-    info_header->blueIntensity = *(char*)&m_bitmapHeaderChar[BLUE_INTENSITY];
+    // A negative height marks rows stored top-down. They are kept bottom-up in memory.
+    m_fileTopDown = (info_header->height < 0);
+    if (m_fileTopDown)
+    {
+        info_header->height = -info_header->height;
+    }
 
-    m_imageSize = info_header->width * info_header->height;
+    m_imageSize = (unsigned long)info_header->width * info_header->height;
     //m_imageSize = m_bitmapFileHeader->fileSize - m_bitmapFileHeader->dataOffset;
 
     return info_header;
 }
 
+//******************************************************************************************
+// @name                    : parseInfoHeader
+//
+// @description             : This is a static function. Populates the InfoHeader structure
+//                            from the raw header bytes.
+//
+// @param headerChar        : BITMAP_HEADER_SIZE bytes read from the start of the file
+// @param infoHeader        : Structure to populate
+//
+// @returns                 : Nothing
+//********************************************************************************************
+void BitmapImage::parseInfoHeader(const char *headerChar, bitmap_info_header_t *infoHeader)
+{
+    memset(infoHeader, 0, sizeof(bitmap_info_header_t));
+
+    infoHeader->infoHeaderSize = *(int*)&headerChar[INFO_HEADER_SIZE];
+    infoHeader->width = *(int*)&headerChar[WIDTH];
+    infoHeader->height = *(int*)&headerChar[HEIGHT];
+    infoHeader->planes = *(short*)&headerChar[PLANES];
+    infoHeader->bitsPerPixel = *(short*)&headerChar[BITS_PER_PIXEL];
+    infoHeader->compressionType = *(int*)&headerChar[COMPRESSION_TYPE];
+    infoHeader->compressedImageSize = *(int*)&headerChar[COMPRESSED_IMAGE_SIZE];
+    infoHeader->xPixelsPerMeter = *(int*)&headerChar[X_PIXELS_PER_METER];
+    infoHeader->yPixelsPerMeter = *(int*)&headerChar[Y_PIXELS_PER_METER];
+    infoHeader->colorsUsed = *(int*)&headerChar[COLORS_USED];
+    infoHeader->importantColors = *(int*)&headerChar[IMPORTANT_COLORS];
+
+    // ColorTable
+    infoHeader->redIntensity = *(char*)&headerChar[RED_INTENSITY];
+    infoHeader->greenIntensity = *(char*)&headerChar[GREEN_INTENSITY];
+    infoHeader->blueIntensity = *(char*)&headerChar[BLUE_INTENSITY];
+}
+
+//******************************************************************************************
+// @name                    : ProbeBitmapHeader
+//
+// @description             : This is a static function. Reads and validates only the file
+//                            and info headers of an image. No pixel buffer is allocated,
+//                            so this is cheap enough to index very large numbers of files.
+//
+// @param imagePath         : Path of image
+// @param fileHeader        : Populated with the FileHeader
+// @param infoHeader        : Populated with the InfoHeader
+//
+// @returns                 : PROBE_OK if both headers are valid
+//********************************************************************************************
+probe_status_t BitmapImage::ProbeBitmapHeader(const char *imagePath, bitmap_file_header_t *fileHeader,
+                                              bitmap_info_header_t *infoHeader)
+{
+    char headerChar[BITMAP_HEADER_SIZE];
+
+    memset(fileHeader, 0, sizeof(bitmap_file_header_t));
+    memset(infoHeader, 0, sizeof(bitmap_info_header_t));
+
+    FILE *fp = fopen(imagePath, "rb");
+    if (fp == nullptr)
+    {
+        return PROBE_FILE_NOT_FOUND;
+    }
+
+    // Unbuffered, so that only the header is read from disk
+    setvbuf(fp, nullptr, _IONBF, 0);
+    size_t bytesRead = fread(headerChar, sizeof(char), BITMAP_HEADER_SIZE, fp);
+    CloseFile(fp);
+
+    if (bytesRead != BITMAP_HEADER_SIZE)
+    {
+        return PROBE_READ_ERROR;
+    }
+
+    if (headerChar[SIGNATURE] != 'B' || headerChar[SIGNATURE + 1] != 'M')
+    {
+        return PROBE_INVALID_SIGNATURE;
+    }
+
+    parseFileHeader(headerChar, fileHeader);
+    parseInfoHeader(headerChar, infoHeader);
+
+    return isValidHeader(fileHeader, infoHeader) ? PROBE_OK : PROBE_INVALID_HEADER;
+}
+
+//******************************************************************************************
+// @name                    : isValidHeader
+//
+// @description             : This is a static function. Validates the fields a reader
+//                            depends on, as parsed from the file (height still signed).
+//                            Compressed images pass; only the loader rejects them.
+//
+// @param fileHeader        : Parsed FileHeader
+// @param infoHeader        : Parsed InfoHeader
+//
+// @returns                 : true if the headers describe an image that can be read
+//********************************************************************************************
+bool BitmapImage::isValidHeader(const bitmap_file_header_t *fileHeader, const bitmap_info_header_t *infoHeader)
+{
+    short bpp = infoHeader->bitsPerPixel;
+    return infoHeader->infoHeaderSize >= BITMAP_INFO_HEADER_SIZE &&
+           infoHeader->width > 0 && infoHeader->width <= MAX_IMAGE_DIMENSION &&
+           infoHeader->height != 0 && infoHeader->height >= -MAX_IMAGE_DIMENSION &&
+           infoHeader->height <= MAX_IMAGE_DIMENSION &&
+           infoHeader->planes == 1 &&
+           (bpp == MONOCHROME || bpp == BITS_4_PALLETIZED || bpp == BITS_8_PALLETIZED ||
+            bpp == BITS_16_RGB || bpp == BITS_24_RGB || bpp == BITS_32_RGBA) &&
+           infoHeader->compressionType >= COMPRESSION_RGB && infoHeader->compressionType <= COMPRESSION_RLE4 &&
+           fileHeader->dataOffset >= BITMAP_HEADER_SIZE;
+}
+
+//******************************************************************************************
+// @name                    : getProbeStatusName
+//
+// @description             : This is a static function. Describes a probe result, for
+//                            error messages.
+//
+// @returns                 : Description
+//********************************************************************************************
+const char* BitmapImage::getProbeStatusName(probe_status_t status)
+{
+    switch (status)
+    {
+        case PROBE_OK:                  return "valid";
+        case PROBE_FILE_NOT_FOUND:      return "file not found";
+        case PROBE_READ_ERROR:          return "file too short";
+        case PROBE_INVALID_SIGNATURE:   return "not a bitmap";
+        case PROBE_INVALID_HEADER:      return "invalid or unsupported header";
+    }
+
+    return "unknown";
+}
+
+//******************************************************************************************
+// @name                    : ProbeBitmapHeaders
+//
+// @description             : This is a static function. Probes many images. The reads are
+//                            small and latency bound, so they are spread over the thread
+//                            pool to keep many of them in flight.
+//
+// @param imagePaths        : Paths of images
+// @param results           : One result per path, in the same order
+//
+// @returns                 : Nothing
+//********************************************************************************************
+void BitmapImage::ProbeBitmapHeaders(const vector<string> &imagePaths, vector<bitmap_probe_result_t> &results)
+{
+    results.resize(imagePaths.size());
+
+    ThreadPool::getInstance().parallelFor((int)imagePaths.size(), PROBE_FILES_PER_TASK, [&](int begin, int end)
+    {
+        for (int i = begin; i < end; i++)
+        {
+            results[i].status = ProbeBitmapHeader(imagePaths[i].c_str(), &results[i].fileHeader, &results[i].infoHeader);
+        }
+    });
+}
+
 //******************************************************************************************
 // @name                    : LoadBitmapImagePixels
 //
-// @description             : Loads the actual image data (pixel values)
+// @description             : Loads the actual image data (pixel values). Pixels are kept in
+//                            memory as 8 bit grayscale, 24 bit BGR or 32 bit BGRA. Other
+//                            formats are decoded to one of these while loading.
 //
 // @returns                 : Pointer to image data.
 //********************************************************************************************
-unsigned char* BitmapImage::LoadBitmapImagePixels()
+unsigned char* BitmapImage::LoadBitmapImagePixels(histogram_table_t &histogram)
 {
-    // If required, read the 1024-byte from fp to colorTable
-    char colorTable[COLOR_TABLE_SIZE + 1];
-    if (m_bitmapInfoHeader->bitsPerPixel <= BITS_8_PALLETIZED) // Color table present
+    if (m_bitmapInfoHeader->compressionType != COMPRESSION_RGB)
+    {
+        printf("ERROR: Cannot process compressed bitmap image files!\n");
+        throw "Exception: Compressed bitmap!";
+    }
+
+    // Read the color table and choose the format pixels are kept in
+    this->loadColorTable();
+
+    // The pixel array must be complete. Checked before its memory is allocated, so a
+    // short file cannot claim a huge image.
+    long long pixelArrayEnd = m_bitmapFileHeader->dataOffset +
+        (long long)getPaddedRowSize(m_bitmapInfoHeader->width, m_fileBitsPerPixel) * m_bitmapInfoHeader->height;
+    unsigned char lastByte;
+    if (this->readInputAt(pixelArrayEnd - 1, &lastByte, 1) != 1)
     {
-        printf("\nReading color table...\n");
-        fread(colorTable, sizeof(unsigned char), COLOR_TABLE_SIZE, m_inputFilePointer);
-        // TODO: What to do of it??
+        printf("ERROR: Bitmap pixel data is truncated!\n");
+        throw "Exception: Truncated bitmap data!";
+    }
+
+    // Partial loads read the rows they need straight from the file
+    if (m_loadOptions.roiX > 0 || m_loadOptions.roiY > 0 || m_loadOptions.roiWidth > 0 || m_loadOptions.roiHeight > 0 ||
+        m_loadOptions.shrinkFactor > 1)
+    {
+        unsigned char *region_pixels = this->loadBitmapImageRegion();
+
+        pixel_buffer_t image = { region_pixels, m_bitmapInfoHeader->width, m_bitmapInfoHeader->height,
+                                 m_paddedWidth, m_bitmapInfoHeader->bitsPerPixel };
+        this->countHistogram(image, histogram);
+        return region_pixels;
     }
 
     printf("\nReading Bitmap pixels...\n");
-    m_paddedWidth = (m_bitmapInfoHeader->width * 3 + 3) & (~3); // padded row length
-    int bytesRead = 0;
-    int totalBytesRead = 0;
-    m_paddedImageSize = m_paddedWidth * m_bitmapInfoHeader->height;
+    m_paddedWidth = getPaddedRowSize(m_bitmapInfoHeader->width, m_bitmapInfoHeader->bitsPerPixel); // padded row length
+    int filePaddedWidth = getPaddedRowSize(m_bitmapInfoHeader->width, m_fileBitsPerPixel);
+    size_t bytesRead = 0;
+    m_paddedImageSize = (unsigned long)m_paddedWidth * m_bitmapInfoHeader->height;
 
-    unsigned char *bitmap_pixels = (unsigned char *)malloc(sizeof(unsigned char) * (m_paddedImageSize));
+    // Zeroed band by band, so the pages of every band are on the node which processes it
+    unsigned char *bitmap_pixels = AllocatePixelMemory(m_paddedWidth, m_bitmapInfoHeader->height);
     if (!bitmap_pixels)
     {
         printf("ERROR: Malloc Failure!\n");
-        assert(0);
+        throw "Exception: Out of memory!";
     }
 
-    memset(bitmap_pixels, 0, m_paddedImageSize);
-    bytesRead = fread(bitmap_pixels, sizeof(unsigned char), m_paddedImageSize, m_inputFilePointer);
+    // Rows have a fixed size, so chunks of rows are read concurrently, each straight into its
+    // place. A chunk is decoded, if needed, and its histogram counted while it is in cache.
+    int width = m_bitmapInfoHeader->width;
+    int height = m_bitmapInfoHeader->height;
+    bool raw = this->isRawPixelLayout();
+    int rowsPerChunk = std::max(1, LOAD_CHUNK_BYTES / filePaddedWidth);
+    int chunks = (height + rowsPerChunk - 1) / rowsPerChunk;
+    pixel_buffer_t image = { bitmap_pixels, width, height, m_paddedWidth, m_bitmapInfoHeader->bitsPerPixel };
+    mutex histogramMutex;
 
-#if 0
-    for (int i = 0; i < m_bitmapInfoHeader->height; i++)
+    memset(&histogram, 0, sizeof(histogram));
+
+    ThreadPool::getInstance().parallelFor(chunks, 1, [&](int begin, int end)
+    {
+        vector<unsigned char> fileRows;
+        histogram_table_t chunkHistogram;
+        memset(&chunkHistogram, 0, sizeof(chunkHistogram));
+        size_t chunkBytesRead = 0;
+
+        for (int chunk = begin; chunk < end; chunk++)
+        {
+            int firstFileRow = chunk * rowsPerChunk;
+            int rowCount = std::min(rowsPerChunk, height - firstFileRow);
+            long long offset = m_bitmapFileHeader->dataOffset + (long long)filePaddedWidth * firstFileRow;
+
+            // Memory rows are bottom-up, so the rows of a top-down file land mirrored
+            int firstRow = m_fileTopDown ? height - firstFileRow - rowCount : firstFileRow;
+            unsigned char *rows = &bitmap_pixels[(size_t)m_paddedWidth * firstRow];
+
+            if (raw)
+            {
+                chunkBytesRead += this->readInputAt(offset, rows, (size_t)filePaddedWidth * rowCount);
+                if (m_fileTopDown)
+                {
+                    ReverseRows(rows, m_paddedWidth, rowCount);
+                }
+            }
+            else
+            {
+                fileRows.resize((size_t)filePaddedWidth * rowCount);
+                chunkBytesRead += this->readInputAt(offset, &fileRows[0], fileRows.size());
+                for (int k = 0; k < rowCount; k++)
+                {
+                    int row = m_fileTopDown ? rowCount - 1 - k : k;
+                    this->decodeRow(&fileRows[(size_t)filePaddedWidth * k], 0, width, rows + (size_t)m_paddedWidth * row);
+                }
+            }
+
+            DispatchPixelFormat(image.bitsPerPixel, [&](auto format)
+            {
+                if (m_histogramSampleStep > 1)
+                {
+                    HistogramSampleRows<decltype(format)>(image, firstRow, firstRow + rowCount, m_histogramSampleStep,
+                                                          0, 0, chunkHistogram);
+                }
+                else
+                {
+                    HistogramRows<decltype(format)>(image, firstRow, firstRow + rowCount, chunkHistogram);
+                }
+            });
+        }
+
+        lock_guard<mutex> lock(histogramMutex);
+        bytesRead += chunkBytesRead;
+        for (int i = 0; i < MAX_COLORS; i++)
+        {
+            histogram.red[i] += chunkHistogram.red[i];
+            histogram.green[i] += chunkHistogram.green[i];
+            histogram.blue[i] += chunkHistogram.blue[i];
+            histogram.brightness[i] += chunkHistogram.brightness[i];
+        }
+    });
+
+    if (bytesRead != (size_t)filePaddedWidth * height)
     {
-        bytesRead = fread(&bitmap_pixels[m_paddedImageSize - m_paddedWidth], sizeof(unsigned char), m_paddedWidth, m_inputFilePointer);
-        totalBytesRead += bytesRead;
-        // TODO: We can prepare a 2-D pixel array here
+        printf("ERROR: Could not read pixels!\n");
+        FreePixelMemory(bitmap_pixels);
+        throw "Exception: Truncated bitmap data!";
     }
-#endif
 
     return bitmap_pixels;
 }
 
+//******************************************************************************************
+// @name                    : loadColorTable
+//
+// @description             : Reads the color table of palettized images and decides the
+//                            format pixels are kept in. A palette of only gray entries is
+//                            kept as 8 bit grayscale, any other palette and 16 bit pixels
+//                            are expanded to 24 bit BGR.
+//
+// @returns                 : Nothing
+//********************************************************************************************
+void BitmapImage::loadColorTable()
+{
+    m_fileBitsPerPixel = m_bitmapInfoHeader->bitsPerPixel;
+    m_colorTable.clear();
+
+    if (m_fileBitsPerPixel == BITS_16_RGB)
+    {
+        m_bitmapInfoHeader->bitsPerPixel = BITS_24_RGB;
+        return;
+    }
+
+    if (m_fileBitsPerPixel != MONOCHROME && m_fileBitsPerPixel != BITS_4_PALLETIZED &&
+        m_fileBitsPerPixel != BITS_8_PALLETIZED)
+    {
+        if (m_fileBitsPerPixel != BITS_24_RGB && m_fileBitsPerPixel != BITS_32_RGBA)
+        {
+            printf("ERROR: Unsupported bits per pixel %d!\n", m_fileBitsPerPixel);
+            throw "Exception: Unsupported bits per pixel!";
+        }
+        return;
+    }
+
+    // Color table present
+    printf("\nReading color table...\n");
+    int entries = m_bitmapInfoHeader->colorsUsed;
+    if (entries <= 0 || entries > (1 << m_fileBitsPerPixel))
+    {
+        entries = 1 << m_fileBitsPerPixel;
+    }
+
+    m_colorTable.assign(COLOR_TABLE_SIZE, 0);
+    this->readInput(BITMAP_FILE_HEADER_SIZE + m_bitmapInfoHeader->infoHeaderSize, &m_colorTable[0], entries * 4);
+
+    bool grayPalette = true;
+    for (int i = 0; i < entries; i++)
+    {
+        if (m_colorTable[i * 4] != m_colorTable[i * 4 + 1] || m_colorTable[i * 4] != m_colorTable[i * 4 + 2])
+        {
+            grayPalette = false;
+            break;
+        }
+    }
+
+    m_bitmapInfoHeader->bitsPerPixel = grayPalette ? BITS_8_PALLETIZED : BITS_24_RGB;
+}
+
+//******************************************************************************************
+// @name                    : isRawPixelLayout
+//
+// @description             : Tells whether the file rows can be used as they are, without
+//                            decoding. True for 24 and 32 bit images and for 8 bit images
+//                            with the identity grayscale palette.
+//
+// @returns                 : true if no decoding is needed
+//********************************************************************************************
+bool BitmapImage::isRawPixelLayout()
+{
+    if (m_fileBitsPerPixel != m_bitmapInfoHeader->bitsPerPixel)
+    {
+        return false;
+    }
+
+    for (size_t i = 0; i < m_colorTable.size() / 4; i++)
+    {
+        if (m_colorTable[i * 4] != i)
+        {
+            return false;
+        }
+    }
+
+    return true;
+}
+
+//******************************************************************************************
+// @name                    : decodeRow
+//
+// @description             : Converts pixels of a file row to the in-memory pixel format
+//
+// @param fileBytes         : File row, starting at the byte holding pixel firstPixel
+// @param firstPixel        : Column of the first pixel to decode
+// @param pixelCount        : Number of pixels to decode
+// @param row               : Output, pixelCount pixels in the in-memory format
+//
+// @returns                 : Nothing
+//********************************************************************************************
+void BitmapImage::decodeRow(const unsigned char *fileBytes, int firstPixel, int pixelCount, unsigned char *row)
+{
+    int bytesPerPixel = m_bitmapInfoHeader->bitsPerPixel / 8;
+
+    if (m_fileBitsPerPixel == BITS_16_RGB)
+    {
+        // 5 bits per color: x rrrrr ggggg bbbbb
+        for (int j = 0; j < pixelCount; j++)
+        {
+            int value = fileBytes[j * 2] | (fileBytes[j * 2 + 1] << 8);
+            int blue = value & 0x1F;
+            int green = (value >> 5) & 0x1F;
+            int red = (value >> 10) & 0x1F;
+            row[j * 3]     = (unsigned char)((blue << 3) | (blue >> 2));
+            row[j * 3 + 1] = (unsigned char)((green << 3) | (green >> 2));
+            row[j * 3 + 2] = (unsigned char)((red << 3) | (red >> 2));
+        }
+    }
+    else if (m_fileBitsPerPixel <= BITS_8_PALLETIZED)
+    {
+        // Palette indices are packed from the most significant bit
+        int bits = m_fileBitsPerPixel;
+        int mask = (1 << bits) - 1;
+        int bitPosition = (firstPixel * bits) % 8;
+        for (int j = 0; j < pixelCount; j++, bitPosition += bits)
+        {
+            int index = (fileBytes[bitPosition / 8] >> (8 - bits - (bitPosition % 8))) & mask;
+            const unsigned char *entry = &m_colorTable[index * 4];
+            for (int k = 0; k < bytesPerPixel; k++)
+            {
+                row[j * bytesPerPixel + k] = entry[k];
+            }
+        }
+    }
+    else
+    {
+        memcpy(row, fileBytes, (size_t)pixelCount * bytesPerPixel);
+    }
+}
+
+//******************************************************************************************
+// @name                    : loadBitmapImageRegion
+//
+// @description             : Loads the region of interest given in the load options,
+//                            averaging shrinkFactor x shrinkFactor blocks as rows stream in.
+//                            Only the rows of the region are read, and of those only the
+//                            bytes of the region's columns. The headers are updated to
+//                            describe the loaded image.
+//
+// @returns                 : Pointer to image data.
+//********************************************************************************************
+unsigned char* BitmapImage::loadBitmapImageRegion()
+{
+    int width = m_bitmapInfoHeader->width;
+    int height = m_bitmapInfoHeader->height;
+    int shrink = (m_loadOptions.shrinkFactor > 1) ? m_loadOptions.shrinkFactor : 1;
+    int bytesPerPixel = m_bitmapInfoHeader->bitsPerPixel / 8;
+
+    // Clip region of interest to the image
+    int roiX = (m_loadOptions.roiX > 0) ? m_loadOptions.roiX : 0;
+    int roiY = (m_loadOptions.roiY > 0) ? m_loadOptions.roiY : 0;
+    int roiWidth = (m_loadOptions.roiWidth > 0) ? m_loadOptions.roiWidth : width - roiX;
+    int roiHeight = (m_loadOptions.roiHeight > 0) ? m_loadOptions.roiHeight : height - roiY;
+    if (roiX + roiWidth > width)
+        roiWidth = width - roiX;
+
+    if (roiY + roiHeight > height)
+        roiHeight = height - roiY;
+
+    int loadedWidth = roiWidth / shrink;
+    int loadedHeight = roiHeight / shrink;
+    if (loadedWidth <= 0 || loadedHeight <= 0)
+    {
+        printf("ERROR: Region of interest is empty!\n");
+        throw "Exception: Empty region of interest!";
+    }
+
+    printf("\nReading Bitmap pixels (region %d,%d %dx%d, shrink %d)...\n", roiX, roiY, roiWidth, roiHeight, shrink);
+
+    int filePaddedWidth = getPaddedRowSize(width, m_fileBitsPerPixel);
+    m_paddedWidth = getPaddedRowSize(loadedWidth, m_bitmapInfoHeader->bitsPerPixel);
+    m_paddedImageSize = (unsigned long)m_paddedWidth * loadedHeight;
+
+    unsigned char *bitmap_pixels = AllocatePixelMemory(m_paddedWidth, loadedHeight);
+    if (!bitmap_pixels)
+    {
+        printf("ERROR: Malloc Failure!\n");
+        throw "Exception: Out of memory!";
+    }
+
+    // Byte range of the region's columns within a file row
+    int pixelsPerRow = loadedWidth * shrink;
+    long firstByte = ((long)roiX * m_fileBitsPerPixel) / 8;
+    long lastByte = ((long)(roiX + pixelsPerRow) * m_fileBitsPerPixel + 7) / 8;
+    int rowBytes = (int)(lastByte - firstByte);
+
+    vector<unsigned char> fileRow(rowBytes);
+    vector<unsigned char> decodedRow((size_t)pixelsPerRow * bytesPerPixel);
+    vector<unsigned long> blockSum((size_t)loadedWidth * bytesPerPixel);
+    unsigned long blockPixels = (unsigned long)shrink * shrink;
+
+    // Rows are stored bottom-up. Loaded row i is made from image rows counted from the top
+    // as roiY + (loadedHeight - 1 - i) * shrink onwards, so file offsets only increase
+    // (unless the file is top-down).
+    for (int i = 0; i < loadedHeight; i++)
+    {
+        int topRow = roiY + (loadedHeight - 1 - i) * shrink;
+        fill(blockSum.begin(), blockSum.end(), 0);
+
+        for (int k = shrink - 1; k >= 0; k--)
+        {
+            long fileRowIndex = m_fileTopDown ? topRow + k : height - 1 - (topRow + k);
+            long offset = m_bitmapFileHeader->dataOffset + fileRowIndex * filePaddedWidth + firstByte;
+            if (this->readInput(offset, &fileRow[0], rowBytes) != (size_t)rowBytes)
+            {
+                printf("ERROR: Could not read row %ld!\n", fileRowIndex);
+                FreePixelMemory(bitmap_pixels);
+                throw "Exception: Truncated bitmap data!";
+            }
+
+            this->decodeRow(&fileRow[0], roiX, pixelsPerRow, &decodedRow[0]);
+
+            for (int x = 0; x < loadedWidth; x++)
+            {
+                const unsigned char *pixel = &decodedRow[(size_t)x * shrink * bytesPerPixel];
+                for (int s = 0; s < shrink * bytesPerPixel; s++)
+                {
+                    blockSum[x * bytesPerPixel + (s % bytesPerPixel)] += pixel[s];
+                }
+            }
+        }
+
+        unsigned char *row = &bitmap_pixels[(size_t)m_paddedWidth * i];
+        for (int x = 0; x < loadedWidth * bytesPerPixel; x++)
+        {
+            row[x] = (unsigned char)((blockSum[x] + blockPixels / 2) / blockPixels);
+        }
+    }
+
+    // The loaded image is what the rest of the class works on
+    m_bitmapInfoHeader->width = loadedWidth;
+    m_bitmapInfoHeader->height = loadedHeight;
+    m_bitmapInfoHeader->xPixelsPerMeter /= shrink;
+    m_bitmapInfoHeader->yPixelsPerMeter /= shrink;
+    m_imageSize = (unsigned long)loadedWidth * loadedHeight;
+
+    *(int*)&m_bitmapHeaderChar[WIDTH] = loadedWidth;
+    *(int*)&m_bitmapHeaderChar[HEIGHT] = loadedHeight;
+    *(int*)&m_bitmapHeaderChar[X_PIXELS_PER_METER] = m_bitmapInfoHeader->xPixelsPerMeter;
+    *(int*)&m_bitmapHeaderChar[Y_PIXELS_PER_METER] = m_bitmapInfoHeader->yPixelsPerMeter;
+
+    return bitmap_pixels;
+}
+
+//******************************************************************************************
+// @name                    : getPaddedRowSize
+//
+// @description             : This is a static function. Every row of a bitmap is padded to
+//                            a multiple of 4 bytes.
+//
+// @param width             : Width of image in pixels
+// @param bitsPerPixel      : Bits used to store a single pixel
+//
+// @returns                 : Length of a padded row in bytes
+//********************************************************************************************
+int BitmapImage::getPaddedRowSize(int width, int bitsPerPixel)
+{
+    return (((width * bitsPerPixel) + 31) / 32) * 4;
+}
+
 //******************************************************************************************
 // @name                    : getBitsPerPixelInfoFromNumber
 //
@@ -295,7 +1096,11 @@ char* BitmapImage::getBitsPerPixelInfoFromNumber(short val)
     }
     else if (val == BITS_24_RGB)
     {
-        return "24-bits RGB. Number of colors: 16 million";
+        return "24-bits RGB. Number of colors: 16 million";
+    }
+    else if (val == BITS_32_RGBA)
+    {
+        return "32-bits RGBA. Number of colors: 16 million";
     }
     else
     {
@@ -374,7 +1179,7 @@ void BitmapImage::displayImageDetails()
     printf("Width                 : %d pixels\n", m_bitmapInfoHeader->width);
     printf("Height                : %d pixels\n", m_bitmapInfoHeader->height);
     printf("Planes                : %d\n", m_bitmapInfoHeader->planes);
-    printf("Bits Per Pixel        : %s\n", getBitsPerPixelInfoFromNumber(m_bitmapInfoHeader->bitsPerPixel));
+    printf("Bits Per Pixel        : %s\n", getBitsPerPixelInfoFromNumber(m_fileBitsPerPixel));
     printf("Compression           : %s\n", getBitsCompressionTypeFromNumber(m_bitmapInfoHeader->compressionType));
     printf("compressedImageSize   : %d bytes\n", m_bitmapInfoHeader->compressedImageSize);
     printf("x_pixelsPerMeter      : %d\n", m_bitmapInfoHeader->xPixelsPerMeter);
@@ -403,27 +1208,19 @@ void BitmapImage::displayImagePixels()
     printf("Image Pixels Information:\n");
     printf("-------------------------------------------------------------\n");
 
-    // For color image (rgb)
     // Formula: val(i,j) = imgArray[width * i + j]
-    //                   = pixelValue[i][j] = m_bitmapImageChar[m_paddedWidth * i + j];
+    //                   = pixelValue[i][j] = m_bitmapImageChar[m_paddedWidth * i + j * bytesPerPixel];
+    int bytesPerPixel = m_bitmapInfoHeader->bitsPerPixel / 8;
+    int greenOffset = (bytesPerPixel > 1) ? 1 : 0;
+    int redOffset = (bytesPerPixel > 1) ? 2 : 0;
 
     for (int i = 0; i < m_bitmapInfoHeader->height; i++)
     {
-        int j = 0;
-        while (j < m_paddedWidth)
+        for (int j = 0; j < m_bitmapInfoHeader->width; j++)
         {
-            if (j >= (m_bitmapInfoHeader->width * 3))
-            {
-                // Reached end of pixels in a row. Rest of the values
-                // in this row are padding
-                break;
-            }
-
-            unsigned char *bluePixelValue  = &m_bitmapImageChar[m_paddedWidth * i + j++];
-            unsigned char *greenPixelValue = &m_bitmapImageChar[m_paddedWidth * i + j++];
-            unsigned char *redPixelValue   = &m_bitmapImageChar[m_paddedWidth * i + j++];
+            unsigned char *pixel = &m_bitmapImageChar[m_paddedWidth * i + j * bytesPerPixel];
 
-            printf("(%02d,%02d,%02d) ", *redPixelValue, *greenPixelValue, *bluePixelValue);
+            printf("(%02d,%02d,%02d) ", pixel[redOffset], pixel[greenOffset], pixel[0]);
         }
     }
 }
@@ -431,42 +1228,110 @@ void BitmapImage::displayImagePixels()
 //******************************************************************************************
 // @name                    : prepareHistogram
 //
-//@description              : Prepares histogram of input image
+//@description              : Prepares histogram of input image from the counts of its pixels
+//
+// @param histogram         : Counts of the pixels at every intensity level
 //
 // @returns                 : Nothing
 //********************************************************************************************
-void BitmapImage::prepareHistogram()
+void BitmapImage::prepareHistogram(const histogram_table_t &histogram)
 {
     printf("\nPreparing histogram information...\n");
-    for (int i = 0; i < m_bitmapInfoHeader->height; i++)
+
+    m_histogramSampleCount = 0;
+    for (int i = 0; i < MAX_COLORS; i++)
+    {
+        m_histogramSampleCount += histogram.red[i];
+        m_redHistogram[i] = histogram.red[i];
+        m_greenHistogram[i] = histogram.green[i];
+        m_blueHistogram[i] = histogram.blue[i];
+        m_brightnessHistogram[i] = histogram.brightness[i];
+    }
+}
+
+//******************************************************************************************
+// @name                    : countHistogram
+//
+// @description             : Counts the pixels of an image, or of a rectangle of it, at
+//                            every intensity level. Only the pixels of the histogram sample
+//                            are counted when the histograms are sampled.
+//
+// @param image             : Pixels to count
+// @param histogram         : Counts on return
+// @param originX           : Image column of the first column of a rectangle
+// @param originRow         : Image memory row of the first row of a rectangle
+//
+// @returns                 : Nothing
+//********************************************************************************************
+void BitmapImage::countHistogram(const pixel_buffer_t &image, histogram_table_t &histogram, int originX, int originRow)
+{
+    memset(&histogram, 0, sizeof(histogram));
+    mutex histogramMutex;
+
+    DispatchPixelFormat(image.bitsPerPixel, [&](auto format)
     {
-        int j = 0;
-        while (j < m_paddedWidth)
+        typedef decltype(format) Format;
+        ThreadPool::getInstance().parallelFor(image.height, DEFAULT_ROWS_PER_TASK, [&](int begin, int end)
         {
-            if (j >= (m_bitmapInfoHeader->width * 3))
+            histogram_table_t bandHistogram;
+            memset(&bandHistogram, 0, sizeof(bandHistogram));
+            if (m_histogramSampleStep > 1)
             {
-                // Reached end of pixels in a row. Rest of the values
-                // in this row are padding
-                break;
+                HistogramSampleRows<Format>(image, begin, end, m_histogramSampleStep, originX, originRow, bandHistogram);
+            }
+            else
+            {
+                HistogramRows<Format>(image, begin, end, bandHistogram);
             }
 
-            pixel_value_rgb_t pixel_value_rgb;
-            pixel_value_rgb.blue  = m_bitmapImageChar[m_paddedWidth * i + j++];
-            pixel_value_rgb.green = m_bitmapImageChar[m_paddedWidth * i + j++];
-            pixel_value_rgb.red   = m_bitmapImageChar[m_paddedWidth * i + j++];
-
-            // RGB histograms
-            m_redHistogram[pixel_value_rgb.red]++;
-            m_greenHistogram[pixel_value_rgb.green]++;
-            m_blueHistogram[pixel_value_rgb.blue]++;
+            lock_guard<mutex> lock(histogramMutex);
+            for (int i = 0; i < MAX_COLORS; i++)
+            {
+                histogram.red[i] += bandHistogram.red[i];
+                histogram.green[i] += bandHistogram.green[i];
+                histogram.blue[i] += bandHistogram.blue[i];
+                histogram.brightness[i] += bandHistogram.brightness[i];
+            }
+        });
+    });
+}
 
-            // Brightness histogram
-            pixel_value_ycbcr_t pixel_value_ycbcr = { 0 };
-            pixel_value_ycbcr = convertToYCbCr(pixel_value_rgb);
+//******************************************************************************************
+// @name                    : getOriginalPixelBuffer
+//
+//@description              : Describes the pixels of the original image
+//
+// @returns                 : Pixel buffer
+//********************************************************************************************
+pixel_buffer_t BitmapImage::getOriginalPixelBuffer()
+{
+    pixel_buffer_t buffer;
+    buffer.pixels = m_bitmapImageChar;
+    buffer.width = m_bitmapInfoHeader->width;
+    buffer.height = m_bitmapInfoHeader->height;
+    buffer.paddedWidth = m_paddedWidth;
+    buffer.bitsPerPixel = m_bitmapInfoHeader->bitsPerPixel;
+
+    return buffer;
+}
 
-            m_brightnessHistogram[pixel_value_ycbcr.y]++;
-        }
-    }
+//******************************************************************************************
+// @name                    : getModifiedPixelBuffer
+//
+//@description              : Describes the pixels of the modified image
+//
+// @returns                 : Pixel buffer
+//********************************************************************************************
+pixel_buffer_t BitmapImage::getModifiedPixelBuffer()
+{
+    pixel_buffer_t buffer;
+    buffer.pixels = m_modifiedBitmapImageChar;
+    buffer.width = m_modifiedWidth;
+    buffer.height = m_modifiedHeight;
+    buffer.paddedWidth = m_modifiedPaddedWidth;
+    buffer.bitsPerPixel = m_modifiedBitsPerPixel;
+
+    return buffer;
 }
 
 //******************************************************************************************
@@ -542,18 +1407,18 @@ int BitmapImage::writeModifiedImageDataToFile(const char *outputFilePath)
     if (outfile == nullptr)
     {
         printf("Cannot create file [%s]\n", outputFilePath);
+        return -1;
     }
 
-    // Write header
-    m_modifiedBitmapHeaderChar = (char *)malloc(BITMAP_HEADER_SIZE + 1);
-    if (m_modifiedBitmapHeaderChar == nullptr)
+    // No modified image. Simply write the same image to output file.
+    if (m_modifiedBitmapImageChar == nullptr)
     {
-        printf("ERROR: Malloc Failure!\n");
-        assert(0);
+        this->allocateModifiedImageBuffer();
+        printf("\nINFO: No modification to image. Making copy of original\n");
     }
 
-    memset(m_modifiedBitmapHeaderChar, 0, BITMAP_HEADER_SIZE + 1);
-    memcpy(m_modifiedBitmapHeaderChar, m_bitmapHeaderChar, BITMAP_HEADER_SIZE);
+    // Write header
+    this->buildModifiedHeader();
 
     retval = fwrite(m_modifiedBitmapHeaderChar, sizeof(char), BITMAP_HEADER_SIZE, outfile);
     if (retval == 0)
@@ -562,15 +1427,19 @@ int BitmapImage::writeModifiedImageDataToFile(const char *outputFilePath)
         assert(0);
     }
 
-    // No modified image. Simply write the same image to output file.
-    if (m_modifiedBitmapImageChar == nullptr)
+    // Write color table
+    if (!m_modifiedColorTable.empty())
     {
-        this->allocateModifiedImageBuffer();
-        printf("\nINFO: No modification to image. Making copy of original\n");
+        retval = fwrite(&m_modifiedColorTable[0], sizeof(unsigned char), m_modifiedColorTable.size(), outfile);
+        if (retval == 0)
+        {
+            printf("ERROR: Color table write error!\n");
+            assert(0);
+        }
     }
 
     // Write modified image data
-    retval = fwrite(m_modifiedBitmapImageChar, sizeof(unsigned char), m_paddedImageSize, outfile);
+    retval = fwrite(m_modifiedBitmapImageChar, sizeof(unsigned char), m_modifiedPaddedImageSize, outfile);
     if (retval == 0)
     {
         printf("ERROR: Content write error!\n");
@@ -582,6 +1451,81 @@ int BitmapImage::writeModifiedImageDataToFile(const char *outputFilePath)
     return 0;
 }
 
+//******************************************************************************************
+// @name                    : getModifiedImageFileData
+//
+// @description             : Serializes the modified image (or a copy of the original if
+//                            there is no modification) to the bytes of a bitmap file, for
+//                            writers that do their own I/O such as AsyncFileIO.
+//
+// @param fileData          : Contents of the bitmap file on return
+//
+// @returns                 : 0 if SUCCESS
+//********************************************************************************************
+int BitmapImage::getModifiedImageFileData(vector<unsigned char> &fileData)
+{
+    if (m_modifiedBitmapImageChar == nullptr)
+    {
+        this->allocateModifiedImageBuffer();
+    }
+
+    this->buildModifiedHeader();
+
+    fileData.resize(BITMAP_HEADER_SIZE + m_modifiedColorTable.size() + m_modifiedPaddedImageSize);
+    unsigned char *out = &fileData[0];
+
+    memcpy(out, m_modifiedBitmapHeaderChar, BITMAP_HEADER_SIZE);
+    out += BITMAP_HEADER_SIZE;
+
+    if (!m_modifiedColorTable.empty())
+    {
+        memcpy(out, &m_modifiedColorTable[0], m_modifiedColorTable.size());
+        out += m_modifiedColorTable.size();
+    }
+
+    memcpy(out, m_modifiedBitmapImageChar, m_modifiedPaddedImageSize);
+
+    return 0;
+}
+
+//******************************************************************************************
+// @name                    : buildModifiedHeader
+//
+//@description              : Prepares the header of the modified image. Starts from the
+//                            original header and rewrites the fields which depend on the
+//                            dimensions and pixel format of the modified image.
+//
+// @returns                 : Nothing
+//********************************************************************************************
+void BitmapImage::buildModifiedHeader()
+{
+    if (m_modifiedBitmapHeaderChar == nullptr)
+    {
+        m_modifiedBitmapHeaderChar = (char *)malloc(BITMAP_HEADER_SIZE + 1);
+        if (m_modifiedBitmapHeaderChar == nullptr)
+        {
+            printf("ERROR: Malloc Failure!\n");
+            assert(0);
+        }
+    }
+
+    memset(m_modifiedBitmapHeaderChar, 0, BITMAP_HEADER_SIZE + 1);
+    memcpy(m_modifiedBitmapHeaderChar, m_bitmapHeaderChar, BITMAP_HEADER_SIZE);
+
+    // Only the 54 byte header and the color table are written, so pixels follow them directly
+    int colorTableSize = (int)m_modifiedColorTable.size();
+    *(int*)&m_modifiedBitmapHeaderChar[FILE_SIZE] = BITMAP_HEADER_SIZE + colorTableSize + m_modifiedPaddedImageSize;
+    *(int*)&m_modifiedBitmapHeaderChar[DATA_OFFSET] = BITMAP_HEADER_SIZE + colorTableSize;
+    *(int*)&m_modifiedBitmapHeaderChar[INFO_HEADER_SIZE] = BITMAP_INFO_HEADER_SIZE;
+    *(int*)&m_modifiedBitmapHeaderChar[WIDTH] = m_modifiedWidth;
+    *(int*)&m_modifiedBitmapHeaderChar[HEIGHT] = m_modifiedTopDown ? -m_modifiedHeight : m_modifiedHeight;
+    *(short*)&m_modifiedBitmapHeaderChar[BITS_PER_PIXEL] = m_modifiedBitsPerPixel;
+    *(int*)&m_modifiedBitmapHeaderChar[COMPRESSION_TYPE] = COMPRESSION_RGB;
+    *(int*)&m_modifiedBitmapHeaderChar[COMPRESSED_IMAGE_SIZE] = m_modifiedPaddedImageSize;
+    *(int*)&m_modifiedBitmapHeaderChar[COLORS_USED] = colorTableSize / 4;
+    *(int*)&m_modifiedBitmapHeaderChar[IMPORTANT_COLORS] = 0;
+}
+
 //******************************************************************************************
 // @name                    : allocateModifiedImageBuffer
 //
@@ -592,21 +1536,108 @@ int BitmapImage::writeModifiedImageDataToFile(const char *outputFilePath)
 //********************************************************************************************
 void BitmapImage::allocateModifiedImageBuffer()
 {
-    // Allocate memory only if not already allocated
+    if (this->allocateModifiedImageBuffer(m_bitmapInfoHeader->width, m_bitmapInfoHeader->height) != 0)
+    {
+        // A buffer of the size of the original image should always be there
+        assert(0);
+    }
+
+    m_modifiedImageSize = m_imageSize;  // Same size image. Not used as of now
+
+    // Copied in the same bands, so every thread reads and writes memory of its own node
+    size_t paddedWidth = m_paddedWidth;
+    ThreadPool::getInstance().parallelFor(m_bitmapInfoHeader->height, DEFAULT_ROWS_PER_TASK, [&](int begin, int end)
+    {
+        memcpy(m_modifiedBitmapImageChar + paddedWidth * begin, m_bitmapImageChar + paddedWidth * begin,
+               paddedWidth * (end - begin));
+    });
+}
+
+//******************************************************************************************
+// @name                    : allocateModifiedImageBuffer
+//
+//@description              : Allocate a zero filled modified image buffer of the given
+//                            dimensions, in the pixel format of the original image. Used by
+//                            operations which change the image size.
+//
+// @param width             : Width of modified image in pixels
+// @param height            : Height of modified image in pixels
+//
+// @returns                 : 0 if SUCCESS
+//********************************************************************************************
+int BitmapImage::allocateModifiedImageBuffer(int width, int height)
+{
+    return this->allocateModifiedImageBuffer(width, height, m_bitmapInfoHeader->bitsPerPixel);
+}
+
+//******************************************************************************************
+// @name                    : allocateModifiedImageBuffer
+//
+//@description              : Allocate a zero filled modified image buffer of the given
+//                            dimensions and pixel format. 8 bit images get a grayscale color
+//                            table, which operations writing palettized images replace.
+//
+// @param width             : Width of modified image in pixels, 1 to MAX_IMAGE_DIMENSION
+// @param height            : Height of modified image in pixels, 1 to MAX_IMAGE_DIMENSION
+// @param bitsPerPixel      : Bits per pixel of modified image
+//
+// @returns                 : 0 if SUCCESS, -1 if the buffer could not be allocated
+//********************************************************************************************
+int BitmapImage::allocateModifiedImageBuffer(int width, int height, short bitsPerPixel)
+{
+    int paddedWidth = getPaddedRowSize(width, bitsPerPixel);
+    unsigned long paddedImageSize = (unsigned long)paddedWidth * height;
+
+    // Reallocate only if the existing buffer has a different size
+    if (m_modifiedBitmapImageChar != nullptr && m_modifiedPaddedImageSize != paddedImageSize)
+    {
+        FreePixelMemory(m_modifiedBitmapImageChar);
+        m_modifiedBitmapImageChar = nullptr;
+    }
+
+    // A new buffer comes zero filled, with its pages on the nodes which process its rows
     if (m_modifiedBitmapImageChar == nullptr)
     {
-        m_modifiedBitmapImageChar = (unsigned char *)malloc(m_paddedImageSize);
+        m_modifiedBitmapImageChar = AllocatePixelMemory(paddedWidth, height);
         if (m_modifiedBitmapImageChar == nullptr)
         {
             printf("ERROR: Malloc Failure!\n");
-            assert(0);
+            m_modifiedPaddedImageSize = 0;
+            m_lastOperation = OPERATION_NONE;
+            return -1;
         }
     }
+    else
+    {
+        ClearPixelMemory(m_modifiedBitmapImageChar, paddedWidth, height);
+    }
 
-    m_modifiedImageSize = m_imageSize;  // Same size image. Not used as of now
-    memset(m_modifiedBitmapImageChar, 0, m_paddedImageSize);
-    memcpy(m_modifiedBitmapImageChar, m_bitmapImageChar, m_paddedImageSize);
+    m_modifiedWidth = width;
+    m_modifiedHeight = height;
+    m_modifiedPaddedWidth = paddedWidth;
+    m_modifiedPaddedImageSize = paddedImageSize;
+    m_modifiedImageSize = (unsigned long)width * height;
+    m_modifiedBitsPerPixel = bitsPerPixel;
+
+    // The buffer no longer holds the result of an incremental operation
+    m_lastOperation = OPERATION_NONE;
+    m_modifiedTopDown = false;
+
+    m_modifiedColorTable.clear();
+    if (bitsPerPixel <= BITS_8_PALLETIZED)
+    {
+        m_modifiedColorTable.assign((size_t)(1 << bitsPerPixel) * 4, 0);
+        int maxIndex = (1 << bitsPerPixel) - 1;
+        for (int i = 0; i <= maxIndex; i++)
+        {
+            unsigned char gray = (unsigned char)((i * (MAX_COLORS - 1)) / maxIndex);
+            m_modifiedColorTable[i * 4] = gray;
+            m_modifiedColorTable[i * 4 + 1] = gray;
+            m_modifiedColorTable[i * 4 + 2] = gray;
+        }
+    }
 
+    return 0;
 }
 
 //******************************************************************************************
@@ -618,48 +1649,37 @@ void BitmapImage::allocateModifiedImageBuffer()
 //********************************************************************************************
 int BitmapImage::ConvertToGrayScale()
 {
-    int i = 0;
-    int retval = -1;
-
-    this->allocateModifiedImageBuffer();
-
-    for (int i = 0; i < m_bitmapInfoHeader->height; i++)
+    bool supported = true;
+    auto kernel = [&](const pixel_buffer_t &src, pixel_buffer_t &dst)
     {
-        int j = 0;
-        while (j < m_paddedWidth)
+        supported = DispatchPixelFormat(src.bitsPerPixel, [&](auto format)
         {
-            if (j >= (m_bitmapInfoHeader->width * 3))
+            typedef decltype(format) Format;
+            ThreadPool::getInstance().parallelFor(src.height, DEFAULT_ROWS_PER_TASK, [&](int begin, int end)
             {
-                // Reached end of pixels in a row. Rest of the values
-                // in this row are padding
-                break;
-            }
-
-            unsigned char* red;
-            unsigned char* green;
-            unsigned char* blue;
-
-            blue  = &m_modifiedBitmapImageChar[m_paddedWidth * i + j++];
-            green = &m_modifiedBitmapImageChar[m_paddedWidth * i + j++];
-            red   = &m_modifiedBitmapImageChar[m_paddedWidth * i + j++];
-
-            pixel_value_rgb_t pixel_value_rgb = { 0 };
-            pixel_value_rgb.red = *red;
-            pixel_value_rgb.green = *green;
-            pixel_value_rgb.blue = *blue;
+                GrayscaleRows<Format>(src, dst, begin, end);
+            });
+        });
+    };
 
-            pixel_value_ycbcr_t pixel_value_ycbcr = { 0 };
-
-            pixel_value_ycbcr = convertToYCbCr(pixel_value_rgb);
-
-            // Do modification to individual pixels here
-            *red = pixel_value_ycbcr.y;
-            *green = pixel_value_ycbcr.y;
-            *blue = pixel_value_ycbcr.y;
+    // After edits, only the edited tiles change
+    if (this->canUpdateIncrementally(OPERATION_GRAYSCALE, PROCESS_PER_CHANNEL))
+    {
+        this->processDirtyTiles(0, kernel);
+    }
+    else
+    {
+        this->allocateModifiedImageBuffer();
+        pixel_buffer_t dst = this->getModifiedPixelBuffer();
+        kernel(this->getOriginalPixelBuffer(), dst);
+    }
 
-        }
+    if (!supported)
+    {
+        return -1;
     }
 
+    this->completeOperation(OPERATION_GRAYSCALE, PROCESS_PER_CHANNEL);
     return 0;
 }
 
@@ -667,17 +1687,17 @@ int BitmapImage::ConvertToGrayScale()
 //******************************************************************************************
 // @name                    : doHistogramEqualization
 //
-//@description              : Do equalization and save to modified image buffer.
+//@description              : Do equalization and save to modified image buffer. With
+//                            sampled histograms (bitmap_load_options_t::histogramSampling)
+//                            the mapping of a level may be off by up to 255 times
+//                            getHistogramErrorBound(), and applying it is the only full pass.
+//
+// @param mode              : Equalize red, green and blue separately, or only brightness
 //
 // @returns                 : return value
 //********************************************************************************************
-int BitmapImage::doHistogramEqualization()
+int BitmapImage::doHistogramEqualization(processing_mode_t mode)
 {
-    int i = 0;
-    int retval = -1;
-
-    this->allocateModifiedImageBuffer();
-
     // Probability table
     double probabilityTableRed[MAX_COLORS];
     double probabilityTableGreen[MAX_COLORS];
@@ -685,10 +1705,10 @@ int BitmapImage::doHistogramEqualization()
     double probabilityTableBrightness[MAX_COLORS];
     for (int i = 0; i < MAX_COLORS; i++)
     {
-        probabilityTableRed[i]        = (double)m_redHistogram[i] / m_imageSize;
-        probabilityTableGreen[i]      = (double)m_greenHistogram[i] / m_imageSize;
-        probabilityTableBlue[i]       = (double)m_blueHistogram[i] / m_imageSize;
-        probabilityTableBrightness[i] = (double)m_brightnessHistogram[i] / m_imageSize;
+        probabilityTableRed[i]        = (double)m_redHistogram[i] / m_histogramSampleCount;
+        probabilityTableGreen[i]      = (double)m_greenHistogram[i] / m_histogramSampleCount;
+        probabilityTableBlue[i]       = (double)m_blueHistogram[i] / m_histogramSampleCount;
+        probabilityTableBrightness[i] = (double)m_brightnessHistogram[i] / m_histogramSampleCount;
     }
 
     // Cumulative Distribution Function
@@ -710,54 +1730,53 @@ int BitmapImage::doHistogramEqualization()
         cdfBrightness[i] = probabilityTableBrightness[i] + cdfBrightness[i - 1];
     }
 
+    // Every intensity level maps to a fixed output level
+    unsigned char lut[4][MAX_COLORS];
+    for (int i = 0; i < MAX_COLORS; i++)
+    {
+        lut[RED][i]        = (unsigned char)(cdfRed[i] * (MAX_COLORS - 1));
+        lut[GREEN][i]      = (unsigned char)(cdfGreen[i] * (MAX_COLORS - 1));
+        lut[BLUE][i]       = (unsigned char)(cdfBlue[i] * (MAX_COLORS - 1));
+        lut[BRIGHTNESS][i] = (unsigned char)(cdfBrightness[i] * (MAX_COLORS - 1));
+    }
+
     // Pixel processing for histogram equalization
-    for (int i = 0; i < m_bitmapInfoHeader->height; i++)
+    bool supported = true;
+    auto kernel = [&](const pixel_buffer_t &src, pixel_buffer_t &dst)
     {
-        int j = 0;
-        while (j < m_paddedWidth)
+        supported = DispatchPixelFormat(src.bitsPerPixel, [&](auto format)
         {
-            if (j >= (m_bitmapInfoHeader->width * 3))
+            DispatchProcessingMode(mode, [&](auto modeTag)
             {
-                // Reached end of pixels in a row. Rest of the values
-                // in this row are padding
-                break;
-            }
+                typedef decltype(format) Format;
+                ThreadPool::getInstance().parallelFor(src.height, DEFAULT_ROWS_PER_TASK, [&](int begin, int end)
+                {
+                    ApplyLookupRows<Format, decltype(modeTag)::value>(src, dst, lut, begin, end);
+                });
+            });
+        });
+    };
+
+    // Edits which leave the table unchanged only change the edited tiles. Otherwise every
+    // pixel maps to a new level.
+    if (this->canUpdateIncrementally(OPERATION_EQUALIZATION, mode) && memcmp(lut, m_lastLookupTable, sizeof(lut)) == 0)
+    {
+        this->processDirtyTiles(0, kernel);
+    }
+    else
+    {
+        this->allocateModifiedImageBuffer();
+        pixel_buffer_t dst = this->getModifiedPixelBuffer();
+        kernel(this->getOriginalPixelBuffer(), dst);
+    }
 
-            unsigned char* red;
-            unsigned char* green;
-            unsigned char* blue;
-            
-            blue  = &m_modifiedBitmapImageChar[m_paddedWidth * i + j++];
-            green = &m_modifiedBitmapImageChar[m_paddedWidth * i + j++];
-            red   = &m_modifiedBitmapImageChar[m_paddedWidth * i + j++];
-
-            pixel_value_rgb_t pixel_value_rgb = { 0 };
-            pixel_value_rgb.red = *red;
-            pixel_value_rgb.green = *green;
-            pixel_value_rgb.blue = *blue;
-
-#ifdef USE_BRIGHTNESS_LEVEL_FOR_HISTOGRAM_EQUALIZATION
-            // Obtain brightness level and do equalization on that.
-            pixel_value_ycbcr_t pixel_value_ycbcr = { 0 };
-            pixel_value_ycbcr = convertToYCbCr(pixel_value_rgb);
-            unsigned char brightness = pixel_value_ycbcr.y;
-            brightness = cdfBrightness[brightness] * (MAX_COLORS - 1);
-            pixel_value_ycbcr.y = cdfBrightness[brightness] * (MAX_COLORS - 1);
-
-            // Convert this to RGB
-            pixel_value_rgb = convertToRGB(pixel_value_ycbcr);
-#else
-            pixel_value_rgb.red = cdfRed[pixel_value_rgb.red] * (MAX_COLORS - 1);
-            pixel_value_rgb.green = cdfGreen[pixel_value_rgb.green] * (MAX_COLORS - 1);
-            pixel_value_rgb.blue = cdfBlue[pixel_value_rgb.blue] * (MAX_COLORS - 1);
-#endif
-            // Do modification to individual pixels here
-            *red = pixel_value_rgb.red;
-            *green = pixel_value_rgb.green;
-            *blue = pixel_value_rgb.blue;
-        }
+    if (!supported)
+    {
+        return -1;
     }
 
+    memcpy(m_lastLookupTable, lut, sizeof(lut));
+    this->completeOperation(OPERATION_EQUALIZATION, mode);
     return 0;
 }
 
@@ -772,51 +1791,7 @@ int BitmapImage::doHistogramEqualization()
 //********************************************************************************************
 pixel_value_ycbcr_t BitmapImage::convertToYCbCr(pixel_value_rgb_t pixelValue)
 {
-    pixel_value_ycbcr_t pixelYCbCr = { 0 };
-    int r = pixelValue.red;
-    int g = pixelValue.green;
-    int b = pixelValue.blue;
-
-#ifdef USE_ITU_CONVERSION_FOR_YCBCR
-    // As per Recommendation ITU-R BT.601[6]
-    int y = 16 + ((0.257 * r) + (0.504 * g) + (0.098 * b));
-    int Cb = 128 + ((-0.148 * r) - (0.291 * g) + (0.439 * b));
-    int Cr = 128 + ((0.439 * r) - (0.368 * g) - (0.071 * b));
-#else
-    // As per http://www.mir.com/DMG/ycbcr.html
-    int y = 16 + ((0.299 * r) + (0.587 * g) + (0.114 * b));
-    int Cb = 128 + ((-0.168736 * r) - (0.331364 * g) + (0.5 * b));
-    int Cr = 128 + ((0.5 * r) - (0.418688 * g) - (0.081312 * b));
-    
-#endif
-
-#if 1
-    // Clamping on YCbCr values
-    if (y > Y_MAX)
-        y = Y_MAX;
-
-    if (y < Y_MIN)
-        y = Y_MIN;
-
-    if (Cb > C_MAX)
-        Cb = C_MAX;
-
-    if (Cb < C_MIN)
-        Cb = C_MIN;
-
-    if (Cr > C_MAX)
-        Cr = C_MAX;
-
-    if (Cr < C_MIN)
-        Cr = C_MIN;
-#endif 
-
-    // Use clamped values
-    pixelYCbCr.y = y;
-    pixelYCbCr.Cb = Cb;
-    pixelYCbCr.Cr = Cr;
-
-    return pixelYCbCr;
+    return RGBToYCbCr(pixelValue.red, pixelValue.green, pixelValue.blue);
 }
 
 //******************************************************************************************
@@ -830,199 +1805,53 @@ pixel_value_ycbcr_t BitmapImage::convertToYCbCr(pixel_value_rgb_t pixelValue)
 //********************************************************************************************
 pixel_value_rgb_t BitmapImage::convertToRGB(pixel_value_ycbcr_t pixelYCbCr)
 {
-    pixel_value_rgb_t pixelValue = { 0 };
-    int y = pixelYCbCr.y;
-    int Cb = pixelYCbCr.Cb;
-    int Cr = pixelYCbCr.Cr;
-
-#ifdef USE_ITU_CONVERSION_FOR_YCBCR
-    // As per Recommendation ITU-R BT.601[6]
-    int r = (1.164 * (y - 16)) + (1.596 * (Cr - 128));
-    int g = (1.164 * (y - 16)) + (-0.392 * (Cb - 128)) + (-0.813 * (Cr - 128));
-    int b = (1.164 * (y - 16)) + (2.017 * (Cb - 128));
-
-#else
-    // As per http://www.mir.com/DMG/ycbcr.html
-    int r = y + (1.402 * Cr);
-    int g = y - (0.344136 * Cb) - (0.714136 * Cr);
-    int b = y + (1.772 * Cb);
-#endif
-
-    // Clamping on RGB values
-    if (r > MAX_COLORS - 1)
-        r = MAX_COLORS - 1;
-
-    if (r < MIN_COLORS)
-        r = MIN_COLORS;
-
-    if (g > MAX_COLORS - 1)
-        g = MAX_COLORS - 1;
-        
-    if (g < MIN_COLORS)
-        g = MIN_COLORS;
-
-    if (b > MAX_COLORS - 1)
-        b = MAX_COLORS - 1;
-        
-    if (b < MIN_COLORS)
-        b = MIN_COLORS;
-
-    pixelValue.red = r;
-    pixelValue.green = g;
-    pixelValue.blue = b;
-
-    return pixelValue;
+    return YCbCrToRGB(pixelYCbCr.y, pixelYCbCr.Cb, pixelYCbCr.Cr);
 }
 
 //******************************************************************************************
 // @name                    : DoImageBlur
 //
-//@description              : Blurs an image
+//@description              : Blurs an image. Every pixel becomes the mean of its neighbours.
+//
+// @param mode              : Average red, green and blue separately, or only brightness
 //
 // @returns                 : 0 if SUCCESS
 //********************************************************************************************
-int BitmapImage::DoImageBlur()
+int BitmapImage::DoImageBlur(processing_mode_t mode)
 {
-    int i = 0;
-    int retval = -1;
-
-    this->allocateModifiedImageBuffer();
-
-    for (int i = 0; i < m_bitmapInfoHeader->height; i++)
+    bool supported = true;
+    auto kernel = [&](const pixel_buffer_t &src, pixel_buffer_t &dst)
     {
-        int j = 0;
-        while (j < m_paddedWidth)
+        supported = DispatchPixelFormat(src.bitsPerPixel, [&](auto format)
         {
-            if (j >= (m_bitmapInfoHeader->width * 3))
+            DispatchProcessingMode(mode, [&](auto modeTag)
             {
-                // Reached end of pixels in a row. Rest of the values
-                // in this row are padding
-                break;
-            }
-
-            
-#ifdef USE_BRIGHTNESS_LEVEL_FOR_BLURRING            
-            unsigned char averageBrightness = findAveragePixelValuesGrayscale(i, j);
-#else
-            pixel_value_rgb_t avgPixelValues = findAveragePixelValuesRGB(i, j);
-#endif
-
-            unsigned char* red;
-            unsigned char* green;
-            unsigned char* blue;
-
-            blue  = &m_modifiedBitmapImageChar[m_paddedWidth * i + j++];
-            green = &m_modifiedBitmapImageChar[m_paddedWidth * i + j++];
-            red   = &m_modifiedBitmapImageChar[m_paddedWidth * i + j++];
-
-#ifdef USE_BRIGHTNESS_LEVEL_FOR_BLURRING 
-            pixel_value_rgb_t pixel_value_rgb = { 0 };
-            pixel_value_rgb.red = *red;
-            pixel_value_rgb.blue = *blue;
-            pixel_value_rgb.green = *green;
-
-            pixel_value_ycbcr_t pixel_value_ycbcr = { 0 };
-            pixel_value_ycbcr = convertToYCbCr(pixel_value_rgb);
-
-            pixel_value_ycbcr.y = averageBrightness;
-            pixel_value_rgb = convertToRGB(pixel_value_ycbcr);
-
-            // Do modification to individual pixels here
-            *red = pixel_value_rgb.red;
-            *green = pixel_value_rgb.blue;
-            *blue = pixel_value_rgb.green;
-#else
-            // Do modification to individual pixels here
-            *red = avgPixelValues.red;
-            *green = avgPixelValues.blue;
-            *blue = avgPixelValues.green;
-#endif
-        }
+                typedef decltype(format) Format;
+                ThreadPool::getInstance().parallelFor(src.height, DEFAULT_ROWS_PER_TASK, [&](int begin, int end)
+                {
+                    BlurRows<Format, decltype(modeTag)::value>(src, dst, begin, end);
+                });
+            });
+        });
+    };
+
+    // After edits, only the edited tiles and the pixels whose neighbourhood reaches into them change
+    if (this->canUpdateIncrementally(OPERATION_BLUR, mode))
+    {
+        this->processDirtyTiles(BLUR_HALO, kernel);
     }
-
-    return 0;
-}
-
-pixel_value_rgb_t BitmapImage::findAveragePixelValuesRGB(int idx_i, int idx_j)
-{
-    pixel_value_rgb_t averagePixelValue = { 0 };
-    unsigned long red = 0;
-    unsigned long  green = 0;
-    unsigned long blue = 0;
-    unsigned long rgbPixels = 0;
-
-    for (int i = -1; i <= 1; i++)
+    else
     {
-        for (int j = -1; j <= 1; j++)
-        {
-            if ((idx_i + i > 0) && (idx_i + i < m_bitmapInfoHeader->height) &&
-                (idx_j + j > 0) && (idx_j + j < (m_bitmapInfoHeader->width * 3)))
-            {
-                if (i == 0 && j == 0)
-                {
-                    continue;
-                }
-
-                blue += m_modifiedBitmapImageChar[(m_paddedWidth * (idx_i + i)) + (idx_j + j)];
-                j++;
-                green += m_modifiedBitmapImageChar[(m_paddedWidth * (idx_i + i)) + (idx_j + j)];
-                j++;
-                red += m_modifiedBitmapImageChar[(m_paddedWidth * (idx_i + i)) + (idx_j + j)];
-
-                rgbPixels++;
-            }
-        }
+        this->allocateModifiedImageBuffer();
+        pixel_buffer_t dst = this->getModifiedPixelBuffer();
+        kernel(this->getOriginalPixelBuffer(), dst);
     }
-    
-    averagePixelValue.red   = red / rgbPixels;
-    averagePixelValue.green = green / rgbPixels;
-    averagePixelValue.blue  = blue / rgbPixels;
-
-    return averagePixelValue;
-}
-
-unsigned char BitmapImage::findAveragePixelValuesGrayscale(int idx_i, int idx_j)
-{
-    unsigned char averagePixelValue = 0;
-    unsigned char red = 0;
-    unsigned char  green = 0;
-    unsigned char blue = 0;
-    unsigned long pixels = 0;
-    unsigned long brightness = 0;
 
-    for (int i = -1; i <= 1; i++)
+    if (!supported)
     {
-        for (int j = -1; j <= 1; j++)
-        {
-            if ((idx_i + i > 0) && (idx_i + i < m_bitmapInfoHeader->height) &&
-                (idx_j + j > 0) && (idx_j + j < (m_bitmapInfoHeader->width * 3)))
-            {
-                if (i == 0 && j == 0)
-                {
-                    continue;
-                }
-
-                blue = m_modifiedBitmapImageChar[(m_paddedWidth * (idx_i + i)) + (idx_j + j)];
-                j++;
-                green = m_modifiedBitmapImageChar[(m_paddedWidth * (idx_i + i)) + (idx_j + j)];
-                j++;
-                red = m_modifiedBitmapImageChar[(m_paddedWidth * (idx_i + i)) + (idx_j + j)];
-
-                pixel_value_rgb_t pixel_value_rgb = { 0 };
-                pixel_value_rgb.red = red;
-                pixel_value_rgb.blue = blue;
-                pixel_value_rgb.green = green;
-
-                pixel_value_ycbcr_t pixel_value_ycbcr = { 0 };
-                pixel_value_ycbcr = convertToYCbCr(pixel_value_rgb);
-                brightness += pixel_value_ycbcr.y;
-
-                pixels++;
-            }
-        }
+        return -1;
     }
 
-    averagePixelValue = brightness / pixels;
-
-    return averagePixelValue;
-}
\ No newline at end of file
+    this->completeOperation(OPERATION_BLUR, mode);
+    return 0;
+}
@@ -3,9 +3,15 @@
 #include<string>
 #include<vector>
 #include<map>
+#include<functional>
 
 using namespace std;
 
+// ==================================================================================================
+// Build options
+// ==================================================================================================
+#define USE_ITU_CONVERSION_FOR_YCBCR
+
 // ==================================================================================================
 // Constants
 // ==================================================================================================
@@ -15,6 +21,10 @@ const int BITMAP_HEADER_SIZE = BITMAP_FILE_HEADER_SIZE + BITMAP_INFO_HEADER_SIZE
 const int COLOR_TABLE_SIZE = 1024;
 const unsigned long HISTOGRAM_SCALING_FACTOR = 10000;
 
+const int PROBE_FILES_PER_TASK = 64;    // Files probed by one task of a batch probe
+const int LOAD_CHUNK_BYTES = 4 << 20;   // Bytes of file rows one task reads and decodes at a time
+const int MAX_IMAGE_DIMENSION = (1 << 26) - 1;  // Largest width or height; row sizes in bits must fit an int
+
 const int MAX_COLORS = 256;
 const int MIN_COLORS = 0;
 
@@ -24,6 +34,69 @@ const int Y_MAX = 235;
 const int C_MAX = 240;   // For Cb and Cr of YCbCr
 const int C_MIN = 16;
 
+// Y = Y_MIN + (r * LUMA_RED_WEIGHT + g * LUMA_GREEN_WEIGHT + b * LUMA_BLUE_WEIGHT) / LUMA_WEIGHT_SCALE
+#ifdef USE_ITU_CONVERSION_FOR_YCBCR
+const int LUMA_RED_WEIGHT = 257;
+const int LUMA_GREEN_WEIGHT = 504;
+const int LUMA_BLUE_WEIGHT = 98;
+#else
+const int LUMA_RED_WEIGHT = 299;
+const int LUMA_GREEN_WEIGHT = 587;
+const int LUMA_BLUE_WEIGHT = 114;
+#endif
+const int LUMA_WEIGHT_SCALE = 1000;
+
+// Gray = (r * GRAY_RED_WEIGHT + g * GRAY_GREEN_WEIGHT + b * GRAY_BLUE_WEIGHT + 128) >> GRAY_WEIGHT_SHIFT,
+// full range gray of the luma weights: both sets of weights above scale to these out of 256, so
+// that gray stays the same gray and white stays 255
+const int GRAY_RED_WEIGHT = 77;
+const int GRAY_GREEN_WEIGHT = 150;
+const int GRAY_BLUE_WEIGHT = 29;
+const int GRAY_WEIGHT_SHIFT = 8;
+
+// Cb = 128 + (r * CB_RED_WEIGHT + g * CB_GREEN_WEIGHT + b * CB_BLUE_WEIGHT) >> CHROMA_WEIGHT_SHIFT, rounded,
+// and likewise Cr. Fixed point RGBToYCbCr coefficients, for converting whole images.
+#ifdef USE_ITU_CONVERSION_FOR_YCBCR
+const int CB_RED_WEIGHT = -38;
+const int CB_GREEN_WEIGHT = -74;
+const int CB_BLUE_WEIGHT = 112;
+const int CR_RED_WEIGHT = 112;
+const int CR_GREEN_WEIGHT = -94;
+const int CR_BLUE_WEIGHT = -18;
+#else
+const int CB_RED_WEIGHT = -43;
+const int CB_GREEN_WEIGHT = -85;
+const int CB_BLUE_WEIGHT = 128;
+const int CR_RED_WEIGHT = 128;
+const int CR_GREEN_WEIGHT = -107;
+const int CR_BLUE_WEIGHT = -21;
+#endif
+const int CHROMA_WEIGHT_SHIFT = 8;
+
+const int RESIZE_WEIGHT_BITS = 14;      // Fixed point precision of the resize filter weights
+const double BILINEAR_SUPPORT = 1.0;    // Filter radius (in source pixels) when not downscaling
+const double LANCZOS_SUPPORT = 3.0;
+
+const int MAX_MEDIAN_RADIUS = 127;      // Window histograms count up to (2 * radius + 1)^2 pixels in 16 bits
+const int MEDIAN_ROWS_PER_TASK = 64;    // Rows per median task, which refills its column histograms
+
+const int DIRTY_TILE_SIZE = 64;         // Edits are tracked in tiles of this many pixels square
+const int BLUR_HALO = 1;                // Pixels around an edit whose blur changes
+
+const int INTEGRAL_COLUMNS_PER_TASK = 1024; // Columns one task adds up in the second pass of an integral image build
+
+const double HISTOGRAM_ERROR_PROBABILITY = 0.05;  // Chance that a sampled histogram is off by more than its error bound
+
+const int ADAPTIVE_THRESHOLD_WINDOW = 31;   // Side of the square whose mean an adaptive threshold uses
+const int ADAPTIVE_THRESHOLD_BIAS = 10;     // Pixels darker than the mean by more than this are black
+
+const int QUANTIZE_HISTOGRAM_BITS = 5;   // Bits per channel of the color histogram a palette is cut from
+const int QUANTIZE_INVERSE_BITS = 6;     // Bits per channel of the inverse color cube pixels are mapped through
+
+const int ORDERED_DITHER_SIZE = 8;      // Side of the Bayer matrix of ordered dithering
+
+const int TRANSPOSE_TILE_SIZE = 64;     // Transposes split the image until blocks fit this many pixels square
+
 // ==================================================================================================
 // Enums
 // ==================================================================================================
@@ -65,7 +138,8 @@ typedef enum bits_per_pixel_tag
     BITS_4_PALLETIZED = 4,
     BITS_8_PALLETIZED = 8,
     BITS_16_RGB = 16,
-    BITS_24_RGB = 24
+    BITS_24_RGB = 24,
+    BITS_32_RGBA = 32
 }bits_per_pixel_t;
 
 typedef enum compression_type_tag
@@ -75,13 +149,91 @@ typedef enum compression_type_tag
     COMPRESSION_RLE4 = 2
 }compression_type_t;
 
+// Result of a header probe
+typedef enum probe_status_tag
+{
+    PROBE_OK = 0,
+    PROBE_FILE_NOT_FOUND = -1,
+    PROBE_READ_ERROR = -2,
+    PROBE_INVALID_SIGNATURE = -3,
+    PROBE_INVALID_HEADER = -4
+}probe_status_t;
+
 typedef enum color_tag
 {
     RED,
     GREEN,
-    BLUE
+    BLUE,
+    BRIGHTNESS
 }color_t;
 
+// How color operations treat a pixel
+typedef enum processing_mode_tag
+{
+    PROCESS_PER_CHANNEL,        // Red, green and blue are processed independently
+    PROCESS_LUMA                // Only brightness (Y) is processed, chroma is kept
+}processing_mode_t;
+
+// Filters available to ResizeImage()
+typedef enum resize_filter_tag
+{
+    RESIZE_AREA_AVERAGE,        // Average of the covered source area. Exact 2x/4x reductions take a fast path
+    RESIZE_BILINEAR,            // Triangle filter, widened when downscaling
+    RESIZE_LANCZOS              // Lanczos-3 windowed sinc
+}resize_filter_t;
+
+// Operations which can bring the modified image up to date by reprocessing only edited tiles
+typedef enum incremental_operation_tag
+{
+    OPERATION_NONE,             // Modified image is not the result of an incremental operation
+    OPERATION_GRAYSCALE,
+    OPERATION_EQUALIZATION,
+    OPERATION_BLUR
+}incremental_operation_t;
+
+// How BinarizeImage() picks the brightness that separates black from white
+typedef enum threshold_method_tag
+{
+    THRESHOLD_OTSU,                 // One threshold for the image, from the brightness histogram
+    THRESHOLD_ADAPTIVE_MEAN         // Mean of the window around every pixel, less a bias
+}threshold_method_t;
+
+// Operations of DoMorphology()
+typedef enum morphology_operation_tag
+{
+    MORPHOLOGY_ERODE,           // Minimum over the structuring element: dark areas grow
+    MORPHOLOGY_DILATE,          // Maximum over the structuring element: bright areas grow
+    MORPHOLOGY_OPEN,            // Erode, then dilate: removes bright specks smaller than the element
+    MORPHOLOGY_CLOSE            // Dilate, then erode: fills dark gaps smaller than the element
+}morphology_operation_t;
+
+// How DitherImage() spreads the gray levels it cannot show
+typedef enum dither_method_tag
+{
+    DITHER_FLOYD_STEINBERG,     // Error diffusion over 4 neighbours: smooth gradients
+    DITHER_ATKINSON,            // Error diffusion of 3/4 of the error over 6 neighbours: more contrast, less noise
+    DITHER_ORDERED              // Bayer matrix thresholds: a regular pattern, every pixel on its own
+}dither_method_t;
+
+// Layouts of planar YCbCr exports. Planes are top-down and follow each other with no padding.
+typedef enum planar_format_tag
+{
+    PLANAR_I420,        // Y, then Cb and Cr at half width and half height
+    PLANAR_NV12,        // Y, then Cb and Cr at half width and half height, interleaved in one plane
+    PLANAR_YUV444       // Y, Cb and Cr at full resolution
+}planar_format_t;
+
+// Geometric operations of TransformImage(). Rotations are clockwise.
+typedef enum geometric_transform_tag
+{
+    TRANSFORM_ROTATE_90,
+    TRANSFORM_ROTATE_180,
+    TRANSFORM_ROTATE_270,
+    TRANSFORM_FLIP_HORIZONTAL,  // Mirror left to right
+    TRANSFORM_FLIP_VERTICAL,    // Mirror top to bottom
+    TRANSFORM_TRANSPOSE         // Mirror about the diagonal from the top left corner
+}geometric_transform_t;
+
 // ==================================================================================================
 // Structures
 // ==================================================================================================
@@ -111,6 +263,26 @@ typedef struct bitmap_info_header_tag
     char blueIntensity;
 }bitmap_info_header_t;
 
+// Header of one file of a batch probe
+typedef struct bitmap_probe_result_tag
+{
+    probe_status_t status;                  // PROBE_OK if both headers are valid
+    bitmap_file_header_t fileHeader;
+    bitmap_info_header_t infoHeader;
+}bitmap_probe_result_t;
+
+// Options to load only part of an image. Rows outside the region are never read and
+// the full resolution image is never held in memory.
+typedef struct bitmap_load_options_tag
+{
+    int roiX;                       // Left column of region of interest
+    int roiY;                       // Top row of region of interest (row 0 is the top of the image)
+    int roiWidth;                   // Width of region of interest. 0 for the full width
+    int roiHeight;                  // Height of region of interest. 0 for the full height
+    int shrinkFactor;               // Average shrinkFactor x shrinkFactor blocks while loading. 1 for no shrink
+    double histogramSampling;       // Fraction of the pixels the histograms count, at least. 0 to count them all
+}bitmap_load_options_t;
+
 // Red, Green and Blue color components
 typedef struct pixel_value_rgb_tag
 {
@@ -129,6 +301,122 @@ typedef struct pixel_value_ycbcr_tag
     unsigned char Cr;
 }pixel_value_ycbcr_t;
 
+// Pixels of an image held in memory. Rows are stored bottom-up, paddedWidth bytes apart.
+// bitsPerPixel is 8 (grayscale), 24 (BGR) or 32 (BGRA).
+typedef struct pixel_buffer_tag
+{
+    unsigned char *pixels;
+    int width;
+    int height;
+    int paddedWidth;
+    short bitsPerPixel;
+}pixel_buffer_t;
+
+// Planes a planar YCbCr kernel writes. Rows are top-down. Cb and Cr samples are chromaStep bytes
+// apart: 1 for separate planes, 2 when they are interleaved.
+typedef struct ycbcr_planes_tag
+{
+    unsigned char *y;
+    unsigned char *cb;
+    unsigned char *cr;
+    int yStride;
+    int chromaStride;
+    int chromaStep;
+}ycbcr_planes_t;
+
+// Number of pixels at every intensity level
+typedef struct histogram_table_tag
+{
+    unsigned long red[MAX_COLORS];
+    unsigned long green[MAX_COLORS];
+    unsigned long blue[MAX_COLORS];
+    unsigned long brightness[MAX_COLORS];
+}histogram_table_t;
+
+// Running sums over pixels, indexed by color_t. Kernels add rows to it; partial sums of bands
+// of rows add up.
+typedef struct statistics_sums_tag
+{
+    unsigned long long count;                   // Pixels
+    unsigned long long sum[4];
+    unsigned long long sumOfSquares[4];
+    unsigned char minimum[4];
+    unsigned char maximum[4];
+}statistics_sums_t;
+
+// Source pixels contributing to one output column (or row) of a resize
+typedef struct resize_contribution_tag
+{
+    int first;                      // Index of first contributing source pixel
+    int count;                      // Number of contributing source pixels
+}resize_contribution_t;
+
+// Filter weights for every output column (or row), computed once per resize. The resize
+// kernels take them as they are.
+typedef struct resize_weights_tag
+{
+    vector<resize_contribution_t> contributions;  // One entry per output pixel
+    vector<short> weights;                        // maxTaps fixed point weights per output pixel
+    int maxTaps;
+}resize_weights_t;
+
+// Statistics of an image, indexed by color_t
+typedef struct image_statistics_tag
+{
+    unsigned long long pixelCount;
+    double mean[4];
+    double standardDeviation[4];
+    unsigned char minimum[4];
+    unsigned char maximum[4];
+}image_statistics_t;
+
+// Summed-area table of one channel: entry (i, j) is the sum of the pixels of the i memory rows
+// below and the j columns left of it, so any rectangle sum takes four entries. The sums are
+// 32 bit when the sum of the whole image fits, else 64 bit; only one of the vectors is used.
+typedef struct integral_image_tag
+{
+    vector<unsigned int> sums32;
+    vector<unsigned long long> sums64;
+    int width;                                  // Of the image; the table is one larger each way
+    int height;
+    int stride;                                 // width + 1
+    bool valid;                                 // Up to date with the original pixels
+}integral_image_t;
+
+// Options of LabelConnectedComponents()
+typedef struct labeling_options_tag
+{
+    int threshold;                  // Brightness separating foreground from background, -1 for Otsu's threshold
+    bool darkForeground;            // Pixels at or below the threshold are foreground, as ink on paper. Else those above
+    bool eightConnected;            // Diagonal neighbours join a component, else only the 4 nearest
+    unsigned long long minimumArea; // Components of fewer pixels are dropped, for example specks of noise
+    bool drawLabels;                // Modified image shows every component in its own color
+}labeling_options_t;
+
+// One connected component of a mask. Coordinates are counted from the top left of the image.
+typedef struct connected_component_tag
+{
+    int label;                      // 1 based, in the order of the first pixel of each component, top row first
+    int left;                       // Bounding box
+    int top;
+    int width;
+    int height;
+    unsigned long long area;        // Pixels
+    double centroidX;
+    double centroidY;
+}connected_component_t;
+
+// Differences between two images of the same size and format
+typedef struct image_comparison_tag
+{
+    bool identical;
+    int maxAbsDifference;                       // Largest difference of any byte of any pixel
+    double meanSquaredError;                    // Over every byte of every pixel, alpha included
+    double psnr;                                // Peak signal to noise ratio in dB, INFINITY if identical
+    double ssim;                                // Structural similarity, mean of the color channels
+    double channelSsim[3];                      // Indexed by color_t
+}image_comparison_t;
+
 // ==================================================================================================
 // BitmapImage class definition
 // ==================================================================================================
@@ -136,7 +424,10 @@ class BitmapImage
 {
 private:
     FILE *m_inputFilePointer;                         // Image file pointer
+    const unsigned char *m_inputData;                 // Image file contents, when loading from memory
+    size_t m_inputDataSize;                           // Size of m_inputData in bytes
     std::string m_imagePath;                          // Image path
+    bitmap_load_options_t m_loadOptions;              // Region and scale to load
 
     char *m_bitmapHeaderChar;                         // Character array of the entire bitmap header - 54 bytes
     unsigned char *m_bitmapImageChar;                 // Character array of the entire bitmap image pixels
@@ -146,29 +437,81 @@ private:
 
     bitmap_file_header_t *m_bitmapFileHeader;         // File header structure
     bitmap_info_header_t *m_bitmapInfoHeader;         // Info header structure
+    short m_fileBitsPerPixel;                         // Bits per pixel as stored in the file
+    bool m_fileTopDown;                               // File stores rows top-down (negative height)
+    vector<unsigned char> m_colorTable;               // Palette of the file (4 bytes per entry)
 
     unsigned long m_imageSize;                        // Size of image
     int m_paddedWidth;                                // Padded width (this will be same as width of image if no padding is done)
     unsigned long m_paddedImageSize;                  // Size of image including padding
     unsigned long m_modifiedImageSize;                // Size of modified image
+    int m_modifiedWidth;                              // Width of modified image in pixels
+    int m_modifiedHeight;                             // Height of modified image in pixels
+    int m_modifiedPaddedWidth;                        // Padded width of modified image
+    unsigned long m_modifiedPaddedImageSize;          // Size of modified image including padding
+    short m_modifiedBitsPerPixel;                     // Bits per pixel of modified image
+    bool m_modifiedTopDown;                           // Write the modified rows as top-down, flipping the image
+    vector<unsigned char> m_modifiedColorTable;       // Palette written with the modified image
 
     map<int, unsigned long> m_redHistogram;           // Map of red-color intensity and number of pixels in that intensity level
     map<int, unsigned long> m_greenHistogram;         // Map of green-color intensity and number of pixels in that intensity level
     map<int, unsigned long> m_blueHistogram;          // Map of blue-color intensity and number of pixels in that intensity level
     map<int, unsigned long> m_brightnessHistogram;    // Map of brightness level (Y) and number of pixels in that intensity level
+    int m_histogramSampleStep;                        // Histograms count one pixel of every step x step block, 1 for all pixels
+    unsigned long long m_histogramSampleCount;        // Pixels the histograms count
+
+    vector<unsigned char> m_dirtyTiles;               // Tiles edited since the last operation, by memory row then column
+    int m_dirtyTileColumns;
+    int m_dirtyTileRows;
+    int m_dirtyTileCount;
+    incremental_operation_t m_lastOperation;          // Operation whose result is in the modified image
+    processing_mode_t m_lastOperationMode;
+    unsigned char m_lastLookupTable[4][MAX_COLORS];   // Equalization table of the last equalization
+
+    vector<unsigned char> m_overlayPixels;            // This image as an overlay: premultiplied, top-down, in the
+                                                      // pixel layout of the images it is drawn on
+    vector<unsigned char> m_overlayInverseAlpha;      // 255 - alpha for every byte of m_overlayPixels
+    short m_overlayBitsPerPixel;                      // Layout of the prepared overlay, 0 if none
+    int m_overlayOpacity;                             // Opacity of the prepared overlay, 0 to 255
+    pixel_value_rgb_t m_overlayMaskColor;             // Color of a grayscale mask overlay
+
+    integral_image_t m_integralImages[4];             // Summed-area tables of the original image, indexed by color_t
 
+    void loadImage(const bitmap_load_options_t *loadOptions);
+    void releaseImage();
+    size_t readInput(long offset, void *buffer, size_t count);
+    size_t readInputAt(long long offset, void *buffer, size_t count);
+    unsigned char *loadBitmapImageRegion();
+    void loadColorTable();
+    bool isRawPixelLayout();
+    void decodeRow(const unsigned char *fileBytes, int firstPixel, int pixelCount, unsigned char *row);
+    static void parseFileHeader(const char *headerChar, bitmap_file_header_t *fileHeader);
+    static void parseInfoHeader(const char *headerChar, bitmap_info_header_t *infoHeader);
+    static bool isValidHeader(const bitmap_file_header_t *fileHeader, const bitmap_info_header_t *infoHeader);
     void allocateModifiedImageBuffer();
-    void prepareHistogram();
-    pixel_value_rgb_t findAveragePixelValuesRGB(int idx_i, int idx_j); // For RGB image
-    unsigned char findAveragePixelValuesGrayscale(int idx_i, int idx_j);     // For grayscale image
+    int allocateModifiedImageBuffer(int width, int height);
+    int allocateModifiedImageBuffer(int width, int height, short bitsPerPixel);
+    void buildModifiedHeader();
+    void prepareHistogram(const histogram_table_t &histogram);
+    pixel_buffer_t getOriginalPixelBuffer();
+    pixel_buffer_t getModifiedPixelBuffer();
+    void countHistogram(const pixel_buffer_t &image, histogram_table_t &histogram, int originX = 0, int originRow = 0);
+    void markDirtyRect(int x, int row, int width, int height);
+    bool canUpdateIncrementally(incremental_operation_t operation, processing_mode_t mode);
+    void processDirtyTiles(int halo, const function<void(const pixel_buffer_t &src, pixel_buffer_t &dst)> &kernel);
+    void completeOperation(incremental_operation_t operation, processing_mode_t mode);
+    const integral_image_t* getIntegralImage(color_t channel, const unsigned char *luma);
+    void invalidateIntegralImages();
 
 public:
-    BitmapImage(const char *imagePath);
+    BitmapImage(const char *imagePath, const bitmap_load_options_t *loadOptions = nullptr);
+    BitmapImage(const unsigned char *fileData, size_t fileSize, const char *imagePath,
+                const bitmap_load_options_t *loadOptions = nullptr);
     ~BitmapImage();
     char * LoadBitmapHeader();
     bitmap_file_header_t* LoadBitmapFileImageHeader();
     bitmap_info_header_t* LoadBitmapInfoImageHeader();
-    unsigned char *LoadBitmapImagePixels();
+    unsigned char *LoadBitmapImagePixels(histogram_table_t &histogram);
     char* getBitsPerPixelInfoFromNumber(short val);
     char* getBitsCompressionTypeFromNumber(int val);
     string getSignatureString();
@@ -176,11 +519,44 @@ public:
     void displayImagePixels();
     void displayHistogram();
     int writeModifiedImageDataToFile(const char *outputFilePath);
+    int getModifiedImageFileData(vector<unsigned char> &fileData);
+    int writePixelRect(int x, int y, int width, int height, const unsigned char *pixels, int stride);
+    int getDirtyTileCount();
+    int getImageStatistics(image_statistics_t &statistics);
+    double getHistogramErrorBound();
+    int getModifiedImageStatistics(image_statistics_t &statistics);
+    const integral_image_t* getIntegralImage(color_t channel);
+    int buildIntegralImages();
+    int getRectSum(color_t channel, int x, int y, int width, int height, unsigned long long &sum);
+    int getRectMean(color_t channel, int x, int y, int width, int height, double &mean);
+    int compareWith(BitmapImage &other, image_comparison_t &comparison, bool modified = false);
+    int prepareOverlay(short targetBitsPerPixel, double opacity, pixel_value_rgb_t maskColor);
+    int overlayImage(BitmapImage &overlay, int x, int y, double opacity = 1.0,
+                     pixel_value_rgb_t maskColor = { MAX_COLORS - 1, MAX_COLORS - 1, MAX_COLORS - 1 });
+    int getPlanarImageData(planar_format_t format, unsigned char *buffer, size_t bufferSize, bool modified = false);
+    int getPlanarImageData(planar_format_t format, vector<unsigned char> &planes, bool modified = false);
+    int writePlanarImageToFile(const char *outputFilePath, planar_format_t format, bool modified = false);
     int ConvertToGrayScale();
-    int doHistogramEqualization();
-    int DoImageBlur();
+    int doHistogramEqualization(processing_mode_t mode = PROCESS_PER_CHANNEL);
+    int DoImageBlur(processing_mode_t mode = PROCESS_PER_CHANNEL);
+    int DoMedianFilter(int radius, processing_mode_t mode = PROCESS_PER_CHANNEL);
+    int TransformImage(geometric_transform_t transform, bool flipByHeader = false);
+    int DoMorphology(morphology_operation_t operation, int width, int height);
+    int BinarizeImage(threshold_method_t method, int windowSize = ADAPTIVE_THRESHOLD_WINDOW,
+                      int bias = ADAPTIVE_THRESHOLD_BIAS);
+    int getOtsuThreshold();
+    int LabelConnectedComponents(vector<connected_component_t> &components, const labeling_options_t *options = nullptr);
+    int QuantizeImage(int colorCount = MAX_COLORS, bool dither = false);
+    int DitherImage(dither_method_t method, short bitsPerPixel = MONOCHROME);
+    int ResizeImage(int newWidth, int newHeight, resize_filter_t filter);
     pixel_value_ycbcr_t convertToYCbCr(pixel_value_rgb_t pixelValue);
     pixel_value_rgb_t convertToRGB(pixel_value_ycbcr_t pixelYCbCr);
+    static int getPaddedRowSize(int width, int bitsPerPixel);
+    static size_t getPlanarImageSize(planar_format_t format, int width, int height);
+    static probe_status_t ProbeBitmapHeader(const char *imagePath, bitmap_file_header_t *fileHeader,
+                                            bitmap_info_header_t *infoHeader);
+    static void ProbeBitmapHeaders(const vector<string> &imagePaths, vector<bitmap_probe_result_t> &results);
+    static const char* getProbeStatusName(probe_status_t status);
 };
 
 
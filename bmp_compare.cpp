@@ -0,0 +1,381 @@
+#include"bmp.h"
+#include"simd.h"
+#include"thread_pool.h"
+#include<algorithm>
+#include<math.h>
+#include<string.h>
+
+const int SSIM_BLOCK_SIZE = 4;          // SSIM windows are 2x2 blocks (8x8 pixels), one block apart
+const int SSIM_WINDOW_PIXELS = 4 * SSIM_BLOCK_SIZE * SSIM_BLOCK_SIZE;
+const int DIFFERENCE_FLUSH_VECTORS = 4096;
+
+// Sums of a block of one channel of both images
+typedef struct ssim_block_tag
+{
+    int sumA;
+    int sumB;
+    int sumOfSquares;                   // Squares of both images
+    int sumOfProducts;
+}ssim_block_t;
+
+// Sums of the pixels of both images in each column (byte) of a block row
+typedef struct ssim_columns_tag
+{
+    vector<unsigned short> sumA;
+    vector<unsigned short> sumB;
+    vector<unsigned int> sumOfSquares;
+    vector<unsigned int> sumOfProducts;
+}ssim_columns_t;
+
+//******************************************************************************************
+// @name                    : DifferenceRow
+//
+// @description             : This is a static function. Adds the squared differences of a
+//                            row of bytes and raises the largest absolute difference.
+//
+// @returns                 : Nothing
+//********************************************************************************************
+static void DifferenceRow(const unsigned char *a, const unsigned char *b, int bytes,
+                          unsigned long long &squaredError, int &maxAbsDifference)
+{
+    int j = 0;
+    unsigned long long sum = 0;
+    int maximum = maxAbsDifference;
+
+#ifdef USE_SSE2_KERNELS
+    const __m128i zero = _mm_setzero_si128();
+    __m128i maxVector = zero;
+
+    while (j + 16 <= bytes)
+    {
+        // Squares of 4 bytes go into each 32-bit lane per vector; flush before they overflow
+        __m128i squares = zero;
+        for (int n = 0; n < DIFFERENCE_FLUSH_VECTORS && j + 16 <= bytes; n++, j += 16)
+        {
+            __m128i va = _mm_loadu_si128((const __m128i*)(a + j));
+            __m128i vb = _mm_loadu_si128((const __m128i*)(b + j));
+            __m128i difference = _mm_or_si128(_mm_subs_epu8(va, vb), _mm_subs_epu8(vb, va));
+            maxVector = _mm_max_epu8(maxVector, difference);
+
+            __m128i low = _mm_unpacklo_epi8(difference, zero);
+            __m128i high = _mm_unpackhi_epi8(difference, zero);
+            squares = _mm_add_epi32(squares, _mm_madd_epi16(low, low));
+            squares = _mm_add_epi32(squares, _mm_madd_epi16(high, high));
+        }
+
+        unsigned int lanes[4];
+        _mm_storeu_si128((__m128i*)lanes, squares);
+        sum += (unsigned long long)lanes[0] + lanes[1] + lanes[2] + lanes[3];
+    }
+
+    unsigned char maxBytes[16];
+    _mm_storeu_si128((__m128i*)maxBytes, maxVector);
+    for (int k = 0; k < 16; k++)
+    {
+        maximum = std::max(maximum, (int)maxBytes[k]);
+    }
+#endif
+
+    for (; j < bytes; j++)
+    {
+        int difference = abs((int)a[j] - (int)b[j]);
+        sum += difference * difference;
+        maximum = std::max(maximum, difference);
+    }
+
+    squaredError += sum;
+    maxAbsDifference = maximum;
+}
+
+//******************************************************************************************
+// @name                    : AddSsimRow
+//
+// @description             : This is a static function. Adds a row of bytes of both images
+//                            to the column sums of a block row.
+//
+// @returns                 : Nothing
+//********************************************************************************************
+static void AddSsimRow(const unsigned char *a, const unsigned char *b, int bytes, ssim_columns_t &columns)
+{
+    unsigned short *sumA = &columns.sumA[0];
+    unsigned short *sumB = &columns.sumB[0];
+    unsigned int *sumOfSquares = &columns.sumOfSquares[0];
+    unsigned int *sumOfProducts = &columns.sumOfProducts[0];
+    int j = 0;
+
+#ifdef USE_SSE2_KERNELS
+    const __m128i zero = _mm_setzero_si128();
+
+    for (; j + 8 <= bytes; j += 8)
+    {
+        __m128i va = _mm_unpacklo_epi8(_mm_loadl_epi64((const __m128i*)(a + j)), zero);
+        __m128i vb = _mm_unpacklo_epi8(_mm_loadl_epi64((const __m128i*)(b + j)), zero);
+
+        _mm_storeu_si128((__m128i*)(sumA + j), _mm_add_epi16(_mm_loadu_si128((const __m128i*)(sumA + j)), va));
+        _mm_storeu_si128((__m128i*)(sumB + j), _mm_add_epi16(_mm_loadu_si128((const __m128i*)(sumB + j)), vb));
+
+        // a*a + b*b from interleaved pairs; a*b against zeros
+        __m128i pairsLow = _mm_unpacklo_epi16(va, vb);
+        __m128i pairsHigh = _mm_unpackhi_epi16(va, vb);
+        __m128i squaresLow = _mm_madd_epi16(pairsLow, pairsLow);
+        __m128i squaresHigh = _mm_madd_epi16(pairsHigh, pairsHigh);
+        __m128i productsLow = _mm_madd_epi16(_mm_unpacklo_epi16(va, zero), _mm_unpacklo_epi16(vb, zero));
+        __m128i productsHigh = _mm_madd_epi16(_mm_unpackhi_epi16(va, zero), _mm_unpackhi_epi16(vb, zero));
+
+        __m128i *squares = (__m128i*)(sumOfSquares + j);
+        __m128i *products = (__m128i*)(sumOfProducts + j);
+        _mm_storeu_si128(squares, _mm_add_epi32(_mm_loadu_si128(squares), squaresLow));
+        _mm_storeu_si128(squares + 1, _mm_add_epi32(_mm_loadu_si128(squares + 1), squaresHigh));
+        _mm_storeu_si128(products, _mm_add_epi32(_mm_loadu_si128(products), productsLow));
+        _mm_storeu_si128(products + 1, _mm_add_epi32(_mm_loadu_si128(products + 1), productsHigh));
+    }
+#endif
+
+    for (; j < bytes; j++)
+    {
+        sumA[j] += a[j];
+        sumB[j] += b[j];
+        sumOfSquares[j] += a[j] * a[j] + b[j] * b[j];
+        sumOfProducts[j] += a[j] * b[j];
+    }
+}
+
+//******************************************************************************************
+// @name                    : SumSsimBlocks
+//
+// @description             : This is a static function. Adds up the column sums of a block
+//                            row into blocks, one per channel.
+//
+// @param blocks            : Blocks by column then channel on return
+//
+// @returns                 : Nothing
+//********************************************************************************************
+static void SumSsimBlocks(const ssim_columns_t &columns, int blockColumns, int bytesPerPixel, int channels,
+                          vector<ssim_block_t> &blocks)
+{
+    for (int bx = 0; bx < blockColumns; bx++)
+    {
+        for (int c = 0; c < channels; c++)
+        {
+            ssim_block_t &block = blocks[(size_t)bx * channels + c];
+            memset(&block, 0, sizeof(block));
+
+            for (int k = 0; k < SSIM_BLOCK_SIZE; k++)
+            {
+                size_t j = (size_t)(bx * SSIM_BLOCK_SIZE + k) * bytesPerPixel + c;
+                block.sumA += columns.sumA[j];
+                block.sumB += columns.sumB[j];
+                block.sumOfSquares += columns.sumOfSquares[j];
+                block.sumOfProducts += columns.sumOfProducts[j];
+            }
+        }
+    }
+}
+
+//******************************************************************************************
+// @name                    : WindowSsim
+//
+// @description             : This is a static function. SSIM of a window from the sums of
+//                            its pixels, with the usual constants (0.01 * 255)^2 and
+//                            (0.03 * 255)^2 scaled to sums.
+//
+// @returns                 : SSIM
+//********************************************************************************************
+static double WindowSsim(double sumA, double sumB, double sumOfSquares, double sumOfProducts)
+{
+    const double n = SSIM_WINDOW_PIXELS;
+    const double c1 = 0.01 * 0.01 * 255 * 255 * n * n;
+    const double c2 = 0.03 * 0.03 * 255 * 255 * n * (n - 1);
+
+    double variances = sumOfSquares * n - sumA * sumA - sumB * sumB;
+    double covariance = sumOfProducts * n - sumA * sumB;
+
+    return (2 * sumA * sumB + c1) * (2 * covariance + c2) /
+           ((sumA * sumA + sumB * sumB + c1) * (variances + c2));
+}
+
+//******************************************************************************************
+// @name                    : compareWith
+//
+// @description             : Compares the image with another image of the same size and
+//                            format: whether they are identical, the largest difference,
+//                            PSNR and SSIM. Differences and SSIM are worked out together in
+//                            one pass over both images, in bands of rows on the thread pool.
+//                            SSIM is computed per channel on 8x8 windows placed every 4
+//                            pixels, which is cheap enough to check a sample of production
+//                            outputs against a reference. Images smaller than 8x8 have no
+//                            windows; their SSIM is 1 if identical and 0 otherwise.
+//
+// @param other             : Image to compare with
+// @param comparison        : Result on return
+// @param modified          : Compare the modified images rather than the original ones
+//
+// @returns                 : 0 if SUCCESS
+//********************************************************************************************
+int BitmapImage::compareWith(BitmapImage &other, image_comparison_t &comparison, bool modified)
+{
+    memset(&comparison, 0, sizeof(comparison));
+
+    pixel_buffer_t imageA = modified ? this->getModifiedPixelBuffer() : this->getOriginalPixelBuffer();
+    pixel_buffer_t imageB = modified ? other.getModifiedPixelBuffer() : other.getOriginalPixelBuffer();
+    if (imageA.pixels == nullptr || imageB.pixels == nullptr)
+    {
+        printf("ERROR: No %s image to compare!\n", modified ? "modified" : "loaded");
+        return -1;
+    }
+
+    if (imageA.width != imageB.width || imageA.height != imageB.height || imageA.bitsPerPixel != imageB.bitsPerPixel)
+    {
+        printf("ERROR: Cannot compare a %dx%d %d bit image with a %dx%d %d bit image!\n",
+               imageA.width, imageA.height, imageA.bitsPerPixel, imageB.width, imageB.height, imageB.bitsPerPixel);
+        return -1;
+    }
+
+    if (imageA.bitsPerPixel % 8 != 0)
+    {
+        printf("ERROR: Comparison is not supported for %d bits per pixel!\n", imageA.bitsPerPixel);
+        return -1;
+    }
+
+    int bytesPerPixel = imageA.bitsPerPixel / 8;
+    int channels = std::min(bytesPerPixel, 3);
+    int rowBytes = imageA.width * bytesPerPixel;
+    int blockColumns = imageA.width / SSIM_BLOCK_SIZE;
+    int windowColumns = std::max(blockColumns - 1, 0);
+    int windowRows = std::max(imageA.height / SSIM_BLOCK_SIZE - 1, 0);
+    if (windowColumns == 0)
+    {
+        windowRows = 0;
+    }
+
+    vector<unsigned long long> bandSquaredErrors;
+    vector<int> bandMaxAbsDifferences;
+    vector<double> rowSsim((size_t)windowRows * channels, 0.0);
+    ThreadPool &pool = ThreadPool::getInstance();
+
+    auto differenceRows = [&](int begin, int end, unsigned long long &squaredError, int &maxAbsDifference)
+    {
+        for (int i = begin; i < end; i++)
+        {
+            DifferenceRow(&imageA.pixels[(size_t)imageA.paddedWidth * i], &imageB.pixels[(size_t)imageB.paddedWidth * i],
+                          rowBytes, squaredError, maxAbsDifference);
+        }
+    };
+
+    if (windowRows == 0)
+    {
+        int bands = (imageA.height + DEFAULT_ROWS_PER_TASK - 1) / DEFAULT_ROWS_PER_TASK;
+        bandSquaredErrors.assign(bands, 0);
+        bandMaxAbsDifferences.assign(bands, 0);
+
+        pool.parallelFor(bands, 1, [&](int begin, int end)
+        {
+            for (int band = begin; band < end; band++)
+            {
+                differenceRows(band * DEFAULT_ROWS_PER_TASK, std::min((band + 1) * DEFAULT_ROWS_PER_TASK, imageA.height),
+                               bandSquaredErrors[band], bandMaxAbsDifferences[band]);
+            }
+        });
+    }
+    else
+    {
+        bandSquaredErrors.assign(windowRows, 0);
+        bandMaxAbsDifferences.assign(windowRows, 0);
+
+        // A band of window rows needs the block row after it too. The band owns the differences of
+        // its own block rows; the last band also owns the rows left below the last window.
+        pool.parallelFor(windowRows, std::max(DEFAULT_ROWS_PER_TASK / SSIM_BLOCK_SIZE, 1), [&](int begin, int end)
+        {
+            ssim_columns_t columns;
+            columns.sumA.resize(rowBytes);
+            columns.sumB.resize(rowBytes);
+            columns.sumOfSquares.resize(rowBytes);
+            columns.sumOfProducts.resize(rowBytes);
+            vector<ssim_block_t> previous((size_t)blockColumns * channels);
+            vector<ssim_block_t> current((size_t)blockColumns * channels);
+
+            for (int by = begin; by <= end; by++)
+            {
+                fill(columns.sumA.begin(), columns.sumA.end(), 0);
+                fill(columns.sumB.begin(), columns.sumB.end(), 0);
+                fill(columns.sumOfSquares.begin(), columns.sumOfSquares.end(), 0);
+                fill(columns.sumOfProducts.begin(), columns.sumOfProducts.end(), 0);
+
+                for (int i = by * SSIM_BLOCK_SIZE; i < (by + 1) * SSIM_BLOCK_SIZE; i++)
+                {
+                    const unsigned char *rowA = &imageA.pixels[(size_t)imageA.paddedWidth * i];
+                    const unsigned char *rowB = &imageB.pixels[(size_t)imageB.paddedWidth * i];
+                    AddSsimRow(rowA, rowB, rowBytes, columns);
+                    if (by < end)
+                    {
+                        DifferenceRow(rowA, rowB, rowBytes, bandSquaredErrors[by], bandMaxAbsDifferences[by]);
+                    }
+                }
+
+                SumSsimBlocks(columns, blockColumns, bytesPerPixel, channels, current);
+
+                if (by > begin)
+                {
+                    for (int c = 0; c < channels; c++)
+                    {
+                        double sum = 0.0;
+                        for (int bx = 0; bx < windowColumns; bx++)
+                        {
+                            const ssim_block_t &b00 = previous[(size_t)bx * channels + c];
+                            const ssim_block_t &b01 = previous[(size_t)(bx + 1) * channels + c];
+                            const ssim_block_t &b10 = current[(size_t)bx * channels + c];
+                            const ssim_block_t &b11 = current[(size_t)(bx + 1) * channels + c];
+
+                            sum += WindowSsim(b00.sumA + b01.sumA + b10.sumA + b11.sumA,
+                                              b00.sumB + b01.sumB + b10.sumB + b11.sumB,
+                                              b00.sumOfSquares + b01.sumOfSquares + b10.sumOfSquares + b11.sumOfSquares,
+                                              b00.sumOfProducts + b01.sumOfProducts + b10.sumOfProducts + b11.sumOfProducts);
+                        }
+                        rowSsim[(size_t)(by - 1) * channels + c] = sum;
+                    }
+                }
+
+                previous.swap(current);
+            }
+
+            if (end == windowRows)
+            {
+                differenceRows(end * SSIM_BLOCK_SIZE, imageA.height, bandSquaredErrors[end - 1], bandMaxAbsDifferences[end - 1]);
+            }
+        });
+    }
+
+    // Bands are added up in order, so the result does not depend on the scheduling
+    unsigned long long squaredError = 0;
+    for (size_t band = 0; band < bandSquaredErrors.size(); band++)
+    {
+        squaredError += bandSquaredErrors[band];
+        comparison.maxAbsDifference = std::max(comparison.maxAbsDifference, bandMaxAbsDifferences[band]);
+    }
+
+    double byteCount = (double)rowBytes * imageA.height;
+    comparison.identical = (squaredError == 0);
+    comparison.meanSquaredError = byteCount > 0 ? squaredError / byteCount : 0.0;
+    comparison.psnr = comparison.identical ? INFINITY : 10.0 * log10(255.0 * 255.0 / comparison.meanSquaredError);
+
+    // Channels of the pixel bytes are blue, green, red
+    static const color_t channelColors[3] = { BLUE, GREEN, RED };
+    for (int c = 0; c < 3; c++)
+    {
+        double ssim = comparison.identical ? 1.0 : 0.0;
+        if (windowRows > 0)
+        {
+            double sum = 0.0;
+            for (int row = 0; row < windowRows; row++)
+            {
+                sum += rowSsim[(size_t)row * channels + std::min(c, channels - 1)];
+            }
+            ssim = sum / ((double)windowRows * windowColumns);
+        }
+        comparison.channelSsim[channelColors[c]] = ssim;
+    }
+
+    comparison.ssim = (comparison.channelSsim[RED] + comparison.channelSsim[GREEN] + comparison.channelSsim[BLUE]) / 3;
+
+    return 0;
+}
@@ -0,0 +1,138 @@
+#include"bmp.h"
+#include"error_diffusion.h"
+#include"pixel_kernels.h"
+#include"thread_pool.h"
+#include<algorithm>
+
+//******************************************************************************************
+// @name                    : BuildBayerThresholds
+//
+// @description             : This is a static function. Ordered dither thresholds of the
+//                            Bayer matrix: every rank of the matrix becomes the middle of its
+//                            share of 0 to 255, so thresholds run from 1 to 253.
+//
+// @param thresholds        : ORDERED_DITHER_SIZE rows of ORDERED_DITHER_SIZE on return
+//
+// @returns                 : Nothing
+//********************************************************************************************
+static void BuildBayerThresholds(unsigned char *thresholds)
+{
+    const int cells = ORDERED_DITHER_SIZE * ORDERED_DITHER_SIZE;
+
+    for (int y = 0; y < ORDERED_DITHER_SIZE; y++)
+    {
+        for (int x = 0; x < ORDERED_DITHER_SIZE; x++)
+        {
+            // The low bits of x ^ y and y, interleaved, are the high bits of the rank
+            int rank = 0;
+            for (int bit = 1; bit < ORDERED_DITHER_SIZE; bit <<= 1)
+            {
+                rank = (rank << 2) | (((x ^ y) & bit) ? 2 : 0) | ((y & bit) ? 1 : 0);
+            }
+
+            thresholds[y * ORDERED_DITHER_SIZE + x] = (unsigned char)(((2 * rank + 1) * (MAX_COLORS - 1)) / (2 * cells));
+        }
+    }
+}
+
+//******************************************************************************************
+// @name                    : DitherImage
+//
+// @description             : Makes a gray palettized modified image of 2, 16 or 256 levels,
+//                            for example for e-ink displays and thermal printers, and spreads
+//                            the gray levels in between over the pixels. Error diffusion
+//                            hands the difference between a pixel and its level on to the
+//                            pixels right of and below it; its rows run as a wavefront on all
+//                            the pool threads. Ordered dithering compares every pixel on its
+//                            own against a Bayer matrix, in the SIMD kernels for 24 bit
+//                            images. Alpha is dropped.
+//
+// @param method            : How the levels are spread
+// @param bitsPerPixel      : MONOCHROME, BITS_4_PALLETIZED or BITS_8_PALLETIZED
+//
+// @returns                 : 0 if SUCCESS
+//********************************************************************************************
+int BitmapImage::DitherImage(dither_method_t method, short bitsPerPixel)
+{
+    if (bitsPerPixel != MONOCHROME && bitsPerPixel != BITS_4_PALLETIZED && bitsPerPixel != BITS_8_PALLETIZED)
+    {
+        printf("ERROR: Dithering to %d bits per pixel is not supported!\n", bitsPerPixel);
+        return -1;
+    }
+
+    pixel_buffer_t src = this->getOriginalPixelBuffer();
+    if (src.pixels == nullptr)
+    {
+        printf("ERROR: No image to dither!\n");
+        return -1;
+    }
+
+    if (!IsSupportedPixelFormat(src.bitsPerPixel))
+    {
+        printf("ERROR: Dithering is not supported for %d bits per pixel!\n", src.bitsPerPixel);
+        return -1;
+    }
+
+    // Gray color table of bitsPerPixel: level i is i * 255 / maxIndex
+    if (this->allocateModifiedImageBuffer(src.width, src.height, bitsPerPixel) != 0)
+    {
+        return -1;
+    }
+    pixel_buffer_t dst = this->getModifiedPixelBuffer();
+
+    if (method == DITHER_ORDERED)
+    {
+        unsigned char thresholds[ORDERED_DITHER_SIZE * ORDERED_DITHER_SIZE];
+        BuildBayerThresholds(thresholds);
+
+        DispatchPixelFormat(src.bitsPerPixel, [&](auto format)
+        {
+            typedef decltype(format) Format;
+            ThreadPool::getInstance().parallelFor(src.height, DEFAULT_ROWS_PER_TASK, [&](int begin, int end)
+            {
+                OrderedDitherRows<Format>(src, dst, thresholds, begin, end);
+            });
+        });
+
+        return 0;
+    }
+
+    int maxIndex = (1 << bitsPerPixel) - 1;
+    int pixelsPerByte = 8 / bitsPerPixel;
+    int height = src.height;
+
+    DispatchPixelFormat(src.bitsPerPixel, [&](auto format)
+    {
+        typedef decltype(format) Format;
+
+        // Rows are bottom-up. Only the thread of a row writes to it, and the buffer is zero
+        // filled, so indices are ORed into their byte.
+        auto rowPixels = [&](int t)
+        {
+            const unsigned char *in = &src.pixels[(size_t)src.paddedWidth * (height - 1 - t)];
+            unsigned char *out = &dst.pixels[(size_t)dst.paddedWidth * (height - 1 - t)];
+
+            return [=](int j, const int *adjust, int *difference)
+            {
+                const unsigned char *p = in + (size_t)j * Format::BYTES_PER_PIXEL;
+                int gray = GrayLevelFromRGB(p[Format::RED_OFFSET], p[Format::GREEN_OFFSET], p[Format::BLUE_OFFSET]);
+                gray = std::min(std::max(gray + adjust[0], 0), MAX_COLORS - 1);
+
+                int level = (gray * maxIndex + (MAX_COLORS - 1) / 2) / (MAX_COLORS - 1);
+                difference[0] = gray - (level * (MAX_COLORS - 1)) / maxIndex;
+                out[j / pixelsPerByte] |= (unsigned char)(level << (8 - bitsPerPixel * (1 + j % pixelsPerByte)));
+            };
+        };
+
+        if (method == DITHER_ATKINSON)
+        {
+            DiffuseErrors<1, AtkinsonKernel>(src.width, height, rowPixels);
+        }
+        else
+        {
+            DiffuseErrors<1, FloydSteinbergKernel>(src.width, height, rowPixels);
+        }
+    });
+
+    return 0;
+}
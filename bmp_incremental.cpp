@@ -0,0 +1,254 @@
+#include"bmp.h"
+#include"thread_pool.h"
+#include<algorithm>
+#include<string.h>
+
+//******************************************************************************************
+// @name                    : SubBuffer
+//
+// @description             : This is a static function. View of a rectangle of an image,
+//                            sharing its pixels. Kernels treat the view as a whole image.
+//
+// @param x                 : First column
+// @param row               : First row, in memory order (bottom-up)
+//
+// @returns                 : View
+//********************************************************************************************
+static pixel_buffer_t SubBuffer(const pixel_buffer_t &image, int x, int row, int width, int height)
+{
+    pixel_buffer_t view = image;
+    view.pixels = image.pixels + (size_t)image.paddedWidth * row + (size_t)x * (image.bitsPerPixel / 8);
+    view.width = width;
+    view.height = height;
+
+    return view;
+}
+
+//******************************************************************************************
+// @name                    : writePixelRect
+//
+// @description             : Overwrites a rectangle of the original image, for example an
+//                            annotation. The histograms are updated by removing the counts
+//                            of the old pixels and adding those of the new ones, and the
+//                            tiles covered are marked dirty, so that the next run of the
+//                            last grayscale, equalization or blur reprocesses only them.
+//                            Summed-area tables are rebuilt on their next use, and so is the
+//                            premultiplied overlay if this image is drawn as one.
+//
+// @param x                 : Left column of the rectangle
+// @param y                 : Top row of the rectangle, counted from the top of the image
+// @param pixels            : Rows of the rectangle, top first, in the format the image is
+//                            kept in memory (8 bit gray, 24 bit BGR or 32 bit BGRA)
+// @param stride            : Bytes from one row of pixels to the next
+//
+// @returns                 : 0 if SUCCESS
+//********************************************************************************************
+int BitmapImage::writePixelRect(int x, int y, int width, int height, const unsigned char *pixels, int stride)
+{
+    pixel_buffer_t image = this->getOriginalPixelBuffer();
+    if (pixels == nullptr || width <= 0 || height <= 0 || x < 0 || y < 0 ||
+        x + width > image.width || y + height > image.height)
+    {
+        printf("ERROR: Invalid pixel rectangle %d,%d %dx%d!\n", x, y, width, height);
+        return -1;
+    }
+
+    int row = image.height - y - height;
+    pixel_buffer_t rect = SubBuffer(image, x, row, width, height);
+    int rowBytes = width * (image.bitsPerPixel / 8);
+
+    histogram_table_t before;
+    histogram_table_t after;
+    this->countHistogram(rect, before, x, row);
+
+    for (int i = 0; i < height; i++)
+    {
+        // Image rows are bottom-up
+        memcpy(&rect.pixels[(size_t)rect.paddedWidth * (height - 1 - i)], pixels + (size_t)stride * i, rowBytes);
+    }
+
+    this->countHistogram(rect, after, x, row);
+
+    for (int i = 0; i < MAX_COLORS; i++)
+    {
+        m_redHistogram[i] = m_redHistogram[i] + after.red[i] - before.red[i];
+        m_greenHistogram[i] = m_greenHistogram[i] + after.green[i] - before.green[i];
+        m_blueHistogram[i] = m_blueHistogram[i] + after.blue[i] - before.blue[i];
+        m_brightnessHistogram[i] = m_brightnessHistogram[i] + after.brightness[i] - before.brightness[i];
+    }
+
+    this->markDirtyRect(x, row, width, height);
+    this->invalidateIntegralImages();
+    m_overlayBitsPerPixel = 0;
+
+    return 0;
+}
+
+//******************************************************************************************
+// @name                    : getDirtyTileCount
+//
+// @description             : Number of tiles edited since the last operation
+//
+// @returns                 : Tile count
+//********************************************************************************************
+int BitmapImage::getDirtyTileCount()
+{
+    return m_dirtyTileCount;
+}
+
+//******************************************************************************************
+// @name                    : markDirtyRect
+//
+// @description             : Marks the tiles a rectangle overlaps as dirty
+//
+// @param row               : First row, in memory order
+//
+// @returns                 : Nothing
+//********************************************************************************************
+void BitmapImage::markDirtyRect(int x, int row, int width, int height)
+{
+    if (m_dirtyTiles.empty())
+    {
+        m_dirtyTileColumns = (m_bitmapInfoHeader->width + DIRTY_TILE_SIZE - 1) / DIRTY_TILE_SIZE;
+        m_dirtyTileRows = (m_bitmapInfoHeader->height + DIRTY_TILE_SIZE - 1) / DIRTY_TILE_SIZE;
+        m_dirtyTiles.assign((size_t)m_dirtyTileColumns * m_dirtyTileRows, 0);
+        m_dirtyTileCount = 0;
+    }
+
+    for (int ty = row / DIRTY_TILE_SIZE; ty <= (row + height - 1) / DIRTY_TILE_SIZE; ty++)
+    {
+        for (int tx = x / DIRTY_TILE_SIZE; tx <= (x + width - 1) / DIRTY_TILE_SIZE; tx++)
+        {
+            unsigned char &tile = m_dirtyTiles[(size_t)ty * m_dirtyTileColumns + tx];
+            if (!tile)
+            {
+                tile = 1;
+                m_dirtyTileCount++;
+            }
+        }
+    }
+}
+
+//******************************************************************************************
+// @name                    : canUpdateIncrementally
+//
+// @description             : Whether the modified image holds the result of the operation
+//                            as of the last edit, so that only dirty tiles need reprocessing
+//
+// @returns                 : true if only the dirty tiles need processing
+//********************************************************************************************
+bool BitmapImage::canUpdateIncrementally(incremental_operation_t operation, processing_mode_t mode)
+{
+    return m_modifiedBitmapImageChar != nullptr && m_lastOperation == operation && m_lastOperationMode == mode;
+}
+
+//******************************************************************************************
+// @name                    : processDirtyTiles
+//
+// @description             : Runs a kernel over the dirty tiles and the pixels within halo
+//                            of them. Dirty tiles next to each other on a tile row are done
+//                            as one rectangle. Like a full run, the kernel writes over a
+//                            copy of the original pixels, so bytes it leaves alone (alpha)
+//                            follow the edit. A kernel with a halo reads halo pixels past
+//                            the rectangle, so it runs on a view grown by the halo into a
+//                            scratch buffer, and only the rectangle is copied out; pixels
+//                            at the edge of the view, which the kernel sees as an image
+//                            edge, are discarded.
+//
+// @param halo              : Reach of the kernel, in pixels
+// @param kernel            : Processes a whole view of the original image into dst
+//
+// @returns                 : Nothing
+//********************************************************************************************
+void BitmapImage::processDirtyTiles(int halo, const function<void(const pixel_buffer_t &src, pixel_buffer_t &dst)> &kernel)
+{
+    pixel_buffer_t src = this->getOriginalPixelBuffer();
+    pixel_buffer_t dst = this->getModifiedPixelBuffer();
+    int bytesPerPixel = src.bitsPerPixel / 8;
+    vector<unsigned char> scratch;
+
+    for (int ty = 0; ty < m_dirtyTileRows && m_dirtyTileCount > 0; ty++)
+    {
+        for (int tx = 0; tx < m_dirtyTileColumns; tx++)
+        {
+            if (!m_dirtyTiles[(size_t)ty * m_dirtyTileColumns + tx])
+            {
+                continue;
+            }
+
+            int runEnd = tx + 1;
+            while (runEnd < m_dirtyTileColumns && m_dirtyTiles[(size_t)ty * m_dirtyTileColumns + runEnd])
+            {
+                runEnd++;
+            }
+
+            // Pixels to update: the tiles grown by the halo
+            int x0 = std::max(tx * DIRTY_TILE_SIZE - halo, 0);
+            int x1 = std::min(runEnd * DIRTY_TILE_SIZE + halo, src.width);
+            int y0 = std::max(ty * DIRTY_TILE_SIZE - halo, 0);
+            int y1 = std::min((ty + 1) * DIRTY_TILE_SIZE + halo, src.height);
+
+            if (halo == 0)
+            {
+                for (int i = y0; i < y1; i++)
+                {
+                    size_t offset = (size_t)src.paddedWidth * i + (size_t)x0 * bytesPerPixel;
+                    memcpy(&dst.pixels[offset], &src.pixels[offset], (size_t)(x1 - x0) * bytesPerPixel);
+                }
+
+                pixel_buffer_t dstView = SubBuffer(dst, x0, y0, x1 - x0, y1 - y0);
+                kernel(SubBuffer(src, x0, y0, x1 - x0, y1 - y0), dstView);
+            }
+            else
+            {
+                // Pixels the kernel reads: grown by the halo again
+                int inX0 = std::max(x0 - halo, 0);
+                int inX1 = std::min(x1 + halo, src.width);
+                int inY0 = std::max(y0 - halo, 0);
+                int inY1 = std::min(y1 + halo, src.height);
+
+                pixel_buffer_t scratchView;
+                scratchView.width = inX1 - inX0;
+                scratchView.height = inY1 - inY0;
+                scratchView.paddedWidth = scratchView.width * bytesPerPixel;
+                scratchView.bitsPerPixel = src.bitsPerPixel;
+                scratch.resize((size_t)scratchView.paddedWidth * scratchView.height);
+                scratchView.pixels = &scratch[0];
+
+                pixel_buffer_t srcView = SubBuffer(src, inX0, inY0, scratchView.width, scratchView.height);
+                for (int i = 0; i < scratchView.height; i++)
+                {
+                    memcpy(&scratch[(size_t)scratchView.paddedWidth * i], &srcView.pixels[(size_t)srcView.paddedWidth * i], scratchView.paddedWidth);
+                }
+
+                kernel(srcView, scratchView);
+
+                for (int i = y0; i < y1; i++)
+                {
+                    memcpy(&dst.pixels[(size_t)dst.paddedWidth * i + (size_t)x0 * bytesPerPixel],
+                           &scratch[(size_t)scratchView.paddedWidth * (i - inY0) + (size_t)(x0 - inX0) * bytesPerPixel],
+                           (size_t)(x1 - x0) * bytesPerPixel);
+                }
+            }
+
+            tx = runEnd - 1;
+        }
+    }
+}
+
+//******************************************************************************************
+// @name                    : completeOperation
+//
+// @description             : Records the operation whose result is now in the modified
+//                            image. Every tile is up to date.
+//
+// @returns                 : Nothing
+//********************************************************************************************
+void BitmapImage::completeOperation(incremental_operation_t operation, processing_mode_t mode)
+{
+    m_lastOperation = operation;
+    m_lastOperationMode = mode;
+
+    fill(m_dirtyTiles.begin(), m_dirtyTiles.end(), 0);
+    m_dirtyTileCount = 0;
+}
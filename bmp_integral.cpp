@@ -0,0 +1,271 @@
+#include"bmp.h"
+#include"pixel_kernels.h"
+#include"thread_pool.h"
+#include<algorithm>
+#include<limits.h>
+#include<string.h>
+
+//******************************************************************************************
+// @name                    : BuildIntegralTable
+//
+// @description             : This is a static function. Two pass parallel build of a
+//                            summed-area table: running sums along every row, in bands of
+//                            rows, then running sums down every column, in bands of columns.
+//
+// @param plane             : First byte of the channel in the first memory row
+// @param planeStride       : Bytes from one row of the channel to the next
+// @param step              : Bytes from one pixel of the channel to the next
+// @param sums              : (width + 1) * (height + 1) entries
+//
+// @returns                 : Nothing
+//********************************************************************************************
+template<typename Sum>
+static void BuildIntegralTable(const unsigned char *plane, size_t planeStride, int step, int width, int height, Sum *sums)
+{
+    ThreadPool &pool = ThreadPool::getInstance();
+    size_t stride = (size_t)width + 1;
+
+    memset(sums, 0, sizeof(Sum) * stride);
+    pool.parallelFor(height, DEFAULT_ROWS_PER_TASK, [&](int begin, int end)
+    {
+        for (int i = begin; i < end; i++)
+        {
+            const unsigned char *in = plane + planeStride * i;
+            Sum *out = &sums[stride * (i + 1)];
+            Sum sum = 0;
+
+            out[0] = 0;
+            for (int j = 0; j < width; j++, in += step)
+            {
+                sum += *in;
+                out[j + 1] = sum;
+            }
+        }
+    });
+
+    int bands = (width + INTEGRAL_COLUMNS_PER_TASK - 1) / INTEGRAL_COLUMNS_PER_TASK;
+    pool.parallelFor(bands, 1, [&](int begin, int end)
+    {
+        size_t first = (size_t)begin * INTEGRAL_COLUMNS_PER_TASK + 1;
+        size_t last = std::min((size_t)end * INTEGRAL_COLUMNS_PER_TASK, (size_t)width) + 1;
+        for (int i = 2; i <= height; i++)
+        {
+            Sum *row = &sums[stride * i];
+            const Sum *above = row - stride;
+            for (size_t j = first; j < last; j++)
+            {
+                row[j] += above[j];
+            }
+        }
+    });
+}
+
+//******************************************************************************************
+// @name                    : invalidateIntegralImages
+//
+// @description             : Marks the summed-area tables out of date after the original
+//                            pixels change. They are rebuilt on their next use.
+//
+// @returns                 : Nothing
+//********************************************************************************************
+void BitmapImage::invalidateIntegralImages()
+{
+    for (int c = RED; c <= BRIGHTNESS; c++)
+    {
+        m_integralImages[c].valid = false;
+    }
+}
+
+//******************************************************************************************
+// @name                    : getIntegralImage
+//
+// @description             : Summed-area table of a channel of the original image, built
+//                            and kept on first use. Tables of a grayscale image are shared
+//                            by its color channels. Not to be called from several threads
+//                            until the table is built; buildIntegralImages() builds them all.
+//
+// @param channel           : Color channel, or BRIGHTNESS for Y as in the histograms
+//
+// @returns                 : Table, nullptr if the image format is not supported
+//********************************************************************************************
+const integral_image_t* BitmapImage::getIntegralImage(color_t channel)
+{
+    return this->getIntegralImage(channel, nullptr);
+}
+
+//******************************************************************************************
+// @name                    : getIntegralImage
+//
+// @description             : Summed-area table of a channel, built from the brightness
+//                            plane a caller has already worked out, if any
+//
+// @param luma              : Brightness of every pixel, width bytes per row, rows in memory
+//                            order, or nullptr
+//
+// @returns                 : Table, nullptr if the image format is not supported
+//********************************************************************************************
+const integral_image_t* BitmapImage::getIntegralImage(color_t channel, const unsigned char *luma)
+{
+    pixel_buffer_t image = this->getOriginalPixelBuffer();
+    if (image.pixels == nullptr || channel < RED || channel > BRIGHTNESS)
+    {
+        return nullptr;
+    }
+
+    if (image.bitsPerPixel == BITS_8_PALLETIZED && channel != BRIGHTNESS)
+    {
+        channel = RED;
+    }
+
+    integral_image_t &table = m_integralImages[channel];
+    if (table.valid)
+    {
+        return &table;
+    }
+
+    const unsigned char *plane = nullptr;
+    size_t planeStride = image.paddedWidth;
+    int step = 1;
+    vector<unsigned char> lumaPlane;
+
+    bool supported = DispatchPixelFormat(image.bitsPerPixel, [&](auto format)
+    {
+        typedef decltype(format) Format;
+        step = Format::BYTES_PER_PIXEL;
+
+        if (channel == RED)
+        {
+            plane = image.pixels + Format::RED_OFFSET;
+        }
+        else if (channel == GREEN)
+        {
+            plane = image.pixels + Format::GREEN_OFFSET;
+        }
+        else if (channel == BLUE)
+        {
+            plane = image.pixels + Format::BLUE_OFFSET;
+        }
+        else
+        {
+            if (luma == nullptr)
+            {
+                lumaPlane.resize((size_t)image.width * image.height);
+                ThreadPool::getInstance().parallelFor(image.height, DEFAULT_ROWS_PER_TASK, [&](int begin, int end)
+                {
+                    LumaRows<Format>(image, &lumaPlane[0], begin, end);
+                });
+                luma = &lumaPlane[0];
+            }
+            plane = luma;
+            planeStride = image.width;
+            step = 1;
+        }
+    });
+
+    if (!supported)
+    {
+        return nullptr;
+    }
+
+    table.width = image.width;
+    table.height = image.height;
+    table.stride = image.width + 1;
+    size_t entries = (size_t)table.stride * (image.height + 1);
+
+    // 32 bit entries halve the memory traffic of the build and of every query
+    if ((unsigned long long)image.width * image.height * (MAX_COLORS - 1) <= UINT_MAX)
+    {
+        vector<unsigned long long>().swap(table.sums64);
+        table.sums32.resize(entries);
+        BuildIntegralTable(plane, planeStride, step, image.width, image.height, &table.sums32[0]);
+    }
+    else
+    {
+        vector<unsigned int>().swap(table.sums32);
+        table.sums64.resize(entries);
+        BuildIntegralTable(plane, planeStride, step, image.width, image.height, &table.sums64[0]);
+    }
+
+    table.valid = true;
+    return &table;
+}
+
+//******************************************************************************************
+// @name                    : buildIntegralImages
+//
+// @description             : Builds the summed-area tables of every channel and of the
+//                            brightness, for example before querying them from several
+//                            threads
+//
+// @returns                 : 0 if SUCCESS
+//********************************************************************************************
+int BitmapImage::buildIntegralImages()
+{
+    for (int c = RED; c <= BRIGHTNESS; c++)
+    {
+        if (this->getIntegralImage((color_t)c) == nullptr)
+        {
+            printf("ERROR: Integral images are not supported for this image!\n");
+            return -1;
+        }
+    }
+
+    return 0;
+}
+
+//******************************************************************************************
+// @name                    : getRectSum
+//
+// @description             : Sum of a channel over a rectangle of the original image, in
+//                            constant time once the channel's summed-area table is built
+//
+// @param channel           : Color channel, or BRIGHTNESS
+// @param x                 : Left column of the rectangle
+// @param y                 : Top row of the rectangle, counted from the top of the image
+// @param sum               : Sum on return
+//
+// @returns                 : 0 if SUCCESS
+//********************************************************************************************
+int BitmapImage::getRectSum(color_t channel, int x, int y, int width, int height, unsigned long long &sum)
+{
+    const integral_image_t *table = this->getIntegralImage(channel);
+    if (table == nullptr)
+    {
+        printf("ERROR: Integral images are not supported for this image!\n");
+        return -1;
+    }
+
+    if (width <= 0 || height <= 0 || x < 0 || y < 0 || x + width > table->width || y + height > table->height)
+    {
+        printf("ERROR: Invalid rectangle %d,%d %dx%d!\n", x, y, width, height);
+        return -1;
+    }
+
+    // Rows are bottom-up
+    int top = table->height - y;
+    sum = IntegralRectSum(*table, x, top - height, x + width, top);
+
+    return 0;
+}
+
+//******************************************************************************************
+// @name                    : getRectMean
+//
+// @description             : Mean of a channel over a rectangle of the original image, for
+//                            example the brightness of a region
+//
+// @param mean              : Mean on return
+//
+// @returns                 : 0 if SUCCESS
+//********************************************************************************************
+int BitmapImage::getRectMean(color_t channel, int x, int y, int width, int height, double &mean)
+{
+    unsigned long long sum = 0;
+    if (this->getRectSum(channel, x, y, width, height, sum) != 0)
+    {
+        return -1;
+    }
+
+    mean = (double)sum / ((double)width * height);
+    return 0;
+}
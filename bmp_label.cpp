@@ -0,0 +1,393 @@
+#include"bmp.h"
+#include"pixel_kernels.h"
+#include"thread_pool.h"
+#include<algorithm>
+#include<limits.h>
+#include<mutex>
+#include<string.h>
+
+// Running sums of the pixels of one provisional label
+typedef struct label_sums_tag
+{
+    unsigned long long area;
+    unsigned long long sumX;
+    unsigned long long sumY;
+    int left;
+    int right;
+    int top;
+    int bottom;
+}label_sums_t;
+
+// Result of labeling one band of rows on its own. Its provisional labels are firstLabel
+// onwards; rows are counted from the top.
+typedef struct label_band_tag
+{
+    int begin;
+    int end;
+    unsigned int firstLabel;
+    vector<label_sums_t> sums;          // Indexed by provisional label - firstLabel
+    vector<unsigned int> firstRow;      // Provisional labels of the top and bottom rows, for the merge
+    vector<unsigned int> lastRow;
+}label_band_t;
+
+//******************************************************************************************
+// @name                    : FindLabelRoot
+//
+// @description             : This is a static function. Root of a provisional label. Parents
+//                            are smaller than their children, so roots are the smallest label
+//                            of their component. Halves the path on the way.
+//
+// @returns                 : Root label
+//********************************************************************************************
+static inline unsigned int FindLabelRoot(unsigned int *parents, unsigned int label)
+{
+    while (parents[label] < label)
+    {
+        parents[label] = parents[parents[label]];
+        label = parents[label];
+    }
+
+    return label;
+}
+
+//******************************************************************************************
+// @name                    : MergeLabels
+//
+// @description             : This is a static function. Joins the components of two labels.
+//
+// @returns                 : Root of the joined component
+//********************************************************************************************
+static inline unsigned int MergeLabels(unsigned int *parents, unsigned int first, unsigned int second)
+{
+    first = FindLabelRoot(parents, first);
+    second = FindLabelRoot(parents, second);
+    if (first < second)
+    {
+        parents[second] = first;
+        return first;
+    }
+
+    parents[first] = second;
+    return second;
+}
+
+//******************************************************************************************
+// @name                    : LabelBandRows
+//
+// @description             : This is a static function. Labels the foreground of rows begin
+//                            to end (from the top) in one scan: a pixel takes the label of a
+//                            neighbour already scanned, and joins the labels of its other
+//                            scanned neighbours, or starts a new label. Neighbours in the row
+//                            above begin are left to the merge.
+//
+// @param foreground        : Writes the mask of a row from the top, 1 for foreground
+// @param parents           : Parent of every provisional label
+// @param labels            : Provisional label of every pixel on return, width per row from
+//                            the top, or nullptr
+//
+// @returns                 : Nothing
+//********************************************************************************************
+static void LabelBandRows(int width, bool eightConnected, const function<void(int row, unsigned char *mask)> &foreground,
+                          unsigned int *parents, unsigned int *labels, label_band_t &band)
+{
+    vector<unsigned char> mask(width);
+    vector<unsigned int> previous(width + 2, 0);
+    vector<unsigned int> current(width + 2, 0);
+    unsigned int nextLabel = band.firstLabel;
+
+    for (int t = band.begin; t < band.end; t++)
+    {
+        foreground(t, &mask[0]);
+
+        // Entry j + 1 is column j, so the neighbours of the edge columns read as background
+        unsigned int *above = &previous[1];
+        unsigned int *row = &current[1];
+
+        for (int j = 0; j < width; j++)
+        {
+            if (!mask[j])
+            {
+                row[j] = 0;
+                continue;
+            }
+
+            unsigned int neighbours[4] = { row[j - 1], above[j], 0, 0 };
+            if (eightConnected)
+            {
+                neighbours[2] = above[j - 1];
+                neighbours[3] = above[j + 1];
+            }
+
+            unsigned int label = 0;
+            for (int k = 0; k < 4; k++)
+            {
+                if (neighbours[k] == 0 || neighbours[k] == label)
+                {
+                    continue;
+                }
+                label = (label == 0) ? neighbours[k] : MergeLabels(parents, label, neighbours[k]);
+            }
+
+            if (label == 0)
+            {
+                label = nextLabel++;
+                parents[label] = label;
+
+                label_sums_t sums = { 0, 0, 0, j, j, t, t };
+                band.sums.push_back(sums);
+            }
+            row[j] = label;
+
+            // Pixels count towards the label they were given; the labels of a component add up later
+            label_sums_t &sums = band.sums[label - band.firstLabel];
+            sums.area++;
+            sums.sumX += j;
+            sums.sumY += t;
+            sums.left = std::min(sums.left, j);
+            sums.right = std::max(sums.right, j);
+            sums.bottom = t;
+        }
+
+        if (t == band.begin)
+        {
+            band.firstRow.assign(row, row + width);
+        }
+        if (labels != nullptr)
+        {
+            memcpy(&labels[(size_t)width * t], row, sizeof(unsigned int) * width);
+        }
+        previous.swap(current);
+    }
+
+    band.lastRow.assign(&previous[1], &previous[1] + width);
+}
+
+//******************************************************************************************
+// @name                    : LabelColor
+//
+// @description             : This is a static function. Palette color of a label index of the
+//                            label image: bright colors, neighbouring indices far apart.
+//
+// @returns                 : Color
+//********************************************************************************************
+static pixel_value_rgb_t LabelColor(int index)
+{
+    unsigned int h = (unsigned int)index * 0x9E3779B1u;
+    h ^= h >> 16;
+    h *= 0x85EBCA6Bu;
+    h ^= h >> 13;
+
+    pixel_value_rgb_t color;
+    color.red = (unsigned char)(64 + (h & 0xBF));
+    color.green = (unsigned char)(64 + ((h >> 8) & 0xBF));
+    color.blue = (unsigned char)(64 + ((h >> 16) & 0xBF));
+
+    return color;
+}
+
+//******************************************************************************************
+// @name                    : LabelConnectedComponents
+//
+// @description             : Finds the connected components of a threshold mask of the
+//                            brightness, for example the stamps, signatures and words of a
+//                            scanned document, with their bounding boxes, areas and
+//                            centroids. Bands of rows are labeled in parallel, each with its
+//                            own range of provisional labels and union-find, keeping only two
+//                            rows of labels; the bands are then merged where they meet. The
+//                            label image is only kept to draw it: an 8 bit modified image with
+//                            background black and every component in a color of its label.
+//
+// @param components        : Components on return, in label order
+// @param options           : Threshold, connectivity and output. nullptr for dark components
+//                            of Otsu's threshold, 8 connected.
+//
+// @returns                 : 0 if SUCCESS
+//********************************************************************************************
+int BitmapImage::LabelConnectedComponents(vector<connected_component_t> &components, const labeling_options_t *options)
+{
+    labeling_options_t settings = { -1, true, true, 0, false };
+    if (options != nullptr)
+    {
+        settings = *options;
+    }
+
+    components.clear();
+
+    pixel_buffer_t image = this->getOriginalPixelBuffer();
+    if (image.pixels == nullptr)
+    {
+        printf("ERROR: No image to label!\n");
+        return -1;
+    }
+
+    int width = image.width;
+    int height = image.height;
+
+    // Every row may start a label at every other pixel at most
+    unsigned long long labelsPerRow = ((unsigned long long)width + 1) / 2;
+    if (labelsPerRow * height + 1 >= UINT_MAX)
+    {
+        printf("ERROR: Image is too large to label!\n");
+        return -1;
+    }
+
+    if (!IsSupportedPixelFormat(image.bitsPerPixel))
+    {
+        printf("ERROR: Labeling is not supported for %d bits per pixel!\n", image.bitsPerPixel);
+        return -1;
+    }
+
+    int threshold = (settings.threshold < 0) ? this->getOtsuThreshold() : settings.threshold;
+    bool dark = settings.darkForeground;
+
+    auto foreground = [&](int t, unsigned char *mask)
+    {
+        // Rows are bottom-up
+        const unsigned char *in = &image.pixels[(size_t)image.paddedWidth * (height - 1 - t)];
+        DispatchPixelFormat(image.bitsPerPixel, [&](auto format)
+        {
+            typedef decltype(format) Format;
+            for (int j = 0; j < width; j++, in += Format::BYTES_PER_PIXEL)
+            {
+                int luma = LumaFromRGB(in[Format::RED_OFFSET], in[Format::GREEN_OFFSET], in[Format::BLUE_OFFSET]);
+                mask[j] = dark ? (luma <= threshold) : (luma > threshold);
+            }
+        });
+    };
+
+    vector<unsigned int> parents((size_t)(labelsPerRow * height + 1));
+    vector<unsigned int> labels(settings.drawLabels ? (size_t)width * height : 0);
+    vector<label_band_t> bands;
+    mutex bandsMutex;
+    ThreadPool &pool = ThreadPool::getInstance();
+
+    pool.parallelFor(height, DEFAULT_ROWS_PER_TASK, [&](int begin, int end)
+    {
+        label_band_t band;
+        band.begin = begin;
+        band.end = end;
+        band.firstLabel = (unsigned int)(labelsPerRow * begin + 1);
+        LabelBandRows(width, settings.eightConnected, foreground, &parents[0], labels.empty() ? nullptr : &labels[0], band);
+
+        lock_guard<mutex> lock(bandsMutex);
+        bands.push_back(std::move(band));
+    });
+
+    std::sort(bands.begin(), bands.end(), [](const label_band_t &a, const label_band_t &b) { return a.begin < b.begin; });
+
+    // Join the components which meet across the edge between two bands
+    for (size_t b = 1; b < bands.size(); b++)
+    {
+        const vector<unsigned int> &above = bands[b - 1].lastRow;
+        const vector<unsigned int> &below = bands[b].firstRow;
+        for (int j = 0; j < width; j++)
+        {
+            if (below[j] == 0)
+            {
+                continue;
+            }
+
+            int first = settings.eightConnected ? std::max(j - 1, 0) : j;
+            int last = settings.eightConnected ? std::min(j + 1, width - 1) : j;
+            for (int k = first; k <= last; k++)
+            {
+                if (above[k] != 0)
+                {
+                    MergeLabels(&parents[0], below[j], above[k]);
+                }
+            }
+        }
+    }
+
+    // Number the roots in order and point every other label at its root's number. Parents are
+    // smaller than their children, so they are numbered first.
+    unsigned int componentCount = 0;
+    for (size_t b = 0; b < bands.size(); b++)
+    {
+        unsigned int last = bands[b].firstLabel + (unsigned int)bands[b].sums.size();
+        for (unsigned int label = bands[b].firstLabel; label < last; label++)
+        {
+            parents[label] = (parents[label] == label) ? ++componentCount : parents[parents[label]];
+        }
+    }
+
+    vector<label_sums_t> totals(componentCount);
+    for (unsigned int c = 0; c < componentCount; c++)
+    {
+        label_sums_t empty = { 0, 0, 0, INT_MAX, -1, INT_MAX, -1 };
+        totals[c] = empty;
+    }
+
+    for (size_t b = 0; b < bands.size(); b++)
+    {
+        for (size_t k = 0; k < bands[b].sums.size(); k++)
+        {
+            const label_sums_t &sums = bands[b].sums[k];
+            label_sums_t &total = totals[parents[bands[b].firstLabel + k] - 1];
+            total.area += sums.area;
+            total.sumX += sums.sumX;
+            total.sumY += sums.sumY;
+            total.left = std::min(total.left, sums.left);
+            total.right = std::max(total.right, sums.right);
+            total.top = std::min(total.top, sums.top);
+            total.bottom = std::max(total.bottom, sums.bottom);
+        }
+    }
+
+    // Components below the minimum area are dropped and the others numbered again
+    vector<int> kept(componentCount + 1, 0);
+    for (unsigned int c = 0; c < componentCount; c++)
+    {
+        const label_sums_t &total = totals[c];
+        if (total.area < settings.minimumArea)
+        {
+            continue;
+        }
+
+        connected_component_t component;
+        component.label = (int)components.size() + 1;
+        component.left = total.left;
+        component.top = total.top;
+        component.width = total.right - total.left + 1;
+        component.height = total.bottom - total.top + 1;
+        component.area = total.area;
+        component.centroidX = (double)total.sumX / total.area;
+        component.centroidY = (double)total.sumY / total.area;
+        components.push_back(component);
+        kept[c + 1] = component.label;
+    }
+
+    if (settings.drawLabels)
+    {
+        if (this->allocateModifiedImageBuffer(width, height, BITS_8_PALLETIZED) != 0)
+        {
+            return -1;
+        }
+        pixel_buffer_t dst = this->getModifiedPixelBuffer();
+
+        // Labels share the 255 colors of the palette after black
+        for (int i = 1; i < MAX_COLORS; i++)
+        {
+            pixel_value_rgb_t color = LabelColor(i);
+            m_modifiedColorTable[i * 4] = color.blue;
+            m_modifiedColorTable[i * 4 + 1] = color.green;
+            m_modifiedColorTable[i * 4 + 2] = color.red;
+        }
+
+        pool.parallelFor(height, DEFAULT_ROWS_PER_TASK, [&](int begin, int end)
+        {
+            for (int t = begin; t < end; t++)
+            {
+                const unsigned int *row = &labels[(size_t)width * t];
+                unsigned char *out = &dst.pixels[(size_t)dst.paddedWidth * (height - 1 - t)];
+                for (int j = 0; j < width; j++)
+                {
+                    int label = (row[j] == 0) ? 0 : kept[parents[row[j]]];
+                    out[j] = (label == 0) ? 0 : (unsigned char)(1 + (label - 1) % (MAX_COLORS - 1));
+                }
+            }
+        });
+    }
+
+    return 0;
+}
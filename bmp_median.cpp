@@ -0,0 +1,497 @@
+#include"bmp.h"
+#include"pixel_kernels.h"
+#include"simd.h"
+#include"thread_pool.h"
+#include<algorithm>
+#include<string.h>
+
+const int HISTOGRAM_SEGMENTS = 16;      // Coarse bins of the sliding histograms
+const int SEGMENT_BINS = MAX_COLORS / HISTOGRAM_SEGMENTS;
+
+// One channel (or the brightness) of the image, with the first and last columns
+// replicated radius times on either side, so that every window is complete.
+typedef struct median_plane_tag
+{
+    vector<unsigned char> pixels;
+    int width;                      // Width of the image
+    int height;
+    int stride;                     // width + 2 * radius
+}median_plane_t;
+
+// ==================================================================================================
+// Sorting networks, written once for single pixels and for SIMD vectors of pixels
+// ==================================================================================================
+struct ScalarMinMax
+{
+    typedef unsigned char value_t;
+
+    static inline value_t load(const unsigned char *p) { return *p; }
+    static inline void store(unsigned char *p, value_t v) { *p = v; }
+    static inline void sort(value_t &a, value_t &b)
+    {
+        value_t low = std::min(a, b);
+        b = std::max(a, b);
+        a = low;
+    }
+};
+
+#ifdef USE_SSE2_KERNELS
+struct Sse2MinMax
+{
+    typedef __m128i value_t;
+
+    static inline value_t load(const unsigned char *p) { return _mm_loadu_si128((const __m128i*)p); }
+    static inline void store(unsigned char *p, value_t v) { _mm_storeu_si128((__m128i*)p, v); }
+    static inline void sort(value_t &a, value_t &b)
+    {
+        value_t low = _mm_min_epu8(a, b);
+        b = _mm_max_epu8(a, b);
+        a = low;
+    }
+};
+#endif
+
+//******************************************************************************************
+// @name                    : MedianOf9
+//
+// @description             : This is a static function. Median of 9 values with a 19
+//                            exchange selection network. The values are reordered.
+//
+// @returns                 : Median
+//********************************************************************************************
+template<typename Ops>
+static inline typename Ops::value_t MedianOf9(typename Ops::value_t *p)
+{
+    static const unsigned char network[][2] =
+    {
+        { 1, 2 }, { 4, 5 }, { 7, 8 }, { 0, 1 }, { 3, 4 }, { 6, 7 }, { 1, 2 }, { 4, 5 }, { 7, 8 }, { 0, 3 },
+        { 5, 8 }, { 4, 7 }, { 3, 6 }, { 1, 4 }, { 2, 5 }, { 4, 7 }, { 4, 2 }, { 6, 4 }, { 4, 2 }
+    };
+
+    for (size_t k = 0; k < sizeof(network) / sizeof(network[0]); k++)
+    {
+        Ops::sort(p[network[k][0]], p[network[k][1]]);
+    }
+
+    return p[4];
+}
+
+//******************************************************************************************
+// @name                    : MedianOf25
+//
+// @description             : This is a static function. Median of 25 values with a 99
+//                            exchange selection network. The values are reordered.
+//
+// @returns                 : Median
+//********************************************************************************************
+template<typename Ops>
+static inline typename Ops::value_t MedianOf25(typename Ops::value_t *p)
+{
+    static const unsigned char network[][2] =
+    {
+        { 0, 1 },   { 3, 4 },   { 2, 4 },   { 2, 3 },   { 6, 7 },   { 5, 7 },   { 5, 6 },   { 9, 10 },  { 8, 10 },
+        { 8, 9 },   { 12, 13 }, { 11, 13 }, { 11, 12 }, { 15, 16 }, { 14, 16 }, { 14, 15 }, { 18, 19 }, { 17, 19 },
+        { 17, 18 }, { 21, 22 }, { 20, 22 }, { 20, 21 }, { 23, 24 }, { 2, 5 },   { 3, 6 },   { 0, 6 },   { 0, 3 },
+        { 4, 7 },   { 1, 7 },   { 1, 4 },   { 11, 14 }, { 8, 14 },  { 8, 11 },  { 12, 15 }, { 9, 15 },  { 9, 12 },
+        { 13, 16 }, { 10, 16 }, { 10, 13 }, { 20, 23 }, { 17, 23 }, { 17, 20 }, { 21, 24 }, { 18, 24 }, { 18, 21 },
+        { 19, 22 }, { 8, 17 },  { 9, 18 },  { 0, 18 },  { 0, 9 },   { 10, 19 }, { 1, 19 },  { 1, 10 },  { 11, 20 },
+        { 2, 20 },  { 2, 11 },  { 12, 21 }, { 3, 21 },  { 3, 12 },  { 13, 22 }, { 4, 22 },  { 4, 13 },  { 14, 23 },
+        { 5, 23 },  { 5, 14 },  { 15, 24 }, { 6, 24 },  { 6, 15 },  { 7, 16 },  { 7, 19 },  { 13, 21 }, { 15, 23 },
+        { 7, 13 },  { 7, 15 },  { 1, 9 },   { 3, 11 },  { 5, 17 },  { 11, 17 }, { 9, 17 },  { 4, 10 },  { 6, 12 },
+        { 7, 14 },  { 4, 6 },   { 4, 7 },   { 12, 14 }, { 10, 14 }, { 6, 7 },   { 10, 12 }, { 6, 10 },  { 6, 17 },
+        { 12, 17 }, { 7, 17 },  { 7, 10 },  { 12, 18 }, { 7, 12 },  { 10, 18 }, { 12, 20 }, { 10, 20 }, { 10, 12 }
+    };
+
+    for (size_t k = 0; k < sizeof(network) / sizeof(network[0]); k++)
+    {
+        Ops::sort(p[network[k][0]], p[network[k][1]]);
+    }
+
+    return p[12];
+}
+
+//******************************************************************************************
+// @name                    : MedianNetworkAt
+//
+// @description             : This is a static function. Median of the window of RADIUS
+//                            (1 or 2) whose top left value is at column of rows.
+//
+// @param rows              : 2 * RADIUS + 1 plane rows, top to bottom
+//
+// @returns                 : Median
+//********************************************************************************************
+template<int RADIUS, typename Ops>
+static inline typename Ops::value_t MedianNetworkAt(const unsigned char * const *rows, int column)
+{
+    const int SIZE = 2 * RADIUS + 1;
+    typename Ops::value_t window[SIZE * SIZE];
+    for (int k = 0; k < SIZE; k++)
+    {
+        for (int l = 0; l < SIZE; l++)
+        {
+            window[k * SIZE + l] = Ops::load(rows[k] + column + l);
+        }
+    }
+
+    return (RADIUS == 1) ? MedianOf9<Ops>(window) : MedianOf25<Ops>(window);
+}
+
+//******************************************************************************************
+// @name                    : MedianNetworkRows
+//
+// @description             : This is a static function. Median filter of rows [rowBegin,
+//                            rowEnd) of a plane with a sorting network, 16 pixels at a time.
+//
+// @returns                 : Nothing
+//********************************************************************************************
+template<int RADIUS>
+static void MedianNetworkRows(const median_plane_t &plane, unsigned char *dst, int rowBegin, int rowEnd)
+{
+    const int SIZE = 2 * RADIUS + 1;
+    const unsigned char *rows[SIZE];
+
+    for (int i = rowBegin; i < rowEnd; i++)
+    {
+        for (int k = 0; k < SIZE; k++)
+        {
+            int row = std::min(std::max(i + k - RADIUS, 0), plane.height - 1);
+            rows[k] = &plane.pixels[(size_t)plane.stride * row];
+        }
+
+        unsigned char *out = dst + (size_t)plane.width * i;
+        int j = 0;
+
+#ifdef USE_SSE2_KERNELS
+        const int VECTOR_PIXELS = 16;
+        if (plane.width >= VECTOR_PIXELS)
+        {
+            for (; j + VECTOR_PIXELS <= plane.width; j += VECTOR_PIXELS)
+            {
+                Sse2MinMax::store(out + j, MedianNetworkAt<RADIUS, Sse2MinMax>(rows, j));
+            }
+
+            // The last vector overlaps the previous one
+            if (j < plane.width)
+            {
+                j = plane.width - VECTOR_PIXELS;
+                Sse2MinMax::store(out + j, MedianNetworkAt<RADIUS, Sse2MinMax>(rows, j));
+                j = plane.width;
+            }
+        }
+#endif
+
+        for (; j < plane.width; j++)
+        {
+            out[j] = MedianNetworkAt<RADIUS, ScalarMinMax>(rows, j);
+        }
+    }
+}
+
+// ==================================================================================================
+// Sliding histograms (Perreault and Hebert, "Median Filtering in Constant Time")
+// ==================================================================================================
+//******************************************************************************************
+// @name                    : UpdateSegment
+//
+// @description             : This is a static function. dst += add - sub over one coarse
+//                            segment (16 bins) of a histogram.
+//
+// @returns                 : Nothing
+//********************************************************************************************
+static inline void UpdateSegment(unsigned short *dst, const unsigned short *add, const unsigned short *sub)
+{
+#ifdef USE_SSE2_KERNELS
+    for (int k = 0; k < SEGMENT_BINS; k += 8)
+    {
+        __m128i value = _mm_loadu_si128((const __m128i*)(dst + k));
+        value = _mm_add_epi16(value, _mm_loadu_si128((const __m128i*)(add + k)));
+        value = _mm_sub_epi16(value, _mm_loadu_si128((const __m128i*)(sub + k)));
+        _mm_storeu_si128((__m128i*)(dst + k), value);
+    }
+#else
+    for (int k = 0; k < SEGMENT_BINS; k++)
+    {
+        dst[k] = (unsigned short)(dst[k] + add[k] - sub[k]);
+    }
+#endif
+}
+
+//******************************************************************************************
+// @name                    : MedianHistogramRows
+//
+// @description             : This is a static function. Median filter of rows [rowBegin,
+//                            rowEnd) of a plane with sliding histograms. Every plane column
+//                            keeps a histogram of the 2 * radius + 1 rows around the current
+//                            row, so moving down a row costs one add and one remove per
+//                            column. The window histogram slides right by adding one column
+//                            histogram and subtracting another. Histograms are two level:
+//                            the coarse level locates the segment holding the median, and
+//                            the fine bins of a segment are only brought up to date when
+//                            the median falls in it. The cost per pixel does not depend on
+//                            the radius.
+//
+// @returns                 : Nothing
+//********************************************************************************************
+static void MedianHistogramRows(const median_plane_t &plane, int radius, unsigned char *dst, int rowBegin, int rowEnd)
+{
+    int size = 2 * radius + 1;
+    int rank = size * size / 2;
+    int stride = plane.stride;
+
+    vector<unsigned short> columnFine((size_t)stride * MAX_COLORS, 0);
+    vector<unsigned short> columnCoarse((size_t)stride * HISTOGRAM_SEGMENTS, 0);
+    unsigned short windowFine[MAX_COLORS];
+    unsigned short windowCoarse[HISTOGRAM_SEGMENTS];
+    int segmentColumn[HISTOGRAM_SEGMENTS];          // Column at which the fine bins of a segment are valid
+
+    auto addRow = [&](int row, int delta)
+    {
+        const unsigned char *in = &plane.pixels[(size_t)stride * std::min(std::max(row, 0), plane.height - 1)];
+        for (int c = 0; c < stride; c++)
+        {
+            columnFine[(size_t)c * MAX_COLORS + in[c]] += delta;
+            columnCoarse[(size_t)c * HISTOGRAM_SEGMENTS + in[c] / SEGMENT_BINS] += delta;
+        }
+    };
+
+    for (int row = rowBegin - radius; row < rowBegin + radius; row++)
+    {
+        addRow(row, 1);
+    }
+
+    for (int i = rowBegin; i < rowEnd; i++)
+    {
+        addRow(i + radius, 1);
+        if (i > rowBegin)
+        {
+            addRow(i - radius - 1, -1);
+        }
+
+        // Window of the first pixel: plane columns [0, size)
+        memset(windowCoarse, 0, sizeof(windowCoarse));
+        for (int c = 0; c < size; c++)
+        {
+            for (int s = 0; s < HISTOGRAM_SEGMENTS; s++)
+            {
+                windowCoarse[s] += columnCoarse[(size_t)c * HISTOGRAM_SEGMENTS + s];
+            }
+        }
+
+        for (int s = 0; s < HISTOGRAM_SEGMENTS; s++)
+        {
+            segmentColumn[s] = -size;
+        }
+
+        unsigned char *out = dst + (size_t)plane.width * i;
+        for (int j = 0; j < plane.width; j++)
+        {
+            if (j > 0)
+            {
+                for (int s = 0; s < HISTOGRAM_SEGMENTS; s++)
+                {
+                    windowCoarse[s] += columnCoarse[(size_t)(j + size - 1) * HISTOGRAM_SEGMENTS + s] -
+                                       columnCoarse[(size_t)(j - 1) * HISTOGRAM_SEGMENTS + s];
+                }
+            }
+
+            // Coarse segment holding the median
+            int count = 0;
+            int s = 0;
+            while (count + windowCoarse[s] <= rank)
+            {
+                count += windowCoarse[s];
+                s++;
+            }
+
+            // Bring the fine bins of the segment to column j. Sliding is cheaper than a
+            // rebuild unless the segment was last used more than a window away.
+            unsigned short *fine = &windowFine[s * SEGMENT_BINS];
+            if (j - segmentColumn[s] >= size)
+            {
+                memset(fine, 0, SEGMENT_BINS * sizeof(unsigned short));
+                for (int c = j; c < j + size; c++)
+                {
+                    const unsigned short *column = &columnFine[(size_t)c * MAX_COLORS + s * SEGMENT_BINS];
+                    for (int k = 0; k < SEGMENT_BINS; k++)
+                    {
+                        fine[k] += column[k];
+                    }
+                }
+            }
+            else
+            {
+                for (int c = segmentColumn[s] + 1; c <= j; c++)
+                {
+                    UpdateSegment(fine, &columnFine[(size_t)(c + size - 1) * MAX_COLORS + s * SEGMENT_BINS],
+                                  &columnFine[(size_t)(c - 1) * MAX_COLORS + s * SEGMENT_BINS]);
+                }
+            }
+            segmentColumn[s] = j;
+
+            int bin = 0;
+            while (count + fine[bin] <= rank)
+            {
+                count += fine[bin];
+                bin++;
+            }
+
+            out[j] = (unsigned char)(s * SEGMENT_BINS + bin);
+        }
+    }
+}
+
+// ==================================================================================================
+// Planes
+// ==================================================================================================
+//******************************************************************************************
+// @name                    : ExtractMedianPlanes
+//
+// @description             : This is a static function. Splits rows [rowBegin, rowEnd) into
+//                            the padded planes: one per channel, or the brightness alone in
+//                            luma mode.
+//
+// @returns                 : Nothing
+//********************************************************************************************
+template<typename Format, processing_mode_t MODE>
+static void ExtractMedianPlanes(const pixel_buffer_t &src, int radius, vector<median_plane_t> &planes,
+                                int rowBegin, int rowEnd)
+{
+    const int offsets[3] = { Format::BLUE_OFFSET, Format::GREEN_OFFSET, Format::RED_OFFSET };
+
+    for (int i = rowBegin; i < rowEnd; i++)
+    {
+        const unsigned char *in = &src.pixels[(size_t)src.paddedWidth * i];
+        for (size_t p = 0; p < planes.size(); p++)
+        {
+            unsigned char *out = &planes[p].pixels[(size_t)planes[p].stride * i + radius];
+            for (int j = 0; j < src.width; j++)
+            {
+                const unsigned char *pixel = in + j * Format::BYTES_PER_PIXEL;
+                if (MODE == PROCESS_LUMA && Format::CHANNELS == 3)
+                    out[j] = LumaFromRGB(pixel[Format::RED_OFFSET], pixel[Format::GREEN_OFFSET], pixel[Format::BLUE_OFFSET]);
+                else
+                    out[j] = pixel[offsets[p]];
+            }
+
+            memset(out - radius, out[0], radius);
+            memset(out + src.width, out[src.width - 1], radius);
+        }
+    }
+}
+
+//******************************************************************************************
+// @name                    : StoreMedianPlanes
+//
+// @description             : This is a static function. Writes the filtered planes of rows
+//                            [rowBegin, rowEnd) to the image. In luma mode the chroma of the
+//                            source pixel is kept.
+//
+// @returns                 : Nothing
+//********************************************************************************************
+template<typename Format, processing_mode_t MODE>
+static void StoreMedianPlanes(const pixel_buffer_t &src, const vector<vector<unsigned char> > &filtered,
+                              pixel_buffer_t &dst, int rowBegin, int rowEnd)
+{
+    const int offsets[3] = { Format::BLUE_OFFSET, Format::GREEN_OFFSET, Format::RED_OFFSET };
+
+    for (int i = rowBegin; i < rowEnd; i++)
+    {
+        const unsigned char *in = &src.pixels[(size_t)src.paddedWidth * i];
+        unsigned char *out = &dst.pixels[(size_t)dst.paddedWidth * i];
+        for (int j = 0; j < src.width; j++, in += Format::BYTES_PER_PIXEL, out += Format::BYTES_PER_PIXEL)
+        {
+            size_t index = (size_t)src.width * i + j;
+            if (MODE == PROCESS_LUMA && Format::CHANNELS == 3)
+            {
+                pixel_value_ycbcr_t ycbcr = RGBToYCbCr(in[Format::RED_OFFSET], in[Format::GREEN_OFFSET], in[Format::BLUE_OFFSET]);
+                pixel_value_rgb_t rgb = YCbCrToRGB(filtered[0][index], ycbcr.Cb, ycbcr.Cr);
+                out[Format::BLUE_OFFSET]  = rgb.blue;
+                out[Format::GREEN_OFFSET] = rgb.green;
+                out[Format::RED_OFFSET]   = rgb.red;
+            }
+            else
+            {
+                for (size_t p = 0; p < filtered.size(); p++)
+                {
+                    out[offsets[p]] = filtered[p][index];
+                }
+            }
+        }
+    }
+}
+
+//******************************************************************************************
+// @name                    : DoMedianFilter
+//
+// @description             : Denoises the image. Every pixel becomes the median of the
+//                            (2 * radius + 1) x (2 * radius + 1) window around it; the image
+//                            edges are extended. Radius 1 and 2 use sorting networks, larger
+//                            radii sliding histograms, whose cost per pixel does not grow
+//                            with the radius.
+//
+// @param radius            : 1 to MAX_MEDIAN_RADIUS
+// @param mode              : Filter red, green and blue separately, or only brightness
+//
+// @returns                 : 0 if SUCCESS
+//********************************************************************************************
+int BitmapImage::DoMedianFilter(int radius, processing_mode_t mode)
+{
+    if (radius < 1 || radius > MAX_MEDIAN_RADIUS)
+    {
+        printf("ERROR: Invalid median radius %d!\n", radius);
+        return -1;
+    }
+
+    this->allocateModifiedImageBuffer();
+
+    pixel_buffer_t src = this->getOriginalPixelBuffer();
+    pixel_buffer_t dst = this->getModifiedPixelBuffer();
+    ThreadPool &pool = ThreadPool::getInstance();
+
+    bool supported = DispatchPixelFormat(src.bitsPerPixel, [&](auto format)
+    {
+        DispatchProcessingMode(mode, [&](auto modeTag)
+        {
+            typedef decltype(format) Format;
+            const processing_mode_t MODE = decltype(modeTag)::value;
+
+            int planeCount = (MODE == PROCESS_LUMA) ? 1 : Format::CHANNELS;
+            vector<median_plane_t> planes(planeCount);
+            vector<vector<unsigned char> > filtered(planeCount);
+            for (int p = 0; p < planeCount; p++)
+            {
+                planes[p].width = src.width;
+                planes[p].height = src.height;
+                planes[p].stride = src.width + 2 * radius;
+                planes[p].pixels.resize((size_t)planes[p].stride * src.height);
+                filtered[p].resize((size_t)src.width * src.height);
+            }
+
+            pool.parallelFor(src.height, DEFAULT_ROWS_PER_TASK, [&](int begin, int end)
+            {
+                ExtractMedianPlanes<Format, MODE>(src, radius, planes, begin, end);
+            });
+
+            // Bands are larger than usual, as every band first fills its column histograms
+            pool.parallelFor(src.height, MEDIAN_ROWS_PER_TASK, [&](int begin, int end)
+            {
+                for (int p = 0; p < planeCount; p++)
+                {
+                    if (radius == 1)
+                        MedianNetworkRows<1>(planes[p], &filtered[p][0], begin, end);
+                    else if (radius == 2)
+                        MedianNetworkRows<2>(planes[p], &filtered[p][0], begin, end);
+                    else
+                        MedianHistogramRows(planes[p], radius, &filtered[p][0], begin, end);
+                }
+            });
+
+            pool.parallelFor(src.height, DEFAULT_ROWS_PER_TASK, [&](int begin, int end)
+            {
+                StoreMedianPlanes<Format, MODE>(src, filtered, dst, begin, end);
+            });
+        });
+    });
+
+    return supported ? 0 : -1;
+}
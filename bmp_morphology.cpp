@@ -0,0 +1,270 @@
+#include"bmp.h"
+#include"pixel_kernels.h"
+#include"simd.h"
+#include"thread_pool.h"
+#include<algorithm>
+#include<string.h>
+
+//******************************************************************************************
+// @name                    : MinMaxBytes
+//
+// @description             : This is a static function. dst = min(a, b) (or max), byte by
+//                            byte. dst may be a or b.
+//
+// @returns                 : Nothing
+//********************************************************************************************
+template<bool IS_MAX>
+static void MinMaxBytes(const unsigned char *a, const unsigned char *b, unsigned char *dst, int count)
+{
+    int i = 0;
+
+#ifdef USE_SSE2_KERNELS
+    for (; i + 16 <= count; i += 16)
+    {
+        __m128i x = _mm_loadu_si128((const __m128i*)(a + i));
+        __m128i y = _mm_loadu_si128((const __m128i*)(b + i));
+        _mm_storeu_si128((__m128i*)(dst + i), IS_MAX ? _mm_max_epu8(x, y) : _mm_min_epu8(x, y));
+    }
+#endif
+
+    for (; i < count; i++)
+    {
+        dst[i] = IS_MAX ? std::max(a[i], b[i]) : std::min(a[i], b[i]);
+    }
+}
+
+//******************************************************************************************
+// @name                    : MorphologyRowPass
+//
+// @description             : This is a static function. Minimum (or maximum) of every
+//                            window of size pixels along a row, with van Herk/Gil-Werman:
+//                            the row is cut in blocks of size pixels, and a window, which
+//                            spans at most two blocks, is the combination of a running
+//                            minimum from the right of one block and from the left of the
+//                            next. Three comparisons per byte, whatever the size. Pixels
+//                            outside the row do not count.
+//
+// @param bytesPerPixel     : Channels are interleaved; each byte is compared with the same
+//                            byte of the other pixels
+// @param anchor            : Pixels of the window left of the pixel it is for
+// @param scratch           : 3 * (width + size - 1) * bytesPerPixel bytes
+//
+// @returns                 : Nothing
+//********************************************************************************************
+template<bool IS_MAX>
+static void MorphologyRowPass(const unsigned char *in, unsigned char *out, int width, int bytesPerPixel,
+                              int size, int anchor, unsigned char *scratch)
+{
+    const unsigned char neutral = IS_MAX ? 0 : MAX_COLORS - 1;
+    int length = (width + size - 1) * bytesPerPixel;
+    unsigned char *padded = scratch;
+    unsigned char *prefix = scratch + length;
+    unsigned char *suffix = prefix + length;
+
+    memset(padded, neutral, (size_t)anchor * bytesPerPixel);
+    memcpy(padded + anchor * bytesPerPixel, in, (size_t)width * bytesPerPixel);
+    memset(padded + (anchor + width) * bytesPerPixel, neutral, (size_t)(size - 1 - anchor) * bytesPerPixel);
+
+    int blockBytes = size * bytesPerPixel;
+    for (int blockStart = 0; blockStart < length; blockStart += blockBytes)
+    {
+        int blockEnd = std::min(blockStart + blockBytes, length);
+
+        memcpy(prefix + blockStart, padded + blockStart, bytesPerPixel);
+        for (int i = blockStart + bytesPerPixel; i < blockEnd; i++)
+        {
+            prefix[i] = IS_MAX ? std::max(prefix[i - bytesPerPixel], padded[i]) : std::min(prefix[i - bytesPerPixel], padded[i]);
+        }
+
+        memcpy(suffix + blockEnd - bytesPerPixel, padded + blockEnd - bytesPerPixel, bytesPerPixel);
+        for (int i = blockEnd - bytesPerPixel - 1; i >= blockStart; i--)
+        {
+            suffix[i] = IS_MAX ? std::max(suffix[i + bytesPerPixel], padded[i]) : std::min(suffix[i + bytesPerPixel], padded[i]);
+        }
+    }
+
+    // The window of pixel x is padded pixels x to x + size - 1
+    MinMaxBytes<IS_MAX>(suffix, prefix + (size - 1) * bytesPerPixel, out, width * bytesPerPixel);
+}
+
+//******************************************************************************************
+// @name                    : MorphologyColumnRows
+//
+// @description             : This is a static function. Minimum (or maximum) of every
+//                            window of size rows, for rows begin to end of dst, with van
+//                            Herk/Gil-Werman on whole rows, so every comparison is a SIMD
+//                            min or max of 16 bytes. The blocks start at the first window of
+//                            the band, so bands of at least size rows keep the cost per
+//                            pixel constant. Alpha is copied from alphaSource.
+//
+// @param src               : Rows of the row pass, width * bytesPerPixel bytes apart
+// @param anchor            : Rows of the window above the pixel it is for
+//
+// @returns                 : Nothing
+//********************************************************************************************
+template<bool IS_MAX>
+static void MorphologyColumnRows(const unsigned char *src, int rowBytes, int height, int size, int anchor,
+                                 const pixel_buffer_t &alphaSource, pixel_buffer_t &dst, int begin, int end)
+{
+    const unsigned char neutral = IS_MAX ? 0 : MAX_COLORS - 1;
+    int rows = end - begin + size - 1;
+    vector<unsigned char> neutralRow(rowBytes, neutral);
+    vector<unsigned char> prefix((size_t)rows * rowBytes);
+    vector<unsigned char> suffix((size_t)rows * rowBytes);
+
+    // Rows are bottom-up: the window of memory row y is rows y - (size - 1 - anchor) to y + anchor
+    int first = begin - (size - 1 - anchor);
+    auto input = [&](int t) -> const unsigned char*
+    {
+        int row = first + t;
+        return (row >= 0 && row < height) ? src + (size_t)rowBytes * row : &neutralRow[0];
+    };
+
+    for (int blockStart = 0; blockStart < rows; blockStart += size)
+    {
+        int blockEnd = std::min(blockStart + size, rows);
+
+        memcpy(&prefix[(size_t)rowBytes * blockStart], input(blockStart), rowBytes);
+        for (int t = blockStart + 1; t < blockEnd; t++)
+        {
+            MinMaxBytes<IS_MAX>(&prefix[(size_t)rowBytes * (t - 1)], input(t), &prefix[(size_t)rowBytes * t], rowBytes);
+        }
+
+        memcpy(&suffix[(size_t)rowBytes * (blockEnd - 1)], input(blockEnd - 1), rowBytes);
+        for (int t = blockEnd - 2; t >= blockStart; t--)
+        {
+            MinMaxBytes<IS_MAX>(&suffix[(size_t)rowBytes * (t + 1)], input(t), &suffix[(size_t)rowBytes * t], rowBytes);
+        }
+    }
+
+    for (int i = begin; i < end; i++)
+    {
+        int t = i - begin;
+        unsigned char *out = &dst.pixels[(size_t)dst.paddedWidth * i];
+        MinMaxBytes<IS_MAX>(&suffix[(size_t)rowBytes * t], &prefix[(size_t)rowBytes * (t + size - 1)], out, rowBytes);
+
+        if (dst.bitsPerPixel == BITS_32_RGBA)
+        {
+            const unsigned char *alpha = &alphaSource.pixels[(size_t)alphaSource.paddedWidth * i];
+            for (int j = 3; j < rowBytes; j += 4)
+            {
+                out[j] = alpha[j];
+            }
+        }
+    }
+}
+
+//******************************************************************************************
+// @name                    : ErodeOrDilate
+//
+// @description             : This is a static function. Minimum (erosion) or maximum
+//                            (dilation) over a width x height rectangle, as a row pass into
+//                            temp and a column pass into dst. src may be dst.
+//
+// @returns                 : Nothing
+//********************************************************************************************
+template<bool IS_MAX>
+static void ErodeOrDilate(const pixel_buffer_t &src, const pixel_buffer_t &original, pixel_buffer_t &dst,
+                          vector<unsigned char> &temp, int width, int height)
+{
+    ThreadPool &pool = ThreadPool::getInstance();
+    int bytesPerPixel = src.bitsPerPixel / 8;
+    int rowBytes = src.width * bytesPerPixel;
+
+    // Anchors make the element start at the top left for even sizes
+    int anchorX = width / 2;
+    int anchorY = height / 2;
+
+    pool.parallelFor(src.height, DEFAULT_ROWS_PER_TASK, [&](int begin, int end)
+    {
+        vector<unsigned char> scratch((size_t)3 * (src.width + width - 1) * bytesPerPixel);
+        for (int i = begin; i < end; i++)
+        {
+            const unsigned char *in = &src.pixels[(size_t)src.paddedWidth * i];
+            unsigned char *out = &temp[(size_t)rowBytes * i];
+            if (width == 1)
+            {
+                memcpy(out, in, rowBytes);
+            }
+            else
+            {
+                MorphologyRowPass<IS_MAX>(in, out, src.width, bytesPerPixel, width, anchorX, &scratch[0]);
+            }
+        }
+    });
+
+    pool.parallelFor(src.height, std::max(DEFAULT_ROWS_PER_TASK, height), [&](int begin, int end)
+    {
+        MorphologyColumnRows<IS_MAX>(&temp[0], rowBytes, src.height, height, anchorY, original, dst, begin, end);
+    });
+}
+
+//******************************************************************************************
+// @name                    : DoMorphology
+//
+// @description             : Erosion, dilation, opening or closing with a rectangular
+//                            structuring element, for example to remove specks from or fill
+//                            gaps in scanned documents. Channels are processed separately;
+//                            alpha is kept. Pixels outside the image do not count. The cost
+//                            per pixel is the same for any element size (van Herk/Gil-Werman).
+//
+// @param operation         : Operation
+// @param width             : Width of the element in pixels. Even sizes extend one pixel
+//                            more left than right.
+// @param height            : Height of the element in pixels. Even sizes extend one pixel
+//                            more up than down.
+//
+// @returns                 : 0 if SUCCESS
+//********************************************************************************************
+int BitmapImage::DoMorphology(morphology_operation_t operation, int width, int height)
+{
+    if (width < 1 || height < 1)
+    {
+        printf("ERROR: Invalid structuring element %dx%d!\n", width, height);
+        return -1;
+    }
+
+    pixel_buffer_t src = this->getOriginalPixelBuffer();
+    if (src.pixels == nullptr)
+    {
+        printf("ERROR: No image to process!\n");
+        return -1;
+    }
+
+    if (!IsSupportedPixelFormat(src.bitsPerPixel))
+    {
+        printf("ERROR: Morphology is not supported for %d bits per pixel!\n", src.bitsPerPixel);
+        return -1;
+    }
+
+    // A window this large covers the whole row (or column) from any pixel
+    width = std::min(width, 2 * src.width - 1);
+    height = std::min(height, 2 * src.height - 1);
+
+    this->allocateModifiedImageBuffer();
+    pixel_buffer_t dst = this->getModifiedPixelBuffer();
+    vector<unsigned char> temp((size_t)src.width * (src.bitsPerPixel / 8) * src.height);
+
+    switch (operation)
+    {
+    case MORPHOLOGY_ERODE:
+        ErodeOrDilate<false>(src, src, dst, temp, width, height);
+        break;
+    case MORPHOLOGY_DILATE:
+        ErodeOrDilate<true>(src, src, dst, temp, width, height);
+        break;
+    case MORPHOLOGY_OPEN:
+        ErodeOrDilate<false>(src, src, dst, temp, width, height);
+        ErodeOrDilate<true>(dst, src, dst, temp, width, height);
+        break;
+    case MORPHOLOGY_CLOSE:
+        ErodeOrDilate<true>(src, src, dst, temp, width, height);
+        ErodeOrDilate<false>(dst, src, dst, temp, width, height);
+        break;
+    default:
+        printf("ERROR: Invalid morphology operation %d!\n", operation);
+        return -1;
+    }
+
+    return 0;
+}
@@ -0,0 +1,254 @@
+#include"bmp.h"
+#include"pixel_kernels.h"
+#include"simd.h"
+#include"thread_pool.h"
+#include<algorithm>
+#include<string.h>
+
+//******************************************************************************************
+// @name                    : Div255
+//
+// @description             : This is a static function. x / 255, rounded, for x up to
+//                            255 * 255, without a division.
+//
+// @returns                 : Quotient
+//********************************************************************************************
+static inline int Div255(int x)
+{
+    x += 128;
+    return (x + (x >> 8)) >> 8;
+}
+
+//******************************************************************************************
+// @name                    : GrayFromRGB
+//
+// @description             : This is a static function. Weighted mean of the channels, with
+//                            the luma weights, so that gray stays the same gray.
+//
+// @returns                 : Gray level
+//********************************************************************************************
+static inline int GrayFromRGB(int red, int green, int blue)
+{
+    const int weights = LUMA_RED_WEIGHT + LUMA_GREEN_WEIGHT + LUMA_BLUE_WEIGHT;
+    return (LUMA_RED_WEIGHT * red + LUMA_GREEN_WEIGHT * green + LUMA_BLUE_WEIGHT * blue + weights / 2) / weights;
+}
+
+//******************************************************************************************
+// @name                    : BlendOverlayBytes
+//
+// @description             : This is a static function. dst = overlay + dst * (255 - alpha)
+//                            / 255, byte by byte, rounded exactly. The overlay is
+//                            premultiplied, so the result never exceeds 255.
+//
+// @returns                 : Nothing
+//********************************************************************************************
+static void BlendOverlayBytes(const unsigned char *overlay, const unsigned char *inverseAlpha, unsigned char *dst, int count)
+{
+    int j = 0;
+
+#ifdef USE_SSE2_KERNELS
+    const __m128i zero = _mm_setzero_si128();
+    const __m128i rounding = _mm_set1_epi16(128);
+
+    for (; j + 16 <= count; j += 16)
+    {
+        __m128i pixels = _mm_loadu_si128((const __m128i*)(dst + j));
+        __m128i inverse = _mm_loadu_si128((const __m128i*)(inverseAlpha + j));
+
+        __m128i low = _mm_add_epi16(_mm_mullo_epi16(_mm_unpacklo_epi8(pixels, zero), _mm_unpacklo_epi8(inverse, zero)), rounding);
+        __m128i high = _mm_add_epi16(_mm_mullo_epi16(_mm_unpackhi_epi8(pixels, zero), _mm_unpackhi_epi8(inverse, zero)), rounding);
+        low = _mm_srli_epi16(_mm_add_epi16(low, _mm_srli_epi16(low, 8)), 8);
+        high = _mm_srli_epi16(_mm_add_epi16(high, _mm_srli_epi16(high, 8)), 8);
+
+        __m128i blended = _mm_add_epi8(_mm_packus_epi16(low, high), _mm_loadu_si128((const __m128i*)(overlay + j)));
+        _mm_storeu_si128((__m128i*)(dst + j), blended);
+    }
+#endif
+
+    for (; j < count; j++)
+    {
+        dst[j] = (unsigned char)(overlay[j] + Div255(dst[j] * inverseAlpha[j]));
+    }
+}
+
+//******************************************************************************************
+// @name                    : prepareOverlay
+//
+// @description             : Premultiplies this image by its alpha and the opacity, in the
+//                            pixel layout of the images it will be drawn on, and keeps the
+//                            result, so that drawing it on a batch of images only blends.
+//                            A 32 bit image brings its own alpha, a 24 bit image is opaque,
+//                            and an 8 bit image is a mask: the alpha of maskColor. Called by
+//                            overlayImage(), which does nothing more when the overlay is
+//                            already prepared; call it first when drawing the overlay from
+//                            several threads.
+//
+// @param targetBitsPerPixel : Pixel format of the images the overlay is drawn on
+// @param opacity           : 0 (invisible) to 1
+// @param maskColor         : Color of an 8 bit mask
+//
+// @returns                 : 0 if SUCCESS
+//********************************************************************************************
+int BitmapImage::prepareOverlay(short targetBitsPerPixel, double opacity, pixel_value_rgb_t maskColor)
+{
+    int opacityLevel = (int)(std::min(std::max(opacity, 0.0), 1.0) * (MAX_COLORS - 1) + 0.5);
+    bool isMask = (m_bitmapInfoHeader->bitsPerPixel == BITS_8_PALLETIZED);
+
+    if (m_overlayBitsPerPixel == targetBitsPerPixel && m_overlayOpacity == opacityLevel &&
+        (!isMask || memcmp(&m_overlayMaskColor, &maskColor, sizeof(maskColor)) == 0))
+    {
+        return 0;
+    }
+
+    pixel_buffer_t image = this->getOriginalPixelBuffer();
+    if (image.pixels == nullptr)
+    {
+        printf("ERROR: No overlay image!\n");
+        return -1;
+    }
+
+    int targetBytesPerPixel = targetBitsPerPixel / 8;
+    if (targetBitsPerPixel != BITS_8_PALLETIZED && targetBitsPerPixel != BITS_24_RGB && targetBitsPerPixel != BITS_32_RGBA)
+    {
+        printf("ERROR: Overlays are not supported on %d bits per pixel!\n", targetBitsPerPixel);
+        return -1;
+    }
+
+    size_t rowBytes = (size_t)image.width * targetBytesPerPixel;
+    m_overlayPixels.resize(rowBytes * image.height);
+    m_overlayInverseAlpha.resize(rowBytes * image.height);
+
+    bool supported = DispatchPixelFormat(image.bitsPerPixel, [&](auto format)
+    {
+        typedef decltype(format) Format;
+        ThreadPool::getInstance().parallelFor(image.height, DEFAULT_ROWS_PER_TASK, [&](int begin, int end)
+        {
+            for (int i = begin; i < end; i++)
+            {
+                // The prepared overlay is top-down
+                const unsigned char *in = &image.pixels[(size_t)image.paddedWidth * (image.height - 1 - i)];
+                unsigned char *out = &m_overlayPixels[rowBytes * i];
+                unsigned char *inverse = &m_overlayInverseAlpha[rowBytes * i];
+
+                for (int j = 0; j < image.width; j++, in += Format::BYTES_PER_PIXEL)
+                {
+                    int alpha = MAX_COLORS - 1;
+                    int color[3] = { in[Format::BLUE_OFFSET], in[Format::GREEN_OFFSET], in[Format::RED_OFFSET] };
+                    if (Format::BYTES_PER_PIXEL == 4)
+                    {
+                        alpha = in[3];
+                    }
+                    else if (isMask)
+                    {
+                        alpha = in[0];
+                        color[0] = maskColor.blue;
+                        color[1] = maskColor.green;
+                        color[2] = maskColor.red;
+                    }
+                    alpha = Div255(alpha * opacityLevel);
+
+                    if (targetBytesPerPixel == 1)
+                    {
+                        *out++ = (unsigned char)Div255(GrayFromRGB(color[2], color[1], color[0]) * alpha);
+                        *inverse++ = (unsigned char)(MAX_COLORS - 1 - alpha);
+                        continue;
+                    }
+
+                    for (int c = 0; c < 3; c++)
+                    {
+                        *out++ = (unsigned char)Div255(color[c] * alpha);
+                        *inverse++ = (unsigned char)(MAX_COLORS - 1 - alpha);
+                    }
+
+                    // Alpha of the image drawn on is kept: 0 + alpha * 255 / 255
+                    if (targetBytesPerPixel == 4)
+                    {
+                        *out++ = 0;
+                        *inverse++ = MAX_COLORS - 1;
+                    }
+                }
+            }
+        });
+    });
+
+    if (!supported)
+    {
+        printf("ERROR: Overlays of %d bits per pixel are not supported!\n", image.bitsPerPixel);
+        m_overlayBitsPerPixel = 0;
+        return -1;
+    }
+
+    m_overlayBitsPerPixel = targetBitsPerPixel;
+    m_overlayOpacity = opacityLevel;
+    m_overlayMaskColor = maskColor;
+
+    return 0;
+}
+
+//******************************************************************************************
+// @name                    : overlayImage
+//
+// @description             : Draws another image over the modified image (a copy of the
+//                            original if there is none yet), for example a watermark. Only
+//                            the rows under the overlay are touched, and an overlay partly
+//                            outside the image is clipped. The overlay keeps its prepared
+//                            premultiplied pixels, so a batch of images drawing the same
+//                            overlay prepares it once.
+//
+// @param overlay           : Image drawn: 32 bit with alpha, 24 bit opaque or an 8 bit mask
+// @param x                 : Column of the left of the overlay
+// @param y                 : Row of the top of the overlay, counted from the top of the image
+// @param opacity           : 0 (invisible) to 1
+// @param maskColor         : Color of an 8 bit mask
+//
+// @returns                 : 0 if SUCCESS
+//********************************************************************************************
+int BitmapImage::overlayImage(BitmapImage &overlay, int x, int y, double opacity, pixel_value_rgb_t maskColor)
+{
+    if (m_modifiedBitmapImageChar == nullptr)
+    {
+        this->allocateModifiedImageBuffer();
+    }
+
+    pixel_buffer_t image = this->getModifiedPixelBuffer();
+    if (overlay.prepareOverlay(image.bitsPerPixel, opacity, maskColor) != 0)
+    {
+        return -1;
+    }
+
+    int overlayWidth = overlay.m_bitmapInfoHeader->width;
+    int overlayHeight = overlay.m_bitmapInfoHeader->height;
+    int bytesPerPixel = image.bitsPerPixel / 8;
+
+    int left = std::max(x, 0);
+    int right = std::min(x + overlayWidth, image.width);
+    int top = std::max(y, 0);
+    int bottom = std::min(y + overlayHeight, image.height);
+    if (left >= right || top >= bottom)
+    {
+        return 0;
+    }
+
+    size_t overlayRowBytes = (size_t)overlayWidth * bytesPerPixel;
+    size_t overlayOffset = (size_t)(left - x) * bytesPerPixel;
+    int count = (right - left) * bytesPerPixel;
+
+    ThreadPool::getInstance().parallelFor(bottom - top, DEFAULT_ROWS_PER_TASK, [&](int begin, int end)
+    {
+        for (int i = begin; i < end; i++)
+        {
+            // Rows counted from the top; the image is bottom-up, the prepared overlay top-down
+            int row = top + i;
+            size_t overlayIndex = overlayRowBytes * (row - y) + overlayOffset;
+
+            BlendOverlayBytes(&overlay.m_overlayPixels[overlayIndex], &overlay.m_overlayInverseAlpha[overlayIndex],
+                              &image.pixels[(size_t)image.paddedWidth * (image.height - 1 - row) + (size_t)left * bytesPerPixel],
+                              count);
+        }
+    });
+
+    // The modified image is no longer the result of the last operation alone
+    m_lastOperation = OPERATION_NONE;
+
+    return 0;
+}
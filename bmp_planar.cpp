@@ -0,0 +1,193 @@
+#include"bmp.h"
+#include"pixel_kernels.h"
+#include"thread_pool.h"
+#include<string.h>
+
+//******************************************************************************************
+// @name                    : getPlanarImageSize
+//
+// @description             : Bytes of a planar YCbCr image. Chroma planes of 4:2:0 layouts
+//                            round odd sizes up.
+//
+// @returns                 : Size in bytes
+//********************************************************************************************
+size_t BitmapImage::getPlanarImageSize(planar_format_t format, int width, int height)
+{
+    size_t lumaSize = (size_t)width * height;
+    if (format == PLANAR_YUV444)
+    {
+        return lumaSize * 3;
+    }
+
+    return lumaSize + (size_t)((width + 1) / 2) * ((height + 1) / 2) * 2;
+}
+
+//******************************************************************************************
+// @name                    : getPlanarImageData
+//
+// @description             : Converts the image to planar YCbCr in a caller's buffer: I420,
+//                            NV12 or 4:4:4, rows top-down, as video encoders and ML
+//                            pipelines take them. Y is the brightness the histograms use;
+//                            Cb and Cr are fixed point versions of convertToYCbCr(). The
+//                            conversion and the 2x2 chroma averaging are done together, in
+//                            bands of rows on the thread pool. A modified image written
+//                            top-down is converted as it is displayed.
+//
+// @param buffer            : getPlanarImageSize() bytes
+// @param modified          : Convert the modified image rather than the original one
+//
+// @returns                 : 0 if SUCCESS
+//********************************************************************************************
+int BitmapImage::getPlanarImageData(planar_format_t format, unsigned char *buffer, size_t bufferSize, bool modified)
+{
+    pixel_buffer_t image = modified ? this->getModifiedPixelBuffer() : this->getOriginalPixelBuffer();
+    if (image.pixels == nullptr)
+    {
+        printf("ERROR: No %s image to convert!\n", modified ? "modified" : "loaded");
+        return -1;
+    }
+
+    if (buffer == nullptr || bufferSize < getPlanarImageSize(format, image.width, image.height))
+    {
+        printf("ERROR: Planar buffer too small for a %dx%d image!\n", image.width, image.height);
+        return -1;
+    }
+
+    // A modified image written top-down has its rows top-down in memory. The kernels take
+    // rows bottom-up, so they convert a copy in that order.
+    vector<unsigned char> bottomUpRows;
+    if (modified && m_modifiedTopDown)
+    {
+        bottomUpRows.resize((size_t)image.paddedWidth * image.height);
+        for (int i = 0; i < image.height; i++)
+        {
+            memcpy(&bottomUpRows[(size_t)image.paddedWidth * i],
+                   &image.pixels[(size_t)image.paddedWidth * (image.height - 1 - i)], image.paddedWidth);
+        }
+        image.pixels = &bottomUpRows[0];
+    }
+
+    ycbcr_planes_t planes;
+    planes.y = buffer;
+    planes.yStride = image.width;
+
+    int chromaRows = image.height;
+    if (format == PLANAR_YUV444)
+    {
+        planes.chromaStride = image.width;
+        planes.chromaStep = 1;
+        planes.cb = planes.y + (size_t)image.width * image.height;
+        planes.cr = planes.cb + (size_t)image.width * image.height;
+    }
+    else
+    {
+        int chromaWidth = (image.width + 1) / 2;
+        chromaRows = (image.height + 1) / 2;
+        planes.cb = planes.y + (size_t)image.width * image.height;
+
+        if (format == PLANAR_NV12)
+        {
+            planes.chromaStride = chromaWidth * 2;
+            planes.chromaStep = 2;
+            planes.cr = planes.cb + 1;
+        }
+        else
+        {
+            planes.chromaStride = chromaWidth;
+            planes.chromaStep = 1;
+            planes.cr = planes.cb + (size_t)chromaWidth * chromaRows;
+        }
+    }
+
+    bool supported = DispatchPixelFormat(image.bitsPerPixel, [&](auto pixelFormat)
+    {
+        typedef decltype(pixelFormat) Format;
+        int rowsPerTask = (format == PLANAR_YUV444) ? DEFAULT_ROWS_PER_TASK : DEFAULT_ROWS_PER_TASK / 2;
+
+        ThreadPool::getInstance().parallelFor(chromaRows, rowsPerTask, [&](int begin, int end)
+        {
+            if (format == PLANAR_YUV444)
+            {
+                YCbCr444Rows<Format>(image, planes, begin, end);
+            }
+            else
+            {
+                YCbCr420Rows<Format>(image, planes, begin, end);
+            }
+        });
+    });
+
+    if (!supported)
+    {
+        printf("ERROR: Planar export is not supported for %d bits per pixel!\n", image.bitsPerPixel);
+        return -1;
+    }
+
+    return 0;
+}
+
+//******************************************************************************************
+// @name                    : getPlanarImageData
+//
+// @description             : Converts the image to planar YCbCr in memory
+//
+// @param planes            : Planes on return
+// @param modified          : Convert the modified image rather than the original one
+//
+// @returns                 : 0 if SUCCESS
+//********************************************************************************************
+int BitmapImage::getPlanarImageData(planar_format_t format, vector<unsigned char> &planes, bool modified)
+{
+    pixel_buffer_t image = modified ? this->getModifiedPixelBuffer() : this->getOriginalPixelBuffer();
+    planes.resize(getPlanarImageSize(format, image.width, image.height));
+    if (planes.empty())
+    {
+        return this->getPlanarImageData(format, nullptr, 0, modified);
+    }
+
+    return this->getPlanarImageData(format, &planes[0], planes.size(), modified);
+}
+
+//******************************************************************************************
+// @name                    : writePlanarImageToFile
+//
+// @description             : Writes the image as a raw planar YCbCr file, with no header:
+//                            readers need the width, height and format
+//
+// @param outputFilePath    : Path of file
+// @param modified          : Convert the modified image rather than the original one
+//
+// @returns                 : 0 if SUCCESS
+//********************************************************************************************
+int BitmapImage::writePlanarImageToFile(const char *outputFilePath, planar_format_t format, bool modified)
+{
+    if (!outputFilePath)
+    {
+        printf("Output file path not specified!\n");
+        return -1;
+    }
+
+    vector<unsigned char> planes;
+    if (this->getPlanarImageData(format, planes, modified) != 0)
+    {
+        return -1;
+    }
+
+    FILE *outfile = fopen(outputFilePath, "wb");
+    if (outfile == nullptr)
+    {
+        printf("Cannot create file [%s]\n", outputFilePath);
+        return -1;
+    }
+
+    size_t written = fwrite(&planes[0], sizeof(unsigned char), planes.size(), outfile);
+    fclose(outfile);
+
+    if (written != planes.size())
+    {
+        printf("ERROR: Planar image write error!\n");
+        return -1;
+    }
+
+    return 0;
+}
@@ -0,0 +1,602 @@
+#include"bmp.h"
+#include"error_diffusion.h"
+#include"pixel_kernels.h"
+#include"thread_pool.h"
+#include<algorithm>
+#include<atomic>
+#include<iterator>
+#include<limits.h>
+#include<mutex>
+#include<string.h>
+
+const int HISTOGRAM_SIDE = 1 << QUANTIZE_HISTOGRAM_BITS;
+const int HISTOGRAM_SHIFT = 8 - QUANTIZE_HISTOGRAM_BITS;
+const int INVERSE_SIDE = 1 << QUANTIZE_INVERSE_BITS;
+const int INVERSE_SHIFT = 8 - QUANTIZE_INVERSE_BITS;
+
+// Pixels of one cell of the color histogram, with their sums per channel (indexed by color_t)
+typedef struct quantize_cell_tag
+{
+    unsigned long long count;
+    unsigned long long sum[3];
+}quantize_cell_t;
+
+// Box of histogram cells, inclusive bounds indexed by color_t, shrunk to the cells holding pixels
+typedef struct quantize_box_tag
+{
+    int low[3];
+    int high[3];
+    unsigned long long count;
+    unsigned long long sum[3];
+    double channelError[3];             // Squared error of the channel if the box were one color
+    double error;
+}quantize_box_t;
+
+//******************************************************************************************
+// @name                    : HistogramCell
+//
+// @description             : This is a static function. Index of the histogram cell of a color
+//
+// @returns                 : Index
+//********************************************************************************************
+static inline int HistogramCell(int red, int green, int blue)
+{
+    return ((red * HISTOGRAM_SIDE + green) * HISTOGRAM_SIDE) + blue;
+}
+
+//******************************************************************************************
+// @name                    : InverseCell
+//
+// @description             : This is a static function. Index of the inverse color cube cell
+//                            of a color
+//
+// @returns                 : Index
+//********************************************************************************************
+static inline int InverseCell(int red, int green, int blue)
+{
+    return (((red >> INVERSE_SHIFT) * INVERSE_SIDE + (green >> INVERSE_SHIFT)) * INVERSE_SIDE) + (blue >> INVERSE_SHIFT);
+}
+
+//******************************************************************************************
+// @name                    : CountColorRows
+//
+// @description             : This is a static function. Adds rows begin to end of an image to
+//                            a color histogram.
+//
+// @param cells             : HISTOGRAM_SIDE^3 cells
+//
+// @returns                 : Nothing
+//********************************************************************************************
+template<typename Format>
+static void CountColorRows(const pixel_buffer_t &image, int begin, int end, quantize_cell_t *cells)
+{
+    for (int i = begin; i < end; i++)
+    {
+        const unsigned char *p = &image.pixels[(size_t)image.paddedWidth * i];
+        for (int j = 0; j < image.width; j++, p += Format::BYTES_PER_PIXEL)
+        {
+            int red = p[Format::RED_OFFSET];
+            int green = p[Format::GREEN_OFFSET];
+            int blue = p[Format::BLUE_OFFSET];
+            quantize_cell_t &cell = cells[HistogramCell(red >> HISTOGRAM_SHIFT, green >> HISTOGRAM_SHIFT, blue >> HISTOGRAM_SHIFT)];
+
+            cell.count++;
+            cell.sum[RED] += red;
+            cell.sum[GREEN] += green;
+            cell.sum[BLUE] += blue;
+        }
+    }
+}
+
+//******************************************************************************************
+// @name                    : CollectExactColors
+//
+// @description             : This is a static function. Distinct colors (0xRRGGBB) of rows
+//                            begin to end, sorted, as long as there are at most limit of them.
+//                            Stops early once another band has found more.
+//
+// @returns                 : false if there are more than limit colors
+//********************************************************************************************
+template<typename Format>
+static bool CollectExactColors(const pixel_buffer_t &image, int begin, int end, int limit,
+                               const std::atomic<bool> &tooMany, vector<unsigned int> &colors)
+{
+    unsigned int last = 0xFFFFFFFF;
+
+    for (int i = begin; i < end && !tooMany; i++)
+    {
+        const unsigned char *p = &image.pixels[(size_t)image.paddedWidth * i];
+        for (int j = 0; j < image.width; j++, p += Format::BYTES_PER_PIXEL)
+        {
+            unsigned int color = ((unsigned int)p[Format::RED_OFFSET] << 16) |
+                                 ((unsigned int)p[Format::GREEN_OFFSET] << 8) | p[Format::BLUE_OFFSET];
+            if (color == last)
+            {
+                continue;
+            }
+            last = color;
+
+            vector<unsigned int>::iterator position = std::lower_bound(colors.begin(), colors.end(), color);
+            if (position == colors.end() || *position != color)
+            {
+                if ((int)colors.size() == limit)
+                {
+                    return false;
+                }
+                colors.insert(position, color);
+            }
+        }
+    }
+
+    return !tooMany;
+}
+
+//******************************************************************************************
+// @name                    : ShrinkBox
+//
+// @description             : This is a static function. Shrinks a box to the cells holding
+//                            pixels and works out its count, sums and errors
+//
+// @returns                 : Nothing
+//********************************************************************************************
+static void ShrinkBox(quantize_box_t &box, const vector<quantize_cell_t> &cells)
+{
+    int low[3] = { HISTOGRAM_SIDE, HISTOGRAM_SIDE, HISTOGRAM_SIDE };
+    int high[3] = { -1, -1, -1 };
+    double squares[3] = { 0.0, 0.0, 0.0 };
+
+    box.count = 0;
+    memset(box.sum, 0, sizeof(box.sum));
+
+    for (int r = box.low[RED]; r <= box.high[RED]; r++)
+    {
+        for (int g = box.low[GREEN]; g <= box.high[GREEN]; g++)
+        {
+            const quantize_cell_t *cell = &cells[HistogramCell(r, g, box.low[BLUE])];
+            for (int b = box.low[BLUE]; b <= box.high[BLUE]; b++, cell++)
+            {
+                if (cell->count == 0)
+                {
+                    continue;
+                }
+
+                int index[3] = { r, g, b };
+                for (int c = RED; c <= BLUE; c++)
+                {
+                    low[c] = std::min(low[c], index[c]);
+                    high[c] = std::max(high[c], index[c]);
+                    box.sum[c] += cell->sum[c];
+
+                    // Pixels of a cell count as its mean color
+                    squares[c] += (double)cell->sum[c] * cell->sum[c] / cell->count;
+                }
+                box.count += cell->count;
+            }
+        }
+    }
+
+    box.error = 0.0;
+    for (int c = RED; c <= BLUE; c++)
+    {
+        box.low[c] = low[c];
+        box.high[c] = high[c];
+        box.channelError[c] = (box.count > 0) ? squares[c] - (double)box.sum[c] * box.sum[c] / box.count : 0.0;
+        box.error += box.channelError[c];
+    }
+}
+
+//******************************************************************************************
+// @name                    : SplitBox
+//
+// @description             : This is a static function. Cuts a box in two across the channel
+//                            with the largest error, at the median pixel
+//
+// @param second            : The upper part on return; box keeps the lower part
+//
+// @returns                 : Nothing
+//********************************************************************************************
+static void SplitBox(quantize_box_t &box, quantize_box_t &second, const vector<quantize_cell_t> &cells)
+{
+    int axis = -1;
+    for (int c = RED; c <= BLUE; c++)
+    {
+        if (box.high[c] > box.low[c] && (axis < 0 || box.channelError[c] > box.channelError[axis]))
+        {
+            axis = c;
+        }
+    }
+
+    // Pixels of every slice of the box across the axis
+    vector<unsigned long long> slices(HISTOGRAM_SIDE, 0);
+    for (int r = box.low[RED]; r <= box.high[RED]; r++)
+    {
+        for (int g = box.low[GREEN]; g <= box.high[GREEN]; g++)
+        {
+            for (int b = box.low[BLUE]; b <= box.high[BLUE]; b++)
+            {
+                int index[3] = { r, g, b };
+                slices[index[axis]] += cells[HistogramCell(r, g, b)].count;
+            }
+        }
+    }
+
+    // The box is shrunk, so both ends hold pixels and the cut leaves neither part empty
+    int cut = box.low[axis];
+    unsigned long long below = slices[cut];
+    while (cut + 1 < box.high[axis] && below * 2 < box.count)
+    {
+        cut++;
+        below += slices[cut];
+    }
+
+    second = box;
+    box.high[axis] = cut;
+    second.low[axis] = cut + 1;
+    ShrinkBox(box, cells);
+    ShrinkBox(second, cells);
+}
+
+//******************************************************************************************
+// @name                    : MedianCutPalette
+//
+// @description             : This is a static function. Median cut: starting from a box of
+//                            all the colors, splits the box with the largest squared error
+//                            until there are colorCount boxes, or every box is one cell. The
+//                            palette is the mean color of every box.
+//
+// @param palette           : 0xRRGGBB entries on return
+//
+// @returns                 : Nothing
+//********************************************************************************************
+static void MedianCutPalette(const vector<quantize_cell_t> &cells, int colorCount, vector<unsigned int> &palette)
+{
+    vector<quantize_box_t> boxes(1);
+    for (int c = RED; c <= BLUE; c++)
+    {
+        boxes[0].low[c] = 0;
+        boxes[0].high[c] = HISTOGRAM_SIDE - 1;
+    }
+    ShrinkBox(boxes[0], cells);
+
+    while ((int)boxes.size() < colorCount)
+    {
+        int largest = -1;
+        for (int k = 0; k < (int)boxes.size(); k++)
+        {
+            const quantize_box_t &box = boxes[k];
+            bool oneCell = box.low[RED] == box.high[RED] && box.low[GREEN] == box.high[GREEN] && box.low[BLUE] == box.high[BLUE];
+            if (!oneCell && (largest < 0 || box.error > boxes[largest].error))
+            {
+                largest = k;
+            }
+        }
+
+        if (largest < 0)
+        {
+            break;
+        }
+
+        quantize_box_t second;
+        SplitBox(boxes[largest], second, cells);
+        boxes.push_back(second);
+    }
+
+    palette.clear();
+    for (size_t k = 0; k < boxes.size(); k++)
+    {
+        unsigned int color = 0;
+        for (int c = RED; c <= BLUE; c++)
+        {
+            unsigned long long mean = (boxes[k].sum[c] + boxes[k].count / 2) / boxes[k].count;
+            color = (color << 8) | (unsigned int)mean;
+        }
+        palette.push_back(color);
+    }
+}
+
+//******************************************************************************************
+// @name                    : BuildInverseColorCube
+//
+// @description             : This is a static function. Nearest palette entry to the center
+//                            of every cell of the inverse color cube, so that mapping a pixel
+//                            is one lookup instead of a search of the palette
+//
+// @param cube              : INVERSE_SIDE^3 palette indices on return
+//
+// @returns                 : Nothing
+//********************************************************************************************
+static void BuildInverseColorCube(const vector<unsigned int> &palette, vector<unsigned char> &cube)
+{
+    cube.resize((size_t)INVERSE_SIDE * INVERSE_SIDE * INVERSE_SIDE);
+    int count = (int)palette.size();
+    const int half = (1 << INVERSE_SHIFT) / 2;
+
+    ThreadPool::getInstance().parallelFor(INVERSE_SIDE, 1, [&](int begin, int end)
+    {
+        for (int r = begin; r < end; r++)
+        {
+            int red = (r << INVERSE_SHIFT) + half;
+            unsigned char *out = &cube[(size_t)r * INVERSE_SIDE * INVERSE_SIDE];
+
+            for (int g = 0; g < INVERSE_SIDE; g++)
+            {
+                int green = (g << INVERSE_SHIFT) + half;
+                for (int b = 0; b < INVERSE_SIDE; b++)
+                {
+                    int blue = (b << INVERSE_SHIFT) + half;
+                    int best = 0;
+                    int bestDistance = INT_MAX;
+
+                    for (int k = 0; k < count; k++)
+                    {
+                        int dr = red - (int)(palette[k] >> 16);
+                        int distance = dr * dr;
+                        if (distance >= bestDistance)
+                        {
+                            continue;
+                        }
+                        int dg = green - (int)((palette[k] >> 8) & 0xFF);
+                        int db = blue - (int)(palette[k] & 0xFF);
+                        distance += dg * dg + db * db;
+                        if (distance < bestDistance)
+                        {
+                            bestDistance = distance;
+                            best = k;
+                        }
+                    }
+                    *out++ = (unsigned char)best;
+                }
+            }
+        }
+    });
+}
+
+//******************************************************************************************
+// @name                    : MapCubeRows
+//
+// @description             : This is a static function. Palette index of every pixel of rows
+//                            begin to end, from the inverse color cube
+//
+// @returns                 : Nothing
+//********************************************************************************************
+template<typename Format>
+static void MapCubeRows(const pixel_buffer_t &src, pixel_buffer_t &dst, const unsigned char *cube, int begin, int end)
+{
+    for (int i = begin; i < end; i++)
+    {
+        const unsigned char *p = &src.pixels[(size_t)src.paddedWidth * i];
+        unsigned char *out = &dst.pixels[(size_t)dst.paddedWidth * i];
+        for (int j = 0; j < src.width; j++, p += Format::BYTES_PER_PIXEL)
+        {
+            out[j] = cube[InverseCell(p[Format::RED_OFFSET], p[Format::GREEN_OFFSET], p[Format::BLUE_OFFSET])];
+        }
+    }
+}
+
+//******************************************************************************************
+// @name                    : MapExactRows
+//
+// @description             : This is a static function. Palette index of every pixel of rows
+//                            begin to end, when the palette holds every color of the image
+//
+// @param palette           : Sorted 0xRRGGBB entries
+//
+// @returns                 : Nothing
+//********************************************************************************************
+template<typename Format>
+static void MapExactRows(const pixel_buffer_t &src, pixel_buffer_t &dst, const vector<unsigned int> &palette, int begin, int end)
+{
+    unsigned int last = 0xFFFFFFFF;
+    unsigned char lastIndex = 0;
+
+    for (int i = begin; i < end; i++)
+    {
+        const unsigned char *p = &src.pixels[(size_t)src.paddedWidth * i];
+        unsigned char *out = &dst.pixels[(size_t)dst.paddedWidth * i];
+        for (int j = 0; j < src.width; j++, p += Format::BYTES_PER_PIXEL)
+        {
+            unsigned int color = ((unsigned int)p[Format::RED_OFFSET] << 16) |
+                                 ((unsigned int)p[Format::GREEN_OFFSET] << 8) | p[Format::BLUE_OFFSET];
+            if (color != last)
+            {
+                last = color;
+                lastIndex = (unsigned char)(std::lower_bound(palette.begin(), palette.end(), color) - palette.begin());
+            }
+            out[j] = lastIndex;
+        }
+    }
+}
+
+//******************************************************************************************
+// @name                    : DiffuseQuantizeErrors
+//
+// @description             : This is a static function. Floyd-Steinberg error diffusion: the
+//                            difference between a pixel and its palette color is spread over
+//                            the pixels right of and below it, top row first. Rows run as a
+//                            wavefront on all the pool threads (see error_diffusion.h).
+//
+// @returns                 : Nothing
+//********************************************************************************************
+template<typename Format>
+static void DiffuseQuantizeErrors(const pixel_buffer_t &src, pixel_buffer_t &dst, const vector<unsigned int> &palette,
+                                  const unsigned char *cube)
+{
+    // Rows are bottom-up
+    DiffuseErrors<3, FloydSteinbergKernel>(src.width, src.height, [&](int t)
+    {
+        const unsigned char *in = &src.pixels[(size_t)src.paddedWidth * (src.height - 1 - t)];
+        unsigned char *out = &dst.pixels[(size_t)dst.paddedWidth * (src.height - 1 - t)];
+        const unsigned int *colors = &palette[0];
+
+        return [=](int j, const int *adjust, int *difference)
+        {
+            const unsigned char *p = in + (size_t)j * Format::BYTES_PER_PIXEL;
+            int red = std::min(std::max(p[Format::RED_OFFSET] + adjust[RED], 0), MAX_COLORS - 1);
+            int green = std::min(std::max(p[Format::GREEN_OFFSET] + adjust[GREEN], 0), MAX_COLORS - 1);
+            int blue = std::min(std::max(p[Format::BLUE_OFFSET] + adjust[BLUE], 0), MAX_COLORS - 1);
+
+            unsigned char index = cube[InverseCell(red, green, blue)];
+            out[j] = index;
+
+            unsigned int color = colors[index];
+            difference[RED] = red - (int)(color >> 16);
+            difference[GREEN] = green - (int)((color >> 8) & 0xFF);
+            difference[BLUE] = blue - (int)(color & 0xFF);
+        };
+    });
+}
+
+//******************************************************************************************
+// @name                    : QuantizeImage
+//
+// @description             : Makes an 8 bit palettized modified image of at most colorCount
+//                            colors, for example to store images of few colors in a third
+//                            of the space. An image with no more colors than that keeps them
+//                            exactly. Otherwise the palette comes from a median cut of a
+//                            color histogram, and pixels are mapped to it through an inverse
+//                            color cube. Alpha is dropped.
+//
+// @param colorCount        : Largest palette size, 2 to 256
+// @param dither            : Diffuse the error of every pixel over its neighbours
+//                            (Floyd-Steinberg), which hides banding in gradients
+//
+// @returns                 : 0 if SUCCESS
+//********************************************************************************************
+int BitmapImage::QuantizeImage(int colorCount, bool dither)
+{
+    if (colorCount < 2 || colorCount > MAX_COLORS)
+    {
+        printf("ERROR: Invalid palette size %d!\n", colorCount);
+        return -1;
+    }
+
+    pixel_buffer_t src = this->getOriginalPixelBuffer();
+    if (src.pixels == nullptr)
+    {
+        printf("ERROR: No image to quantize!\n");
+        return -1;
+    }
+
+    if (!IsSupportedPixelFormat(src.bitsPerPixel))
+    {
+        printf("ERROR: Quantization is not supported for %d bits per pixel!\n", src.bitsPerPixel);
+        return -1;
+    }
+
+    ThreadPool &pool = ThreadPool::getInstance();
+    vector<unsigned int> palette;
+    vector<unsigned char> cube;
+    std::atomic<bool> tooMany(false);
+    mutex colorsMutex;
+
+    // Images of few colors are common (drawings, screenshots, charts); a photograph stops this
+    // within a few hundred pixels
+    DispatchPixelFormat(src.bitsPerPixel, [&](auto format)
+    {
+        typedef decltype(format) Format;
+        pool.parallelFor(src.height, DEFAULT_ROWS_PER_TASK, [&](int begin, int end)
+        {
+            vector<unsigned int> bandColors;
+            if (!CollectExactColors<Format>(src, begin, end, colorCount, tooMany, bandColors))
+            {
+                tooMany = true;
+                return;
+            }
+
+            lock_guard<mutex> lock(colorsMutex);
+            vector<unsigned int> merged;
+            std::set_union(palette.begin(), palette.end(), bandColors.begin(), bandColors.end(), std::back_inserter(merged));
+            palette.swap(merged);
+            if ((int)palette.size() > colorCount)
+            {
+                tooMany = true;
+            }
+        });
+    });
+
+    bool exact = !tooMany;
+    if (!exact)
+    {
+        // A histogram is 1 MiB, so there is one per band and one band per thread at most. A
+        // band takes the rows of all the partials it is given, so a job run inline counts
+        // into one.
+        size_t cellCount = (size_t)HISTOGRAM_SIDE * HISTOGRAM_SIDE * HISTOGRAM_SIDE;
+        int partialCount = std::min(pool.getThreadCount(), (src.height + DEFAULT_ROWS_PER_TASK - 1) / DEFAULT_ROWS_PER_TASK);
+        vector<vector<quantize_cell_t> > partials(partialCount);
+
+        DispatchPixelFormat(src.bitsPerPixel, [&](auto format)
+        {
+            typedef decltype(format) Format;
+            pool.parallelFor(partialCount, 1, [&](int begin, int end)
+            {
+                partials[begin].resize(cellCount);
+                CountColorRows<Format>(src, (int)((long long)src.height * begin / partialCount),
+                                       (int)((long long)src.height * end / partialCount), &partials[begin][0]);
+            });
+        });
+
+        // One reduction into the first partial, its cells split over the threads
+        vector<quantize_cell_t> &cells = partials[0];
+        pool.parallelFor((int)cellCount, HISTOGRAM_SIDE * HISTOGRAM_SIDE, [&](int begin, int end)
+        {
+            for (int p = 1; p < partialCount; p++)
+            {
+                if (partials[p].empty())
+                {
+                    continue;
+                }
+
+                for (int k = begin; k < end; k++)
+                {
+                    cells[k].count += partials[p][k].count;
+                    for (int c = RED; c <= BLUE; c++)
+                    {
+                        cells[k].sum[c] += partials[p][k].sum[c];
+                    }
+                }
+            }
+        });
+
+        MedianCutPalette(cells, colorCount, palette);
+        BuildInverseColorCube(palette, cube);
+    }
+
+    if (this->allocateModifiedImageBuffer(src.width, src.height, BITS_8_PALLETIZED) != 0)
+    {
+        return -1;
+    }
+    pixel_buffer_t dst = this->getModifiedPixelBuffer();
+
+    m_modifiedColorTable.assign(palette.size() * 4, 0);
+    for (size_t k = 0; k < palette.size(); k++)
+    {
+        m_modifiedColorTable[k * 4] = (unsigned char)(palette[k] & 0xFF);
+        m_modifiedColorTable[k * 4 + 1] = (unsigned char)((palette[k] >> 8) & 0xFF);
+        m_modifiedColorTable[k * 4 + 2] = (unsigned char)(palette[k] >> 16);
+    }
+
+    DispatchPixelFormat(src.bitsPerPixel, [&](auto format)
+    {
+        typedef decltype(format) Format;
+        if (exact)
+        {
+            pool.parallelFor(src.height, DEFAULT_ROWS_PER_TASK, [&](int begin, int end)
+            {
+                MapExactRows<Format>(src, dst, palette, begin, end);
+            });
+        }
+        else if (dither)
+        {
+            DiffuseQuantizeErrors<Format>(src, dst, palette, &cube[0]);
+        }
+        else
+        {
+            pool.parallelFor(src.height, DEFAULT_ROWS_PER_TASK, [&](int begin, int end)
+            {
+                MapCubeRows<Format>(src, dst, &cube[0], begin, end);
+            });
+        }
+    });
+
+    return 0;
+}
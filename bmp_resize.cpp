@@ -0,0 +1,301 @@
+#include"bmp.h"
+#include"kernel_registry.h"
+#include"thread_pool.h"
+#include<math.h>
+#include<stdint.h>
+#include<string.h>
+
+const double PI = 3.14159265358979323846;
+
+//******************************************************************************************
+// @name                    : Sinc
+//
+// @description             : This is a static function. Normalized sinc function
+//
+// @returns                 : sin(pi * x) / (pi * x)
+//********************************************************************************************
+static double Sinc(double x)
+{
+    if (x == 0.0)
+    {
+        return 1.0;
+    }
+
+    x *= PI;
+    return sin(x) / x;
+}
+
+//******************************************************************************************
+// @name                    : FilterValue
+//
+// @description             : This is a static function. Evaluates the resize filter.
+//
+// @param filter            : Bilinear or Lanczos
+// @param x                 : Distance from the filter center, in filter units
+//
+// @returns                 : Filter weight
+//********************************************************************************************
+static double FilterValue(resize_filter_t filter, double x)
+{
+    x = fabs(x);
+    if (filter == RESIZE_LANCZOS)
+    {
+        return (x < LANCZOS_SUPPORT) ? Sinc(x) * Sinc(x / LANCZOS_SUPPORT) : 0.0;
+    }
+
+    return (x < BILINEAR_SUPPORT) ? 1.0 - x : 0.0;
+}
+
+//******************************************************************************************
+// @name                    : ComputeResizeWeights
+//
+// @description             : This is a static function. Precomputes, for every output pixel
+//                            along one axis, the contributing source pixels and their fixed
+//                            point weights. Weights of every output pixel sum to exactly
+//                            1 << RESIZE_WEIGHT_BITS so that flat areas stay flat.
+//
+// @param srcSize           : Number of source pixels along the axis
+// @param dstSize           : Number of output pixels along the axis
+// @param filter            : Resize filter
+// @param resizeWeights     : Filled with the contributions and weights
+//
+// @returns                 : Nothing
+//********************************************************************************************
+static void ComputeResizeWeights(int srcSize, int dstSize, resize_filter_t filter, resize_weights_t *resizeWeights)
+{
+    double scale = (double)srcSize / dstSize;
+    double filterScale = (scale > 1.0) ? scale : 1.0;
+    double support = 0.0;
+
+    if (filter == RESIZE_AREA_AVERAGE)
+    {
+        support = scale / 2 + 1;
+    }
+    else if (filter == RESIZE_LANCZOS)
+    {
+        support = LANCZOS_SUPPORT * filterScale;
+    }
+    else
+    {
+        support = BILINEAR_SUPPORT * filterScale;
+    }
+
+    int maxTaps = (int)ceil(support) * 2 + 3;
+    vector<double> weights(maxTaps);
+
+    resizeWeights->maxTaps = maxTaps;
+    resizeWeights->contributions.resize(dstSize);
+    resizeWeights->weights.assign((size_t)dstSize * maxTaps, 0);
+
+    for (int i = 0; i < dstSize; i++)
+    {
+        double center = (i + 0.5) * scale;
+        int first = (int)floor(center - support);
+        int last = (int)ceil(center + support);
+        if (first < 0)
+            first = 0;
+
+        if (last > srcSize - 1)
+            last = srcSize - 1;
+
+        if (last - first + 1 > maxTaps)
+            last = first + maxTaps - 1;
+
+        double total = 0.0;
+        for (int k = first; k <= last; k++)
+        {
+            double weight = 0.0;
+            if (filter == RESIZE_AREA_AVERAGE)
+            {
+                // Overlap of source pixel [k, k+1) with the output footprint
+                double start = i * scale;
+                double end = (i + 1) * scale;
+                double overlapStart = (k > start) ? k : start;
+                double overlapEnd = (k + 1 < end) ? k + 1 : end;
+                weight = (overlapEnd > overlapStart) ? overlapEnd - overlapStart : 0.0;
+            }
+            else
+            {
+                weight = FilterValue(filter, (k + 0.5 - center) / filterScale);
+            }
+
+            weights[k - first] = weight;
+            total += weight;
+        }
+
+        // Drop zero weights at both ends
+        int begin = 0;
+        int end = last - first;
+        while (begin < end && weights[begin] == 0.0)
+        {
+            begin++;
+        }
+
+        while (end > begin && weights[end] == 0.0)
+        {
+            end--;
+        }
+
+        // Convert to fixed point, putting the rounding error on the largest weight
+        short *fixedWeights = &resizeWeights->weights[(size_t)i * maxTaps];
+        int fixedTotal = 0;
+        int largest = 0;
+        for (int k = 0; k <= end - begin; k++)
+        {
+            double normalized = (total != 0.0) ? weights[begin + k] / total : 0.0;
+            fixedWeights[k] = (short)floor(normalized * (1 << RESIZE_WEIGHT_BITS) + 0.5);
+            fixedTotal += fixedWeights[k];
+            if (fixedWeights[k] > fixedWeights[largest])
+            {
+                largest = k;
+            }
+        }
+        fixedWeights[largest] += (short)((1 << RESIZE_WEIGHT_BITS) - fixedTotal);
+
+        resizeWeights->contributions[i].first = first + begin;
+        resizeWeights->contributions[i].count = end - begin + 1;
+    }
+}
+
+//******************************************************************************************
+// @name                    : BoxReduceRows
+//
+// @description             : This is a static function. Averages factor x factor blocks of
+//                            pixels for an exact power of two reduction.
+//
+// @param src               : First of the factor source rows
+// @param srcStride         : Distance between source rows in bytes
+// @param srcRowBytes       : Bytes of pixel data in a source row
+// @param factor            : 2 or 4
+// @param bytesPerPixel     : Bytes of one pixel
+// @param rowSum            : Scratch buffer of srcRowBytes entries
+// @param dst               : Output row
+// @param dstWidth          : Output width in pixels
+//
+// @returns                 : Nothing
+//********************************************************************************************
+static void BoxReduceRows(const unsigned char *src, size_t srcStride, int srcRowBytes, int factor, int bytesPerPixel,
+                          unsigned short *rowSum, unsigned char *dst, int dstWidth)
+{
+    // Sum the rows vertically, then horizontally, channel by channel
+    KernelRegistry::getKernels().boxSumRow(src, srcStride, factor, srcRowBytes, rowSum);
+
+    int shift = (factor == 2) ? 2 : 4;
+    int rounding = 1 << (shift - 1);
+    for (int i = 0; i < dstWidth; i++)
+    {
+        const unsigned short *block = &rowSum[i * factor * bytesPerPixel];
+        for (int channel = 0; channel < bytesPerPixel; channel++)
+        {
+            int sum = rounding;
+            for (int k = 0; k < factor; k++)
+            {
+                sum += block[k * bytesPerPixel + channel];
+            }
+            dst[i * bytesPerPixel + channel] = (unsigned char)(sum >> shift);
+        }
+    }
+}
+
+//******************************************************************************************
+// @name                    : ResizeImage
+//
+//@description              : Resize the image to newWidth x newHeight and save it to the
+//                            modified image buffer. The filter is separable: rows are first
+//                            resampled along x into a scratch image, which is then resampled
+//                            along y. Both passes run on bands of rows in parallel, through
+//                            the KernelRegistry row kernels. Exact 2x and 4x area reductions
+//                            are done directly as block averages.
+//
+// @param newWidth          : Width of resized image in pixels, 1 to MAX_IMAGE_DIMENSION
+// @param newHeight         : Height of resized image in pixels, 1 to MAX_IMAGE_DIMENSION
+// @param filter            : Resize filter
+//
+// @returns                 : 0 if SUCCESS
+//********************************************************************************************
+int BitmapImage::ResizeImage(int newWidth, int newHeight, resize_filter_t filter)
+{
+    if (newWidth <= 0 || newHeight <= 0 || newWidth > MAX_IMAGE_DIMENSION || newHeight > MAX_IMAGE_DIMENSION)
+    {
+        printf("ERROR: Invalid resize dimensions %d x %d!\n", newWidth, newHeight);
+        return -1;
+    }
+
+    int srcWidth = m_bitmapInfoHeader->width;
+    int srcHeight = m_bitmapInfoHeader->height;
+    int bytesPerPixel = m_bitmapInfoHeader->bitsPerPixel / 8;
+    ThreadPool &pool = ThreadPool::getInstance();
+
+    // Rows of up to MAX_IMAGE_DIMENSION pixels fit an int; the whole buffers must fit a size_t
+    unsigned long long imageBytes = (unsigned long long)getPaddedRowSize(newWidth, m_bitmapInfoHeader->bitsPerPixel) * newHeight;
+    unsigned long long scratchBytes = (unsigned long long)newWidth * bytesPerPixel * srcHeight;
+    if (imageBytes > SIZE_MAX || scratchBytes > SIZE_MAX)
+    {
+        printf("ERROR: Resized image of %d x %d is too large!\n", newWidth, newHeight);
+        return -1;
+    }
+
+    if (this->allocateModifiedImageBuffer(newWidth, newHeight) != 0)
+    {
+        return -1;
+    }
+
+    // Fast path for exact 2x and 4x reductions
+    int factor = srcWidth / newWidth;
+    if (filter == RESIZE_AREA_AVERAGE && (factor == 2 || factor == 4) &&
+        srcWidth == newWidth * factor && srcHeight == newHeight * factor)
+    {
+        pool.parallelFor(newHeight, DEFAULT_ROWS_PER_TASK, [&](int begin, int end)
+        {
+            vector<unsigned short> rowSum(srcWidth * bytesPerPixel);
+            for (int i = begin; i < end; i++)
+            {
+                BoxReduceRows(&m_bitmapImageChar[(size_t)m_paddedWidth * i * factor], m_paddedWidth, srcWidth * bytesPerPixel,
+                              factor, bytesPerPixel, &rowSum[0],
+                              &m_modifiedBitmapImageChar[(size_t)m_modifiedPaddedWidth * i], newWidth);
+            }
+        });
+
+        return 0;
+    }
+
+    resize_weights_t horizontalWeights;
+    resize_weights_t verticalWeights;
+    ComputeResizeWeights(srcWidth, newWidth, filter, &horizontalWeights);
+    ComputeResizeWeights(srcHeight, newHeight, filter, &verticalWeights);
+
+    // Horizontal pass into a scratch image of srcHeight rows, newWidth pixels each
+    size_t scratchStride = (size_t)newWidth * bytesPerPixel;
+    unsigned char *scratch = (unsigned char *)malloc(scratchStride * srcHeight);
+    if (scratch == nullptr)
+    {
+        printf("ERROR: Malloc Failure!\n");
+        return -1;
+    }
+
+    const kernel_table_t &kernels = KernelRegistry::getKernels();
+    pool.parallelFor(srcHeight, DEFAULT_ROWS_PER_TASK, [&](int begin, int end)
+    {
+        for (int i = begin; i < end; i++)
+        {
+            kernels.resizeHorizontalRow(&m_bitmapImageChar[(size_t)m_paddedWidth * i], &scratch[scratchStride * i],
+                                        bytesPerPixel, horizontalWeights);
+        }
+    });
+
+    // Vertical pass into the modified image
+    pool.parallelFor(newHeight, DEFAULT_ROWS_PER_TASK, [&](int begin, int end)
+    {
+        for (int i = begin; i < end; i++)
+        {
+            const resize_contribution_t &contribution = verticalWeights.contributions[i];
+            kernels.resizeVerticalRow(&scratch[scratchStride * contribution.first], scratchStride,
+                                      &verticalWeights.weights[(size_t)i * verticalWeights.maxTaps], contribution.count,
+                                      &m_modifiedBitmapImageChar[(size_t)m_modifiedPaddedWidth * i], newWidth * bytesPerPixel);
+        }
+    });
+
+    free(scratch);
+
+    return 0;
+}
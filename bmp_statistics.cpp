@@ -0,0 +1,177 @@
+#include"bmp.h"
+#include"pixel_kernels.h"
+#include"thread_pool.h"
+#include<algorithm>
+#include<math.h>
+#include<mutex>
+#include<string.h>
+
+//******************************************************************************************
+// @name                    : ResetStatisticsSums
+//
+// @description             : This is a static function. Empties sums, ready for pixels.
+//
+// @returns                 : Nothing
+//********************************************************************************************
+static void ResetStatisticsSums(statistics_sums_t &sums)
+{
+    memset(&sums, 0, sizeof(sums));
+    memset(sums.minimum, MAX_COLORS - 1, sizeof(sums.minimum));
+}
+
+//******************************************************************************************
+// @name                    : FinishStatistics
+//
+// @description             : This is a static function. Mean and standard deviation of sums.
+//
+// @returns                 : Nothing
+//********************************************************************************************
+static void FinishStatistics(const statistics_sums_t &sums, image_statistics_t &statistics)
+{
+    memset(&statistics, 0, sizeof(statistics));
+    statistics.pixelCount = sums.count;
+    if (sums.count == 0)
+    {
+        return;
+    }
+
+    for (int c = 0; c < 4; c++)
+    {
+        double mean = (double)sums.sum[c] / sums.count;
+        double variance = (double)sums.sumOfSquares[c] / sums.count - mean * mean;
+
+        statistics.mean[c] = mean;
+        statistics.standardDeviation[c] = sqrt(std::max(variance, 0.0));
+        statistics.minimum[c] = sums.minimum[c];
+        statistics.maximum[c] = sums.maximum[c];
+    }
+}
+
+//******************************************************************************************
+// @name                    : getImageStatistics
+//
+// @description             : Mean, standard deviation, minimum and maximum of every channel
+//                            and the brightness of the original image. They are worked out
+//                            from the histograms the load counted, and which edits keep up to
+//                            date, so the pixels are not read again. They are estimates if
+//                            the histograms are sampled.
+//
+// @param statistics        : Statistics on return
+//
+// @returns                 : 0 if SUCCESS
+//********************************************************************************************
+int BitmapImage::getImageStatistics(image_statistics_t &statistics)
+{
+    map<int, unsigned long> *histograms[4];
+    histograms[RED] = &m_redHistogram;
+    histograms[GREEN] = &m_greenHistogram;
+    histograms[BLUE] = &m_blueHistogram;
+    histograms[BRIGHTNESS] = &m_brightnessHistogram;
+
+    statistics_sums_t sums;
+    ResetStatisticsSums(sums);
+
+    for (int c = 0; c < 4; c++)
+    {
+        unsigned long long count = 0;
+        for (int i = 0; i < MAX_COLORS; i++)
+        {
+            unsigned long long pixels = (*histograms[c])[i];
+            if (pixels == 0)
+            {
+                continue;
+            }
+
+            count += pixels;
+            sums.sum[c] += pixels * i;
+            sums.sumOfSquares[c] += pixels * i * i;
+            sums.minimum[c] = std::min(sums.minimum[c], (unsigned char)i);
+            sums.maximum[c] = (unsigned char)i;
+        }
+        sums.count = count;
+    }
+
+    FinishStatistics(sums, statistics);
+
+    // Sampled histograms count fewer pixels than the image has
+    statistics.pixelCount = m_imageSize;
+
+    return 0;
+}
+
+//******************************************************************************************
+// @name                    : getHistogramErrorBound
+//
+// @description             : Bound on the error of the cumulative distribution of a sampled
+//                            histogram (Dvoretzky-Kiefer-Wolfowitz): with probability
+//                            1 - HISTOGRAM_ERROR_PROBABILITY, the fraction of pixels at or
+//                            below any level is off by no more than this. It is worked out
+//                            for independent samples; the stratified sample is usually closer.
+//
+// @returns                 : Bound, 0 if the histograms count every pixel
+//********************************************************************************************
+double BitmapImage::getHistogramErrorBound()
+{
+    if (m_histogramSampleStep <= 1 || m_histogramSampleCount == 0)
+    {
+        return 0.0;
+    }
+
+    return sqrt(log(2.0 / HISTOGRAM_ERROR_PROBABILITY) / (2.0 * m_histogramSampleCount));
+}
+
+//******************************************************************************************
+// @name                    : getModifiedImageStatistics
+//
+// @description             : Mean, standard deviation, minimum and maximum of every channel
+//                            and the brightness of the modified image, in one pass over its
+//                            rows
+//
+// @param statistics        : Statistics on return
+//
+// @returns                 : 0 if SUCCESS
+//********************************************************************************************
+int BitmapImage::getModifiedImageStatistics(image_statistics_t &statistics)
+{
+    if (m_modifiedBitmapImageChar == nullptr)
+    {
+        printf("ERROR: No modified image!\n");
+        return -1;
+    }
+
+    pixel_buffer_t image = this->getModifiedPixelBuffer();
+    statistics_sums_t sums;
+    ResetStatisticsSums(sums);
+    mutex sumsMutex;
+
+    bool supported = DispatchPixelFormat(image.bitsPerPixel, [&](auto format)
+    {
+        typedef decltype(format) Format;
+        ThreadPool::getInstance().parallelFor(image.height, DEFAULT_ROWS_PER_TASK, [&](int begin, int end)
+        {
+            statistics_sums_t bandSums;
+            ResetStatisticsSums(bandSums);
+            StatisticsRows<Format>(image, begin, end, bandSums);
+
+            lock_guard<mutex> lock(sumsMutex);
+            sums.count += bandSums.count;
+            for (int c = 0; c < 4; c++)
+            {
+                sums.sum[c] += bandSums.sum[c];
+                sums.sumOfSquares[c] += bandSums.sumOfSquares[c];
+                sums.minimum[c] = std::min(sums.minimum[c], bandSums.minimum[c]);
+                sums.maximum[c] = std::max(sums.maximum[c], bandSums.maximum[c]);
+            }
+        });
+    });
+
+    if (!supported)
+    {
+        printf("ERROR: Statistics are not supported for %d bits per pixel!\n", image.bitsPerPixel);
+        return -1;
+    }
+
+    FinishStatistics(sums, statistics);
+
+    return 0;
+}
@@ -0,0 +1,197 @@
+#include"bmp.h"
+#include"pixel_kernels.h"
+#include"simd.h"
+#include"thread_pool.h"
+#include<algorithm>
+#include<string.h>
+
+//******************************************************************************************
+// @name                    : ThresholdRowBits
+//
+// @description             : This is a static function. Packs a row to 1 bit per pixel: set
+//                            (white) where the brightness is above the threshold. The first
+//                            pixel is the most significant bit of the first byte, as in
+//                            1 bit bitmaps.
+//
+// @returns                 : Nothing
+//********************************************************************************************
+static void ThresholdRowBits(const unsigned char *luma, const unsigned char *threshold, int width, unsigned char *bits)
+{
+    int j = 0;
+
+#ifdef USE_SSE2_KERNELS
+    const __m128i signBits = _mm_set1_epi8((char)0x80);
+
+    for (; j + 16 <= width; j += 16)
+    {
+        __m128i values = _mm_xor_si128(_mm_loadu_si128((const __m128i*)(luma + j)), signBits);
+        __m128i limits = _mm_xor_si128(_mm_loadu_si128((const __m128i*)(threshold + j)), signBits);
+        __m128i white = _mm_cmpgt_epi8(values, limits);
+
+        // movemask puts the first pixel in the lowest bit, so reverse each group of 8 pixels
+        white = _mm_shufflehi_epi16(_mm_shufflelo_epi16(white, 0x1B), 0x1B);
+        white = _mm_or_si128(_mm_slli_epi16(white, 8), _mm_srli_epi16(white, 8));
+
+        int mask = _mm_movemask_epi8(white);
+        bits[j / 8] = (unsigned char)mask;
+        bits[j / 8 + 1] = (unsigned char)(mask >> 8);
+    }
+#endif
+
+    memset(bits + j / 8, 0, (width - j + 7) / 8);
+    for (; j < width; j++)
+    {
+        if (luma[j] > threshold[j])
+        {
+            bits[j / 8] |= (unsigned char)(0x80 >> (j % 8));
+        }
+    }
+}
+
+//******************************************************************************************
+// @name                    : getOtsuThreshold
+//
+// @description             : Otsu's threshold of the brightness histogram: the level which
+//                            best separates the pixels into a dark and a bright class
+//                            (largest variance between them). An image with a single level
+//                            gets the middle of the range.
+//
+// @returns                 : Threshold. Pixels brighter than it are white.
+//********************************************************************************************
+int BitmapImage::getOtsuThreshold()
+{
+    double counts[MAX_COLORS];
+    double total = 0.0;
+    double sumAll = 0.0;
+    for (int i = 0; i < MAX_COLORS; i++)
+    {
+        counts[i] = (double)m_brightnessHistogram[i];
+        total += counts[i];
+        sumAll += counts[i] * i;
+    }
+
+    int threshold = (Y_MIN + Y_MAX) / 2;
+    double bestVariance = -1.0;
+    double darkCount = 0.0;
+    double darkSum = 0.0;
+
+    for (int t = 0; t < MAX_COLORS - 1; t++)
+    {
+        darkCount += counts[t];
+        darkSum += counts[t] * t;
+
+        double brightCount = total - darkCount;
+        if (darkCount == 0.0)
+        {
+            continue;
+        }
+        if (brightCount == 0.0)
+        {
+            break;
+        }
+
+        double meanDifference = darkSum / darkCount - (sumAll - darkSum) / brightCount;
+        double variance = darkCount * brightCount * meanDifference * meanDifference;
+        if (variance > bestVariance)
+        {
+            bestVariance = variance;
+            threshold = t;
+        }
+    }
+
+    return threshold;
+}
+
+//******************************************************************************************
+// @name                    : BinarizeImage
+//
+// @description             : Makes a black and white, 1 bit per pixel modified image, for
+//                            example of a document for OCR. A pixel is white if it is
+//                            brighter than the threshold. Otsu's threshold is the same for
+//                            the whole image; the adaptive threshold follows uneven lighting:
+//                            the mean brightness of the window around the pixel, worked out
+//                            from the brightness summed-area table, less the bias.
+//
+// @param method            : How the threshold is picked
+// @param windowSize        : Side of the adaptive window in pixels, made odd
+// @param bias              : Adaptive threshold below the window mean
+//
+// @returns                 : 0 if SUCCESS
+//********************************************************************************************
+int BitmapImage::BinarizeImage(threshold_method_t method, int windowSize, int bias)
+{
+    pixel_buffer_t image = this->getOriginalPixelBuffer();
+    if (image.pixels == nullptr)
+    {
+        printf("ERROR: No image to binarize!\n");
+        return -1;
+    }
+
+    if (method == THRESHOLD_ADAPTIVE_MEAN && windowSize < 1)
+    {
+        printf("ERROR: Invalid adaptive window %d!\n", windowSize);
+        return -1;
+    }
+
+    int width = image.width;
+    int height = image.height;
+    vector<unsigned char> luma((size_t)width * height);
+    ThreadPool &pool = ThreadPool::getInstance();
+
+    bool supported = DispatchPixelFormat(image.bitsPerPixel, [&](auto format)
+    {
+        typedef decltype(format) Format;
+        pool.parallelFor(height, DEFAULT_ROWS_PER_TASK, [&](int begin, int end)
+        {
+            LumaRows<Format>(image, &luma[0], begin, end);
+        });
+    });
+
+    if (!supported)
+    {
+        printf("ERROR: Binarization is not supported for %d bits per pixel!\n", image.bitsPerPixel);
+        return -1;
+    }
+
+    int radius = windowSize / 2;
+    const integral_image_t *integral = nullptr;
+    if (method == THRESHOLD_ADAPTIVE_MEAN)
+    {
+        integral = this->getIntegralImage(BRIGHTNESS, &luma[0]);
+    }
+
+    int otsuThreshold = (method == THRESHOLD_OTSU) ? this->getOtsuThreshold() : 0;
+
+    if (this->allocateModifiedImageBuffer(width, height, MONOCHROME) != 0)
+    {
+        return -1;
+    }
+    pixel_buffer_t dst = this->getModifiedPixelBuffer();
+
+    pool.parallelFor(height, DEFAULT_ROWS_PER_TASK, [&](int begin, int end)
+    {
+        vector<unsigned char> threshold(width, (unsigned char)otsuThreshold);
+
+        for (int i = begin; i < end; i++)
+        {
+            if (method == THRESHOLD_ADAPTIVE_MEAN)
+            {
+                int bottom = std::max(i - radius, 0);
+                int top = std::min(i + radius + 1, height);
+
+                for (int j = 0; j < width; j++)
+                {
+                    int left = std::max(j - radius, 0);
+                    int right = std::min(j + radius + 1, width);
+                    unsigned long long sum = IntegralRectSum(*integral, left, bottom, right, top);
+                    int mean = (int)(sum / (unsigned long long)((right - left) * (top - bottom)));
+                    threshold[j] = (unsigned char)std::min(std::max(mean - bias, 0), MAX_COLORS - 1);
+                }
+            }
+
+            ThresholdRowBits(&luma[(size_t)width * i], &threshold[0], width, &dst.pixels[(size_t)dst.paddedWidth * i]);
+        }
+    });
+
+    return 0;
+}
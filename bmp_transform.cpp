@@ -0,0 +1,389 @@
+#include"bmp.h"
+#include"simd.h"
+#include"thread_pool.h"
+#include<stddef.h>
+#include<string.h>
+
+// Every geometric operation is a copy of rows, possibly mirrored, or a transpose, with the
+// source and destination rows walked forwards or backwards. A negative stride walks rows
+// backwards, so the flips cost nothing beyond the copy itself.
+
+// ==================================================================================================
+// Kernels moving blocks of pixels. The generic transpose moves a 4 x 4 block a pixel at a
+// time, filling destination rows in order, and the generic mirror moves one pixel; SIMD ones
+// move a square block (transpose) or a run (mirror) in registers.
+// ==================================================================================================
+template<int BYTES_PER_PIXEL>
+struct TransposeKernel
+{
+    static const int BLOCK = 4;
+
+    static inline void transposeBlock(const unsigned char *src, ptrdiff_t srcStride, unsigned char *dst, ptrdiff_t dstStride)
+    {
+        for (int c = 0; c < BLOCK; c++)
+        {
+            for (int r = 0; r < BLOCK; r++)
+            {
+                memcpy(dst + dstStride * c + r * BYTES_PER_PIXEL, src + srcStride * r + c * BYTES_PER_PIXEL, BYTES_PER_PIXEL);
+            }
+        }
+    }
+};
+
+template<int BYTES_PER_PIXEL>
+struct MirrorKernel
+{
+    static const int BLOCK = 1;
+
+    static inline void mirrorBlock(const unsigned char *src, unsigned char *dst)
+    {
+        memcpy(dst, src, BYTES_PER_PIXEL);
+    }
+};
+
+#ifdef USE_SSE2_KERNELS
+// 8 x 8 gray pixels: bytes, then 16 and 32 bit pairs are interleaved
+template<>
+struct TransposeKernel<1>
+{
+    static const int BLOCK = 8;
+
+    static inline void transposeBlock(const unsigned char *src, ptrdiff_t srcStride, unsigned char *dst, ptrdiff_t dstStride)
+    {
+        __m128i rows[8];
+        for (int k = 0; k < 8; k++)
+        {
+            rows[k] = _mm_loadl_epi64((const __m128i*)(src + srcStride * k));
+        }
+
+        __m128i s0 = _mm_unpacklo_epi8(rows[0], rows[1]);
+        __m128i s1 = _mm_unpacklo_epi8(rows[2], rows[3]);
+        __m128i s2 = _mm_unpacklo_epi8(rows[4], rows[5]);
+        __m128i s3 = _mm_unpacklo_epi8(rows[6], rows[7]);
+
+        __m128i t0 = _mm_unpacklo_epi16(s0, s1);        // Columns 0-3 of rows 0-3
+        __m128i t1 = _mm_unpackhi_epi16(s0, s1);        // Columns 4-7 of rows 0-3
+        __m128i t2 = _mm_unpacklo_epi16(s2, s3);        // Columns 0-3 of rows 4-7
+        __m128i t3 = _mm_unpackhi_epi16(s2, s3);
+
+        __m128i columns[4];                             // Two columns each
+        columns[0] = _mm_unpacklo_epi32(t0, t2);
+        columns[1] = _mm_unpackhi_epi32(t0, t2);
+        columns[2] = _mm_unpacklo_epi32(t1, t3);
+        columns[3] = _mm_unpackhi_epi32(t1, t3);
+
+        for (int k = 0; k < 4; k++)
+        {
+            _mm_storel_epi64((__m128i*)(dst + dstStride * (2 * k)), columns[k]);
+            _mm_storel_epi64((__m128i*)(dst + dstStride * (2 * k + 1)), _mm_srli_si128(columns[k], 8));
+        }
+    }
+};
+
+// 4 x 4 pixels of 32 bits
+template<>
+struct TransposeKernel<4>
+{
+    static const int BLOCK = 4;
+
+    static inline void transposeBlock(const unsigned char *src, ptrdiff_t srcStride, unsigned char *dst, ptrdiff_t dstStride)
+    {
+        __m128i r0 = _mm_loadu_si128((const __m128i*)src);
+        __m128i r1 = _mm_loadu_si128((const __m128i*)(src + srcStride));
+        __m128i r2 = _mm_loadu_si128((const __m128i*)(src + srcStride * 2));
+        __m128i r3 = _mm_loadu_si128((const __m128i*)(src + srcStride * 3));
+
+        __m128i t0 = _mm_unpacklo_epi32(r0, r1);
+        __m128i t1 = _mm_unpacklo_epi32(r2, r3);
+        __m128i t2 = _mm_unpackhi_epi32(r0, r1);
+        __m128i t3 = _mm_unpackhi_epi32(r2, r3);
+
+        _mm_storeu_si128((__m128i*)dst, _mm_unpacklo_epi64(t0, t1));
+        _mm_storeu_si128((__m128i*)(dst + dstStride), _mm_unpackhi_epi64(t0, t1));
+        _mm_storeu_si128((__m128i*)(dst + dstStride * 2), _mm_unpacklo_epi64(t2, t3));
+        _mm_storeu_si128((__m128i*)(dst + dstStride * 3), _mm_unpackhi_epi64(t2, t3));
+    }
+};
+
+// 16 gray pixels: reverse the 32 bit words, the 16 bit halves of each, then the bytes of those
+template<>
+struct MirrorKernel<1>
+{
+    static const int BLOCK = 16;
+
+    static inline void mirrorBlock(const unsigned char *src, unsigned char *dst)
+    {
+        __m128i x = _mm_shuffle_epi32(_mm_loadu_si128((const __m128i*)src), _MM_SHUFFLE(0, 1, 2, 3));
+        x = _mm_shufflehi_epi16(_mm_shufflelo_epi16(x, _MM_SHUFFLE(2, 3, 0, 1)), _MM_SHUFFLE(2, 3, 0, 1));
+        x = _mm_or_si128(_mm_slli_epi16(x, 8), _mm_srli_epi16(x, 8));
+        _mm_storeu_si128((__m128i*)dst, x);
+    }
+};
+
+// 4 pixels of 32 bits
+template<>
+struct MirrorKernel<4>
+{
+    static const int BLOCK = 4;
+
+    static inline void mirrorBlock(const unsigned char *src, unsigned char *dst)
+    {
+        _mm_storeu_si128((__m128i*)dst, _mm_shuffle_epi32(_mm_loadu_si128((const __m128i*)src), _MM_SHUFFLE(0, 1, 2, 3)));
+    }
+};
+#endif
+
+//******************************************************************************************
+// @name                    : TransposeTile
+//
+// @description             : This is a static function. Transposes a block small enough for
+//                            its source and destination rows to stay in cache: destination
+//                            row c, column r is source row r, column c.
+//
+// @param width             : Source columns
+// @param height            : Source rows
+//
+// @returns                 : Nothing
+//********************************************************************************************
+template<int BYTES_PER_PIXEL>
+static void TransposeTile(const unsigned char *src, ptrdiff_t srcStride, unsigned char *dst, ptrdiff_t dstStride,
+                          int width, int height)
+{
+    typedef TransposeKernel<BYTES_PER_PIXEL> Kernel;
+    int blockRows = height - height % Kernel::BLOCK;
+    int blockColumns = width - width % Kernel::BLOCK;
+
+    for (int r = 0; r < blockRows; r += Kernel::BLOCK)
+    {
+        for (int c = 0; c < blockColumns; c += Kernel::BLOCK)
+        {
+            Kernel::transposeBlock(src + srcStride * r + c * BYTES_PER_PIXEL, srcStride,
+                                   dst + dstStride * c + r * BYTES_PER_PIXEL, dstStride);
+        }
+    }
+
+    // Edges narrower than a block
+    for (int r = 0; r < height; r++)
+    {
+        int c = (r < blockRows) ? blockColumns : 0;
+        for (; c < width; c++)
+        {
+            memcpy(dst + dstStride * c + r * BYTES_PER_PIXEL, src + srcStride * r + c * BYTES_PER_PIXEL, BYTES_PER_PIXEL);
+        }
+    }
+}
+
+//******************************************************************************************
+// @name                    : TransposeRecursive
+//
+// @description             : This is a static function. Halves the longer side of the block
+//                            until it fits a tile, so every level of the cache sees blocks
+//                            it can hold without the tile size being tuned to it.
+//
+// @param width             : Source columns
+// @param height            : Source rows
+//
+// @returns                 : Nothing
+//********************************************************************************************
+template<int BYTES_PER_PIXEL>
+static void TransposeRecursive(const unsigned char *src, ptrdiff_t srcStride, unsigned char *dst, ptrdiff_t dstStride,
+                               int width, int height)
+{
+    if (width <= TRANSPOSE_TILE_SIZE && height <= TRANSPOSE_TILE_SIZE)
+    {
+        TransposeTile<BYTES_PER_PIXEL>(src, srcStride, dst, dstStride, width, height);
+        return;
+    }
+
+    // Halves stay multiples of a tile, so blocks are only narrower than a SIMD block at the image edge
+    if (width >= height)
+    {
+        int half = ((width / 2 + TRANSPOSE_TILE_SIZE - 1) / TRANSPOSE_TILE_SIZE) * TRANSPOSE_TILE_SIZE;
+        TransposeRecursive<BYTES_PER_PIXEL>(src, srcStride, dst, dstStride, half, height);
+        TransposeRecursive<BYTES_PER_PIXEL>(src + half * BYTES_PER_PIXEL, srcStride, dst + dstStride * half, dstStride,
+                                            width - half, height);
+    }
+    else
+    {
+        int half = ((height / 2 + TRANSPOSE_TILE_SIZE - 1) / TRANSPOSE_TILE_SIZE) * TRANSPOSE_TILE_SIZE;
+        TransposeRecursive<BYTES_PER_PIXEL>(src, srcStride, dst, dstStride, width, half);
+        TransposeRecursive<BYTES_PER_PIXEL>(src + srcStride * half, srcStride, dst + half * BYTES_PER_PIXEL, dstStride,
+                                            width, height - half);
+    }
+}
+
+//******************************************************************************************
+// @name                    : TransposePixels
+//
+// @description             : This is a static function. Transposes an image. Every task
+//                            takes a band of source columns, which are destination rows no
+//                            other task writes.
+//
+// @param width             : Source columns
+// @param height            : Source rows
+//
+// @returns                 : Nothing
+//********************************************************************************************
+template<int BYTES_PER_PIXEL>
+static void TransposePixels(const unsigned char *src, ptrdiff_t srcStride, unsigned char *dst, ptrdiff_t dstStride,
+                            int width, int height)
+{
+    int bands = (width + TRANSPOSE_TILE_SIZE - 1) / TRANSPOSE_TILE_SIZE;
+
+    ThreadPool::getInstance().parallelFor(bands, 1, [&](int begin, int end)
+    {
+        int first = begin * TRANSPOSE_TILE_SIZE;
+        int last = (end * TRANSPOSE_TILE_SIZE < width) ? end * TRANSPOSE_TILE_SIZE : width;
+        TransposeRecursive<BYTES_PER_PIXEL>(src + first * BYTES_PER_PIXEL, srcStride, dst + dstStride * first, dstStride,
+                                            last - first, height);
+    });
+}
+
+//******************************************************************************************
+// @name                    : CopyPixelRows
+//
+// @description             : This is a static function. Copies rows, optionally mirroring
+//                            every row left to right.
+//
+// @returns                 : Nothing
+//********************************************************************************************
+template<int BYTES_PER_PIXEL>
+static void CopyPixelRows(const unsigned char *src, ptrdiff_t srcStride, unsigned char *dst, ptrdiff_t dstStride,
+                          int width, int height, bool mirror)
+{
+    typedef MirrorKernel<BYTES_PER_PIXEL> Kernel;
+
+    ThreadPool::getInstance().parallelFor(height, DEFAULT_ROWS_PER_TASK, [&](int begin, int end)
+    {
+        for (int i = begin; i < end; i++)
+        {
+            const unsigned char *in = src + srcStride * i;
+            unsigned char *out = dst + dstStride * i;
+            if (!mirror)
+            {
+                memcpy(out, in, (size_t)width * BYTES_PER_PIXEL);
+                continue;
+            }
+
+            int j = 0;
+            for (; j + Kernel::BLOCK <= width; j += Kernel::BLOCK)
+            {
+                Kernel::mirrorBlock(in + (size_t)(width - j - Kernel::BLOCK) * BYTES_PER_PIXEL, out + (size_t)j * BYTES_PER_PIXEL);
+            }
+
+            for (; j < width; j++)
+            {
+                memcpy(out + (size_t)j * BYTES_PER_PIXEL, in + (size_t)(width - 1 - j) * BYTES_PER_PIXEL, BYTES_PER_PIXEL);
+            }
+        }
+    });
+}
+
+//******************************************************************************************
+// @name                    : TransformPixels
+//
+// @description             : This is a static function. Runs the operation for the pixel size.
+//
+// @param transpose         : Transpose, else copy rows
+// @param reverseSource     : Walk the source rows from the last
+// @param reverseDestination: Walk the destination rows from the last
+// @param mirror            : Mirror rows left to right, when copying rows
+//
+// @returns                 : Nothing
+//********************************************************************************************
+template<int BYTES_PER_PIXEL>
+static void TransformPixels(const pixel_buffer_t &src, pixel_buffer_t &dst, bool transpose,
+                            bool reverseSource, bool reverseDestination, bool mirror)
+{
+    const unsigned char *in = src.pixels;
+    ptrdiff_t inStride = src.paddedWidth;
+    if (reverseSource)
+    {
+        in += (ptrdiff_t)src.paddedWidth * (src.height - 1);
+        inStride = -inStride;
+    }
+
+    unsigned char *out = dst.pixels;
+    ptrdiff_t outStride = dst.paddedWidth;
+    if (reverseDestination)
+    {
+        out += (ptrdiff_t)dst.paddedWidth * (dst.height - 1);
+        outStride = -outStride;
+    }
+
+    if (transpose)
+    {
+        TransposePixels<BYTES_PER_PIXEL>(in, inStride, out, outStride, src.width, src.height);
+    }
+    else
+    {
+        CopyPixelRows<BYTES_PER_PIXEL>(in, inStride, out, outStride, src.width, src.height, mirror);
+    }
+}
+
+//******************************************************************************************
+// @name                    : TransformImage
+//
+// @description             : Rotates, flips or transposes the image. Rows are kept bottom-up,
+//                            so image row y from the top is stored in row height - 1 - y, and
+//                            the rotations come out as a transpose with the source or the
+//                            destination rows walked backwards:
+//                              rotate 90    destination rows backwards
+//                              rotate 270   source rows backwards
+//                              transpose    both
+//
+// @param transform         : Operation
+// @param flipByHeader      : Do the vertical part of a vertical flip or a 180 degree rotation
+//                            by writing the image top-down (a negative height in the header)
+//                            instead of moving rows
+//
+// @returns                 : 0 if SUCCESS
+//********************************************************************************************
+int BitmapImage::TransformImage(geometric_transform_t transform, bool flipByHeader)
+{
+    pixel_buffer_t src = this->getOriginalPixelBuffer();
+    int bytesPerPixel = src.bitsPerPixel / 8;
+    if (bytesPerPixel != 1 && bytesPerPixel != 3 && bytesPerPixel != 4)
+    {
+        printf("ERROR: Geometric operations are not supported for %d bits per pixel!\n", src.bitsPerPixel);
+        return -1;
+    }
+
+    bool transpose = (transform == TRANSFORM_ROTATE_90 || transform == TRANSFORM_ROTATE_270 || transform == TRANSFORM_TRANSPOSE);
+    bool reverseSource = (transform == TRANSFORM_ROTATE_270 || transform == TRANSFORM_TRANSPOSE ||
+                          transform == TRANSFORM_ROTATE_180 || transform == TRANSFORM_FLIP_VERTICAL);
+    bool reverseDestination = (transform == TRANSFORM_ROTATE_90 || transform == TRANSFORM_TRANSPOSE);
+    bool mirror = (transform == TRANSFORM_ROTATE_180 || transform == TRANSFORM_FLIP_HORIZONTAL);
+
+    bool topDown = false;
+    if (flipByHeader && (transform == TRANSFORM_FLIP_VERTICAL || transform == TRANSFORM_ROTATE_180))
+    {
+        reverseSource = false;
+        topDown = true;
+    }
+
+    if (transform == TRANSFORM_FLIP_VERTICAL && topDown)
+    {
+        // The pixels are the original ones. Only the header changes.
+        this->allocateModifiedImageBuffer();
+    }
+    else
+    {
+        if (this->allocateModifiedImageBuffer(transpose ? src.height : src.width, transpose ? src.width : src.height) != 0)
+        {
+            return -1;
+        }
+
+        pixel_buffer_t dst = this->getModifiedPixelBuffer();
+        if (bytesPerPixel == 1)
+            TransformPixels<1>(src, dst, transpose, reverseSource, reverseDestination, mirror);
+        else if (bytesPerPixel == 3)
+            TransformPixels<3>(src, dst, transpose, reverseSource, reverseDestination, mirror);
+        else
+            TransformPixels<4>(src, dst, transpose, reverseSource, reverseDestination, mirror);
+    }
+
+    m_modifiedTopDown = topDown;
+
+    return 0;
+}
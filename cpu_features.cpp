@@ -0,0 +1,152 @@
+#include"cpu_features.h"
+#include"simd.h"
+#include<string.h>
+
+#if defined(_MSC_VER)
+#include<intrin.h>
+#elif defined(USE_SSE2_KERNELS)
+#include<cpuid.h>
+#endif
+
+#ifdef USE_SSE2_KERNELS
+//******************************************************************************************
+// @name                    : Cpuid
+//
+// @description             : This is a static function. Runs the CPUID instruction.
+//
+// @param leaf              : CPUID leaf (eax)
+// @param subleaf           : CPUID subleaf (ecx)
+// @param registers         : eax, ebx, ecx, edx on return
+//
+// @returns                 : Nothing
+//********************************************************************************************
+static void Cpuid(unsigned int leaf, unsigned int subleaf, unsigned int registers[4])
+{
+#if defined(_MSC_VER)
+    int values[4];
+    __cpuidex(values, (int)leaf, (int)subleaf);
+    for (int i = 0; i < 4; i++)
+    {
+        registers[i] = (unsigned int)values[i];
+    }
+#else
+    __cpuid_count(leaf, subleaf, registers[0], registers[1], registers[2], registers[3]);
+#endif
+}
+
+//******************************************************************************************
+// @name                    : ReadXcr0
+//
+// @description             : This is a static function. Reads the register telling which
+//                            vector registers the operating system saves on context switch.
+//
+// @returns                 : XCR0
+//********************************************************************************************
+static unsigned long long ReadXcr0()
+{
+#if defined(_MSC_VER)
+    return _xgetbv(0);
+#else
+    unsigned int eax = 0;
+    unsigned int edx = 0;
+    __asm__ __volatile__("xgetbv" : "=a"(eax), "=d"(edx) : "c"(0));
+    return ((unsigned long long)edx << 32) | eax;
+#endif
+}
+#endif
+
+//******************************************************************************************
+// @name                    : DetectSimdLevel
+//
+// @description             : Finds the widest instruction set that both the CPU and the
+//                            operating system support.
+//
+// @returns                 : SIMD level
+//********************************************************************************************
+simd_level_t DetectSimdLevel()
+{
+#ifdef USE_SSE2_KERNELS
+    unsigned int registers[4] = { 0 };
+
+    Cpuid(0, 0, registers);
+    unsigned int maxLeaf = registers[0];
+
+    Cpuid(1, 0, registers);
+    bool osxsave = (registers[2] & (1u << 27)) != 0;
+    bool avx = (registers[2] & (1u << 28)) != 0;
+    if (!osxsave || !avx || maxLeaf < 7)
+    {
+        return SIMD_SSE2;
+    }
+
+    // YMM state (bits 1, 2) for AVX2, plus opmask and ZMM state (bits 5, 6, 7) for AVX-512
+    unsigned long long xcr0 = ReadXcr0();
+    bool ymmEnabled = (xcr0 & 0x6) == 0x6;
+    bool zmmEnabled = (xcr0 & 0xE6) == 0xE6;
+
+    Cpuid(7, 0, registers);
+    bool avx2 = (registers[1] & (1u << 5)) != 0;
+    bool avx512f = (registers[1] & (1u << 16)) != 0;
+    bool avx512bw = (registers[1] & (1u << 30)) != 0;
+
+    if (avx2 && avx512f && avx512bw && zmmEnabled)
+    {
+        return SIMD_AVX512;
+    }
+
+    if (avx2 && ymmEnabled)
+    {
+        return SIMD_AVX2;
+    }
+
+    return SIMD_SSE2;
+#else
+    return SIMD_SCALAR;
+#endif
+}
+
+//******************************************************************************************
+// @name                    : GetSimdLevelName
+//
+// @description             : Name of a SIMD level, as accepted by ParseSimdLevel
+//
+// @returns                 : Name
+//********************************************************************************************
+const char* GetSimdLevelName(simd_level_t level)
+{
+    switch (level)
+    {
+    case SIMD_SSE2:
+        return "sse2";
+    case SIMD_AVX2:
+        return "avx2";
+    case SIMD_AVX512:
+        return "avx512";
+    default:
+        return "scalar";
+    }
+}
+
+//******************************************************************************************
+// @name                    : ParseSimdLevel
+//
+// @description             : Converts a name ("scalar", "sse2", "avx2", "avx512") to a level
+//
+// @param name              : Name of level
+// @param level             : Level on return
+//
+// @returns                 : false if the name is unknown
+//********************************************************************************************
+bool ParseSimdLevel(const char *name, simd_level_t *level)
+{
+    for (int i = SIMD_SCALAR; i <= SIMD_AVX512; i++)
+    {
+        if (strcmp(name, GetSimdLevelName((simd_level_t)i)) == 0)
+        {
+            *level = (simd_level_t)i;
+            return true;
+        }
+    }
+
+    return false;
+}
@@ -0,0 +1,23 @@
+#ifndef _CPU_FEATURES_H_
+#define _CPU_FEATURES_H_
+
+// ==================================================================================================
+// Enums
+// ==================================================================================================
+// Instruction set levels with kernels, in increasing order of vector width
+typedef enum simd_level_tag
+{
+    SIMD_SCALAR = 0,
+    SIMD_SSE2 = 1,
+    SIMD_AVX2 = 2,
+    SIMD_AVX512 = 3
+}simd_level_t;
+
+// ==================================================================================================
+// Functions
+// ==================================================================================================
+simd_level_t DetectSimdLevel();
+const char* GetSimdLevelName(simd_level_t level);
+bool ParseSimdLevel(const char *name, simd_level_t *level);
+
+#endif
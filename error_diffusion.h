@@ -0,0 +1,176 @@
+#ifndef _ERROR_DIFFUSION_H_
+#define _ERROR_DIFFUSION_H_
+#include"thread_pool.h"
+#include<algorithm>
+#include<atomic>
+#include<thread>
+#include<vector>
+
+// Error diffusion hands the error of every pixel to pixels right of it and in the rows below,
+// so a row can only run behind the row above it. Rows run on all the pool threads at once as a
+// wavefront: each row stays WAVEFRONT_LAG pixels behind the one above, close enough that every
+// thread is busy after the first few rows, far enough that the errors a row still receives from
+// the row above are never written by both at once.
+
+// ==================================================================================================
+// Constants
+// ==================================================================================================
+const int ERROR_DIFFUSION_REACH = 2;        // Furthest tap from its pixel, left, right or down
+const int WAVEFRONT_LAG = 4;                // Pixels a row stays behind the row above
+const int WAVEFRONT_PUBLISH_PIXELS = 64;    // A row tells the row below how far it is every this many pixels
+const int WAVEFRONT_CACHE_LINE = 64;
+
+// ==================================================================================================
+// Structures
+// ==================================================================================================
+// Pixels a row has finished, on its own cache line so that neighbouring rows do not share one
+typedef struct wavefront_row_tag
+{
+    std::atomic<int> done;
+    char padding[WAVEFRONT_CACHE_LINE - sizeof(std::atomic<int>)];
+}wavefront_row_t;
+
+// Error diffusion weights as types, like the pixel formats, so that the taps compile to
+// constants. spread() adds the error of the pixel at row[0] to its neighbours, weighted by
+// DIVISOR times their share; below and belowTwo point at the same column one and two rows down.
+// Every kernel takes both, so DiffuseErrors calls them alike. No tap is further than
+// ERROR_DIFFUSION_REACH from its pixel.
+
+// 7/16 right, 3/16, 5/16 and 1/16 below; nothing two rows down
+struct FloydSteinbergKernel
+{
+    static const int DIVISOR = 16;
+
+    template<int CHANNELS>
+    static inline void spread(const int *difference, int *row, int *below, int * /* belowTwo */)
+    {
+        for (int c = 0; c < CHANNELS; c++)
+        {
+            row[c + CHANNELS] += difference[c] * 7;
+            below[c - CHANNELS] += difference[c] * 3;
+            below[c] += difference[c] * 5;
+            below[c + CHANNELS] += difference[c];
+        }
+    }
+};
+
+// 1/8 to each of two pixels right, three below and one two rows down. Only 6/8 of the error
+// is handed on, which keeps highlights and shadows clean.
+struct AtkinsonKernel
+{
+    static const int DIVISOR = 8;
+
+    template<int CHANNELS>
+    static inline void spread(const int *difference, int *row, int *below, int *belowTwo)
+    {
+        for (int c = 0; c < CHANNELS; c++)
+        {
+            row[c + CHANNELS] += difference[c];
+            row[c + 2 * CHANNELS] += difference[c];
+            below[c - CHANNELS] += difference[c];
+            below[c] += difference[c];
+            below[c + CHANNELS] += difference[c];
+            belowTwo[c] += difference[c];
+        }
+    }
+};
+
+//******************************************************************************************
+// @name                    : DiffuseErrors
+//
+// @description             : Runs an error diffusion over rows 0 to height - 1 in wavefront
+//                            order. Threads take the next row as they finish one, so a thread
+//                            only ever waits on rows taken before its own, and the result is
+//                            the same as scanning the rows one after the other.
+//
+// @param CHANNELS          : Error values per pixel
+// @param Kernel            : FloydSteinbergKernel or AtkinsonKernel
+// @param rowPixels         : Called as rowPixels(row) at the start of every row, returns the
+//                            function the pixels of the row are given to in order, as
+//                            pixel(column, adjust, difference). adjust holds the diffused error
+//                            to add to the pixel; the pixel is quantized and its error left in
+//                            difference.
+//
+// @returns                 : Nothing
+//********************************************************************************************
+template<int CHANNELS, typename Kernel, typename RowPixels>
+void DiffuseErrors(int width, int height, RowPixels &&rowPixels)
+{
+    ThreadPool &pool = ThreadPool::getInstance();
+    int threadCount = pool.getThreadCount();
+
+    // Errors of a row, with ERROR_DIFFUSION_REACH pixels of margin either side. Row t is kept in
+    // slot t % slots. A row is only done once the row above is, so the rows not done yet are at
+    // most the threadCount newest; with threadCount + ERROR_DIFFUSION_REACH slots, the rows
+    // written to fit, and so do they in cache.
+    int slots = threadCount + ERROR_DIFFUSION_REACH;
+    size_t stride = (size_t)(width + 2 * ERROR_DIFFUSION_REACH) * CHANNELS;
+    std::vector<int> errors(stride * slots, 0);
+    std::vector<wavefront_row_t> rows(height);
+    for (int t = 0; t < height; t++)
+    {
+        rows[t].done.store(0, std::memory_order_relaxed);
+    }
+
+    std::atomic<int> nextRow(0);
+
+    pool.runOnThreads([&]()
+    {
+        // A copy the compiler can keep in a register: stores through pixel pointers may alias
+        // anything reached by reference
+        const int columns = width;
+
+        for (int t = nextRow++; t < height; t = nextRow++)
+        {
+            // The slot of the furthest row this one writes to was last used by a row which
+            // must be done with it first; with as many slots as above, it always is by now
+            int reused = t + ERROR_DIFFUSION_REACH - slots;
+            while (reused >= 0 && rows[reused].done.load(std::memory_order_acquire) < columns)
+            {
+                std::this_thread::yield();
+            }
+            int *slot = &errors[stride * ((t + ERROR_DIFFUSION_REACH) % slots)];
+            std::fill(slot, slot + stride, 0);
+
+            int *rowErrors = &errors[stride * (t % slots) + ERROR_DIFFUSION_REACH * CHANNELS];
+            int *belowErrors = &errors[stride * ((t + 1) % slots) + ERROR_DIFFUSION_REACH * CHANNELS];
+            int *belowTwoErrors = &errors[stride * ((t + 2) % slots) + ERROR_DIFFUSION_REACH * CHANNELS];
+
+            auto pixel = rowPixels(t);
+            int above = (t == 0) ? columns : 0;
+            int publish = WAVEFRONT_PUBLISH_PIXELS;
+            for (int j = 0; j < columns; j++)
+            {
+                if (above < columns && above < j + WAVEFRONT_LAG)
+                {
+                    int needed = std::min(j + WAVEFRONT_LAG, columns);
+                    while ((above = rows[t - 1].done.load(std::memory_order_acquire)) < needed)
+                    {
+                        std::this_thread::yield();
+                    }
+                }
+
+                int adjust[CHANNELS];
+                int difference[CHANNELS];
+                size_t offset = (size_t)j * CHANNELS;
+                for (int c = 0; c < CHANNELS; c++)
+                {
+                    adjust[c] = rowErrors[offset + c] / Kernel::DIVISOR;
+                }
+
+                pixel(j, adjust, difference);
+                Kernel::template spread<CHANNELS>(difference, rowErrors + offset, belowErrors + offset, belowTwoErrors + offset);
+
+                if (j + 1 == publish)
+                {
+                    rows[t].done.store(publish, std::memory_order_release);
+                    publish += WAVEFRONT_PUBLISH_PIXELS;
+                }
+            }
+
+            rows[t].done.store(columns, std::memory_order_release);
+        }
+    });
+}
+
+#endif
@@ -0,0 +1,1222 @@
+#include"image_server.h"
+#include"bmp.h"
+#include"kernel_registry.h"
+#include"thread_pool.h"
+#include<chrono>
+#include<ctype.h>
+#include<errno.h>
+#include<memory>
+#include<mutex>
+#include<new>
+#include<stdlib.h>
+#include<string.h>
+
+#if defined(_WIN32)
+#include<io.h>
+#define dup _dup
+#define dup2 _dup2
+#define fdopen _fdopen
+#define fileno _fileno
+#else
+#include<poll.h>
+#include<signal.h>
+#include<unistd.h>
+#include<sys/socket.h>
+#include<sys/un.h>
+#endif
+
+#if defined(__GLIBC__)
+#include<malloc.h>
+#endif
+
+const size_t SERVER_HEAP_RETAIN_SIZE = 256 << 20;  // Free heap kept rather than returned to the system
+
+// ==================================================================================================
+// Helpers
+// ==================================================================================================
+//******************************************************************************************
+// @name                    : NowMs
+//
+// @description             : This is a static function. Monotonic clock in milliseconds
+//
+// @returns                 : Time
+//********************************************************************************************
+static double NowMs()
+{
+    return std::chrono::duration<double, std::milli>(std::chrono::steady_clock::now().time_since_epoch()).count();
+}
+
+//******************************************************************************************
+// @name                    : JsonEscape
+//
+// @description             : This is a static function. Quotes a string as a JSON string
+//
+// @returns                 : JSON text
+//********************************************************************************************
+static std::string JsonEscape(const std::string &value)
+{
+    std::string text = "\"";
+    for (size_t i = 0; i < value.size(); i++)
+    {
+        unsigned char c = (unsigned char)value[i];
+        if (c == '"' || c == '\\')
+        {
+            text += '\\';
+            text += (char)c;
+        }
+        else if (c == '\n')
+        {
+            text += "\\n";
+        }
+        else if (c == '\t')
+        {
+            text += "\\t";
+        }
+        else if (c < 0x20)
+        {
+            char escape[8];
+            snprintf(escape, sizeof(escape), "\\u%04x", c);
+            text += escape;
+        }
+        else
+        {
+            text += (char)c;
+        }
+    }
+
+    return text + "\"";
+}
+
+//******************************************************************************************
+// @name                    : SkipWhitespace
+//
+// @description             : This is a static function. Moves pos past JSON whitespace
+//
+// @returns                 : Nothing
+//********************************************************************************************
+static void SkipWhitespace(const std::string &text, size_t &pos)
+{
+    while (pos < text.size() && (text[pos] == ' ' || text[pos] == '\t' || text[pos] == '\r' || text[pos] == '\n'))
+    {
+        pos++;
+    }
+}
+
+//******************************************************************************************
+// @name                    : ParseJsonString
+//
+// @description             : This is a static function. Reads the JSON string at pos, which
+//                            is at its opening quote. \u escapes are stored as UTF-8.
+//
+// @returns                 : true if SUCCESS
+//********************************************************************************************
+static bool ParseJsonString(const std::string &text, size_t &pos, std::string &value)
+{
+    if (pos >= text.size() || text[pos] != '"')
+    {
+        return false;
+    }
+
+    value.clear();
+    for (pos++; pos < text.size(); pos++)
+    {
+        char c = text[pos];
+        if (c == '"')
+        {
+            pos++;
+            return true;
+        }
+        if (c != '\\')
+        {
+            value += c;
+            continue;
+        }
+
+        if (++pos >= text.size())
+        {
+            return false;
+        }
+
+        switch (text[pos])
+        {
+        case 'b': value += '\b'; break;
+        case 'f': value += '\f'; break;
+        case 'n': value += '\n'; break;
+        case 'r': value += '\r'; break;
+        case 't': value += '\t'; break;
+        case 'u':
+        {
+            if (pos + 4 >= text.size())
+            {
+                return false;
+            }
+            unsigned int code = (unsigned int)strtoul(text.substr(pos + 1, 4).c_str(), nullptr, 16);
+            pos += 4;
+
+            // Characters of the Basic Multilingual Plane only, which covers file names
+            if (code < 0x80)
+            {
+                value += (char)code;
+            }
+            else if (code < 0x800)
+            {
+                value += (char)(0xC0 | (code >> 6));
+                value += (char)(0x80 | (code & 0x3F));
+            }
+            else
+            {
+                value += (char)(0xE0 | (code >> 12));
+                value += (char)(0x80 | ((code >> 6) & 0x3F));
+                value += (char)(0x80 | (code & 0x3F));
+            }
+            break;
+        }
+        default: value += text[pos]; break;
+        }
+    }
+
+    return false;
+}
+
+//******************************************************************************************
+// @name                    : ParseJsonLiteral
+//
+// @description             : This is a static function. Reads a number, true, false or null
+//
+// @returns                 : true if SUCCESS
+//********************************************************************************************
+static bool ParseJsonLiteral(const std::string &text, size_t &pos, std::string &value)
+{
+    size_t start = pos;
+    while (pos < text.size() && (isalnum((unsigned char)text[pos]) || text[pos] == '-' || text[pos] == '+' || text[pos] == '.'))
+    {
+        pos++;
+    }
+
+    value = text.substr(start, pos - start);
+    return !value.empty();
+}
+
+//******************************************************************************************
+// @name                    : SplitOperation
+//
+// @description             : This is a static function. Splits "name:argument:argument"
+//
+// @returns                 : Name followed by the arguments
+//********************************************************************************************
+static std::vector<std::string> SplitOperation(const std::string &operation)
+{
+    std::vector<std::string> parts;
+    size_t start = 0;
+    while (true)
+    {
+        size_t end = operation.find(':', start);
+        parts.push_back(operation.substr(start, end == std::string::npos ? std::string::npos : end - start));
+        if (end == std::string::npos)
+        {
+            return parts;
+        }
+        start = end + 1;
+    }
+}
+
+//******************************************************************************************
+// @name                    : ParseResizeSize
+//
+// @description             : This is a static function. Reads the "<width>x<height>" of a
+//                            resize and checks that both are 1 to MAX_IMAGE_DIMENSION.
+//
+// @returns                 : true if the size is valid
+//********************************************************************************************
+static bool ParseResizeSize(const std::string &size, int &width, int &height)
+{
+    return sscanf(size.c_str(), "%dx%d", &width, &height) == 2 &&
+           width > 0 && width <= MAX_IMAGE_DIMENSION && height > 0 && height <= MAX_IMAGE_DIMENSION;
+}
+
+//******************************************************************************************
+// @name                    : PaddedImageBytes
+//
+// @description             : This is a static function. Bytes of an image with padded rows,
+//                            in 64 bits for any width and height a header or job may hold.
+//
+// @returns                 : Size in bytes
+//********************************************************************************************
+static unsigned long long PaddedImageBytes(int width, int height, int bitsPerPixel)
+{
+    return ((unsigned long long)width * bitsPerPixel + 31) / 32 * 4 * (unsigned long long)height;
+}
+
+//******************************************************************************************
+// @name                    : JobCacheOperations
+//
+// @description             : This is a static function. Describes everything besides the
+//                            input that decides the output of a job, for its cache key.
+//
+// @returns                 : Operations in order, and the histogram sampling
+//********************************************************************************************
+static std::string JobCacheOperations(const server_job_t &job)
+{
+    std::string operations;
+    for (size_t i = 0; i < job.operations.size(); i++)
+    {
+        operations += job.operations[i] + "|";
+    }
+
+    char sampling[64];
+    snprintf(sampling, sizeof(sampling), "sampling=%.17g", job.histogramSampling);
+    return operations + sampling;
+}
+
+// ==================================================================================================
+// ImageServer
+// ==================================================================================================
+//******************************************************************************************
+// @name                    : ImageServer
+//
+// @description             : Constructor. Starts the thread pool and picks the pixel kernels
+//                            now rather than in the first job. With glibc, pixel buffers up
+//                            to SERVER_MMAP_THRESHOLD come from the heap and freed memory is
+//                            kept, so the next job reuses pages already mapped instead of
+//                            faulting in fresh ones.
+//
+// @param memoryBudget      : Bytes the jobs running at once may use together
+// @param workerCount       : Jobs run at once at most. 0 for the number of hardware threads.
+// @param cacheDirectory    : Directory of the result cache, nullptr to run every job
+//
+// @returns                 : Nothing
+//********************************************************************************************
+ImageServer::ImageServer(unsigned long long memoryBudget, int workerCount, const char *cacheDirectory)
+{
+    m_jobCount = 0;
+    m_stop = false;
+
+#if defined(__GLIBC__)
+    mallopt(M_MMAP_THRESHOLD, (int)SERVER_MMAP_THRESHOLD);
+    mallopt(M_TRIM_THRESHOLD, (int)SERVER_HEAP_RETAIN_SIZE);
+#endif
+
+    ThreadPool::getInstance();
+    KernelRegistry::getKernels();
+
+    m_scheduler = new JobScheduler(memoryBudget, workerCount);
+    m_buffers.resize(m_scheduler->getWorkerCount());
+
+    // A worker has one file in flight at a time
+    for (size_t i = 0; i < m_buffers.size(); i++)
+    {
+        m_buffers[i].io = new AsyncFileIO(ASYNC_IO_AUTO, 1);
+    }
+
+    m_cache = (cacheDirectory != nullptr) ? new ResultCache(cacheDirectory) : nullptr;
+}
+
+//******************************************************************************************
+// @name                    : ~ImageServer
+//
+// @description             : Destructor. Finishes the jobs still running.
+//
+// @returns                 : Nothing
+//********************************************************************************************
+ImageServer::~ImageServer()
+{
+    delete m_scheduler;
+
+    for (size_t i = 0; i < m_buffers.size(); i++)
+    {
+        delete m_buffers[i].io;
+    }
+    delete m_cache;
+}
+
+//******************************************************************************************
+// @name                    : ParseJob
+//
+// @description             : This is a static function. Reads a job from a line of JSON.
+//                            Keys other than id, command, input, output, operations and
+//                            histogram_sampling are ignored.
+//
+// @param error             : Reason on failure
+//
+// @returns                 : 0 if SUCCESS
+//********************************************************************************************
+int ImageServer::ParseJob(const std::string &line, server_job_t &job, std::string &error)
+{
+    job.id = "null";
+    job.command = "process";
+    job.inputPath.clear();
+    job.outputPath.clear();
+    job.operations.clear();
+    job.histogramSampling = 0.0;
+
+    size_t pos = 0;
+    SkipWhitespace(line, pos);
+    if (pos >= line.size() || line[pos] != '{')
+    {
+        error = "job is not a JSON object";
+        return -1;
+    }
+    pos++;
+
+    SkipWhitespace(line, pos);
+    bool empty = (pos < line.size() && line[pos] == '}');
+    if (empty)
+    {
+        pos++;
+    }
+
+    while (!empty)
+    {
+        std::string key;
+        SkipWhitespace(line, pos);
+        if (!ParseJsonString(line, pos, key))
+        {
+            error = "invalid key";
+            return -1;
+        }
+
+        SkipWhitespace(line, pos);
+        if (pos >= line.size() || line[pos] != ':')
+        {
+            error = "missing ':' after \"" + key + "\"";
+            return -1;
+        }
+        pos++;
+        SkipWhitespace(line, pos);
+
+        std::string value;
+        if (pos < line.size() && line[pos] == '[')
+        {
+            // Arrays of other keys are read and dropped; they may hold strings and literals
+            pos++;
+            SkipWhitespace(line, pos);
+            while (pos < line.size() && line[pos] != ']')
+            {
+                bool isString = (line[pos] == '"');
+                if (isString ? !ParseJsonString(line, pos, value) : !ParseJsonLiteral(line, pos, value))
+                {
+                    error = "invalid array element for \"" + key + "\"";
+                    return -1;
+                }
+                if (key == "operations")
+                {
+                    if (!isString)
+                    {
+                        error = "operations must be strings";
+                        return -1;
+                    }
+                    job.operations.push_back(value);
+                }
+
+                SkipWhitespace(line, pos);
+                if (pos < line.size() && line[pos] == ',')
+                {
+                    pos++;
+                    SkipWhitespace(line, pos);
+                }
+            }
+            if (pos >= line.size())
+            {
+                error = "unterminated array for \"" + key + "\"";
+                return -1;
+            }
+            pos++;
+        }
+        else if (pos < line.size() && line[pos] == '"')
+        {
+            ParseJsonString(line, pos, value);
+            if (key == "id")
+            {
+                job.id = JsonEscape(value);
+            }
+            else if (key == "command")
+            {
+                job.command = value;
+            }
+            else if (key == "input")
+            {
+                job.inputPath = value;
+            }
+            else if (key == "output")
+            {
+                job.outputPath = value;
+            }
+            else if (key == "operations")
+            {
+                job.operations.push_back(value);
+            }
+        }
+        else if (ParseJsonLiteral(line, pos, value))
+        {
+            if (key == "id")
+            {
+                job.id = value;
+            }
+            else if (key == "histogram_sampling")
+            {
+                job.histogramSampling = atof(value.c_str());
+            }
+        }
+        else
+        {
+            error = "invalid value for \"" + key + "\"";
+            return -1;
+        }
+
+        SkipWhitespace(line, pos);
+        if (pos < line.size() && line[pos] == ',')
+        {
+            pos++;
+            continue;
+        }
+        if (pos < line.size() && line[pos] == '}')
+        {
+            pos++;
+            break;
+        }
+
+        error = "expected ',' or '}'";
+        return -1;
+    }
+
+    SkipWhitespace(line, pos);
+    if (pos != line.size())
+    {
+        error = "text after the job object";
+        return -1;
+    }
+
+    if (job.command == "process" && (job.inputPath.empty() || job.outputPath.empty()))
+    {
+        error = "input and output are required";
+        return -1;
+    }
+
+    // Sizes decide the memory estimate, so they are checked before the job is scheduled
+    for (size_t i = 0; i < job.operations.size(); i++)
+    {
+        std::vector<std::string> parts = SplitOperation(job.operations[i]);
+        int width = 0;
+        int height = 0;
+        if (parts[0] == "resize" && (parts.size() < 2 || !ParseResizeSize(parts[1], width, height)))
+        {
+            error = "resize needs <width>x<height> of 1 to " + std::to_string(MAX_IMAGE_DIMENSION) + " pixels";
+            return -1;
+        }
+    }
+
+    return 0;
+}
+
+//******************************************************************************************
+// @name                    : ProbeJobInput
+//
+// @description             : This is a static function. Reads the headers of the input of a
+//                            job and checks that the loader can decode it: the headers are
+//                            valid and the pixels are not compressed.
+//
+// @param fileHeader        : Populated with the FileHeader
+// @param infoHeader        : Populated with the InfoHeader
+// @param error             : Reason on failure
+//
+// @returns                 : 0 if SUCCESS
+//********************************************************************************************
+int ImageServer::ProbeJobInput(const server_job_t &job, bitmap_file_header_t &fileHeader,
+                               bitmap_info_header_t &infoHeader, std::string &error)
+{
+    probe_status_t status = BitmapImage::ProbeBitmapHeader(job.inputPath.c_str(), &fileHeader, &infoHeader);
+    if (status != PROBE_OK)
+    {
+        error = job.inputPath + ": " + BitmapImage::getProbeStatusName(status);
+        return -1;
+    }
+
+    if (infoHeader.compressionType != COMPRESSION_RGB)
+    {
+        error = job.inputPath + ": compressed images are not supported";
+        return -1;
+    }
+
+    return 0;
+}
+
+//******************************************************************************************
+// @name                    : EstimateJobMemory
+//
+// @description             : This is a static function. Memory a job needs at its peak,
+//                            from the header of its input alone: the input file, and three
+//                            images of the largest size in the chain (original and modified
+//                            image, and the file buffer the next operation decodes from).
+//                            Palettized and 16 bit inputs are counted as 24 bit, as they
+//                            may be decoded.
+//
+// @param fileHeader        : FileHeader of the input, as ProbeJobInput read it
+// @param infoHeader        : InfoHeader of the input
+//
+// @returns                 : Size in bytes
+//********************************************************************************************
+unsigned long long ImageServer::EstimateJobMemory(const server_job_t &job, const bitmap_file_header_t &fileHeader,
+                                                  const bitmap_info_header_t &infoHeader)
+{
+    int height = (infoHeader.height < 0) ? -infoHeader.height : infoHeader.height;
+    short bitsPerPixel = (infoHeader.bitsPerPixel == BITS_32_RGBA) ? BITS_32_RGBA : BITS_24_RGB;
+    unsigned long long fileBytes = (unsigned long long)fileHeader.dataOffset +
+                                   PaddedImageBytes(infoHeader.width, height, infoHeader.bitsPerPixel);
+    unsigned long long largest = PaddedImageBytes(infoHeader.width, height, bitsPerPixel);
+
+    for (size_t i = 0; i < job.operations.size(); i++)
+    {
+        int width = 0;
+        int resizedHeight = 0;
+        std::vector<std::string> parts = SplitOperation(job.operations[i]);
+        if (parts[0] == "resize" && parts.size() > 1 && ParseResizeSize(parts[1], width, resizedHeight))
+        {
+            unsigned long long size = PaddedImageBytes(width, resizedHeight, bitsPerPixel);
+            if (size > largest)
+            {
+                largest = size;
+            }
+        }
+    }
+
+    return fileBytes + 3 * largest + SERVER_JOB_OVERHEAD_BYTES;
+}
+
+//******************************************************************************************
+// @name                    : runOperation
+//
+// @description             : Runs one operation of a job. Operations are a name and
+//                            arguments separated by ':':
+//                              grayscale
+//                              equalize[:luma]          blur[:luma]
+//                              median:<radius>[:luma]
+//                              resize:<width>x<height>[:area|bilinear|lanczos]
+//                              rotate90  rotate180  rotate270  flip-horizontal  flip-vertical  transpose
+//                              binarize[:otsu|adaptive[:<window>[:<bias>]]]
+//                              erode|dilate|open|close:<width>x<height>
+//                              quantize[:<colors>][:dither]
+//                              label[:<min area>]
+//                              dither[:floyd-steinberg|atkinson|ordered][:1|4|8]
+//
+// @param error             : Reason on failure
+//
+// @returns                 : 0 if SUCCESS
+//********************************************************************************************
+int ImageServer::runOperation(BitmapImage &image, const std::string &operation, std::string &error)
+{
+    std::vector<std::string> parts = SplitOperation(operation);
+    const std::string &name = parts[0];
+    processing_mode_t mode = (parts.size() > 1 && parts.back() == "luma") ? PROCESS_LUMA : PROCESS_PER_CHANNEL;
+    int retval = -1;
+
+    if (name == "grayscale")
+    {
+        retval = image.ConvertToGrayScale();
+    }
+    else if (name == "equalize")
+    {
+        retval = image.doHistogramEqualization(mode);
+    }
+    else if (name == "blur")
+    {
+        retval = image.DoImageBlur(mode);
+    }
+    else if (name == "median")
+    {
+        int radius = (parts.size() > 1) ? atoi(parts[1].c_str()) : 1;
+        retval = image.DoMedianFilter(radius, mode);
+    }
+    else if (name == "resize")
+    {
+        int width = 0;
+        int height = 0;
+        if (parts.size() < 2 || !ParseResizeSize(parts[1], width, height))
+        {
+            error = "resize needs <width>x<height> of 1 to " + std::to_string(MAX_IMAGE_DIMENSION) + " pixels";
+            return -1;
+        }
+
+        resize_filter_t filter = RESIZE_AREA_AVERAGE;
+        if (parts.size() > 2 && parts[2] == "bilinear")
+        {
+            filter = RESIZE_BILINEAR;
+        }
+        else if (parts.size() > 2 && parts[2] == "lanczos")
+        {
+            filter = RESIZE_LANCZOS;
+        }
+        retval = image.ResizeImage(width, height, filter);
+    }
+    else if (name == "rotate90" || name == "rotate180" || name == "rotate270" ||
+             name == "flip-horizontal" || name == "flip-vertical" || name == "transpose")
+    {
+        geometric_transform_t transform = (name == "rotate90") ? TRANSFORM_ROTATE_90 :
+                                          (name == "rotate180") ? TRANSFORM_ROTATE_180 :
+                                          (name == "rotate270") ? TRANSFORM_ROTATE_270 :
+                                          (name == "flip-horizontal") ? TRANSFORM_FLIP_HORIZONTAL :
+                                          (name == "flip-vertical") ? TRANSFORM_FLIP_VERTICAL : TRANSFORM_TRANSPOSE;
+        retval = image.TransformImage(transform);
+    }
+    else if (name == "binarize")
+    {
+        if (parts.size() > 1 && parts[1] == "adaptive")
+        {
+            int windowSize = (parts.size() > 2) ? atoi(parts[2].c_str()) : ADAPTIVE_THRESHOLD_WINDOW;
+            int bias = (parts.size() > 3) ? atoi(parts[3].c_str()) : ADAPTIVE_THRESHOLD_BIAS;
+            retval = image.BinarizeImage(THRESHOLD_ADAPTIVE_MEAN, windowSize, bias);
+        }
+        else
+        {
+            retval = image.BinarizeImage(THRESHOLD_OTSU);
+        }
+    }
+    else if (name == "erode" || name == "dilate" || name == "open" || name == "close")
+    {
+        int width = 0;
+        int height = 0;
+        if (parts.size() < 2 || sscanf(parts[1].c_str(), "%dx%d", &width, &height) != 2)
+        {
+            error = name + " needs <width>x<height>";
+            return -1;
+        }
+
+        morphology_operation_t morphology = (name == "erode") ? MORPHOLOGY_ERODE :
+                                            (name == "dilate") ? MORPHOLOGY_DILATE :
+                                            (name == "open") ? MORPHOLOGY_OPEN : MORPHOLOGY_CLOSE;
+        retval = image.DoMorphology(morphology, width, height);
+    }
+    else if (name == "quantize")
+    {
+        int colorCount = (parts.size() > 1 && parts[1] != "dither") ? atoi(parts[1].c_str()) : MAX_COLORS;
+        retval = image.QuantizeImage(colorCount, parts.back() == "dither");
+    }
+    else if (name == "dither")
+    {
+        std::string method = (parts.size() > 1) ? parts[1] : "floyd-steinberg";
+        short bitsPerPixel = (parts.size() > 2) ? (short)atoi(parts[2].c_str()) : (short)MONOCHROME;
+        if (method != "floyd-steinberg" && method != "atkinson" && method != "ordered")
+        {
+            error = "unknown dither method \"" + method + "\"";
+            return -1;
+        }
+
+        retval = image.DitherImage((method == "atkinson") ? DITHER_ATKINSON :
+                                   (method == "ordered") ? DITHER_ORDERED : DITHER_FLOYD_STEINBERG, bitsPerPixel);
+    }
+    else if (name == "label")
+    {
+        labeling_options_t options = { -1, true, true, 0, true };
+        if (parts.size() > 1)
+        {
+            options.minimumArea = strtoull(parts[1].c_str(), nullptr, 10);
+        }
+
+        std::vector<connected_component_t> components;
+        retval = image.LabelConnectedComponents(components, &options);
+    }
+    else
+    {
+        error = "unknown operation \"" + operation + "\"";
+        return -1;
+    }
+
+    if (retval != 0)
+    {
+        error = "operation \"" + operation + "\" failed";
+    }
+
+    return retval;
+}
+
+//******************************************************************************************
+// @name                    : runJob
+//
+// @description             : Reads the input, runs the operations in order and writes the
+//                            output. Every operation after the first works on the result
+//                            of the one before, decoded again from the output buffer. With
+//                            a result cache, an input and operations seen before copy the
+//                            stored output instead, and new outputs are stored.
+//
+// @param worker            : Scheduler worker running the job, whose buffers it uses
+// @param timing            : Where the time went, on return
+// @param error             : Reason on failure
+//
+// @returns                 : 0 if SUCCESS
+//********************************************************************************************
+int ImageServer::runJob(const server_job_t &job, int worker, server_job_timing_t &timing, std::string &error)
+{
+    std::vector<unsigned char> &inputBuffer = m_buffers[worker].input;
+    std::vector<unsigned char> &outputBuffer = m_buffers[worker].output;
+    AsyncFileIO &io = *m_buffers[worker].io;
+    memset(&timing, 0, sizeof(timing));
+    double start = NowMs();
+
+    std::vector<std::string> inputPaths(1, job.inputPath);
+    io.readFiles(inputPaths, [&](int, int status, std::vector<unsigned char> &data)
+    {
+        inputBuffer.clear();
+        if (status == 0)
+        {
+            inputBuffer.swap(data);
+        }
+    });
+    if (inputBuffer.size() < (size_t)BITMAP_HEADER_SIZE)
+    {
+        error = "cannot read " + job.inputPath;
+        return -1;
+    }
+    double read = NowMs();
+    timing.readMs = read - start;
+
+    std::string key;
+    if (m_cache != nullptr)
+    {
+        key = ResultCache::MakeKey(&inputBuffer[0], inputBuffer.size(), JobCacheOperations(job));
+        if (m_cache->lookup(key, job.outputPath.c_str()))
+        {
+            double end = NowMs();
+            timing.writeMs = end - read;
+            timing.totalMs = end - start;
+            timing.cached = true;
+            return 0;
+        }
+    }
+
+    bitmap_load_options_t loadOptions;
+    memset(&loadOptions, 0, sizeof(loadOptions));
+    loadOptions.shrinkFactor = 1;
+    loadOptions.histogramSampling = job.histogramSampling;
+
+    // The loader throws on inputs it cannot decode, such as files cut short
+    std::unique_ptr<BitmapImage> image;
+    try
+    {
+        image.reset(new BitmapImage(&inputBuffer[0], inputBuffer.size(), job.inputPath.c_str(), &loadOptions));
+
+        double decoded = NowMs();
+        timing.decodeMs = decoded - read;
+
+        for (size_t i = 0; i < job.operations.size(); i++)
+        {
+            if (i > 0)
+            {
+                // The previous image goes first, so that at most three images are held
+                image->getModifiedImageFileData(outputBuffer);
+                image.reset();
+                image.reset(new BitmapImage(&outputBuffer[0], outputBuffer.size(), job.inputPath.c_str(), &loadOptions));
+            }
+
+            if (this->runOperation(*image, job.operations[i], error) != 0)
+            {
+                return -1;
+            }
+        }
+
+        double processed = NowMs();
+        timing.processMs = processed - decoded;
+
+        image->getModifiedImageFileData(outputBuffer);
+    }
+    catch (const char *exception)
+    {
+        error = job.inputPath + ": " + exception;
+        return -1;
+    }
+    catch (const std::bad_alloc &)
+    {
+        error = job.inputPath + ": out of memory";
+        return -1;
+    }
+    image.reset();
+
+    std::vector<async_write_request_t> outputs(1);
+    outputs[0].path = job.outputPath;
+    outputs[0].data = &outputBuffer[0];
+    outputs[0].size = outputBuffer.size();
+    if (io.writeFiles(outputs, [](int, int) {}) != 0)
+    {
+        error = "cannot write " + job.outputPath;
+        return -1;
+    }
+
+    if (m_cache != nullptr)
+    {
+        m_cache->store(key, &outputBuffer[0], outputBuffer.size());
+    }
+
+    double end = NowMs();
+    timing.writeMs = end - start - timing.readMs - timing.decodeMs - timing.processMs;
+    timing.totalMs = end - start;
+
+    return 0;
+}
+
+//******************************************************************************************
+// @name                    : handleLine
+//
+// @description             : Submits the job of one line of input. Replies to lines which
+//                            are not jobs at once, and to jobs when they finish.
+//
+// @param reply             : Called with the reply line, without the newline
+//
+// @returns                 : Nothing
+//********************************************************************************************
+void ImageServer::handleLine(const std::string &line, const server_reply_fn_t &reply)
+{
+    server_job_t job;
+    std::string error;
+
+    if (ParseJob(line, job, error) != 0)
+    {
+        reply("{\"id\":" + job.id + ",\"status\":\"error\",\"error\":" + JsonEscape(error) + "}");
+        return;
+    }
+
+    if (job.command == "shutdown")
+    {
+        m_stop = true;
+        reply("{\"id\":" + job.id + ",\"status\":\"ok\"}");
+        return;
+    }
+    if (job.command != "process")
+    {
+        reply("{\"id\":" + job.id + ",\"status\":\"error\",\"error\":" + JsonEscape("unknown command " + job.command) + "}");
+        return;
+    }
+
+    // Inputs the loader cannot decode never reach a worker
+    bitmap_file_header_t fileHeader;
+    bitmap_info_header_t infoHeader;
+    if (ProbeJobInput(job, fileHeader, infoHeader, error) != 0)
+    {
+        m_jobCount++;
+        reply("{\"id\":" + job.id + ",\"status\":\"error\",\"error\":" + JsonEscape(error) + "}");
+        return;
+    }
+
+    m_scheduler->submit([this, job, reply](int worker)
+    {
+        server_job_timing_t timing;
+        std::string error;
+        char numbers[256];
+
+        m_jobCount++;
+        if (this->runJob(job, worker, timing, error) != 0)
+        {
+            reply("{\"id\":" + job.id + ",\"status\":\"error\",\"error\":" + JsonEscape(error) + "}");
+            return;
+        }
+
+        snprintf(numbers, sizeof(numbers),
+                 ",\"cached\":%s,\"read_ms\":%.3f,\"decode_ms\":%.3f,\"process_ms\":%.3f,\"write_ms\":%.3f,\"total_ms\":%.3f}",
+                 timing.cached ? "true" : "false", timing.readMs, timing.decodeMs, timing.processMs, timing.writeMs, timing.totalMs);
+        reply("{\"id\":" + job.id + ",\"status\":\"ok\"" + numbers);
+    }, EstimateJobMemory(job, fileHeader, infoHeader));
+}
+
+//******************************************************************************************
+// @name                    : serveStream
+//
+// @description             : Runs the jobs of input, one per line, and writes a reply line
+//                            for each to output, until the end of input or a shutdown
+//                            command. Blank lines are skipped. Returns when the jobs read
+//                            have finished.
+//
+// @returns                 : 0 if SUCCESS
+//********************************************************************************************
+int ImageServer::serveStream(FILE *input, FILE *output)
+{
+    std::vector<char> chunk(SERVER_READ_CHUNK_SIZE);
+    std::string line;
+    bool tooLong = false;
+    std::mutex outputMutex;
+
+    server_reply_fn_t reply = [output, &outputMutex](const std::string &text)
+    {
+        std::unique_lock<std::mutex> lock(outputMutex);
+        fprintf(output, "%s\n", text.c_str());
+        fflush(output);
+    };
+
+    while (!m_stop && fgets(&chunk[0], (int)chunk.size(), input) != nullptr)
+    {
+        size_t length = strlen(&chunk[0]);
+        bool complete = (length > 0 && chunk[length - 1] == '\n');
+        if (!tooLong)
+        {
+            line.append(&chunk[0], complete ? length - 1 : length);
+            tooLong = (line.size() > SERVER_MAX_LINE_SIZE);
+        }
+
+        if (!complete && !feof(input))
+        {
+            continue;
+        }
+
+        if (tooLong)
+        {
+            reply("{\"id\":null,\"status\":\"error\",\"error\":\"job line too long\"}");
+        }
+        else if (line.find_first_not_of(" \t\r") != std::string::npos)
+        {
+            this->handleLine(line, reply);
+        }
+
+        line.clear();
+        tooLong = false;
+    }
+
+    m_scheduler->waitIdle();
+    return 0;
+}
+
+//******************************************************************************************
+// @name                    : serveStdio
+//
+// @description             : Runs jobs from stdin and replies on stdout. Messages the image
+//                            code prints go to stderr instead, so stdout only carries replies.
+//
+// @returns                 : 0 if SUCCESS
+//********************************************************************************************
+int ImageServer::serveStdio()
+{
+    fflush(stdout);
+    int replyFd = dup(fileno(stdout));
+    if (replyFd < 0 || dup2(fileno(stderr), fileno(stdout)) < 0)
+    {
+        printf("ERROR: Cannot redirect stdout!\n");
+        return -1;
+    }
+
+    FILE *replies = fdopen(replyFd, "w");
+    if (replies == nullptr)
+    {
+        printf("ERROR: Cannot open the reply stream!\n");
+        return -1;
+    }
+
+    int retval = this->serveStream(stdin, replies);
+    fclose(replies);
+
+    return retval;
+}
+
+#if !defined(_WIN32)
+//******************************************************************************************
+// @name                    : SendAll
+//
+// @description             : This is a static function. Writes all of data to a socket
+//
+// @returns                 : 0 if SUCCESS
+//********************************************************************************************
+static int SendAll(int fd, const std::string &data)
+{
+    size_t sent = 0;
+    while (sent < data.size())
+    {
+        ssize_t count = send(fd, data.data() + sent, data.size() - sent, 0);
+        if (count < 0 && errno == EINTR)
+        {
+            continue;
+        }
+        if (count <= 0)
+        {
+            return -1;
+        }
+        sent += (size_t)count;
+    }
+
+    return 0;
+}
+
+// A client connection. Replies of its jobs hold it too, so it is closed when the client has
+// gone and its last job has replied.
+typedef struct server_client_tag
+{
+    int fd;
+    std::mutex mutex;                   // Keeps the reply lines of concurrent jobs whole
+}server_client_t;
+
+//******************************************************************************************
+// @name                    : CloseClient
+//
+// @description             : This is a static function. Deleter of a client connection
+//
+// @returns                 : Nothing
+//********************************************************************************************
+static void CloseClient(server_client_t *client)
+{
+    close(client->fd);
+    delete client;
+}
+#endif
+
+//******************************************************************************************
+// @name                    : serveSocket
+//
+// @description             : Listens on a Unix domain socket and runs the jobs of every
+//                            client, one line per job, replying on the same connection as
+//                            each job finishes. Clients may close their sending side after
+//                            the last job and still get the replies. Returns after a
+//                            shutdown command, when the jobs read have finished.
+//
+// @param socketPath        : Path of the socket. A stale socket there is replaced.
+//
+// @returns                 : 0 if SUCCESS
+//********************************************************************************************
+int ImageServer::serveSocket(const char *socketPath)
+{
+#if defined(_WIN32)
+    printf("ERROR: Socket mode is not supported on this platform!\n");
+    return -1;
+#else
+    struct sockaddr_un address;
+    if (socketPath == nullptr || strlen(socketPath) >= sizeof(address.sun_path))
+    {
+        printf("ERROR: Invalid socket path!\n");
+        return -1;
+    }
+
+    // A client closing early must not end the server
+    signal(SIGPIPE, SIG_IGN);
+
+    int listenFd = socket(AF_UNIX, SOCK_STREAM, 0);
+    if (listenFd < 0)
+    {
+        printf("ERROR: Cannot create socket (%s)!\n", strerror(errno));
+        return -1;
+    }
+
+    memset(&address, 0, sizeof(address));
+    address.sun_family = AF_UNIX;
+    strcpy(address.sun_path, socketPath);
+    unlink(socketPath);
+
+    if (bind(listenFd, (struct sockaddr*)&address, sizeof(address)) != 0 || listen(listenFd, SERVER_LISTEN_BACKLOG) != 0)
+    {
+        printf("ERROR: Cannot listen on [%s] (%s)!\n", socketPath, strerror(errno));
+        close(listenFd);
+        return -1;
+    }
+
+    // Entry 0 is the listening socket, the rest are clients with their unfinished lines
+    std::vector<struct pollfd> fds(1);
+    std::vector<std::shared_ptr<server_client_t> > clients(1);
+    std::vector<std::string> pending(1);
+    fds[0].fd = listenFd;
+    fds[0].events = POLLIN;
+    std::vector<char> chunk(SERVER_READ_CHUNK_SIZE);
+
+    while (!m_stop)
+    {
+        if (poll(&fds[0], fds.size(), -1) < 0)
+        {
+            if (errno == EINTR)
+            {
+                continue;
+            }
+            printf("ERROR: poll failed (%s)!\n", strerror(errno));
+            break;
+        }
+
+        for (size_t i = fds.size() - 1; i > 0 && !m_stop; i--)
+        {
+            if (fds[i].revents == 0)
+            {
+                continue;
+            }
+
+            bool closeClient = false;
+            ssize_t count = read(fds[i].fd, &chunk[0], chunk.size());
+            if (count <= 0)
+            {
+                closeClient = (count == 0 || errno != EINTR);
+            }
+            else
+            {
+                pending[i].append(&chunk[0], (size_t)count);
+
+                std::shared_ptr<server_client_t> client = clients[i];
+                server_reply_fn_t reply = [client](const std::string &text)
+                {
+                    std::unique_lock<std::mutex> lock(client->mutex);
+                    SendAll(client->fd, text + "\n");
+                };
+
+                // submit() blocks while too many jobs wait for memory, which stops reading
+                // from every client until the backlog clears
+                size_t newline;
+                while (!m_stop && (newline = pending[i].find('\n')) != std::string::npos)
+                {
+                    std::string line = pending[i].substr(0, newline);
+                    pending[i].erase(0, newline + 1);
+
+                    if (line.find_first_not_of(" \t\r") != std::string::npos)
+                    {
+                        this->handleLine(line, reply);
+                    }
+                }
+
+                if (pending[i].size() > SERVER_MAX_LINE_SIZE)
+                {
+                    reply("{\"id\":null,\"status\":\"error\",\"error\":\"job line too long\"}");
+                    closeClient = true;
+                }
+            }
+
+            if (closeClient)
+            {
+                fds.erase(fds.begin() + i);
+                clients.erase(clients.begin() + i);
+                pending.erase(pending.begin() + i);
+            }
+        }
+
+        if (!m_stop && (fds[0].revents & POLLIN))
+        {
+            int clientFd = accept(listenFd, nullptr, nullptr);
+            if (clientFd >= 0)
+            {
+                struct pollfd client;
+                client.fd = clientFd;
+                client.events = POLLIN;
+                client.revents = 0;
+                fds.push_back(client);
+                clients.push_back(std::shared_ptr<server_client_t>(new server_client_t, CloseClient));
+                clients.back()->fd = clientFd;
+                pending.push_back(std::string());
+            }
+        }
+    }
+
+    close(listenFd);
+    unlink(socketPath);
+    m_scheduler->waitIdle();
+
+    return 0;
+#endif
+}
+
+//******************************************************************************************
+// @name                    : getJobCount
+//
+// @description             : Number of jobs run so far, successful or not
+//
+// @returns                 : Job count
+//********************************************************************************************
+unsigned long long ImageServer::getJobCount()
+{
+    return m_jobCount;
+}
+
+//******************************************************************************************
+// @name                    : getSchedulerStats
+//
+// @description             : Job, steal and memory counters of the scheduler
+//
+// @returns                 : Counters
+//********************************************************************************************
+scheduler_stats_t ImageServer::getSchedulerStats()
+{
+    return m_scheduler->getStats();
+}
@@ -0,0 +1,104 @@
+#ifndef _IMAGE_SERVER_H_
+#define _IMAGE_SERVER_H_
+#include<stdio.h>
+#include<atomic>
+#include<functional>
+#include<string>
+#include<vector>
+#include"async_io.h"
+#include"job_scheduler.h"
+#include"result_cache.h"
+
+class BitmapImage;
+struct bitmap_file_header_tag;
+struct bitmap_info_header_tag;
+
+// ==================================================================================================
+// Constants
+// ==================================================================================================
+const int SERVER_LISTEN_BACKLOG = 64;               // Connections waiting to be accepted
+const int SERVER_READ_CHUNK_SIZE = 64 << 10;        // Bytes read from a client or stdin at a time
+const size_t SERVER_MAX_LINE_SIZE = 1 << 20;        // Longer job lines are rejected
+const size_t SERVER_MMAP_THRESHOLD = 32 << 20;      // Freed buffers below this size stay in the heap
+const unsigned long long SERVER_JOB_OVERHEAD_BYTES = 1 << 20;   // Histograms, headers and palettes of a job
+
+// ==================================================================================================
+// Structures
+// ==================================================================================================
+// One job: a line of JSON such as
+//   {"id": 7, "input": "a.bmp", "operations": ["resize:640x480:lanczos", "equalize:luma"], "output": "b.bmp"}
+// Operations run in order, each on the result of the one before. "histogram_sampling": 0.01
+// has equalization and Otsu thresholds use histograms of a sample of the pixels.
+typedef struct server_job_tag
+{
+    std::string id;                     // Echoed in the reply as it was sent (JSON text), "null" if none
+    std::string command;                // "process" (the default) or "shutdown"
+    std::string inputPath;
+    std::string outputPath;
+    std::vector<std::string> operations;
+    double histogramSampling;           // Fraction of the pixels the histograms count, 0 for all
+}server_job_t;
+
+// Where the time of a job went, in milliseconds
+typedef struct server_job_timing_tag
+{
+    double readMs;                      // Reading the input file
+    double decodeMs;                    // Decoding it
+    double processMs;                   // Running the operations
+    double writeMs;                     // Encoding and writing the output file
+    double totalMs;
+    bool cached;                        // The output was copied from the result cache
+}server_job_timing_t;
+
+// File buffers and file I/O of one scheduler worker, reused by every job it runs
+typedef struct server_buffers_tag
+{
+    std::vector<unsigned char> input;   // Input file
+    std::vector<unsigned char> output;  // Output file and intermediate results
+    AsyncFileIO *io;                    // Reads inputs and writes outputs
+}server_buffers_t;
+
+// Sends a reply line, without its newline. May be called from any worker.
+typedef std::function<void(const std::string &reply)> server_reply_fn_t;
+
+// ==================================================================================================
+// ImageServer class definition
+// ==================================================================================================
+// Long running process that takes jobs as newline delimited JSON, from stdin or from clients
+// of a Unix domain socket, and replies to each with a line of JSON giving its status and
+// timing. The thread pool, kernel selection and file buffers stay warm from job to job, so
+// one server replaces a process per image. Jobs run concurrently on a JobScheduler, within
+// a memory budget estimated from the input headers; replies come in completion order.
+// Inputs whose headers are invalid, or which are compressed, are rejected before they are
+// queued. With a cache directory, a job whose input and operations were seen before copies
+// the earlier output.
+class ImageServer
+{
+private:
+    JobScheduler *m_scheduler;                        // Runs the jobs
+    std::vector<server_buffers_t> m_buffers;          // One per scheduler worker
+    ResultCache *m_cache;                             // Outputs of earlier jobs, nullptr if not cached
+    std::atomic<unsigned long long> m_jobCount;       // Jobs run, successful or not
+    std::atomic<bool> m_stop;                         // Set by a shutdown command
+
+    int runOperation(BitmapImage &image, const std::string &operation, std::string &error);
+    int runJob(const server_job_t &job, int worker, server_job_timing_t &timing, std::string &error);
+    void handleLine(const std::string &line, const server_reply_fn_t &reply);
+
+public:
+    ImageServer(unsigned long long memoryBudget = SCHEDULER_DEFAULT_MEMORY_BUDGET, int workerCount = 0,
+                const char *cacheDirectory = nullptr);
+    ~ImageServer();
+    static int ParseJob(const std::string &line, server_job_t &job, std::string &error);
+    static int ProbeJobInput(const server_job_t &job, struct bitmap_file_header_tag &fileHeader,
+                             struct bitmap_info_header_tag &infoHeader, std::string &error);
+    static unsigned long long EstimateJobMemory(const server_job_t &job, const struct bitmap_file_header_tag &fileHeader,
+                                                const struct bitmap_info_header_tag &infoHeader);
+    int serveStream(FILE *input, FILE *output);
+    int serveStdio();
+    int serveSocket(const char *socketPath);
+    unsigned long long getJobCount();
+    scheduler_stats_t getSchedulerStats();
+};
+
+#endif
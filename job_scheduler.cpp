@@ -0,0 +1,270 @@
+#include"job_scheduler.h"
+#include"thread_pool.h"
+#include<string.h>
+
+//******************************************************************************************
+// @name                    : JobScheduler
+//
+// @description             : Constructor. Starts the workers.
+//
+// @param memoryBudget      : Bytes the admitted jobs may use together
+// @param workerCount       : Jobs run at once at most. 0 for the number of hardware threads.
+// @param largeJobBytes     : Jobs expected to use this much or more run with intra-image
+//                            parallelism
+//
+// @returns                 : Nothing
+//********************************************************************************************
+JobScheduler::JobScheduler(unsigned long long memoryBudget, int workerCount, unsigned long long largeJobBytes)
+{
+    if (workerCount <= 0)
+    {
+        workerCount = (std::thread::hardware_concurrency() > 0) ? (int)std::thread::hardware_concurrency() : 1;
+    }
+
+    m_memoryBudget = memoryBudget;
+    m_largeJobBytes = largeJobBytes;
+    m_maxPendingJobs = SCHEDULER_MAX_PENDING_JOBS;
+    m_activeJobs = 0;
+    m_nextQueue = 0;
+    m_queuedJobs = 0;
+    memset(&m_stats, 0, sizeof(m_stats));
+    m_stop = false;
+
+    for (int i = 0; i < workerCount; i++)
+    {
+        m_queues.push_back(std::unique_ptr<scheduler_queue_t>(new scheduler_queue_t));
+    }
+    for (int i = 0; i < workerCount; i++)
+    {
+        m_workers.push_back(std::thread(&JobScheduler::workerLoop, this, i));
+    }
+}
+
+//******************************************************************************************
+// @name                    : ~JobScheduler
+//
+// @description             : Destructor. Finishes the submitted jobs and joins the workers.
+//
+// @returns                 : Nothing
+//********************************************************************************************
+JobScheduler::~JobScheduler()
+{
+    this->waitIdle();
+
+    {
+        std::unique_lock<std::mutex> lock(m_mutex);
+        m_stop = true;
+    }
+    m_workAvailable.notify_all();
+
+    for (size_t i = 0; i < m_workers.size(); i++)
+    {
+        m_workers[i].join();
+    }
+}
+
+//******************************************************************************************
+// @name                    : submit
+//
+// @description             : Queues a job. Blocks while SCHEDULER_MAX_PENDING_JOBS jobs are
+//                            waiting for memory, which holds back a producer that is faster
+//                            than the budget allows.
+//
+// @param run               : The job
+// @param bytes             : Memory the job is expected to need at its peak
+//
+// @returns                 : Nothing
+//********************************************************************************************
+void JobScheduler::submit(const scheduled_job_fn_t &run, unsigned long long bytes)
+{
+    std::unique_lock<std::mutex> lock(m_mutex);
+    m_spaceAvailable.wait(lock, [this] { return (int)m_pending.size() < m_maxPendingJobs; });
+
+    scheduled_job_t job;
+    job.run = run;
+    job.bytes = bytes;
+    job.large = (bytes >= m_largeJobBytes);
+    m_pending.push_back(job);
+    m_stats.submitted++;
+
+    this->admitPendingJobs();
+}
+
+//******************************************************************************************
+// @name                    : admitPendingJobs
+//
+// @description             : Admits waiting jobs, oldest first, while they fit the budget.
+//                            A job which does not fit holds back the ones behind it, so it
+//                            is not starved by a stream of smaller jobs. A job larger than
+//                            the budget is admitted once nothing else runs. Called with
+//                            m_mutex held.
+//
+// @returns                 : Nothing
+//********************************************************************************************
+void JobScheduler::admitPendingJobs()
+{
+    bool admitted = false;
+
+    while (!m_pending.empty())
+    {
+        scheduled_job_t &job = m_pending.front();
+        if (m_activeJobs > 0 && m_stats.bytesInUse + job.bytes > m_memoryBudget)
+        {
+            break;
+        }
+
+        m_stats.bytesInUse += job.bytes;
+        if (m_stats.bytesInUse > m_stats.peakBytesInUse)
+        {
+            m_stats.peakBytesInUse = m_stats.bytesInUse;
+        }
+        m_activeJobs++;
+
+        // Counted first, so that the count never drops below zero when a worker takes the job at once
+        m_queuedJobs++;
+        scheduler_queue_t &queue = *m_queues[m_nextQueue];
+        m_nextQueue = (m_nextQueue + 1) % (int)m_queues.size();
+        {
+            std::unique_lock<std::mutex> queueLock(queue.mutex);
+            queue.jobs.push_back(std::move(job));
+        }
+        m_pending.pop_front();
+        admitted = true;
+    }
+
+    if (admitted)
+    {
+        m_workAvailable.notify_all();
+        m_spaceAvailable.notify_all();
+    }
+}
+
+//******************************************************************************************
+// @name                    : takeJob
+//
+// @description             : Takes the next job of the worker's own queue, or else steals
+//                            the last job of another worker's queue
+//
+// @returns                 : true if a job was taken
+//********************************************************************************************
+bool JobScheduler::takeJob(int worker, scheduled_job_t &job)
+{
+    int count = (int)m_queues.size();
+
+    for (int i = 0; i < count; i++)
+    {
+        scheduler_queue_t &queue = *m_queues[(worker + i) % count];
+        std::unique_lock<std::mutex> queueLock(queue.mutex);
+        if (queue.jobs.empty())
+        {
+            continue;
+        }
+
+        if (i == 0)
+        {
+            job = std::move(queue.jobs.front());
+            queue.jobs.pop_front();
+        }
+        else
+        {
+            job = std::move(queue.jobs.back());
+            queue.jobs.pop_back();
+        }
+        queueLock.unlock();
+        m_queuedJobs--;
+
+        if (i > 0)
+        {
+            std::unique_lock<std::mutex> lock(m_mutex);
+            m_stats.steals++;
+        }
+        return true;
+    }
+
+    return false;
+}
+
+//******************************************************************************************
+// @name                    : workerLoop
+//
+// @description             : Body of every worker. Runs jobs until the scheduler stops.
+//
+// @returns                 : Nothing
+//********************************************************************************************
+void JobScheduler::workerLoop(int worker)
+{
+    while (true)
+    {
+        scheduled_job_t job;
+        if (!this->takeJob(worker, job))
+        {
+            std::unique_lock<std::mutex> lock(m_mutex);
+            m_workAvailable.wait(lock, [this] { return m_stop || m_queuedJobs > 0; });
+            if (m_stop && m_queuedJobs == 0)
+            {
+                return;
+            }
+            continue;
+        }
+
+        ThreadPool::setRunInline(!job.large);
+        job.run(worker);
+        ThreadPool::setRunInline(false);
+
+        std::unique_lock<std::mutex> lock(m_mutex);
+        m_stats.bytesInUse -= job.bytes;
+        m_stats.completed++;
+        if (job.large)
+        {
+            m_stats.largeJobs++;
+        }
+        m_activeJobs--;
+
+        this->admitPendingJobs();
+        if (m_activeJobs == 0 && m_pending.empty())
+        {
+            m_idle.notify_all();
+        }
+    }
+}
+
+//******************************************************************************************
+// @name                    : waitIdle
+//
+// @description             : Waits until every submitted job has finished
+//
+// @returns                 : Nothing
+//********************************************************************************************
+void JobScheduler::waitIdle()
+{
+    std::unique_lock<std::mutex> lock(m_mutex);
+    m_idle.wait(lock, [this] { return m_activeJobs == 0 && m_pending.empty(); });
+}
+
+//******************************************************************************************
+// @name                    : getWorkerCount
+//
+// @description             : Number of jobs run at once at most
+//
+// @returns                 : Worker count
+//********************************************************************************************
+int JobScheduler::getWorkerCount()
+{
+    return (int)m_workers.size();
+}
+
+//******************************************************************************************
+// @name                    : getStats
+//
+// @description             : Job, steal and memory counters
+//
+// @returns                 : Counters
+//********************************************************************************************
+scheduler_stats_t JobScheduler::getStats()
+{
+    std::unique_lock<std::mutex> lock(m_mutex);
+    scheduler_stats_t stats = m_stats;
+    stats.pendingJobs = (int)m_pending.size();
+
+    return stats;
+}
@@ -0,0 +1,93 @@
+#ifndef _JOB_SCHEDULER_H_
+#define _JOB_SCHEDULER_H_
+#include<atomic>
+#include<condition_variable>
+#include<deque>
+#include<functional>
+#include<memory>
+#include<mutex>
+#include<thread>
+#include<vector>
+
+// ==================================================================================================
+// Constants
+// ==================================================================================================
+const unsigned long long SCHEDULER_DEFAULT_MEMORY_BUDGET = 2ULL << 30;     // 2 GiB
+const unsigned long long SCHEDULER_LARGE_JOB_BYTES = 64ULL << 20;          // Jobs this big split their image over the thread pool
+const int SCHEDULER_MAX_PENDING_JOBS = 256;         // submit() blocks while this many jobs wait for memory
+
+// ==================================================================================================
+// Structures
+// ==================================================================================================
+// Called on a scheduler worker, with the worker's index (0 to getWorkerCount() - 1) for
+// per-worker buffers
+typedef std::function<void(int worker)> scheduled_job_fn_t;
+
+typedef struct scheduled_job_tag
+{
+    scheduled_job_fn_t run;
+    unsigned long long bytes;           // Memory the job is expected to need at its peak
+    bool large;                         // Runs with intra-image parallelism
+}scheduled_job_t;
+
+typedef struct scheduler_stats_tag
+{
+    unsigned long long submitted;
+    unsigned long long completed;
+    unsigned long long largeJobs;       // Jobs run with intra-image parallelism
+    unsigned long long steals;          // Jobs a worker took from another worker's queue
+    unsigned long long bytesInUse;      // Memory of the admitted jobs
+    unsigned long long peakBytesInUse;
+    int pendingJobs;                    // Waiting for memory
+}scheduler_stats_t;
+
+// Admitted jobs of one worker. The owner takes from the front, thieves from the back.
+typedef struct scheduler_queue_tag
+{
+    std::mutex mutex;
+    std::deque<scheduled_job_t> jobs;
+}scheduler_queue_t;
+
+// ==================================================================================================
+// JobScheduler class definition
+// ==================================================================================================
+// Runs image jobs concurrently within a memory budget. Jobs are admitted in submission order
+// while their estimated memory fits the budget; a job larger than the whole budget runs
+// alone. Admitted jobs are dealt to the workers' queues, and idle workers steal from busy
+// ones, so a few huge images do not hold up the small ones queued behind them on the same
+// worker. Small jobs run on their worker alone, many images at once; large ones split their
+// image over the shared thread pool.
+class JobScheduler
+{
+private:
+    std::vector<std::thread> m_workers;
+    std::vector<std::unique_ptr<scheduler_queue_t> > m_queues;    // One per worker
+    std::deque<scheduled_job_t> m_pending;            // Waiting for memory, in submission order
+    unsigned long long m_memoryBudget;
+    unsigned long long m_largeJobBytes;
+    int m_maxPendingJobs;
+    int m_activeJobs;                                 // Admitted and not yet finished
+    int m_nextQueue;                                  // Queue the next admitted job goes to
+    std::atomic<int> m_queuedJobs;                    // Admitted and not yet taken by a worker
+    scheduler_stats_t m_stats;
+    bool m_stop;
+    std::mutex m_mutex;                               // Guards everything above except the queues
+    std::condition_variable m_workAvailable;          // Signalled when jobs are admitted
+    std::condition_variable m_spaceAvailable;         // Signalled when pending jobs are admitted
+    std::condition_variable m_idle;                   // Signalled when the last job finishes
+
+    void workerLoop(int worker);
+    bool takeJob(int worker, scheduled_job_t &job);
+    void admitPendingJobs();
+
+public:
+    JobScheduler(unsigned long long memoryBudget = SCHEDULER_DEFAULT_MEMORY_BUDGET, int workerCount = 0,
+                 unsigned long long largeJobBytes = SCHEDULER_LARGE_JOB_BYTES);
+    ~JobScheduler();
+    void submit(const scheduled_job_fn_t &run, unsigned long long bytes);
+    void waitIdle();
+    int getWorkerCount();
+    scheduler_stats_t getStats();
+};
+
+#endif
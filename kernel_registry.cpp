@@ -0,0 +1,405 @@
+#include"kernel_registry.h"
+#include<algorithm>
+#include<stdio.h>
+#include<stdlib.h>
+#include<string.h>
+
+//******************************************************************************************
+// @name                    : KernelRegistry
+//
+// @description             : Constructor. Detects the CPU features once and binds the
+//                            widest kernels available. BMP_SIMD_LEVEL overrides the choice.
+//
+// @returns                 : Nothing
+//********************************************************************************************
+KernelRegistry::KernelRegistry()
+{
+    m_supportedLevel = DetectSimdLevel();
+    while (getKernelTable(m_supportedLevel) == nullptr)
+    {
+        m_supportedLevel = (simd_level_t)(m_supportedLevel - 1);
+    }
+
+    m_kernels = getKernelTable(m_supportedLevel);
+
+    const char *forcedLevelName = getenv(SIMD_LEVEL_ENVIRONMENT_VARIABLE);
+    if (forcedLevelName != nullptr && forcedLevelName[0] != '\0')
+    {
+        simd_level_t forcedLevel = SIMD_SCALAR;
+        if (!ParseSimdLevel(forcedLevelName, &forcedLevel))
+        {
+            printf("WARNING: Unknown %s value [%s]\n", SIMD_LEVEL_ENVIRONMENT_VARIABLE, forcedLevelName);
+        }
+        else if (forcedLevel > m_supportedLevel)
+        {
+            printf("WARNING: %s=%s is not supported on this CPU\n", SIMD_LEVEL_ENVIRONMENT_VARIABLE, forcedLevelName);
+        }
+        else
+        {
+            m_kernels = getKernelTable(forcedLevel);
+        }
+    }
+}
+
+//******************************************************************************************
+// @name                    : getInstance
+//
+// @description             : This is a static function. Returns the process wide registry.
+//
+// @returns                 : Reference to the registry
+//********************************************************************************************
+KernelRegistry& KernelRegistry::getInstance()
+{
+    static KernelRegistry registry;
+    return registry;
+}
+
+//******************************************************************************************
+// @name                    : getKernelTable
+//
+// @description             : This is a static function. Kernels of a level.
+//
+// @returns                 : Kernel table, nullptr if the level is not compiled in
+//********************************************************************************************
+const kernel_table_t* KernelRegistry::getKernelTable(simd_level_t level)
+{
+    switch (level)
+    {
+    case SIMD_SSE2:
+        return GetSse2KernelTable();
+    case SIMD_AVX2:
+        return GetAvx2KernelTable();
+    case SIMD_AVX512:
+        return GetAvx512KernelTable();
+    default:
+        return GetScalarKernelTable();
+    }
+}
+
+//******************************************************************************************
+// @name                    : getKernels
+//
+// @description             : This is a static function. Kernels in use.
+//
+// @returns                 : Kernel table
+//********************************************************************************************
+const kernel_table_t& KernelRegistry::getKernels()
+{
+    return *getInstance().m_kernels;
+}
+
+//******************************************************************************************
+// @name                    : getSimdLevel
+//
+// @description             : This is a static function. Level of the kernels in use.
+//
+// @returns                 : SIMD level
+//********************************************************************************************
+simd_level_t KernelRegistry::getSimdLevel()
+{
+    return getInstance().m_kernels->level;
+}
+
+//******************************************************************************************
+// @name                    : getSupportedSimdLevel
+//
+// @description             : This is a static function. Widest level usable on this CPU.
+//
+// @returns                 : SIMD level
+//********************************************************************************************
+simd_level_t KernelRegistry::getSupportedSimdLevel()
+{
+    return getInstance().m_supportedLevel;
+}
+
+//******************************************************************************************
+// @name                    : setSimdLevel
+//
+// @description             : This is a static function. Forces the kernels of a level, for
+//                            testing and benchmarking. Not to be called while images are
+//                            being processed.
+//
+// @param level             : SIMD level
+//
+// @returns                 : false if the level is not usable on this CPU
+//********************************************************************************************
+bool KernelRegistry::setSimdLevel(simd_level_t level)
+{
+    KernelRegistry &registry = getInstance();
+    if (level > registry.m_supportedLevel || getKernelTable(level) == nullptr)
+    {
+        return false;
+    }
+
+    registry.m_kernels = getKernelTable(level);
+    return true;
+}
+
+//******************************************************************************************
+// @name                    : CompareResizeKernels
+//
+// @description             : Runs the resize kernels of a level and the scalar ones on
+//                            pseudo-random rows of a width, with random contributions and
+//                            weights, negative ones included, for every pixel size.
+//
+// @param seed              : State of the random numbers
+//
+// @returns                 : Name of the first kernel that differs, nullptr if none does
+//********************************************************************************************
+static const char* CompareResizeKernels(const kernel_table_t *reference, const kernel_table_t *kernels, int width,
+                                        unsigned int &seed)
+{
+    const int maxTaps = 37;
+    const int maxRows = 7;
+    int rowBytes = width * 4;
+    vector<unsigned char> rows(rowBytes * maxRows);
+    for (size_t k = 0; k < rows.size(); k++)
+    {
+        seed = seed * 1103515245 + 12345;
+        rows[k] = (k % 11 == 0) ? 255 : (k % 13 == 0) ? 0 : (unsigned char)(seed >> 16);
+    }
+
+    const int bytesPerPixel[3] = { 1, 3, 4 };
+    for (int b = 0; b < 3; b++)
+    {
+        resize_weights_t resizeWeights;
+        resizeWeights.maxTaps = maxTaps;
+        resizeWeights.contributions.resize(width + 3);
+        resizeWeights.weights.resize(resizeWeights.contributions.size() * maxTaps);
+        for (size_t x = 0; x < resizeWeights.contributions.size(); x++)
+        {
+            seed = seed * 1103515245 + 12345;
+            int count = 1 + (int)((seed >> 16) % std::min(width, maxTaps));
+            seed = seed * 1103515245 + 12345;
+            resizeWeights.contributions[x].first = (int)((seed >> 16) % (width - count + 1));
+            resizeWeights.contributions[x].count = count;
+            for (int k = 0; k < maxTaps; k++)
+            {
+                seed = seed * 1103515245 + 12345;
+                resizeWeights.weights[x * maxTaps + k] = (short)((int)((seed >> 16) % 12000) - 3000);
+            }
+        }
+
+        // The source row is exactly as long as its pixels, so overreads past it would show
+        vector<unsigned char> src(rows.begin(), rows.begin() + width * bytesPerPixel[b]);
+        vector<unsigned char> expected(resizeWeights.contributions.size() * bytesPerPixel[b]);
+        vector<unsigned char> actual(expected.size());
+        reference->resizeHorizontalRow(&src[0], &expected[0], bytesPerPixel[b], resizeWeights);
+        kernels->resizeHorizontalRow(&src[0], &actual[0], bytesPerPixel[b], resizeWeights);
+        if (expected != actual)
+            return "resize horizontal";
+    }
+
+    vector<unsigned char> expected(rowBytes);
+    vector<unsigned char> actual(rowBytes);
+    for (int count = 1; count <= maxRows; count++)
+    {
+        short weights[maxRows];
+        for (int k = 0; k < count; k++)
+        {
+            seed = seed * 1103515245 + 12345;
+            weights[k] = (short)((int)((seed >> 16) % 24000) - 6000);
+        }
+
+        reference->resizeVerticalRow(&rows[0], rowBytes, weights, count, &expected[0], rowBytes);
+        kernels->resizeVerticalRow(&rows[0], rowBytes, weights, count, &actual[0], rowBytes);
+        if (expected != actual)
+            return "resize vertical";
+    }
+
+    for (int factor = 2; factor <= 4; factor += 2)
+    {
+        vector<unsigned short> expectedSum(rowBytes);
+        vector<unsigned short> actualSum(rowBytes);
+        reference->boxSumRow(&rows[0], rowBytes, factor, rowBytes, &expectedSum[0]);
+        kernels->boxSumRow(&rows[0], rowBytes, factor, rowBytes, &actualSum[0]);
+        if (expectedSum != actualSum)
+            return "box sum";
+    }
+
+    return nullptr;
+}
+
+//******************************************************************************************
+// @name                    : runSelfTest
+//
+// @description             : This is a static function. Runs the kernels of every usable
+//                            level on pseudo-random rows of awkward widths and checks that
+//                            they produce exactly the output of the scalar kernels.
+//
+// @returns                 : true if all levels agree
+//********************************************************************************************
+bool KernelRegistry::runSelfTest()
+{
+    const int widths[] = { 1, 2, 3, 5, 7, 15, 16, 17, 31, 33, 63, 64, 65, 100, 257 };
+    const kernel_table_t *reference = GetScalarKernelTable();
+    bool passed = true;
+
+    // Lookup tables with a different mapping per channel
+    unsigned char lut[4][MAX_COLORS];
+    for (int i = 0; i < MAX_COLORS; i++)
+    {
+        lut[RED][i] = (unsigned char)(MAX_COLORS - 1 - i);
+        lut[GREEN][i] = (unsigned char)(i * 7);
+        lut[BLUE][i] = (unsigned char)(i / 2);
+        lut[BRIGHTNESS][i] = (unsigned char)i;
+    }
+
+    unsigned int seed = 12345;
+    for (int level = SIMD_SSE2; level <= getSupportedSimdLevel(); level++)
+    {
+        const kernel_table_t *kernels = getKernelTable((simd_level_t)level);
+        if (kernels == nullptr)
+        {
+            continue;
+        }
+
+        for (size_t w = 0; w < sizeof(widths) / sizeof(widths[0]); w++)
+        {
+            int width = widths[w];
+            int rowBytes = width * 3;
+
+            // Three input rows. Include the extremes, which stress the arithmetic.
+            vector<unsigned char> rows(rowBytes * 3);
+            for (size_t k = 0; k < rows.size(); k++)
+            {
+                seed = seed * 1103515245 + 12345;
+                rows[k] = (k % 11 == 0) ? 255 : (k % 13 == 0) ? 0 : (unsigned char)(seed >> 16);
+            }
+
+            const unsigned char *above = &rows[0];
+            const unsigned char *row = &rows[rowBytes];
+            const unsigned char *below = &rows[rowBytes * 2];
+            vector<unsigned char> expected(rowBytes);
+            vector<unsigned char> actual(rowBytes);
+            const char *failedKernel = nullptr;
+
+            reference->grayscaleRow(row, &expected[0], width);
+            kernels->grayscaleRow(row, &actual[0], width);
+            if (expected != actual)
+                failedKernel = "grayscale";
+
+            reference->lookupRow(row, &expected[0], width, lut);
+            kernels->lookupRow(row, &actual[0], width, lut);
+            if (expected != actual)
+                failedKernel = "lookup";
+
+            const unsigned char *neighbours[3][2] = { { above, below }, { nullptr, below }, { above, nullptr } };
+            for (int n = 0; n < 3; n++)
+            {
+                reference->blurRow(neighbours[n][0], row, neighbours[n][1], &expected[0], width);
+                kernels->blurRow(neighbours[n][0], row, neighbours[n][1], &actual[0], width);
+                if (expected != actual)
+                    failedKernel = "blur";
+            }
+
+            histogram_table_t expectedHistogram;
+            histogram_table_t actualHistogram;
+            memset(&expectedHistogram, 0, sizeof(expectedHistogram));
+            memset(&actualHistogram, 0, sizeof(actualHistogram));
+            reference->histogramRow(row, width, expectedHistogram);
+            kernels->histogramRow(row, width, actualHistogram);
+            if (memcmp(&expectedHistogram, &actualHistogram, sizeof(histogram_table_t)) != 0)
+                failedKernel = "histogram";
+
+            statistics_sums_t expectedSums;
+            statistics_sums_t actualSums;
+            memset(&expectedSums, 0, sizeof(expectedSums));
+            memset(expectedSums.minimum, MAX_COLORS - 1, sizeof(expectedSums.minimum));
+            actualSums = expectedSums;
+            reference->statisticsRow(row, width, expectedSums);
+            kernels->statisticsRow(row, width, actualSums);
+            if (memcmp(&expectedSums, &actualSums, sizeof(statistics_sums_t)) != 0)
+                failedKernel = "statistics";
+
+            // Two rows to separate and interleaved chroma, and a last odd row
+            int chromaWidth = (width + 1) / 2;
+            vector<unsigned char> expectedPlanes(width * 3 + chromaWidth * 2);
+            vector<unsigned char> actualPlanes(expectedPlanes.size());
+            for (int n = 0; n < 3; n++)
+            {
+                const unsigned char *bottom = (n == 2) ? row : below;
+                int chromaStep = (n == 1) ? 2 : 1;
+                int crOffset = (n == 1) ? 1 : chromaWidth;
+                unsigned char *planes[2] = { &expectedPlanes[0], &actualPlanes[0] };
+                const kernel_table_t *tables[2] = { reference, kernels };
+
+                for (int k = 0; k < 2; k++)
+                {
+                    memset(planes[k], 0, expectedPlanes.size());
+                    tables[k]->ycbcr420Row(row, bottom, width, planes[k], (n == 2) ? nullptr : planes[k] + width,
+                                           planes[k] + width * 2, planes[k] + width * 2 + crOffset, chromaStep);
+                }
+                if (expectedPlanes != actualPlanes)
+                    failedKernel = "ycbcr 4:2:0";
+            }
+
+            reference->ycbcr444Row(row, width, &expectedPlanes[0], &expectedPlanes[width], &expectedPlanes[width * 2]);
+            kernels->ycbcr444Row(row, width, &actualPlanes[0], &actualPlanes[width], &actualPlanes[width * 2]);
+            if (expectedPlanes != actualPlanes)
+                failedKernel = "ycbcr 4:4:4";
+
+            reference->lumaRow(row, &expected[0], width);
+            kernels->lumaRow(row, &actual[0], width);
+            if (expected != actual)
+                failedKernel = "luma";
+
+            // Every palette depth, with thresholds of both extremes
+            const unsigned char thresholds[ORDERED_DITHER_SIZE] = { 0, 254, 127, 1, 253, 64, 190, 32 };
+            const int depths[3] = { MONOCHROME, BITS_4_PALLETIZED, BITS_8_PALLETIZED };
+            for (int d = 0; d < 3; d++)
+            {
+                reference->orderedDitherRow(row, width, thresholds, depths[d], &expected[0]);
+                kernels->orderedDitherRow(row, width, thresholds, depths[d], &actual[0]);
+                if (memcmp(&expected[0], &actual[0], (width * depths[d] + 7) / 8) != 0)
+                    failedKernel = "ordered dither";
+            }
+
+            const char *failedResizeKernel = CompareResizeKernels(reference, kernels, width, seed);
+            if (failedResizeKernel != nullptr)
+                failedKernel = failedResizeKernel;
+
+            if (failedKernel != nullptr)
+            {
+                printf("ERROR: %s %s kernel differs from scalar for width %d\n",
+                       GetSimdLevelName((simd_level_t)level), failedKernel, width);
+                passed = false;
+            }
+        }
+
+        // Every possible color through the luma and chroma arithmetic
+        vector<unsigned char> allColors(MAX_COLORS * MAX_COLORS * 3);
+        vector<unsigned char> expected(allColors.size());
+        vector<unsigned char> actual(allColors.size());
+        const int colorCount = MAX_COLORS * MAX_COLORS;
+        for (int blue = 0; blue < MAX_COLORS; blue++)
+        {
+            for (int i = 0; i < MAX_COLORS * MAX_COLORS; i++)
+            {
+                allColors[i * 3] = (unsigned char)blue;
+                allColors[i * 3 + 1] = (unsigned char)(i & 0xFF);
+                allColors[i * 3 + 2] = (unsigned char)(i >> 8);
+            }
+
+            reference->grayscaleRow(&allColors[0], &expected[0], MAX_COLORS * MAX_COLORS);
+            kernels->grayscaleRow(&allColors[0], &actual[0], MAX_COLORS * MAX_COLORS);
+            if (expected != actual)
+            {
+                printf("ERROR: %s luma differs from scalar for blue %d\n", GetSimdLevelName((simd_level_t)level), blue);
+                passed = false;
+                break;
+            }
+
+            reference->ycbcr444Row(&allColors[0], colorCount, &expected[0], &expected[colorCount], &expected[colorCount * 2]);
+            kernels->ycbcr444Row(&allColors[0], colorCount, &actual[0], &actual[colorCount], &actual[colorCount * 2]);
+            if (expected != actual)
+            {
+                printf("ERROR: %s chroma differs from scalar for blue %d\n", GetSimdLevelName((simd_level_t)level), blue);
+                passed = false;
+                break;
+            }
+        }
+    }
+
+    return passed;
+}
@@ -0,0 +1,119 @@
+#ifndef _KERNEL_REGISTRY_H_
+#define _KERNEL_REGISTRY_H_
+#include"bmp.h"
+#include"cpu_features.h"
+
+// ==================================================================================================
+// Constants
+// ==================================================================================================
+const char* const SIMD_LEVEL_ENVIRONMENT_VARIABLE = "BMP_SIMD_LEVEL";   // Forces a level, e.g. "sse2"
+
+// The SIMD kernels compute luma exactly as LumaFromRGB does, without a division:
+//   s / LUMA_WEIGHT_SCALE == (((s >> 3) * LUMA_RECIPROCAL) >> 22)   for every 0 <= s <= 255 * 1000
+// s >> 3 fits 16 bits, so the multiply is a 16 bit multiply-high followed by a shift of 6.
+const int LUMA_SUM_SHIFT = 3;
+const int LUMA_RECIPROCAL = 33555;
+const int LUMA_RECIPROCAL_SHIFT = 6;
+
+// Chroma weights as pairs of 16 bit weights, for multiply-adds on 32 bit lanes of blue | red << 16
+// and of green
+const int CB_BLUE_RED_WEIGHTS = (CB_BLUE_WEIGHT & 0xFFFF) | (int)((unsigned int)CB_RED_WEIGHT << 16);
+const int CB_GREEN_WEIGHTS = CB_GREEN_WEIGHT & 0xFFFF;
+const int CR_BLUE_RED_WEIGHTS = (CR_BLUE_WEIGHT & 0xFFFF) | (int)((unsigned int)CR_RED_WEIGHT << 16);
+const int CR_GREEN_WEIGHTS = CR_GREEN_WEIGHT & 0xFFFF;
+
+// The SIMD statistics kernels sum squares in 32 bit lanes, which take at most 780300 per block
+// of pixels, so they are moved to 64 bit sums after this many blocks
+const int STATISTICS_FLUSH_BLOCKS = 4096;
+
+// ==================================================================================================
+// Kernel signatures. All kernels work on one row of 24 bit BGR pixels, except the resize kernels,
+// which filter every byte of a pixel alike and so take 8, 24 and 32 bit rows.
+// ==================================================================================================
+typedef void (*grayscale_row_fn)(const unsigned char *src, unsigned char *dst, int width);
+typedef void (*histogram_row_fn)(const unsigned char *row, int width, histogram_table_t &histogram);
+typedef void (*lookup_row_fn)(const unsigned char *src, unsigned char *dst, int width,
+                              const unsigned char lut[4][MAX_COLORS]);
+typedef void (*blur_row_fn)(const unsigned char *above, const unsigned char *row, const unsigned char *below,
+                            unsigned char *dst, int width);
+typedef void (*statistics_row_fn)(const unsigned char *row, int width, statistics_sums_t &sums);
+typedef void (*luma_row_fn)(const unsigned char *src, unsigned char *luma, int width);
+typedef void (*ycbcr420_row_fn)(const unsigned char *top, const unsigned char *bottom, int width,
+                                unsigned char *yTop, unsigned char *yBottom, unsigned char *cb, unsigned char *cr,
+                                int chromaStep);
+typedef void (*ycbcr444_row_fn)(const unsigned char *src, int width, unsigned char *y, unsigned char *cb, unsigned char *cr);
+typedef void (*ordered_dither_row_fn)(const unsigned char *src, int width, const unsigned char *thresholds,
+                                      int bitsPerPixel, unsigned char *dst);
+typedef void (*resize_horizontal_row_fn)(const unsigned char *src, unsigned char *dst, int bytesPerPixel,
+                                         const resize_weights_t &resizeWeights);
+typedef void (*resize_vertical_row_fn)(const unsigned char *rows, size_t rowStride, const short *weights, int count,
+                                       unsigned char *dst, int rowBytes);
+typedef void (*box_sum_row_fn)(const unsigned char *src, size_t srcStride, int factor, int rowBytes,
+                               unsigned short *rowSum);
+
+// One implementation of every operation
+typedef struct kernel_table_tag
+{
+    simd_level_t level;
+    grayscale_row_fn grayscaleRow;      // Every channel becomes the luma of the pixel
+    histogram_row_fn histogramRow;      // Adds a row to the red, green, blue and brightness histograms
+    lookup_row_fn lookupRow;            // Maps red, green and blue through their own table
+    blur_row_fn blurRow;                // Mean of the neighbours. above/below are nullptr at the edges
+    statistics_row_fn statisticsRow;    // Adds a row to the sums, minima and maxima of every channel and the luma
+    ycbcr420_row_fn ycbcr420Row;        // Y of two rows, Cb and Cr of their 2x2 blocks. bottom == top and yBottom
+                                        // is nullptr for a last odd row. chromaStep 2 interleaves Cb and Cr
+                                        // (cr == cb + 1)
+    ycbcr444_row_fn ycbcr444Row;        // Y, Cb and Cr of every pixel
+    luma_row_fn lumaRow;                // Luma of every pixel, one byte each
+    ordered_dither_row_fn orderedDitherRow; // Gray palette indices under a row of ORDERED_DITHER_SIZE thresholds,
+                                        // packed bitsPerPixel (1, 4 or 8) to a byte
+    resize_horizontal_row_fn resizeHorizontalRow; // One output pixel per contribution, the weighted sum of its
+                                        // source pixels. bytesPerPixel is 1, 3 or 4
+    resize_vertical_row_fn resizeVerticalRow;   // Weighted sum of count rows, rowStride bytes apart
+    box_sum_row_fn boxSumRow;           // Sum of factor (2 or 4) rows, srcStride bytes apart, for every byte
+}kernel_table_t;
+
+// ==================================================================================================
+// Kernel tables, one per level. nullptr if the level is not compiled in.
+// ==================================================================================================
+const kernel_table_t* GetScalarKernelTable();
+const kernel_table_t* GetSse2KernelTable();
+const kernel_table_t* GetAvx2KernelTable();
+const kernel_table_t* GetAvx512KernelTable();
+
+// Scalar helpers the SIMD kernels use for row ends
+void ScalarGrayscalePixels(const unsigned char *src, unsigned char *dst, int count);
+void ScalarBlurPixels(const unsigned char *above, const unsigned char *row, const unsigned char *below,
+                      unsigned char *dst, int width, int first, int last);
+void ScalarStatisticsPixels(const unsigned char *row, int count, statistics_sums_t &sums);
+void MergeStatisticsLanes(const unsigned char *minimum, const unsigned char *maximum, int count, bool interleaved,
+                          statistics_sums_t &sums);
+void ScalarResizeTaps(const unsigned char *src, const short *weights, int bytesPerPixel, int first, int last,
+                      int *sums);
+void ScalarResizeVerticalBytes(const unsigned char *rows, size_t rowStride, const short *weights, int count,
+                               unsigned char *dst, int first, int last);
+void ScalarBoxSumBytes(const unsigned char *src, size_t srcStride, int factor, unsigned short *rowSum,
+                       int first, int last);
+
+// ==================================================================================================
+// KernelRegistry class definition
+// ==================================================================================================
+class KernelRegistry
+{
+private:
+    const kernel_table_t *m_kernels;                  // Kernels in use
+    simd_level_t m_supportedLevel;                    // Widest level the CPU supports
+
+    KernelRegistry();
+    static KernelRegistry& getInstance();
+    static const kernel_table_t* getKernelTable(simd_level_t level);
+
+public:
+    static const kernel_table_t& getKernels();
+    static simd_level_t getSimdLevel();
+    static simd_level_t getSupportedSimdLevel();
+    static bool setSimdLevel(simd_level_t level);
+    static bool runSelfTest();
+};
+
+#endif
@@ -0,0 +1,825 @@
+#include"kernel_registry.h"
+#include"pixel_kernels.h"
+#include"simd.h"
+
+#ifdef USE_AVX2_KERNELS
+const int AVX2_LUMA_PIXELS = 16;
+const int AVX2_LOOKUP_BYTES = 24;       // 3 gathers of 8 bytes, so the channel pattern repeats
+
+//******************************************************************************************
+// @name                    : LumaWeightedSumAvx2
+//
+// @description             : This is a static function. Gathers 8 pixels as 32 bit lanes of
+//                            blue | green << 8 | red << 16 and returns (weighted sum) >> 3.
+//                            Reads one byte past the last pixel.
+//
+// @returns                 : 32 bit sums
+//********************************************************************************************
+static TARGET_AVX2 inline __m256i LumaWeightedSumAvx2(const unsigned char *src)
+{
+    const __m256i offsets = _mm256_setr_epi32(0, 3, 6, 9, 12, 15, 18, 21);
+    const __m256i blueRedWeights = _mm256_set1_epi32(LUMA_BLUE_WEIGHT | (LUMA_RED_WEIGHT << 16));
+    const __m256i greenWeight = _mm256_set1_epi32(LUMA_GREEN_WEIGHT);
+
+    __m256i pixels = _mm256_i32gather_epi32((const int*)src, offsets, 1);
+    __m256i blueRed = _mm256_and_si256(pixels, _mm256_set1_epi32(0x00FF00FF));
+    __m256i green = _mm256_and_si256(_mm256_srli_epi32(pixels, 8), _mm256_set1_epi32(0xFF));
+    __m256i sum = _mm256_add_epi32(_mm256_madd_epi16(blueRed, blueRedWeights), _mm256_madd_epi16(green, greenWeight));
+
+    return _mm256_srli_epi32(sum, LUMA_SUM_SHIFT);
+}
+
+//******************************************************************************************
+// @name                    : GrayVectorAvx2
+//
+// @description             : This is a static function. Gray level (GrayLevelFromRGB) of 16 pixels.
+//                            Reads one byte past the last pixel.
+//
+// @returns                 : 16 bit gray values
+//********************************************************************************************
+static TARGET_AVX2 inline __m256i GrayVectorAvx2(const unsigned char *src)
+{
+    const __m256i offsets = _mm256_setr_epi32(0, 3, 6, 9, 12, 15, 18, 21);
+    const __m256i blueRedWeights = _mm256_set1_epi32(GRAY_BLUE_WEIGHT | (GRAY_RED_WEIGHT << 16));
+    const __m256i greenWeight = _mm256_set1_epi32(GRAY_GREEN_WEIGHT);
+    const __m256i rounding = _mm256_set1_epi32(1 << (GRAY_WEIGHT_SHIFT - 1));
+    __m256i gray[2];
+
+    for (int k = 0; k < 2; k++)
+    {
+        __m256i pixels = _mm256_i32gather_epi32((const int*)(src + k * 24), offsets, 1);
+        __m256i blueRed = _mm256_and_si256(pixels, _mm256_set1_epi32(0x00FF00FF));
+        __m256i green = _mm256_and_si256(_mm256_srli_epi32(pixels, 8), _mm256_set1_epi32(0xFF));
+        __m256i sum = _mm256_add_epi32(_mm256_madd_epi16(blueRed, blueRedWeights), _mm256_madd_epi16(green, greenWeight));
+        gray[k] = _mm256_srli_epi32(_mm256_add_epi32(sum, rounding), GRAY_WEIGHT_SHIFT);
+    }
+
+    // The pack works per 128 bit lane, so the 64 bit quarters come out as 0-3, 8-11, 4-7, 12-15
+    return _mm256_permute4x64_epi64(_mm256_packs_epi32(gray[0], gray[1]), 0xD8);
+}
+
+//******************************************************************************************
+// @name                    : LumaVectorAvx2
+//
+// @description             : This is a static function. Luma of 16 pixels.
+//
+// @returns                 : 16 bit luma values
+//********************************************************************************************
+static TARGET_AVX2 inline __m256i LumaVectorAvx2(const unsigned char *src)
+{
+    __m256i low = LumaWeightedSumAvx2(src);
+    __m256i high = LumaWeightedSumAvx2(src + 24);
+
+    // The pack works per 128 bit lane, so the 64 bit quarters come out as 0-3, 8-11, 4-7, 12-15
+    __m256i y = _mm256_permute4x64_epi64(_mm256_packs_epi32(low, high), 0xD8);
+    y = _mm256_srli_epi16(_mm256_mulhi_epu16(y, _mm256_set1_epi16(LUMA_RECIPROCAL)), LUMA_RECIPROCAL_SHIFT);
+
+    return _mm256_min_epi16(_mm256_add_epi16(y, _mm256_set1_epi16(Y_MIN)), _mm256_set1_epi16(Y_MAX));
+}
+
+//******************************************************************************************
+// @name                    : LumaAvx2
+//
+// @description             : This is a static function. Luma of 16 pixels.
+//
+// @param luma              : 16 values on return
+//
+// @returns                 : Nothing
+//********************************************************************************************
+static TARGET_AVX2 inline void LumaAvx2(const unsigned char *src, unsigned short *luma)
+{
+    _mm256_storeu_si256((__m256i*)luma, LumaVectorAvx2(src));
+}
+
+//******************************************************************************************
+// @name                    : GrayscaleRowAvx2
+//
+// @description             : This is a static function. Replaces every color channel with
+//                            the luma of the pixel.
+//
+// @returns                 : Nothing
+//********************************************************************************************
+static TARGET_AVX2 void GrayscaleRowAvx2(const unsigned char *src, unsigned char *dst, int width)
+{
+    unsigned short luma[AVX2_LUMA_PIXELS];
+    int j = 0;
+
+    // The gathers read one byte past their last pixel, so the last pixel is left to the scalar code
+    for (; j + AVX2_LUMA_PIXELS < width; j += AVX2_LUMA_PIXELS)
+    {
+        LumaAvx2(src + j * 3, luma);
+        for (int k = 0; k < AVX2_LUMA_PIXELS; k++)
+        {
+            unsigned char *out = dst + (j + k) * 3;
+            out[0] = out[1] = out[2] = (unsigned char)luma[k];
+        }
+    }
+
+    ScalarGrayscalePixels(src + j * 3, dst + j * 3, width - j);
+}
+
+//******************************************************************************************
+// @name                    : HistogramRowAvx2
+//
+// @description             : This is a static function. Adds a row to the histograms.
+//
+// @returns                 : Nothing
+//********************************************************************************************
+static TARGET_AVX2 void HistogramRowAvx2(const unsigned char *row, int width, histogram_table_t &histogram)
+{
+    unsigned short luma[AVX2_LUMA_PIXELS];
+    int j = 0;
+
+    for (; j + AVX2_LUMA_PIXELS < width; j += AVX2_LUMA_PIXELS)
+    {
+        LumaAvx2(row + j * 3, luma);
+        for (int k = 0; k < AVX2_LUMA_PIXELS; k++)
+        {
+            const unsigned char *in = row + (j + k) * 3;
+            histogram.blue[in[0]]++;
+            histogram.green[in[1]]++;
+            histogram.red[in[2]]++;
+            histogram.brightness[luma[k]]++;
+        }
+    }
+
+    for (const unsigned char *in = row + j * 3; j < width; j++, in += 3)
+    {
+        histogram.blue[in[0]]++;
+        histogram.green[in[1]]++;
+        histogram.red[in[2]]++;
+        histogram.brightness[LumaFromRGB(in[2], in[1], in[0])]++;
+    }
+}
+
+//******************************************************************************************
+// @name                    : LookupRowAvx2
+//
+// @description             : This is a static function. Maps blue, green and red through
+//                            their own table, 8 bytes per gather. The three tables are laid
+//                            out one after another and every byte is offset to its own.
+//
+// @returns                 : Nothing
+//********************************************************************************************
+static TARGET_AVX2 void LookupRowAvx2(const unsigned char *src, unsigned char *dst, int width,
+                                      const unsigned char lut[4][MAX_COLORS])
+{
+    int table[3 * MAX_COLORS];
+    for (int i = 0; i < MAX_COLORS; i++)
+    {
+        table[i] = lut[BLUE][i];
+        table[MAX_COLORS + i] = lut[GREEN][i];
+        table[2 * MAX_COLORS + i] = lut[RED][i];
+    }
+
+    // Table offset of every byte of 24, by channel (byte position mod 3)
+    __m256i channelOffsets[3];
+    for (int g = 0; g < 3; g++)
+    {
+        int offsets[8];
+        for (int k = 0; k < 8; k++)
+        {
+            offsets[k] = ((g * 8 + k) % 3) * MAX_COLORS;
+        }
+        channelOffsets[g] = _mm256_loadu_si256((const __m256i*)offsets);
+    }
+
+    // Byte 0 of every 32 bit lane, then the two lanes side by side
+    const __m256i firstBytes = _mm256_setr_epi8(0, 4, 8, 12, -1, -1, -1, -1, -1, -1, -1, -1, -1, -1, -1, -1,
+                                                0, 4, 8, 12, -1, -1, -1, -1, -1, -1, -1, -1, -1, -1, -1, -1);
+    const __m256i joinLanes = _mm256_setr_epi32(0, 4, 0, 0, 0, 0, 0, 0);
+
+    int rowBytes = width * 3;
+    int p = 0;
+    for (; p + AVX2_LOOKUP_BYTES <= rowBytes; p += AVX2_LOOKUP_BYTES)
+    {
+        for (int g = 0; g < 3; g++)
+        {
+            __m256i bytes = _mm256_cvtepu8_epi32(_mm_loadl_epi64((const __m128i*)(src + p + g * 8)));
+            __m256i mapped = _mm256_i32gather_epi32(table, _mm256_add_epi32(bytes, channelOffsets[g]), 4);
+            mapped = _mm256_permutevar8x32_epi32(_mm256_shuffle_epi8(mapped, firstBytes), joinLanes);
+            _mm_storel_epi64((__m128i*)(dst + p + g * 8), _mm256_castsi256_si128(mapped));
+        }
+    }
+
+    for (; p < rowBytes; p++)
+    {
+        dst[p] = (unsigned char)table[(p % 3) * MAX_COLORS + src[p]];
+    }
+}
+
+//******************************************************************************************
+// @name                    : BlurRowAvx2
+//
+// @description             : This is a static function. Blurs a row. Pixels with all 8
+//                            neighbours are 32 bytes at a time: the 3x3 sum of every byte,
+//                            minus the byte itself, divided by 8.
+//
+// @returns                 : Nothing
+//********************************************************************************************
+static TARGET_AVX2 void BlurRowAvx2(const unsigned char *above, const unsigned char *row, const unsigned char *below,
+                                    unsigned char *dst, int width)
+{
+    if (above == nullptr || below == nullptr || width < 3)
+    {
+        ScalarBlurPixels(above, row, below, dst, width, 0, width);
+        return;
+    }
+
+    const unsigned char *rows[3] = { above, row, below };
+    int interiorEnd = (width - 1) * 3;
+    int p = 3;
+
+    for (; p + 32 <= interiorEnd; p += 32)
+    {
+        __m256i sumLow = _mm256_setzero_si256();
+        __m256i sumHigh = _mm256_setzero_si256();
+        for (int k = 0; k < 3; k++)
+        {
+            for (int offset = -3; offset <= 3; offset += 3)
+            {
+                const unsigned char *in = rows[k] + p + offset;
+                sumLow = _mm256_add_epi16(sumLow, _mm256_cvtepu8_epi16(_mm_loadu_si128((const __m128i*)in)));
+                sumHigh = _mm256_add_epi16(sumHigh, _mm256_cvtepu8_epi16(_mm_loadu_si128((const __m128i*)(in + 16))));
+            }
+        }
+
+        sumLow = _mm256_sub_epi16(sumLow, _mm256_cvtepu8_epi16(_mm_loadu_si128((const __m128i*)(row + p))));
+        sumHigh = _mm256_sub_epi16(sumHigh, _mm256_cvtepu8_epi16(_mm_loadu_si128((const __m128i*)(row + p + 16))));
+        __m256i mean = _mm256_packus_epi16(_mm256_srli_epi16(sumLow, 3), _mm256_srli_epi16(sumHigh, 3));
+        _mm256_storeu_si256((__m256i*)(dst + p), _mm256_permute4x64_epi64(mean, 0xD8));
+    }
+
+    for (; p < interiorEnd; p++)
+    {
+        unsigned int sum = 0;
+        for (int k = 0; k < 3; k++)
+        {
+            sum += rows[k][p - 3] + rows[k][p] + rows[k][p + 3];
+        }
+
+        dst[p] = (unsigned char)((sum - row[p]) >> 3);
+    }
+
+    ScalarBlurPixels(above, row, below, dst, width, 0, 1);
+    ScalarBlurPixels(above, row, below, dst, width, width - 1, width);
+}
+
+//******************************************************************************************
+// @name                    : StatisticsRowAvx2
+//
+// @description             : This is a static function. Adds a row to the sums, minima and
+//                            maxima, 32 pixels (3 vectors) at a time, as StatisticsRowSse2 does.
+//
+// @returns                 : Nothing
+//********************************************************************************************
+static TARGET_AVX2 void StatisticsRowAvx2(const unsigned char *row, int width, statistics_sums_t &sums)
+{
+    const __m256i zero = _mm256_setzero_si256();
+    const int colors[4] = { BLUE, GREEN, RED, BRIGHTNESS };     // Of channels 0, 1 and 2, and of the luma
+
+    __m256i byteMasks[3][3];            // By vector, then by channel
+    __m256i lowMasks[3][3];             // Same, for the bytes the 16 bit unpacks take
+    __m256i highMasks[3][3];
+    __m256i minimum[3];
+    __m256i maximum[3];
+    for (int v = 0; v < 3; v++)
+    {
+        unsigned char channels[32];
+        for (int k = 0; k < 32; k++)
+        {
+            channels[k] = (unsigned char)((v * 32 + k) % 3);
+        }
+
+        __m256i channelVector = _mm256_loadu_si256((const __m256i*)channels);
+        for (int c = 0; c < 3; c++)
+        {
+            byteMasks[v][c] = _mm256_cmpeq_epi8(channelVector, _mm256_set1_epi8((char)c));
+            lowMasks[v][c] = _mm256_unpacklo_epi8(byteMasks[v][c], byteMasks[v][c]);
+            highMasks[v][c] = _mm256_unpackhi_epi8(byteMasks[v][c], byteMasks[v][c]);
+        }
+
+        minimum[v] = _mm256_set1_epi8((char)0xFF);
+        maximum[v] = zero;
+    }
+
+    __m256i sum[4] = { zero, zero, zero, zero };            // 64 bit lanes, channels then luma
+    __m256i squares[4] = { zero, zero, zero, zero };        // 32 bit lanes
+    __m256i lumaMinimum = _mm256_set1_epi8((char)0xFF);
+    __m256i lumaMaximum = zero;
+    int blocks = 0;
+    int j = 0;
+
+    // The gathers read one byte past their last pixel, so the last pixel is left to the scalar code
+    for (; j + 32 < width; j += 32)
+    {
+        for (int v = 0; v < 3; v++)
+        {
+            __m256i bytes = _mm256_loadu_si256((const __m256i*)(row + j * 3 + v * 32));
+            __m256i low = _mm256_unpacklo_epi8(bytes, zero);
+            __m256i high = _mm256_unpackhi_epi8(bytes, zero);
+            minimum[v] = _mm256_min_epu8(minimum[v], bytes);
+            maximum[v] = _mm256_max_epu8(maximum[v], bytes);
+
+            for (int c = 0; c < 3; c++)
+            {
+                sum[c] = _mm256_add_epi64(sum[c], _mm256_sad_epu8(_mm256_and_si256(bytes, byteMasks[v][c]), zero));
+                squares[c] = _mm256_add_epi32(squares[c], _mm256_madd_epi16(low, _mm256_and_si256(low, lowMasks[v][c])));
+                squares[c] = _mm256_add_epi32(squares[c], _mm256_madd_epi16(high, _mm256_and_si256(high, highMasks[v][c])));
+            }
+        }
+
+        __m256i lumaLow = LumaVectorAvx2(row + j * 3);
+        __m256i lumaHigh = LumaVectorAvx2(row + j * 3 + 48);
+        __m256i luma = _mm256_packus_epi16(lumaLow, lumaHigh);
+        sum[3] = _mm256_add_epi64(sum[3], _mm256_sad_epu8(luma, zero));
+        squares[3] = _mm256_add_epi32(squares[3], _mm256_add_epi32(_mm256_madd_epi16(lumaLow, lumaLow),
+                                                                   _mm256_madd_epi16(lumaHigh, lumaHigh)));
+        lumaMinimum = _mm256_min_epu8(lumaMinimum, luma);
+        lumaMaximum = _mm256_max_epu8(lumaMaximum, luma);
+
+        if (++blocks == STATISTICS_FLUSH_BLOCKS || j + 64 >= width)
+        {
+            for (int c = 0; c < 4; c++)
+            {
+                unsigned int lanes[8];
+                _mm256_storeu_si256((__m256i*)lanes, squares[c]);
+                for (int k = 0; k < 8; k++)
+                {
+                    sums.sumOfSquares[colors[c]] += lanes[k];
+                }
+                squares[c] = zero;
+            }
+            blocks = 0;
+        }
+    }
+
+    if (j > 0)
+    {
+        for (int c = 0; c < 4; c++)
+        {
+            unsigned long long lanes[4];
+            _mm256_storeu_si256((__m256i*)lanes, sum[c]);
+            sums.sum[colors[c]] += lanes[0] + lanes[1] + lanes[2] + lanes[3];
+        }
+
+        unsigned char low[96];
+        unsigned char high[96];
+        for (int v = 0; v < 3; v++)
+        {
+            _mm256_storeu_si256((__m256i*)(low + v * 32), minimum[v]);
+            _mm256_storeu_si256((__m256i*)(high + v * 32), maximum[v]);
+        }
+        MergeStatisticsLanes(low, high, 96, true, sums);
+
+        _mm256_storeu_si256((__m256i*)low, lumaMinimum);
+        _mm256_storeu_si256((__m256i*)high, lumaMaximum);
+        MergeStatisticsLanes(low, high, 32, false, sums);
+
+        sums.count += j;
+    }
+
+    ScalarStatisticsPixels(row + j * 3, width - j, sums);
+}
+
+//******************************************************************************************
+// @name                    : LoadPixelsAvx2
+//
+// @description             : This is a static function. Gathers 8 pixels as 32 bit lanes of
+//                            blue | green << 8 | red << 16. Reads one byte past the last pixel.
+//
+// @param step              : Bytes from one pixel to the next; 6 loads every other pixel
+//
+// @returns                 : Pixels
+//********************************************************************************************
+static TARGET_AVX2 inline __m256i LoadPixelsAvx2(const unsigned char *src, int step)
+{
+    __m256i offsets = _mm256_mullo_epi32(_mm256_setr_epi32(0, 1, 2, 3, 4, 5, 6, 7), _mm256_set1_epi32(step));
+
+    return _mm256_i32gather_epi32((const int*)src, offsets, 1);
+}
+
+//******************************************************************************************
+// @name                    : AddChannelsAvx2
+//
+// @description             : This is a static function. Adds loaded pixels to sums of blue
+//                            and red (16 bit halves of 32 bit lanes) and of green.
+//
+// @returns                 : Nothing
+//********************************************************************************************
+static TARGET_AVX2 inline void AddChannelsAvx2(__m256i pixels, __m256i &blueRed, __m256i &green)
+{
+    blueRed = _mm256_add_epi32(blueRed, _mm256_and_si256(pixels, _mm256_set1_epi32(0x00FF00FF)));
+    green = _mm256_add_epi32(green, _mm256_and_si256(_mm256_srli_epi32(pixels, 8), _mm256_set1_epi32(0xFF)));
+}
+
+//******************************************************************************************
+// @name                    : ChromaAvx2
+//
+// @description             : This is a static function. Cb or Cr of 8 sums of 1 << SUM_SHIFT
+//                            pixels, as ChromaFromRGBSums works it out, before clamping.
+//
+// @returns                 : 32 bit values
+//********************************************************************************************
+template<int SUM_SHIFT>
+static TARGET_AVX2 inline __m256i ChromaAvx2(__m256i blueRed, __m256i green, int blueRedWeights, int greenWeights)
+{
+    const int shift = CHROMA_WEIGHT_SHIFT + SUM_SHIFT;
+
+    __m256i sum = _mm256_add_epi32(_mm256_madd_epi16(blueRed, _mm256_set1_epi32(blueRedWeights)),
+                                   _mm256_madd_epi16(green, _mm256_set1_epi32(greenWeights)));
+    sum = _mm256_srai_epi32(_mm256_add_epi32(sum, _mm256_set1_epi32(1 << (shift - 1))), shift);
+
+    return _mm256_add_epi32(sum, _mm256_set1_epi32(128));
+}
+
+//******************************************************************************************
+// @name                    : PackChromaAvx2
+//
+// @description             : This is a static function. Packs 8 Cb and 8 Cr values to bytes
+//                            clamped to [C_MIN, C_MAX].
+//
+// @returns                 : 8 Cb bytes followed by 8 Cr bytes
+//********************************************************************************************
+static TARGET_AVX2 inline __m128i PackChromaAvx2(__m256i cbValues, __m256i crValues)
+{
+    __m128i cb = _mm_packs_epi32(_mm256_castsi256_si128(cbValues), _mm256_extracti128_si256(cbValues, 1));
+    __m128i cr = _mm_packs_epi32(_mm256_castsi256_si128(crValues), _mm256_extracti128_si256(crValues, 1));
+    __m128i chroma = _mm_packus_epi16(cb, cr);
+
+    return _mm_min_epu8(_mm_max_epu8(chroma, _mm_set1_epi8(C_MIN)), _mm_set1_epi8((char)C_MAX));
+}
+
+//******************************************************************************************
+// @name                    : PackLumaAvx2
+//
+// @description             : This is a static function. Packs 16 luma values to bytes.
+//
+// @returns                 : Bytes
+//********************************************************************************************
+static TARGET_AVX2 inline __m128i PackLumaAvx2(__m256i luma)
+{
+    return _mm_packus_epi16(_mm256_castsi256_si128(luma), _mm256_extracti128_si256(luma, 1));
+}
+
+//******************************************************************************************
+// @name                    : YCbCr420RowAvx2
+//
+// @description             : This is a static function. Converts two rows to Y, and their
+//                            2x2 blocks to Cb and Cr, in one pass.
+//
+// @returns                 : Nothing
+//********************************************************************************************
+static TARGET_AVX2 void YCbCr420RowAvx2(const unsigned char *top, const unsigned char *bottom, int width,
+                                        unsigned char *yTop, unsigned char *yBottom, unsigned char *cb, unsigned char *cr,
+                                        int chromaStep)
+{
+    int j = 0;
+
+    // The gathers read one byte past their last pixel, so the last pixel is left to the scalar code
+    for (; j + AVX2_LUMA_PIXELS < width; j += AVX2_LUMA_PIXELS)
+    {
+        const unsigned char *rows[2] = { top + j * 3, bottom + j * 3 };
+
+        // Even and odd pixels of both rows add up to the 8 blocks
+        __m256i blueRed = _mm256_setzero_si256();
+        __m256i green = _mm256_setzero_si256();
+        for (int n = 0; n < 2; n++)
+        {
+            AddChannelsAvx2(LoadPixelsAvx2(rows[n], 6), blueRed, green);
+            AddChannelsAvx2(LoadPixelsAvx2(rows[n] + 3, 6), blueRed, green);
+        }
+
+        __m128i chroma = PackChromaAvx2(ChromaAvx2<2>(blueRed, green, CB_BLUE_RED_WEIGHTS, CB_GREEN_WEIGHTS),
+                                        ChromaAvx2<2>(blueRed, green, CR_BLUE_RED_WEIGHTS, CR_GREEN_WEIGHTS));
+
+        int k = j / 2;
+        if (chromaStep == 1)
+        {
+            _mm_storel_epi64((__m128i*)(cb + k), chroma);
+            _mm_storel_epi64((__m128i*)(cr + k), _mm_srli_si128(chroma, 8));
+        }
+        else
+        {
+            _mm_storeu_si128((__m128i*)(cb + k * 2), _mm_unpacklo_epi8(chroma, _mm_srli_si128(chroma, 8)));
+        }
+
+        _mm_storeu_si128((__m128i*)(yTop + j), PackLumaAvx2(LumaVectorAvx2(rows[0])));
+        if (yBottom != nullptr)
+        {
+            _mm_storeu_si128((__m128i*)(yBottom + j), PackLumaAvx2(LumaVectorAvx2(rows[1])));
+        }
+    }
+
+    YCbCr420Pixels<Bgr24Format>(top, bottom, j, width, yTop, yBottom, cb, cr, chromaStep);
+}
+
+//******************************************************************************************
+// @name                    : YCbCr444RowAvx2
+//
+// @description             : This is a static function. Converts a row to Y, Cb and Cr.
+//
+// @returns                 : Nothing
+//********************************************************************************************
+static TARGET_AVX2 void YCbCr444RowAvx2(const unsigned char *src, int width, unsigned char *y, unsigned char *cb, unsigned char *cr)
+{
+    int j = 0;
+
+    for (; j + AVX2_LUMA_PIXELS < width; j += AVX2_LUMA_PIXELS)
+    {
+        const unsigned char *in = src + j * 3;
+        for (int h = 0; h < 2; h++)
+        {
+            __m256i blueRed = _mm256_setzero_si256();
+            __m256i green = _mm256_setzero_si256();
+            AddChannelsAvx2(LoadPixelsAvx2(in + h * 24, 3), blueRed, green);
+
+            __m128i chroma = PackChromaAvx2(ChromaAvx2<0>(blueRed, green, CB_BLUE_RED_WEIGHTS, CB_GREEN_WEIGHTS),
+                                            ChromaAvx2<0>(blueRed, green, CR_BLUE_RED_WEIGHTS, CR_GREEN_WEIGHTS));
+            _mm_storel_epi64((__m128i*)(cb + j + h * 8), chroma);
+            _mm_storel_epi64((__m128i*)(cr + j + h * 8), _mm_srli_si128(chroma, 8));
+        }
+
+        _mm_storeu_si128((__m128i*)(y + j), PackLumaAvx2(LumaVectorAvx2(in)));
+    }
+
+    YCbCr444Pixels<Bgr24Format>(src, j, width, y, cb, cr);
+}
+
+//******************************************************************************************
+// @name                    : LumaRowAvx2
+//
+// @description             : This is a static function. Luma of every pixel of a row.
+//
+// @returns                 : Nothing
+//********************************************************************************************
+static TARGET_AVX2 void LumaRowAvx2(const unsigned char *src, unsigned char *luma, int width)
+{
+    int j = 0;
+
+    for (; j + AVX2_LUMA_PIXELS < width; j += AVX2_LUMA_PIXELS)
+    {
+        _mm_storeu_si128((__m128i*)(luma + j), PackLumaAvx2(LumaVectorAvx2(src + j * 3)));
+    }
+
+    for (src += j * 3; j < width; j++, src += 3)
+    {
+        luma[j] = LumaFromRGB(src[2], src[1], src[0]);
+    }
+}
+
+//******************************************************************************************
+// @name                    : OrderedDitherRowAvx2
+//
+// @description             : This is a static function. Ordered dithering of a row to gray
+//                            palette indices, 16 pixels (two threshold rows) at a time.
+//
+// @returns                 : Nothing
+//********************************************************************************************
+static TARGET_AVX2 void OrderedDitherRowAvx2(const unsigned char *src, int width, const unsigned char *thresholds,
+                                             int bitsPerPixel, unsigned char *dst)
+{
+    const __m128i zero = _mm_setzero_si128();
+    const __m256i one = _mm256_set1_epi16(1);
+    const __m256i bitWeights = _mm256_setr_epi16(128, 64, 32, 16, 8, 4, 2, 1, 128, 64, 32, 16, 8, 4, 2, 1);
+    const __m256i nibbleWeights = _mm256_set1_epi32(16 | (1 << 16));
+    __m256i threshold = _mm256_broadcastsi128_si256(_mm_unpacklo_epi8(_mm_loadl_epi64((const __m128i*)thresholds), zero));
+    __m256i maxIndex = _mm256_set1_epi16((short)((1 << bitsPerPixel) - 1));
+    int j = 0;
+
+    for (; j + AVX2_LUMA_PIXELS < width; j += AVX2_LUMA_PIXELS)
+    {
+        // OrderedDitherLevel in unsigned 16 bit lanes: n is at most 65279
+        __m256i n = _mm256_add_epi16(_mm256_mullo_epi16(GrayVectorAvx2(src + j * 3), maxIndex), threshold);
+        __m256i level = _mm256_srli_epi16(_mm256_add_epi16(_mm256_add_epi16(n, one), _mm256_srli_epi16(n, 8)), 8);
+
+        if (bitsPerPixel == MONOCHROME)
+        {
+            __m128i bits = _mm_sad_epu8(PackLumaAvx2(_mm256_mullo_epi16(level, bitWeights)), zero);
+            dst[j / 8] = (unsigned char)_mm_cvtsi128_si32(bits);
+            dst[j / 8 + 1] = (unsigned char)_mm_extract_epi16(bits, 4);
+        }
+        else if (bitsPerPixel == BITS_4_PALLETIZED)
+        {
+            __m256i pairs = _mm256_madd_epi16(level, nibbleWeights);
+            __m128i packed = _mm_packs_epi32(_mm256_castsi256_si128(pairs), _mm256_extracti128_si256(pairs, 1));
+            _mm_storel_epi64((__m128i*)(dst + j / 2), _mm_packus_epi16(packed, zero));
+        }
+        else
+        {
+            _mm_storeu_si128((__m128i*)(dst + j), PackLumaAvx2(level));
+        }
+    }
+
+    OrderedDitherPixels<Bgr24Format>(src, j, width, thresholds, bitsPerPixel, dst);
+}
+
+//******************************************************************************************
+// @name                    : ResizeHorizontalPixelsAvx2
+//
+// @description             : This is a static function. Resamples a row along x. Gray rows
+//                            take 16 taps per multiply-add, then 8; color rows take 4, two in
+//                            each 128 bit lane with channel c of both pixels side by side in
+//                            32 bit lane c. 24 bit pixels are masked loads spread to 4 bytes.
+//                            The taps left over are added by ScalarResizeTaps.
+//
+// @returns                 : Nothing
+//********************************************************************************************
+template<int BYTES_PER_PIXEL>
+static TARGET_AVX2 void ResizeHorizontalPixelsAvx2(const unsigned char *src, unsigned char *dst,
+                                                   const resize_weights_t &resizeWeights)
+{
+    const __m128i threePixelsMask = _mm_setr_epi32(-1, -1, -1, 0);
+    const __m128i spreadPixels = _mm_setr_epi8(0, 1, 2, -1, 3, 4, 5, -1, 6, 7, 8, -1, 9, 10, 11, -1);
+    const __m256i pairIndices = _mm256_setr_epi32(0, 0, 0, 0, 1, 1, 1, 1);
+    int dstWidth = (int)resizeWeights.contributions.size();
+    for (int x = 0; x < dstWidth; x++, dst += BYTES_PER_PIXEL)
+    {
+        const resize_contribution_t &contribution = resizeWeights.contributions[x];
+        const short *weights = &resizeWeights.weights[(size_t)x * resizeWeights.maxTaps];
+        const unsigned char *pixel = &src[contribution.first * BYTES_PER_PIXEL];
+
+        __m256i acc = _mm256_setzero_si256();
+        int k = 0;
+        if (BYTES_PER_PIXEL == 1)
+        {
+            for (; k + 16 <= contribution.count; k += 16)
+            {
+                __m256i values = _mm256_cvtepu8_epi16(_mm_loadu_si128((const __m128i*)(pixel + k)));
+                acc = _mm256_add_epi32(acc, _mm256_madd_epi16(values, _mm256_loadu_si256((const __m256i*)(weights + k))));
+            }
+        }
+        else
+        {
+            for (; k + 4 <= contribution.count; k += 4)
+            {
+                __m128i pixels;
+                if (BYTES_PER_PIXEL == 3)
+                    pixels = _mm_shuffle_epi8(_mm_maskload_epi32((const int*)(pixel + k * 3), threePixelsMask), spreadPixels);
+                else
+                    pixels = _mm_loadu_si128((const __m128i*)(pixel + k * 4));
+
+                __m256i values = _mm256_cvtepu8_epi16(pixels);
+                values = _mm256_unpacklo_epi16(values, _mm256_srli_si256(values, 8));
+
+                __m256i weightPairs = _mm256_permutevar8x32_epi32(
+                    _mm256_broadcastsi128_si256(_mm_loadl_epi64((const __m128i*)(weights + k))), pairIndices);
+                acc = _mm256_add_epi32(acc, _mm256_madd_epi16(values, weightPairs));
+            }
+        }
+
+        __m128i sum = _mm_add_epi32(_mm256_castsi256_si128(acc), _mm256_extracti128_si256(acc, 1));
+        if (BYTES_PER_PIXEL == 1)
+        {
+            for (; k + 8 <= contribution.count; k += 8)
+            {
+                __m128i values = _mm_cvtepu8_epi16(_mm_loadl_epi64((const __m128i*)(pixel + k)));
+                sum = _mm_add_epi32(sum, _mm_madd_epi16(values, _mm_loadu_si128((const __m128i*)(weights + k))));
+            }
+            sum = _mm_add_epi32(sum, _mm_srli_si128(sum, 8));
+            sum = _mm_add_epi32(sum, _mm_srli_si128(sum, 4));
+        }
+
+        int sums[4];
+        _mm_storeu_si128((__m128i*)sums, _mm_add_epi32(sum, _mm_set1_epi32(1 << (RESIZE_WEIGHT_BITS - 1))));
+        ScalarResizeTaps(pixel, weights, BYTES_PER_PIXEL, k, contribution.count, sums);
+        for (int c = 0; c < BYTES_PER_PIXEL; c++)
+        {
+            dst[c] = ResizeSumToByte(sums[c]);
+        }
+    }
+}
+
+//******************************************************************************************
+// @name                    : ResizeHorizontalRowAvx2
+//
+// @description             : This is a static function. Resamples a row along x.
+//
+// @returns                 : Nothing
+//********************************************************************************************
+static TARGET_AVX2 void ResizeHorizontalRowAvx2(const unsigned char *src, unsigned char *dst, int bytesPerPixel,
+                                                const resize_weights_t &resizeWeights)
+{
+    if (bytesPerPixel == 1)
+        ResizeHorizontalPixelsAvx2<1>(src, dst, resizeWeights);
+    else if (bytesPerPixel == 3)
+        ResizeHorizontalPixelsAvx2<3>(src, dst, resizeWeights);
+    else
+        ResizeHorizontalPixelsAvx2<4>(src, dst, resizeWeights);
+}
+
+//******************************************************************************************
+// @name                    : ResizeVerticalRowAvx2
+//
+// @description             : This is a static function. Produces one row of a vertical
+//                            resize, 32 bytes at a time, rows in pairs as ResizeVerticalRowSse2.
+//                            Unpacking and packing both work within 128 bit lanes, so the
+//                            bytes come out in order.
+//
+// @returns                 : Nothing
+//********************************************************************************************
+static TARGET_AVX2 void ResizeVerticalRowAvx2(const unsigned char *rows, size_t rowStride, const short *weights,
+                                              int count, unsigned char *dst, int rowBytes)
+{
+    const __m256i zero = _mm256_setzero_si256();
+    const __m256i rounding = _mm256_set1_epi32(1 << (RESIZE_WEIGHT_BITS - 1));
+    int x = 0;
+    for (; x + 32 <= rowBytes; x += 32)
+    {
+        __m256i acc0 = rounding;
+        __m256i acc1 = rounding;
+        __m256i acc2 = rounding;
+        __m256i acc3 = rounding;
+
+        for (int k = 0; k < count; k += 2)
+        {
+            __m256i rowA = _mm256_loadu_si256((const __m256i*)&rows[rowStride * k + x]);
+            __m256i rowB = zero;
+            int weightB = 0;
+            if (k + 1 < count)
+            {
+                rowB = _mm256_loadu_si256((const __m256i*)&rows[rowStride * (k + 1) + x]);
+                weightB = weights[k + 1];
+            }
+
+            __m256i weightPair = _mm256_set1_epi32((weightB << 16) | (weights[k] & 0xFFFF));
+
+            __m256i rowALow  = _mm256_unpacklo_epi8(rowA, zero);
+            __m256i rowAHigh = _mm256_unpackhi_epi8(rowA, zero);
+            __m256i rowBLow  = _mm256_unpacklo_epi8(rowB, zero);
+            __m256i rowBHigh = _mm256_unpackhi_epi8(rowB, zero);
+
+            acc0 = _mm256_add_epi32(acc0, _mm256_madd_epi16(_mm256_unpacklo_epi16(rowALow, rowBLow), weightPair));
+            acc1 = _mm256_add_epi32(acc1, _mm256_madd_epi16(_mm256_unpackhi_epi16(rowALow, rowBLow), weightPair));
+            acc2 = _mm256_add_epi32(acc2, _mm256_madd_epi16(_mm256_unpacklo_epi16(rowAHigh, rowBHigh), weightPair));
+            acc3 = _mm256_add_epi32(acc3, _mm256_madd_epi16(_mm256_unpackhi_epi16(rowAHigh, rowBHigh), weightPair));
+        }
+
+        acc0 = _mm256_srai_epi32(acc0, RESIZE_WEIGHT_BITS);
+        acc1 = _mm256_srai_epi32(acc1, RESIZE_WEIGHT_BITS);
+        acc2 = _mm256_srai_epi32(acc2, RESIZE_WEIGHT_BITS);
+        acc3 = _mm256_srai_epi32(acc3, RESIZE_WEIGHT_BITS);
+
+        __m256i packed = _mm256_packus_epi16(_mm256_packs_epi32(acc0, acc1), _mm256_packs_epi32(acc2, acc3));
+        _mm256_storeu_si256((__m256i*)&dst[x], packed);
+    }
+
+    ScalarResizeVerticalBytes(rows, rowStride, weights, count, dst, x, rowBytes);
+}
+
+//******************************************************************************************
+// @name                    : BoxSumRowAvx2
+//
+// @description             : This is a static function. Sums factor rows, 32 bytes at a time.
+//
+// @returns                 : Nothing
+//********************************************************************************************
+static TARGET_AVX2 void BoxSumRowAvx2(const unsigned char *src, size_t srcStride, int factor, int rowBytes,
+                                      unsigned short *rowSum)
+{
+    int x = 0;
+    for (; x + 32 <= rowBytes; x += 32)
+    {
+        __m256i sumLow = _mm256_setzero_si256();
+        __m256i sumHigh = _mm256_setzero_si256();
+        for (int k = 0; k < factor; k++)
+        {
+            const unsigned char *row = &src[srcStride * k + x];
+            sumLow = _mm256_add_epi16(sumLow, _mm256_cvtepu8_epi16(_mm_loadu_si128((const __m128i*)row)));
+            sumHigh = _mm256_add_epi16(sumHigh, _mm256_cvtepu8_epi16(_mm_loadu_si128((const __m128i*)(row + 16))));
+        }
+
+        _mm256_storeu_si256((__m256i*)&rowSum[x], sumLow);
+        _mm256_storeu_si256((__m256i*)&rowSum[x + 16], sumHigh);
+    }
+
+    ScalarBoxSumBytes(src, srcStride, factor, rowSum, x, rowBytes);
+}
+
+static const kernel_table_t AVX2_KERNELS =
+{
+    SIMD_AVX2,
+    GrayscaleRowAvx2,
+    HistogramRowAvx2,
+    LookupRowAvx2,
+    BlurRowAvx2,
+    StatisticsRowAvx2,
+    YCbCr420RowAvx2,
+    YCbCr444RowAvx2,
+    LumaRowAvx2,
+    OrderedDitherRowAvx2,
+    ResizeHorizontalRowAvx2,
+    ResizeVerticalRowAvx2,
+    BoxSumRowAvx2
+};
+
+const kernel_table_t* GetAvx2KernelTable()
+{
+    return &AVX2_KERNELS;
+}
+#else
+const kernel_table_t* GetAvx2KernelTable()
+{
+    return nullptr;
+}
+#endif
@@ -0,0 +1,804 @@
+#include"kernel_registry.h"
+#include"pixel_kernels.h"
+#include"simd.h"
+
+#ifdef USE_AVX512_KERNELS
+const int AVX512_LUMA_PIXELS = 32;
+const int AVX512_LOOKUP_BYTES = 48;     // 3 gathers of 16 bytes, so the channel pattern repeats
+// Full lane mask for the masked intrinsic forms. The unmasked forms merge into an uninitialized
+// vector, which GCC reports as maybe-uninitialized; the masked forms merge into zero and compile
+// to the same instructions.
+const int AVX512_ALL_LANES = -1;
+
+//******************************************************************************************
+// @name                    : LumaWeightedSumAvx512
+//
+// @description             : This is a static function. Gathers 16 pixels as 32 bit lanes of
+//                            blue | green << 8 | red << 16 and returns (weighted sum) >> 3.
+//                            Reads one byte past the last pixel.
+//
+// @returns                 : 32 bit sums
+//********************************************************************************************
+static TARGET_AVX512 inline __m512i LumaWeightedSumAvx512(const unsigned char *src)
+{
+    const __m512i offsets = _mm512_setr_epi32(0, 3, 6, 9, 12, 15, 18, 21, 24, 27, 30, 33, 36, 39, 42, 45);
+    const __m512i blueRedWeights = _mm512_set1_epi32(LUMA_BLUE_WEIGHT | (LUMA_RED_WEIGHT << 16));
+    const __m512i greenWeight = _mm512_set1_epi32(LUMA_GREEN_WEIGHT);
+
+    __m512i pixels = _mm512_mask_i32gather_epi32(_mm512_setzero_si512(), AVX512_ALL_LANES, offsets, (const int*)src, 1);
+    __m512i blueRed = _mm512_and_si512(pixels, _mm512_set1_epi32(0x00FF00FF));
+    __m512i green = _mm512_and_si512(_mm512_maskz_srli_epi32(AVX512_ALL_LANES, pixels, 8), _mm512_set1_epi32(0xFF));
+    __m512i sum = _mm512_add_epi32(_mm512_madd_epi16(blueRed, blueRedWeights), _mm512_madd_epi16(green, greenWeight));
+
+    return _mm512_maskz_srli_epi32(AVX512_ALL_LANES, sum, LUMA_SUM_SHIFT);
+}
+
+//******************************************************************************************
+// @name                    : GrayVectorAvx512
+//
+// @description             : This is a static function. Gray level (GrayLevelFromRGB) of 32 pixels.
+//                            Reads one byte past the last pixel.
+//
+// @returns                 : 16 bit gray values
+//********************************************************************************************
+static TARGET_AVX512 inline __m512i GrayVectorAvx512(const unsigned char *src)
+{
+    const __m512i offsets = _mm512_setr_epi32(0, 3, 6, 9, 12, 15, 18, 21, 24, 27, 30, 33, 36, 39, 42, 45);
+    const __m512i order = _mm512_setr_epi64(0, 2, 4, 6, 1, 3, 5, 7);
+    const __m512i blueRedWeights = _mm512_set1_epi32(GRAY_BLUE_WEIGHT | (GRAY_RED_WEIGHT << 16));
+    const __m512i greenWeight = _mm512_set1_epi32(GRAY_GREEN_WEIGHT);
+    const __m512i rounding = _mm512_set1_epi32(1 << (GRAY_WEIGHT_SHIFT - 1));
+    __m512i gray[2];
+
+    for (int k = 0; k < 2; k++)
+    {
+        __m512i pixels = _mm512_mask_i32gather_epi32(_mm512_setzero_si512(), AVX512_ALL_LANES, offsets, (const int*)(src + k * 48), 1);
+        __m512i blueRed = _mm512_and_si512(pixels, _mm512_set1_epi32(0x00FF00FF));
+        __m512i green = _mm512_and_si512(_mm512_maskz_srli_epi32(AVX512_ALL_LANES, pixels, 8), _mm512_set1_epi32(0xFF));
+        __m512i sum = _mm512_add_epi32(_mm512_madd_epi16(blueRed, blueRedWeights), _mm512_madd_epi16(green, greenWeight));
+        gray[k] = _mm512_maskz_srli_epi32(AVX512_ALL_LANES, _mm512_add_epi32(sum, rounding), GRAY_WEIGHT_SHIFT);
+    }
+
+    // The pack works per 128 bit lane, so the 64 bit eighths come out as 0-3, 16-19, 4-7, 20-23, ...
+    return _mm512_maskz_permutexvar_epi64(AVX512_ALL_LANES, order, _mm512_packs_epi32(gray[0], gray[1]));
+}
+
+//******************************************************************************************
+// @name                    : LumaVectorAvx512
+//
+// @description             : This is a static function. Luma of 32 pixels.
+//
+// @returns                 : 16 bit luma values
+//********************************************************************************************
+static TARGET_AVX512 inline __m512i LumaVectorAvx512(const unsigned char *src)
+{
+    // The pack works per 128 bit lane, so the 64 bit eighths come out as 0-3, 16-19, 4-7, 20-23, ...
+    const __m512i order = _mm512_setr_epi64(0, 2, 4, 6, 1, 3, 5, 7);
+
+    __m512i low = LumaWeightedSumAvx512(src);
+    __m512i high = LumaWeightedSumAvx512(src + 48);
+    __m512i y = _mm512_maskz_permutexvar_epi64(AVX512_ALL_LANES, order, _mm512_packs_epi32(low, high));
+    y = _mm512_srli_epi16(_mm512_mulhi_epu16(y, _mm512_set1_epi16(LUMA_RECIPROCAL)), LUMA_RECIPROCAL_SHIFT);
+
+    return _mm512_min_epi16(_mm512_add_epi16(y, _mm512_set1_epi16(Y_MIN)), _mm512_set1_epi16(Y_MAX));
+}
+
+//******************************************************************************************
+// @name                    : LumaAvx512
+//
+// @description             : This is a static function. Luma of 32 pixels.
+//
+// @param luma              : 32 values on return
+//
+// @returns                 : Nothing
+//********************************************************************************************
+static TARGET_AVX512 inline void LumaAvx512(const unsigned char *src, unsigned short *luma)
+{
+    _mm512_storeu_si512((void*)luma, LumaVectorAvx512(src));
+}
+
+//******************************************************************************************
+// @name                    : GrayscaleRowAvx512
+//
+// @description             : This is a static function. Replaces every color channel with
+//                            the luma of the pixel.
+//
+// @returns                 : Nothing
+//********************************************************************************************
+static TARGET_AVX512 void GrayscaleRowAvx512(const unsigned char *src, unsigned char *dst, int width)
+{
+    unsigned short luma[AVX512_LUMA_PIXELS];
+    int j = 0;
+
+    // The gathers read one byte past their last pixel, so the last pixel is left to the scalar code
+    for (; j + AVX512_LUMA_PIXELS < width; j += AVX512_LUMA_PIXELS)
+    {
+        LumaAvx512(src + j * 3, luma);
+        for (int k = 0; k < AVX512_LUMA_PIXELS; k++)
+        {
+            unsigned char *out = dst + (j + k) * 3;
+            out[0] = out[1] = out[2] = (unsigned char)luma[k];
+        }
+    }
+
+    ScalarGrayscalePixels(src + j * 3, dst + j * 3, width - j);
+}
+
+//******************************************************************************************
+// @name                    : HistogramRowAvx512
+//
+// @description             : This is a static function. Adds a row to the histograms.
+//
+// @returns                 : Nothing
+//********************************************************************************************
+static TARGET_AVX512 void HistogramRowAvx512(const unsigned char *row, int width, histogram_table_t &histogram)
+{
+    unsigned short luma[AVX512_LUMA_PIXELS];
+    int j = 0;
+
+    for (; j + AVX512_LUMA_PIXELS < width; j += AVX512_LUMA_PIXELS)
+    {
+        LumaAvx512(row + j * 3, luma);
+        for (int k = 0; k < AVX512_LUMA_PIXELS; k++)
+        {
+            const unsigned char *in = row + (j + k) * 3;
+            histogram.blue[in[0]]++;
+            histogram.green[in[1]]++;
+            histogram.red[in[2]]++;
+            histogram.brightness[luma[k]]++;
+        }
+    }
+
+    for (const unsigned char *in = row + j * 3; j < width; j++, in += 3)
+    {
+        histogram.blue[in[0]]++;
+        histogram.green[in[1]]++;
+        histogram.red[in[2]]++;
+        histogram.brightness[LumaFromRGB(in[2], in[1], in[0])]++;
+    }
+}
+
+//******************************************************************************************
+// @name                    : LookupRowAvx512
+//
+// @description             : This is a static function. Maps blue, green and red through
+//                            their own table, 16 bytes per gather. The three tables are laid
+//                            out one after another and every byte is offset to its own.
+//
+// @returns                 : Nothing
+//********************************************************************************************
+static TARGET_AVX512 void LookupRowAvx512(const unsigned char *src, unsigned char *dst, int width,
+                                          const unsigned char lut[4][MAX_COLORS])
+{
+    int table[3 * MAX_COLORS];
+    for (int i = 0; i < MAX_COLORS; i++)
+    {
+        table[i] = lut[BLUE][i];
+        table[MAX_COLORS + i] = lut[GREEN][i];
+        table[2 * MAX_COLORS + i] = lut[RED][i];
+    }
+
+    // Table offset of every byte of 48, by channel (byte position mod 3)
+    __m512i channelOffsets[3];
+    for (int g = 0; g < 3; g++)
+    {
+        int offsets[16];
+        for (int k = 0; k < 16; k++)
+        {
+            offsets[k] = ((g * 16 + k) % 3) * MAX_COLORS;
+        }
+        channelOffsets[g] = _mm512_loadu_si512((const void*)offsets);
+    }
+
+    int rowBytes = width * 3;
+    int p = 0;
+    for (; p + AVX512_LOOKUP_BYTES <= rowBytes; p += AVX512_LOOKUP_BYTES)
+    {
+        for (int g = 0; g < 3; g++)
+        {
+            __m512i bytes = _mm512_maskz_cvtepu8_epi32(AVX512_ALL_LANES, _mm_loadu_si128((const __m128i*)(src + p + g * 16)));
+            __m512i mapped = _mm512_mask_i32gather_epi32(_mm512_setzero_si512(), AVX512_ALL_LANES, _mm512_add_epi32(bytes, channelOffsets[g]), table, 4);
+            _mm_storeu_si128((__m128i*)(dst + p + g * 16), _mm512_maskz_cvtepi32_epi8(AVX512_ALL_LANES, mapped));
+        }
+    }
+
+    for (; p < rowBytes; p++)
+    {
+        dst[p] = (unsigned char)table[(p % 3) * MAX_COLORS + src[p]];
+    }
+}
+
+//******************************************************************************************
+// @name                    : BlurRowAvx512
+//
+// @description             : This is a static function. Blurs a row. Pixels with all 8
+//                            neighbours are 32 bytes at a time: the 3x3 sum of every byte,
+//                            minus the byte itself, divided by 8.
+//
+// @returns                 : Nothing
+//********************************************************************************************
+static TARGET_AVX512 void BlurRowAvx512(const unsigned char *above, const unsigned char *row, const unsigned char *below,
+                                        unsigned char *dst, int width)
+{
+    if (above == nullptr || below == nullptr || width < 3)
+    {
+        ScalarBlurPixels(above, row, below, dst, width, 0, width);
+        return;
+    }
+
+    const unsigned char *rows[3] = { above, row, below };
+    int interiorEnd = (width - 1) * 3;
+    int p = 3;
+
+    for (; p + 32 <= interiorEnd; p += 32)
+    {
+        __m512i sum = _mm512_setzero_si512();
+        for (int k = 0; k < 3; k++)
+        {
+            for (int offset = -3; offset <= 3; offset += 3)
+            {
+                sum = _mm512_add_epi16(sum, _mm512_maskz_cvtepu8_epi16(AVX512_ALL_LANES, _mm256_loadu_si256((const __m256i*)(rows[k] + p + offset))));
+            }
+        }
+
+        sum = _mm512_sub_epi16(sum, _mm512_maskz_cvtepu8_epi16(AVX512_ALL_LANES, _mm256_loadu_si256((const __m256i*)(row + p))));
+        _mm256_storeu_si256((__m256i*)(dst + p), _mm512_maskz_cvtepi16_epi8(AVX512_ALL_LANES, _mm512_srli_epi16(sum, 3)));
+    }
+
+    for (; p < interiorEnd; p++)
+    {
+        unsigned int sum = 0;
+        for (int k = 0; k < 3; k++)
+        {
+            sum += rows[k][p - 3] + rows[k][p] + rows[k][p + 3];
+        }
+
+        dst[p] = (unsigned char)((sum - row[p]) >> 3);
+    }
+
+    ScalarBlurPixels(above, row, below, dst, width, 0, 1);
+    ScalarBlurPixels(above, row, below, dst, width, width - 1, width);
+}
+
+//******************************************************************************************
+// @name                    : StatisticsRowAvx512
+//
+// @description             : This is a static function. Adds a row to the sums, minima and
+//                            maxima, 64 pixels (3 vectors) at a time, as StatisticsRowSse2 does.
+//
+// @returns                 : Nothing
+//********************************************************************************************
+static TARGET_AVX512 void StatisticsRowAvx512(const unsigned char *row, int width, statistics_sums_t &sums)
+{
+    const __m512i zero = _mm512_setzero_si512();
+    const int colors[4] = { BLUE, GREEN, RED, BRIGHTNESS };     // Of channels 0, 1 and 2, and of the luma
+
+    __m512i byteMasks[3][3];            // By vector, then by channel
+    __m512i lowMasks[3][3];             // Same, for the bytes the 16 bit unpacks take
+    __m512i highMasks[3][3];
+    __m512i minimum[3];
+    __m512i maximum[3];
+    for (int v = 0; v < 3; v++)
+    {
+        unsigned char channels[64];
+        for (int k = 0; k < 64; k++)
+        {
+            channels[k] = (unsigned char)((v * 64 + k) % 3);
+        }
+
+        __m512i channelVector = _mm512_loadu_si512((const void*)channels);
+        for (int c = 0; c < 3; c++)
+        {
+            byteMasks[v][c] = _mm512_movm_epi8(_mm512_cmpeq_epi8_mask(channelVector, _mm512_set1_epi8((char)c)));
+            lowMasks[v][c] = _mm512_unpacklo_epi8(byteMasks[v][c], byteMasks[v][c]);
+            highMasks[v][c] = _mm512_unpackhi_epi8(byteMasks[v][c], byteMasks[v][c]);
+        }
+
+        minimum[v] = _mm512_set1_epi8((char)0xFF);
+        maximum[v] = zero;
+    }
+
+    __m512i sum[4] = { zero, zero, zero, zero };            // 64 bit lanes, channels then luma
+    __m512i squares[4] = { zero, zero, zero, zero };        // 32 bit lanes
+    __m512i lumaMinimum = _mm512_set1_epi8((char)0xFF);
+    __m512i lumaMaximum = zero;
+    int blocks = 0;
+    int j = 0;
+
+    // The gathers read one byte past their last pixel, so the last pixel is left to the scalar code
+    for (; j + 64 < width; j += 64)
+    {
+        for (int v = 0; v < 3; v++)
+        {
+            __m512i bytes = _mm512_loadu_si512((const void*)(row + j * 3 + v * 64));
+            __m512i low = _mm512_unpacklo_epi8(bytes, zero);
+            __m512i high = _mm512_unpackhi_epi8(bytes, zero);
+            minimum[v] = _mm512_min_epu8(minimum[v], bytes);
+            maximum[v] = _mm512_max_epu8(maximum[v], bytes);
+
+            for (int c = 0; c < 3; c++)
+            {
+                sum[c] = _mm512_add_epi64(sum[c], _mm512_sad_epu8(_mm512_and_si512(bytes, byteMasks[v][c]), zero));
+                squares[c] = _mm512_add_epi32(squares[c], _mm512_madd_epi16(low, _mm512_and_si512(low, lowMasks[v][c])));
+                squares[c] = _mm512_add_epi32(squares[c], _mm512_madd_epi16(high, _mm512_and_si512(high, highMasks[v][c])));
+            }
+        }
+
+        __m512i lumaLow = LumaVectorAvx512(row + j * 3);
+        __m512i lumaHigh = LumaVectorAvx512(row + j * 3 + 96);
+        __m512i luma = _mm512_packus_epi16(lumaLow, lumaHigh);
+        sum[3] = _mm512_add_epi64(sum[3], _mm512_sad_epu8(luma, zero));
+        squares[3] = _mm512_add_epi32(squares[3], _mm512_add_epi32(_mm512_madd_epi16(lumaLow, lumaLow),
+                                                                   _mm512_madd_epi16(lumaHigh, lumaHigh)));
+        lumaMinimum = _mm512_min_epu8(lumaMinimum, luma);
+        lumaMaximum = _mm512_max_epu8(lumaMaximum, luma);
+
+        if (++blocks == STATISTICS_FLUSH_BLOCKS || j + 128 >= width)
+        {
+            for (int c = 0; c < 4; c++)
+            {
+                unsigned int lanes[16];
+                _mm512_storeu_si512((void*)lanes, squares[c]);
+                for (int k = 0; k < 16; k++)
+                {
+                    sums.sumOfSquares[colors[c]] += lanes[k];
+                }
+                squares[c] = zero;
+            }
+            blocks = 0;
+        }
+    }
+
+    if (j > 0)
+    {
+        for (int c = 0; c < 4; c++)
+        {
+            unsigned long long lanes[8];
+            _mm512_storeu_si512((void*)lanes, sum[c]);
+            for (int k = 0; k < 8; k++)
+            {
+                sums.sum[colors[c]] += lanes[k];
+            }
+        }
+
+        unsigned char low[192];
+        unsigned char high[192];
+        for (int v = 0; v < 3; v++)
+        {
+            _mm512_storeu_si512((void*)(low + v * 64), minimum[v]);
+            _mm512_storeu_si512((void*)(high + v * 64), maximum[v]);
+        }
+        MergeStatisticsLanes(low, high, 192, true, sums);
+
+        _mm512_storeu_si512((void*)low, lumaMinimum);
+        _mm512_storeu_si512((void*)high, lumaMaximum);
+        MergeStatisticsLanes(low, high, 64, false, sums);
+
+        sums.count += j;
+    }
+
+    ScalarStatisticsPixels(row + j * 3, width - j, sums);
+}
+
+//******************************************************************************************
+// @name                    : LoadPixelsAvx512
+//
+// @description             : This is a static function. Gathers 16 pixels as 32 bit lanes of
+//                            blue | green << 8 | red << 16. Reads one byte past the last pixel.
+//
+// @param step              : Bytes from one pixel to the next; 6 loads every other pixel
+//
+// @returns                 : Pixels
+//********************************************************************************************
+static TARGET_AVX512 inline __m512i LoadPixelsAvx512(const unsigned char *src, int step)
+{
+    __m512i offsets = _mm512_mullo_epi32(_mm512_setr_epi32(0, 1, 2, 3, 4, 5, 6, 7, 8, 9, 10, 11, 12, 13, 14, 15),
+                                         _mm512_set1_epi32(step));
+
+    return _mm512_mask_i32gather_epi32(_mm512_setzero_si512(), AVX512_ALL_LANES, offsets, (const int*)src, 1);
+}
+
+//******************************************************************************************
+// @name                    : AddChannelsAvx512
+//
+// @description             : This is a static function. Adds loaded pixels to sums of blue
+//                            and red (16 bit halves of 32 bit lanes) and of green.
+//
+// @returns                 : Nothing
+//********************************************************************************************
+static TARGET_AVX512 inline void AddChannelsAvx512(__m512i pixels, __m512i &blueRed, __m512i &green)
+{
+    blueRed = _mm512_add_epi32(blueRed, _mm512_and_si512(pixels, _mm512_set1_epi32(0x00FF00FF)));
+    green = _mm512_add_epi32(green, _mm512_and_si512(_mm512_maskz_srli_epi32(AVX512_ALL_LANES, pixels, 8), _mm512_set1_epi32(0xFF)));
+}
+
+//******************************************************************************************
+// @name                    : ChromaAvx512
+//
+// @description             : This is a static function. Cb or Cr of 16 sums of 1 << SUM_SHIFT
+//                            pixels, as ChromaFromRGBSums works it out.
+//
+// @returns                 : Bytes, clamped to [C_MIN, C_MAX]
+//********************************************************************************************
+template<int SUM_SHIFT>
+static TARGET_AVX512 inline __m128i ChromaAvx512(__m512i blueRed, __m512i green, int blueRedWeights, int greenWeights)
+{
+    const int shift = CHROMA_WEIGHT_SHIFT + SUM_SHIFT;
+
+    __m512i sum = _mm512_add_epi32(_mm512_madd_epi16(blueRed, _mm512_set1_epi32(blueRedWeights)),
+                                   _mm512_madd_epi16(green, _mm512_set1_epi32(greenWeights)));
+    sum = _mm512_maskz_srai_epi32(AVX512_ALL_LANES, _mm512_add_epi32(sum, _mm512_set1_epi32(1 << (shift - 1))), shift);
+    sum = _mm512_add_epi32(sum, _mm512_set1_epi32(128));
+    sum = _mm512_maskz_min_epi32(AVX512_ALL_LANES, _mm512_maskz_max_epi32(AVX512_ALL_LANES, sum, _mm512_set1_epi32(C_MIN)), _mm512_set1_epi32(C_MAX));
+
+    return _mm512_maskz_cvtepi32_epi8(AVX512_ALL_LANES, sum);
+}
+
+//******************************************************************************************
+// @name                    : YCbCr420RowAvx512
+//
+// @description             : This is a static function. Converts two rows to Y, and their
+//                            2x2 blocks to Cb and Cr, in one pass.
+//
+// @returns                 : Nothing
+//********************************************************************************************
+static TARGET_AVX512 void YCbCr420RowAvx512(const unsigned char *top, const unsigned char *bottom, int width,
+                                            unsigned char *yTop, unsigned char *yBottom, unsigned char *cb,
+                                            unsigned char *cr, int chromaStep)
+{
+    int j = 0;
+
+    // The gathers read one byte past their last pixel, so the last pixel is left to the scalar code
+    for (; j + AVX512_LUMA_PIXELS < width; j += AVX512_LUMA_PIXELS)
+    {
+        const unsigned char *rows[2] = { top + j * 3, bottom + j * 3 };
+
+        // Even and odd pixels of both rows add up to the 16 blocks
+        __m512i blueRed = _mm512_setzero_si512();
+        __m512i green = _mm512_setzero_si512();
+        for (int n = 0; n < 2; n++)
+        {
+            AddChannelsAvx512(LoadPixelsAvx512(rows[n], 6), blueRed, green);
+            AddChannelsAvx512(LoadPixelsAvx512(rows[n] + 3, 6), blueRed, green);
+        }
+
+        __m128i cbBytes = ChromaAvx512<2>(blueRed, green, CB_BLUE_RED_WEIGHTS, CB_GREEN_WEIGHTS);
+        __m128i crBytes = ChromaAvx512<2>(blueRed, green, CR_BLUE_RED_WEIGHTS, CR_GREEN_WEIGHTS);
+
+        int k = j / 2;
+        if (chromaStep == 1)
+        {
+            _mm_storeu_si128((__m128i*)(cb + k), cbBytes);
+            _mm_storeu_si128((__m128i*)(cr + k), crBytes);
+        }
+        else
+        {
+            _mm_storeu_si128((__m128i*)(cb + k * 2), _mm_unpacklo_epi8(cbBytes, crBytes));
+            _mm_storeu_si128((__m128i*)(cb + k * 2 + 16), _mm_unpackhi_epi8(cbBytes, crBytes));
+        }
+
+        _mm256_storeu_si256((__m256i*)(yTop + j), _mm512_maskz_cvtepi16_epi8(AVX512_ALL_LANES, LumaVectorAvx512(rows[0])));
+        if (yBottom != nullptr)
+        {
+            _mm256_storeu_si256((__m256i*)(yBottom + j), _mm512_maskz_cvtepi16_epi8(AVX512_ALL_LANES, LumaVectorAvx512(rows[1])));
+        }
+    }
+
+    YCbCr420Pixels<Bgr24Format>(top, bottom, j, width, yTop, yBottom, cb, cr, chromaStep);
+}
+
+//******************************************************************************************
+// @name                    : YCbCr444RowAvx512
+//
+// @description             : This is a static function. Converts a row to Y, Cb and Cr.
+//
+// @returns                 : Nothing
+//********************************************************************************************
+static TARGET_AVX512 void YCbCr444RowAvx512(const unsigned char *src, int width, unsigned char *y, unsigned char *cb,
+                                            unsigned char *cr)
+{
+    int j = 0;
+
+    for (; j + AVX512_LUMA_PIXELS < width; j += AVX512_LUMA_PIXELS)
+    {
+        const unsigned char *in = src + j * 3;
+        for (int h = 0; h < 2; h++)
+        {
+            __m512i blueRed = _mm512_setzero_si512();
+            __m512i green = _mm512_setzero_si512();
+            AddChannelsAvx512(LoadPixelsAvx512(in + h * 48, 3), blueRed, green);
+
+            _mm_storeu_si128((__m128i*)(cb + j + h * 16), ChromaAvx512<0>(blueRed, green, CB_BLUE_RED_WEIGHTS, CB_GREEN_WEIGHTS));
+            _mm_storeu_si128((__m128i*)(cr + j + h * 16), ChromaAvx512<0>(blueRed, green, CR_BLUE_RED_WEIGHTS, CR_GREEN_WEIGHTS));
+        }
+
+        _mm256_storeu_si256((__m256i*)(y + j), _mm512_maskz_cvtepi16_epi8(AVX512_ALL_LANES, LumaVectorAvx512(in)));
+    }
+
+    YCbCr444Pixels<Bgr24Format>(src, j, width, y, cb, cr);
+}
+
+//******************************************************************************************
+// @name                    : LumaRowAvx512
+//
+// @description             : This is a static function. Luma of every pixel of a row.
+//
+// @returns                 : Nothing
+//********************************************************************************************
+static TARGET_AVX512 void LumaRowAvx512(const unsigned char *src, unsigned char *luma, int width)
+{
+    int j = 0;
+
+    for (; j + AVX512_LUMA_PIXELS < width; j += AVX512_LUMA_PIXELS)
+    {
+        _mm256_storeu_si256((__m256i*)(luma + j), _mm512_maskz_cvtepi16_epi8(AVX512_ALL_LANES, LumaVectorAvx512(src + j * 3)));
+    }
+
+    for (src += j * 3; j < width; j++, src += 3)
+    {
+        luma[j] = LumaFromRGB(src[2], src[1], src[0]);
+    }
+}
+
+//******************************************************************************************
+// @name                    : OrderedDitherRowAvx512
+//
+// @description             : This is a static function. Ordered dithering of a row to gray
+//                            palette indices, 32 pixels (four threshold rows) at a time.
+//
+// @returns                 : Nothing
+//********************************************************************************************
+static TARGET_AVX512 void OrderedDitherRowAvx512(const unsigned char *src, int width, const unsigned char *thresholds,
+                                                 int bitsPerPixel, unsigned char *dst)
+{
+    const __m512i one = _mm512_set1_epi16(1);
+    const __m512i bitWeights = _mm512_maskz_broadcast_i32x4(AVX512_ALL_LANES, _mm_setr_epi16(128, 64, 32, 16, 8, 4, 2, 1));
+    const __m512i nibbleWeights = _mm512_set1_epi32(16 | (1 << 16));
+    __m512i threshold = _mm512_maskz_broadcast_i32x4(AVX512_ALL_LANES, _mm_unpacklo_epi8(_mm_loadl_epi64((const __m128i*)thresholds),
+                                                                 _mm_setzero_si128()));
+    __m512i maxIndex = _mm512_set1_epi16((short)((1 << bitsPerPixel) - 1));
+    int j = 0;
+
+    for (; j + AVX512_LUMA_PIXELS < width; j += AVX512_LUMA_PIXELS)
+    {
+        // OrderedDitherLevel in unsigned 16 bit lanes: n is at most 65279
+        __m512i n = _mm512_add_epi16(_mm512_mullo_epi16(GrayVectorAvx512(src + j * 3), maxIndex), threshold);
+        __m512i level = _mm512_srli_epi16(_mm512_add_epi16(_mm512_add_epi16(n, one), _mm512_srli_epi16(n, 8)), 8);
+
+        if (bitsPerPixel == MONOCHROME)
+        {
+            __m256i bits = _mm256_sad_epu8(_mm512_maskz_cvtepi16_epi8(AVX512_ALL_LANES, _mm512_mullo_epi16(level, bitWeights)), _mm256_setzero_si256());
+            dst[j / 8] = (unsigned char)_mm256_extract_epi16(bits, 0);
+            dst[j / 8 + 1] = (unsigned char)_mm256_extract_epi16(bits, 4);
+            dst[j / 8 + 2] = (unsigned char)_mm256_extract_epi16(bits, 8);
+            dst[j / 8 + 3] = (unsigned char)_mm256_extract_epi16(bits, 12);
+        }
+        else if (bitsPerPixel == BITS_4_PALLETIZED)
+        {
+            _mm_storeu_si128((__m128i*)(dst + j / 2), _mm512_maskz_cvtepi32_epi8(AVX512_ALL_LANES, _mm512_madd_epi16(level, nibbleWeights)));
+        }
+        else
+        {
+            _mm256_storeu_si256((__m256i*)(dst + j), _mm512_maskz_cvtepi16_epi8(AVX512_ALL_LANES, level));
+        }
+    }
+
+    OrderedDitherPixels<Bgr24Format>(src, j, width, thresholds, bitsPerPixel, dst);
+}
+
+//******************************************************************************************
+// @name                    : ResizeHorizontalPixelsAvx512
+//
+// @description             : This is a static function. Resamples a row along x. Gray rows
+//                            take 32 taps per multiply-add, then 8; color rows take 8, two in
+//                            each 128 bit lane with channel c of both pixels side by side in
+//                            32 bit lane c. 24 bit pixels are masked loads spread to 4 bytes.
+//                            The taps left over are added by ScalarResizeTaps.
+//
+// @returns                 : Nothing
+//********************************************************************************************
+template<int BYTES_PER_PIXEL>
+static TARGET_AVX512 void ResizeHorizontalPixelsAvx512(const unsigned char *src, unsigned char *dst,
+                                                       const resize_weights_t &resizeWeights)
+{
+    const __mmask64 eightPixelsMask = 0xFFFFFF;
+    const __m256i halvesIndices = _mm256_setr_epi32(0, 1, 2, 3, 3, 4, 5, 6);
+    const __m256i spreadPixels = _mm256_setr_epi8(0, 1, 2, -1, 3, 4, 5, -1, 6, 7, 8, -1, 9, 10, 11, -1,
+                                                  0, 1, 2, -1, 3, 4, 5, -1, 6, 7, 8, -1, 9, 10, 11, -1);
+    const __m512i pairIndices = _mm512_setr_epi32(0, 0, 0, 0, 1, 1, 1, 1, 2, 2, 2, 2, 3, 3, 3, 3);
+    int dstWidth = (int)resizeWeights.contributions.size();
+    for (int x = 0; x < dstWidth; x++, dst += BYTES_PER_PIXEL)
+    {
+        const resize_contribution_t &contribution = resizeWeights.contributions[x];
+        const short *weights = &resizeWeights.weights[(size_t)x * resizeWeights.maxTaps];
+        const unsigned char *pixel = &src[contribution.first * BYTES_PER_PIXEL];
+
+        __m512i acc = _mm512_setzero_si512();
+        int k = 0;
+        if (BYTES_PER_PIXEL == 1)
+        {
+            for (; k + 32 <= contribution.count; k += 32)
+            {
+                __m512i values = _mm512_maskz_cvtepu8_epi16(AVX512_ALL_LANES, _mm256_loadu_si256((const __m256i*)(pixel + k)));
+                acc = _mm512_add_epi32(acc, _mm512_madd_epi16(values, _mm512_loadu_si512((const void*)(weights + k))));
+            }
+        }
+        else
+        {
+            for (; k + 8 <= contribution.count; k += 8)
+            {
+                __m256i pixels;
+                if (BYTES_PER_PIXEL == 3)
+                {
+                    // Pixels 4 to 7 start at byte 12, which becomes byte 0 of the upper half
+                    __m256i loaded = _mm512_maskz_extracti64x4_epi64(AVX512_ALL_LANES, _mm512_maskz_loadu_epi8(eightPixelsMask, pixel + k * 3), 0);
+                    pixels = _mm256_shuffle_epi8(_mm256_permutevar8x32_epi32(loaded, halvesIndices), spreadPixels);
+                }
+                else
+                {
+                    pixels = _mm256_loadu_si256((const __m256i*)(pixel + k * 4));
+                }
+
+                __m512i values = _mm512_maskz_cvtepu8_epi16(AVX512_ALL_LANES, pixels);
+                values = _mm512_unpacklo_epi16(values, _mm512_bsrli_epi128(values, 8));
+
+                __m512i weightPairs = _mm512_maskz_permutexvar_epi32(AVX512_ALL_LANES, pairIndices,
+                    _mm512_maskz_broadcast_i32x4(AVX512_ALL_LANES, _mm_loadu_si128((const __m128i*)(weights + k))));
+                acc = _mm512_add_epi32(acc, _mm512_madd_epi16(values, weightPairs));
+            }
+        }
+
+        __m256i halves = _mm256_add_epi32(_mm512_maskz_extracti64x4_epi64(AVX512_ALL_LANES, acc, 0), _mm512_maskz_extracti64x4_epi64(AVX512_ALL_LANES, acc, 1));
+        __m128i sum = _mm_add_epi32(_mm256_castsi256_si128(halves), _mm256_extracti128_si256(halves, 1));
+        if (BYTES_PER_PIXEL == 1)
+        {
+            for (; k + 8 <= contribution.count; k += 8)
+            {
+                __m128i values = _mm_cvtepu8_epi16(_mm_loadl_epi64((const __m128i*)(pixel + k)));
+                sum = _mm_add_epi32(sum, _mm_madd_epi16(values, _mm_loadu_si128((const __m128i*)(weights + k))));
+            }
+            sum = _mm_add_epi32(sum, _mm_srli_si128(sum, 8));
+            sum = _mm_add_epi32(sum, _mm_srli_si128(sum, 4));
+        }
+
+        int sums[4];
+        _mm_storeu_si128((__m128i*)sums, _mm_add_epi32(sum, _mm_set1_epi32(1 << (RESIZE_WEIGHT_BITS - 1))));
+        ScalarResizeTaps(pixel, weights, BYTES_PER_PIXEL, k, contribution.count, sums);
+        for (int c = 0; c < BYTES_PER_PIXEL; c++)
+        {
+            dst[c] = ResizeSumToByte(sums[c]);
+        }
+    }
+}
+
+//******************************************************************************************
+// @name                    : ResizeHorizontalRowAvx512
+//
+// @description             : This is a static function. Resamples a row along x.
+//
+// @returns                 : Nothing
+//********************************************************************************************
+static TARGET_AVX512 void ResizeHorizontalRowAvx512(const unsigned char *src, unsigned char *dst, int bytesPerPixel,
+                                                    const resize_weights_t &resizeWeights)
+{
+    if (bytesPerPixel == 1)
+        ResizeHorizontalPixelsAvx512<1>(src, dst, resizeWeights);
+    else if (bytesPerPixel == 3)
+        ResizeHorizontalPixelsAvx512<3>(src, dst, resizeWeights);
+    else
+        ResizeHorizontalPixelsAvx512<4>(src, dst, resizeWeights);
+}
+
+//******************************************************************************************
+// @name                    : ResizeVerticalRowAvx512
+//
+// @description             : This is a static function. Produces one row of a vertical
+//                            resize, 64 bytes at a time, as ResizeVerticalRowAvx2.
+//
+// @returns                 : Nothing
+//********************************************************************************************
+static TARGET_AVX512 void ResizeVerticalRowAvx512(const unsigned char *rows, size_t rowStride, const short *weights,
+                                                  int count, unsigned char *dst, int rowBytes)
+{
+    const __m512i zero = _mm512_setzero_si512();
+    const __m512i rounding = _mm512_set1_epi32(1 << (RESIZE_WEIGHT_BITS - 1));
+    int x = 0;
+    for (; x + 64 <= rowBytes; x += 64)
+    {
+        __m512i acc0 = rounding;
+        __m512i acc1 = rounding;
+        __m512i acc2 = rounding;
+        __m512i acc3 = rounding;
+
+        for (int k = 0; k < count; k += 2)
+        {
+            __m512i rowA = _mm512_loadu_si512((const void*)&rows[rowStride * k + x]);
+            __m512i rowB = zero;
+            int weightB = 0;
+            if (k + 1 < count)
+            {
+                rowB = _mm512_loadu_si512((const void*)&rows[rowStride * (k + 1) + x]);
+                weightB = weights[k + 1];
+            }
+
+            __m512i weightPair = _mm512_set1_epi32((weightB << 16) | (weights[k] & 0xFFFF));
+
+            __m512i rowALow  = _mm512_unpacklo_epi8(rowA, zero);
+            __m512i rowAHigh = _mm512_unpackhi_epi8(rowA, zero);
+            __m512i rowBLow  = _mm512_unpacklo_epi8(rowB, zero);
+            __m512i rowBHigh = _mm512_unpackhi_epi8(rowB, zero);
+
+            acc0 = _mm512_add_epi32(acc0, _mm512_madd_epi16(_mm512_unpacklo_epi16(rowALow, rowBLow), weightPair));
+            acc1 = _mm512_add_epi32(acc1, _mm512_madd_epi16(_mm512_unpackhi_epi16(rowALow, rowBLow), weightPair));
+            acc2 = _mm512_add_epi32(acc2, _mm512_madd_epi16(_mm512_unpacklo_epi16(rowAHigh, rowBHigh), weightPair));
+            acc3 = _mm512_add_epi32(acc3, _mm512_madd_epi16(_mm512_unpackhi_epi16(rowAHigh, rowBHigh), weightPair));
+        }
+
+        acc0 = _mm512_maskz_srai_epi32(AVX512_ALL_LANES, acc0, RESIZE_WEIGHT_BITS);
+        acc1 = _mm512_maskz_srai_epi32(AVX512_ALL_LANES, acc1, RESIZE_WEIGHT_BITS);
+        acc2 = _mm512_maskz_srai_epi32(AVX512_ALL_LANES, acc2, RESIZE_WEIGHT_BITS);
+        acc3 = _mm512_maskz_srai_epi32(AVX512_ALL_LANES, acc3, RESIZE_WEIGHT_BITS);
+
+        __m512i packed = _mm512_packus_epi16(_mm512_packs_epi32(acc0, acc1), _mm512_packs_epi32(acc2, acc3));
+        _mm512_storeu_si512((void*)&dst[x], packed);
+    }
+
+    ScalarResizeVerticalBytes(rows, rowStride, weights, count, dst, x, rowBytes);
+}
+
+//******************************************************************************************
+// @name                    : BoxSumRowAvx512
+//
+// @description             : This is a static function. Sums factor rows, 64 bytes at a time.
+//
+// @returns                 : Nothing
+//********************************************************************************************
+static TARGET_AVX512 void BoxSumRowAvx512(const unsigned char *src, size_t srcStride, int factor, int rowBytes,
+                                          unsigned short *rowSum)
+{
+    int x = 0;
+    for (; x + 64 <= rowBytes; x += 64)
+    {
+        __m512i sumLow = _mm512_setzero_si512();
+        __m512i sumHigh = _mm512_setzero_si512();
+        for (int k = 0; k < factor; k++)
+        {
+            const unsigned char *row = &src[srcStride * k + x];
+            sumLow = _mm512_add_epi16(sumLow, _mm512_maskz_cvtepu8_epi16(AVX512_ALL_LANES, _mm256_loadu_si256((const __m256i*)row)));
+            sumHigh = _mm512_add_epi16(sumHigh, _mm512_maskz_cvtepu8_epi16(AVX512_ALL_LANES, _mm256_loadu_si256((const __m256i*)(row + 32))));
+        }
+
+        _mm512_storeu_si512((void*)&rowSum[x], sumLow);
+        _mm512_storeu_si512((void*)&rowSum[x + 32], sumHigh);
+    }
+
+    ScalarBoxSumBytes(src, srcStride, factor, rowSum, x, rowBytes);
+}
+
+static const kernel_table_t AVX512_KERNELS =
+{
+    SIMD_AVX512,
+    GrayscaleRowAvx512,
+    HistogramRowAvx512,
+    LookupRowAvx512,
+    BlurRowAvx512,
+    StatisticsRowAvx512,
+    YCbCr420RowAvx512,
+    YCbCr444RowAvx512,
+    LumaRowAvx512,
+    OrderedDitherRowAvx512,
+    ResizeHorizontalRowAvx512,
+    ResizeVerticalRowAvx512,
+    BoxSumRowAvx512
+};
+
+const kernel_table_t* GetAvx512KernelTable()
+{
+    return &AVX512_KERNELS;
+}
+#else
+const kernel_table_t* GetAvx512KernelTable()
+{
+    return nullptr;
+}
+#endif
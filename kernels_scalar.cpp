@@ -0,0 +1,411 @@
+#include"kernel_registry.h"
+#include"pixel_kernels.h"
+#include<algorithm>
+
+// Reference kernels. Every other level must produce exactly the same output as these,
+// which KernelRegistry::runSelfTest verifies.
+
+//******************************************************************************************
+// @name                    : ScalarGrayscalePixels
+//
+// @description             : Replaces every color channel of count pixels with their luma
+//
+// @returns                 : Nothing
+//********************************************************************************************
+void ScalarGrayscalePixels(const unsigned char *src, unsigned char *dst, int count)
+{
+    for (int j = 0; j < count; j++, src += 3, dst += 3)
+    {
+        unsigned char y = LumaFromRGB(src[2], src[1], src[0]);
+        dst[0] = y;
+        dst[1] = y;
+        dst[2] = y;
+    }
+}
+
+//******************************************************************************************
+// @name                    : ScalarBlurPixels
+//
+// @description             : Blurs pixels [first, last) of a row: the mean of the (up to 8)
+//                            neighbours of every channel
+//
+// @param above             : Row above, nullptr for the first row
+// @param below             : Row below, nullptr for the last row
+//
+// @returns                 : Nothing
+//********************************************************************************************
+void ScalarBlurPixels(const unsigned char *above, const unsigned char *row, const unsigned char *below,
+                      unsigned char *dst, int width, int first, int last)
+{
+    const unsigned char *rows[3] = { above, row, below };
+    int rowCount = 1 + (above != nullptr) + (below != nullptr);
+
+    for (int j = first; j < last; j++)
+    {
+        int left = (j > 0) ? j - 1 : j;
+        int right = (j < width - 1) ? j + 1 : j;
+        int neighbours = rowCount * (right - left + 1) - 1;
+        if (neighbours == 0)
+        {
+            continue;
+        }
+
+        for (int c = 0; c < 3; c++)
+        {
+            unsigned int sum = 0;
+            for (int k = 0; k < 3; k++)
+            {
+                if (rows[k] == nullptr)
+                {
+                    continue;
+                }
+
+                for (int l = left; l <= right; l++)
+                {
+                    sum += rows[k][l * 3 + c];
+                }
+            }
+
+            sum -= row[j * 3 + c];
+            dst[j * 3 + c] = (unsigned char)(sum / neighbours);
+        }
+    }
+}
+
+//******************************************************************************************
+// @name                    : ScalarStatisticsPixels
+//
+// @description             : Adds count pixels to the sums, minima and maxima of every
+//                            channel and the luma
+//
+// @returns                 : Nothing
+//********************************************************************************************
+void ScalarStatisticsPixels(const unsigned char *row, int count, statistics_sums_t &sums)
+{
+    for (int j = 0; j < count; j++, row += 3)
+    {
+        unsigned char values[4];
+        values[RED] = row[2];
+        values[GREEN] = row[1];
+        values[BLUE] = row[0];
+        values[BRIGHTNESS] = LumaFromRGB(row[2], row[1], row[0]);
+
+        for (int c = 0; c < 4; c++)
+        {
+            sums.sum[c] += values[c];
+            sums.sumOfSquares[c] += values[c] * values[c];
+            sums.minimum[c] = std::min(sums.minimum[c], values[c]);
+            sums.maximum[c] = std::max(sums.maximum[c], values[c]);
+        }
+    }
+
+    sums.count += count;
+}
+
+//******************************************************************************************
+// @name                    : MergeStatisticsLanes
+//
+// @description             : Merges the per lane minima and maxima of a SIMD kernel into the
+//                            sums
+//
+// @param count             : Lanes
+// @param interleaved       : Lane k holds channel k % 3 of BGR pixels, else every lane is luma
+//
+// @returns                 : Nothing
+//********************************************************************************************
+void MergeStatisticsLanes(const unsigned char *minimum, const unsigned char *maximum, int count, bool interleaved,
+                          statistics_sums_t &sums)
+{
+    const int colors[3] = { BLUE, GREEN, RED };
+    for (int k = 0; k < count; k++)
+    {
+        int color = interleaved ? colors[k % 3] : BRIGHTNESS;
+        sums.minimum[color] = std::min(sums.minimum[color], minimum[k]);
+        sums.maximum[color] = std::max(sums.maximum[color], maximum[k]);
+    }
+}
+
+//******************************************************************************************
+// @name                    : ScalarResizeTaps
+//
+// @description             : Adds taps [first, last) of one output pixel of a horizontal
+//                            resize to the sums of its bytes
+//
+// @param src               : First contributing source pixel
+// @param weights           : Weights of the contributing pixels
+// @param sums              : bytesPerPixel sums
+//
+// @returns                 : Nothing
+//********************************************************************************************
+void ScalarResizeTaps(const unsigned char *src, const short *weights, int bytesPerPixel, int first, int last,
+                      int *sums)
+{
+    for (int k = first; k < last; k++)
+    {
+        for (int c = 0; c < bytesPerPixel; c++)
+        {
+            sums[c] += src[k * bytesPerPixel + c] * weights[k];
+        }
+    }
+}
+
+//******************************************************************************************
+// @name                    : ScalarResizeVerticalBytes
+//
+// @description             : Bytes [first, last) of a vertical resize: the weighted sum of
+//                            count rows
+//
+// @param rowStride         : Distance between source rows in bytes
+//
+// @returns                 : Nothing
+//********************************************************************************************
+void ScalarResizeVerticalBytes(const unsigned char *rows, size_t rowStride, const short *weights, int count,
+                               unsigned char *dst, int first, int last)
+{
+    for (int x = first; x < last; x++)
+    {
+        int value = 1 << (RESIZE_WEIGHT_BITS - 1);
+        for (int k = 0; k < count; k++)
+        {
+            value += rows[rowStride * k + x] * weights[k];
+        }
+
+        dst[x] = ResizeSumToByte(value);
+    }
+}
+
+//******************************************************************************************
+// @name                    : ScalarBoxSumBytes
+//
+// @description             : Bytes [first, last) of the sum of factor rows. At most
+//                            4 * 255, so 16 bits are enough.
+//
+// @param srcStride         : Distance between source rows in bytes
+//
+// @returns                 : Nothing
+//********************************************************************************************
+void ScalarBoxSumBytes(const unsigned char *src, size_t srcStride, int factor, unsigned short *rowSum,
+                       int first, int last)
+{
+    for (int x = first; x < last; x++)
+    {
+        unsigned short sum = 0;
+        for (int k = 0; k < factor; k++)
+        {
+            sum += src[srcStride * k + x];
+        }
+        rowSum[x] = sum;
+    }
+}
+
+//******************************************************************************************
+// @name                    : HistogramRowScalar
+//
+// @description             : This is a static function. Adds a row to the histograms.
+//
+// @returns                 : Nothing
+//********************************************************************************************
+static void HistogramRowScalar(const unsigned char *row, int width, histogram_table_t &histogram)
+{
+    for (int j = 0; j < width; j++, row += 3)
+    {
+        histogram.blue[row[0]]++;
+        histogram.green[row[1]]++;
+        histogram.red[row[2]]++;
+        histogram.brightness[LumaFromRGB(row[2], row[1], row[0])]++;
+    }
+}
+
+//******************************************************************************************
+// @name                    : LookupRowScalar
+//
+// @description             : This is a static function. Maps blue, green and red through
+//                            their own table.
+//
+// @returns                 : Nothing
+//********************************************************************************************
+static void LookupRowScalar(const unsigned char *src, unsigned char *dst, int width,
+                            const unsigned char lut[4][MAX_COLORS])
+{
+    for (int j = 0; j < width; j++, src += 3, dst += 3)
+    {
+        dst[0] = lut[BLUE][src[0]];
+        dst[1] = lut[GREEN][src[1]];
+        dst[2] = lut[RED][src[2]];
+    }
+}
+
+//******************************************************************************************
+// @name                    : BlurRowScalar
+//
+// @description             : This is a static function. Blurs a whole row.
+//
+// @returns                 : Nothing
+//********************************************************************************************
+static void BlurRowScalar(const unsigned char *above, const unsigned char *row, const unsigned char *below,
+                          unsigned char *dst, int width)
+{
+    ScalarBlurPixels(above, row, below, dst, width, 0, width);
+}
+
+//******************************************************************************************
+// @name                    : YCbCr420RowScalar
+//
+// @description             : This is a static function. Converts two whole rows to Y, and
+//                            their 2x2 blocks to Cb and Cr.
+//
+// @returns                 : Nothing
+//********************************************************************************************
+static void YCbCr420RowScalar(const unsigned char *top, const unsigned char *bottom, int width,
+                              unsigned char *yTop, unsigned char *yBottom, unsigned char *cb, unsigned char *cr,
+                              int chromaStep)
+{
+    YCbCr420Pixels<Bgr24Format>(top, bottom, 0, width, yTop, yBottom, cb, cr, chromaStep);
+}
+
+//******************************************************************************************
+// @name                    : YCbCr444RowScalar
+//
+// @description             : This is a static function. Converts a whole row to Y, Cb and Cr.
+//
+// @returns                 : Nothing
+//********************************************************************************************
+static void YCbCr444RowScalar(const unsigned char *src, int width, unsigned char *y, unsigned char *cb, unsigned char *cr)
+{
+    YCbCr444Pixels<Bgr24Format>(src, 0, width, y, cb, cr);
+}
+
+//******************************************************************************************
+// @name                    : LumaRowScalar
+//
+// @description             : This is a static function. Luma of every pixel of a row.
+//
+// @returns                 : Nothing
+//********************************************************************************************
+static void LumaRowScalar(const unsigned char *src, unsigned char *luma, int width)
+{
+    for (int j = 0; j < width; j++, src += 3)
+    {
+        luma[j] = LumaFromRGB(src[2], src[1], src[0]);
+    }
+}
+
+//******************************************************************************************
+// @name                    : OrderedDitherRowScalar
+//
+// @description             : This is a static function. Ordered dithering of a whole row to
+//                            gray palette indices.
+//
+// @returns                 : Nothing
+//********************************************************************************************
+static void OrderedDitherRowScalar(const unsigned char *src, int width, const unsigned char *thresholds,
+                                   int bitsPerPixel, unsigned char *dst)
+{
+    OrderedDitherPixels<Bgr24Format>(src, 0, width, thresholds, bitsPerPixel, dst);
+}
+
+//******************************************************************************************
+// @name                    : ResizeHorizontalPixelsScalar
+//
+// @description             : This is a static function. Resamples a row along x, with the
+//                            pixel size known at compile time.
+//
+// @returns                 : Nothing
+//********************************************************************************************
+template<int BYTES_PER_PIXEL>
+static void ResizeHorizontalPixelsScalar(const unsigned char *src, unsigned char *dst,
+                                         const resize_weights_t &resizeWeights)
+{
+    int dstWidth = (int)resizeWeights.contributions.size();
+    for (int x = 0; x < dstWidth; x++, dst += BYTES_PER_PIXEL)
+    {
+        const resize_contribution_t &contribution = resizeWeights.contributions[x];
+        const short *weights = &resizeWeights.weights[(size_t)x * resizeWeights.maxTaps];
+        const unsigned char *pixel = &src[contribution.first * BYTES_PER_PIXEL];
+
+        int sums[BYTES_PER_PIXEL];
+        for (int c = 0; c < BYTES_PER_PIXEL; c++)
+        {
+            sums[c] = 1 << (RESIZE_WEIGHT_BITS - 1);
+        }
+
+        for (int k = 0; k < contribution.count; k++, pixel += BYTES_PER_PIXEL)
+        {
+            for (int c = 0; c < BYTES_PER_PIXEL; c++)
+            {
+                sums[c] += pixel[c] * weights[k];
+            }
+        }
+
+        for (int c = 0; c < BYTES_PER_PIXEL; c++)
+        {
+            dst[c] = ResizeSumToByte(sums[c]);
+        }
+    }
+}
+
+//******************************************************************************************
+// @name                    : ResizeHorizontalRowScalar
+//
+// @description             : This is a static function. Resamples a row along x.
+//
+// @returns                 : Nothing
+//********************************************************************************************
+static void ResizeHorizontalRowScalar(const unsigned char *src, unsigned char *dst, int bytesPerPixel,
+                                      const resize_weights_t &resizeWeights)
+{
+    if (bytesPerPixel == 1)
+        ResizeHorizontalPixelsScalar<1>(src, dst, resizeWeights);
+    else if (bytesPerPixel == 3)
+        ResizeHorizontalPixelsScalar<3>(src, dst, resizeWeights);
+    else
+        ResizeHorizontalPixelsScalar<4>(src, dst, resizeWeights);
+}
+
+//******************************************************************************************
+// @name                    : ResizeVerticalRowScalar
+//
+// @description             : This is a static function. Produces one row of a vertical resize.
+//
+// @returns                 : Nothing
+//********************************************************************************************
+static void ResizeVerticalRowScalar(const unsigned char *rows, size_t rowStride, const short *weights, int count,
+                                    unsigned char *dst, int rowBytes)
+{
+    ScalarResizeVerticalBytes(rows, rowStride, weights, count, dst, 0, rowBytes);
+}
+
+//******************************************************************************************
+// @name                    : BoxSumRowScalar
+//
+// @description             : This is a static function. Sums factor rows, byte by byte.
+//
+// @returns                 : Nothing
+//********************************************************************************************
+static void BoxSumRowScalar(const unsigned char *src, size_t srcStride, int factor, int rowBytes,
+                            unsigned short *rowSum)
+{
+    ScalarBoxSumBytes(src, srcStride, factor, rowSum, 0, rowBytes);
+}
+
+static const kernel_table_t SCALAR_KERNELS =
+{
+    SIMD_SCALAR,
+    ScalarGrayscalePixels,
+    HistogramRowScalar,
+    LookupRowScalar,
+    BlurRowScalar,
+    ScalarStatisticsPixels,
+    YCbCr420RowScalar,
+    YCbCr444RowScalar,
+    LumaRowScalar,
+    OrderedDitherRowScalar,
+    ResizeHorizontalRowScalar,
+    ResizeVerticalRowScalar,
+    BoxSumRowScalar
+};
+
+const kernel_table_t* GetScalarKernelTable()
+{
+    return &SCALAR_KERNELS;
+}
@@ -0,0 +1,759 @@
+#include"kernel_registry.h"
+#include"pixel_kernels.h"
+#include"simd.h"
+#include<string.h>
+
+#ifdef USE_SSE2_KERNELS
+const int SSE2_LUMA_PIXELS = 8;
+
+//******************************************************************************************
+// @name                    : LoadPixelsSse2
+//
+// @description             : This is a static function. Loads 4 pixels as 32 bit lanes of
+//                            blue | green << 8 | red << 16. Reads one byte past the last pixel.
+//
+// @param step              : Bytes from one pixel to the next; 6 loads every other pixel
+//
+// @returns                 : Pixels
+//********************************************************************************************
+static inline __m128i LoadPixelsSse2(const unsigned char *src, int step = 3)
+{
+    int pixels[4];
+    for (int k = 0; k < 4; k++)
+    {
+        memcpy(&pixels[k], src + k * step, sizeof(int));
+    }
+
+    return _mm_loadu_si128((const __m128i*)pixels);
+}
+
+//******************************************************************************************
+// @name                    : LumaWeightedSumSse2
+//
+// @description             : This is a static function. (weighted sum of 4 pixels) >> 3
+//
+// @returns                 : 32 bit sums
+//********************************************************************************************
+static inline __m128i LumaWeightedSumSse2(__m128i pixels)
+{
+    const __m128i lowBytes = _mm_set1_epi32(0x00FF00FF);
+    const __m128i blueRedWeights = _mm_set1_epi32(LUMA_BLUE_WEIGHT | (LUMA_RED_WEIGHT << 16));
+    const __m128i greenWeight = _mm_set1_epi32(LUMA_GREEN_WEIGHT);
+
+    __m128i blueRed = _mm_and_si128(pixels, lowBytes);
+    __m128i green = _mm_and_si128(_mm_srli_epi32(pixels, 8), _mm_set1_epi32(0xFF));
+    __m128i sum = _mm_add_epi32(_mm_madd_epi16(blueRed, blueRedWeights), _mm_madd_epi16(green, greenWeight));
+
+    return _mm_srli_epi32(sum, LUMA_SUM_SHIFT);
+}
+
+//******************************************************************************************
+// @name                    : GrayVectorSse2
+//
+// @description             : This is a static function. Gray level (GrayLevelFromRGB) of 8 pixels.
+//
+// @returns                 : 16 bit gray values
+//********************************************************************************************
+static inline __m128i GrayVectorSse2(const unsigned char *src)
+{
+    const __m128i lowBytes = _mm_set1_epi32(0x00FF00FF);
+    const __m128i blueRedWeights = _mm_set1_epi32(GRAY_BLUE_WEIGHT | (GRAY_RED_WEIGHT << 16));
+    const __m128i greenWeight = _mm_set1_epi32(GRAY_GREEN_WEIGHT);
+    const __m128i rounding = _mm_set1_epi32(1 << (GRAY_WEIGHT_SHIFT - 1));
+    __m128i gray[2];
+
+    for (int k = 0; k < 2; k++)
+    {
+        __m128i pixels = LoadPixelsSse2(src + k * 12);
+        __m128i blueRed = _mm_and_si128(pixels, lowBytes);
+        __m128i green = _mm_and_si128(_mm_srli_epi32(pixels, 8), _mm_set1_epi32(0xFF));
+        __m128i sum = _mm_add_epi32(_mm_madd_epi16(blueRed, blueRedWeights), _mm_madd_epi16(green, greenWeight));
+        gray[k] = _mm_srli_epi32(_mm_add_epi32(sum, rounding), GRAY_WEIGHT_SHIFT);
+    }
+
+    return _mm_packs_epi32(gray[0], gray[1]);
+}
+
+//******************************************************************************************
+// @name                    : LumaVectorSse2
+//
+// @description             : This is a static function. Luma of 8 pixels.
+//
+// @returns                 : 16 bit luma values
+//********************************************************************************************
+static inline __m128i LumaVectorSse2(const unsigned char *src)
+{
+    __m128i low = LumaWeightedSumSse2(LoadPixelsSse2(src));
+    __m128i high = LumaWeightedSumSse2(LoadPixelsSse2(src + 12));
+    __m128i y = _mm_srli_epi16(_mm_mulhi_epu16(_mm_packs_epi32(low, high), _mm_set1_epi16(LUMA_RECIPROCAL)),
+                               LUMA_RECIPROCAL_SHIFT);
+
+    return _mm_min_epi16(_mm_add_epi16(y, _mm_set1_epi16(Y_MIN)), _mm_set1_epi16(Y_MAX));
+}
+
+//******************************************************************************************
+// @name                    : LumaSse2
+//
+// @description             : This is a static function. Luma of 8 pixels.
+//
+// @param luma              : 8 values on return
+//
+// @returns                 : Nothing
+//********************************************************************************************
+static inline void LumaSse2(const unsigned char *src, unsigned short *luma)
+{
+    _mm_storeu_si128((__m128i*)luma, LumaVectorSse2(src));
+}
+
+//******************************************************************************************
+// @name                    : GrayscaleRowSse2
+//
+// @description             : This is a static function. Replaces every color channel with
+//                            the luma of the pixel.
+//
+// @returns                 : Nothing
+//********************************************************************************************
+static void GrayscaleRowSse2(const unsigned char *src, unsigned char *dst, int width)
+{
+    unsigned short luma[SSE2_LUMA_PIXELS];
+    int j = 0;
+
+    // The loads read one byte past their last pixel, so the last pixel is left to the scalar code
+    for (; j + SSE2_LUMA_PIXELS < width; j += SSE2_LUMA_PIXELS)
+    {
+        LumaSse2(src + j * 3, luma);
+        for (int k = 0; k < SSE2_LUMA_PIXELS; k++)
+        {
+            unsigned char *out = dst + (j + k) * 3;
+            out[0] = out[1] = out[2] = (unsigned char)luma[k];
+        }
+    }
+
+    ScalarGrayscalePixels(src + j * 3, dst + j * 3, width - j);
+}
+
+//******************************************************************************************
+// @name                    : HistogramRowSse2
+//
+// @description             : This is a static function. Adds a row to the histograms.
+//
+// @returns                 : Nothing
+//********************************************************************************************
+static void HistogramRowSse2(const unsigned char *row, int width, histogram_table_t &histogram)
+{
+    unsigned short luma[SSE2_LUMA_PIXELS];
+    int j = 0;
+
+    for (; j + SSE2_LUMA_PIXELS < width; j += SSE2_LUMA_PIXELS)
+    {
+        LumaSse2(row + j * 3, luma);
+        for (int k = 0; k < SSE2_LUMA_PIXELS; k++)
+        {
+            const unsigned char *in = row + (j + k) * 3;
+            histogram.blue[in[0]]++;
+            histogram.green[in[1]]++;
+            histogram.red[in[2]]++;
+            histogram.brightness[luma[k]]++;
+        }
+    }
+
+    for (const unsigned char *in = row + j * 3; j < width; j++, in += 3)
+    {
+        histogram.blue[in[0]]++;
+        histogram.green[in[1]]++;
+        histogram.red[in[2]]++;
+        histogram.brightness[LumaFromRGB(in[2], in[1], in[0])]++;
+    }
+}
+
+//******************************************************************************************
+// @name                    : LookupRowSse2
+//
+// @description             : This is a static function. SSE2 has no gather, so table lookups
+//                            stay scalar.
+//
+// @returns                 : Nothing
+//********************************************************************************************
+static void LookupRowSse2(const unsigned char *src, unsigned char *dst, int width,
+                          const unsigned char lut[4][MAX_COLORS])
+{
+    GetScalarKernelTable()->lookupRow(src, dst, width, lut);
+}
+
+//******************************************************************************************
+// @name                    : BlurRowSse2
+//
+// @description             : This is a static function. Blurs a row. Pixels with all 8
+//                            neighbours are 16 bytes at a time: the 3x3 sum of every byte,
+//                            minus the byte itself, divided by 8.
+//
+// @returns                 : Nothing
+//********************************************************************************************
+static void BlurRowSse2(const unsigned char *above, const unsigned char *row, const unsigned char *below,
+                        unsigned char *dst, int width)
+{
+    if (above == nullptr || below == nullptr || width < 3)
+    {
+        ScalarBlurPixels(above, row, below, dst, width, 0, width);
+        return;
+    }
+
+    const __m128i zero = _mm_setzero_si128();
+    const unsigned char *rows[3] = { above, row, below };
+    int interiorEnd = (width - 1) * 3;
+    int p = 3;
+
+    for (; p + 16 <= interiorEnd; p += 16)
+    {
+        __m128i sumLow = zero;
+        __m128i sumHigh = zero;
+        for (int k = 0; k < 3; k++)
+        {
+            for (int offset = -3; offset <= 3; offset += 3)
+            {
+                __m128i bytes = _mm_loadu_si128((const __m128i*)(rows[k] + p + offset));
+                sumLow = _mm_add_epi16(sumLow, _mm_unpacklo_epi8(bytes, zero));
+                sumHigh = _mm_add_epi16(sumHigh, _mm_unpackhi_epi8(bytes, zero));
+            }
+        }
+
+        __m128i center = _mm_loadu_si128((const __m128i*)(row + p));
+        sumLow = _mm_srli_epi16(_mm_sub_epi16(sumLow, _mm_unpacklo_epi8(center, zero)), 3);
+        sumHigh = _mm_srli_epi16(_mm_sub_epi16(sumHigh, _mm_unpackhi_epi8(center, zero)), 3);
+        _mm_storeu_si128((__m128i*)(dst + p), _mm_packus_epi16(sumLow, sumHigh));
+    }
+
+    for (; p < interiorEnd; p++)
+    {
+        unsigned int sum = 0;
+        for (int k = 0; k < 3; k++)
+        {
+            sum += rows[k][p - 3] + rows[k][p] + rows[k][p + 3];
+        }
+
+        dst[p] = (unsigned char)((sum - row[p]) >> 3);
+    }
+
+    ScalarBlurPixels(above, row, below, dst, width, 0, 1);
+    ScalarBlurPixels(above, row, below, dst, width, width - 1, width);
+}
+
+//******************************************************************************************
+// @name                    : StatisticsRowSse2
+//
+// @description             : This is a static function. Adds a row to the sums, minima and
+//                            maxima. 16 pixels are 3 vectors in which byte k is channel k % 3,
+//                            so every byte lane is accumulated on its own, with masks picking
+//                            the lanes of each channel, and the lanes are told apart at the end.
+//
+// @returns                 : Nothing
+//********************************************************************************************
+static void StatisticsRowSse2(const unsigned char *row, int width, statistics_sums_t &sums)
+{
+    const __m128i zero = _mm_setzero_si128();
+    const int colors[4] = { BLUE, GREEN, RED, BRIGHTNESS };     // Of channels 0, 1 and 2, and of the luma
+
+    __m128i byteMasks[3][3];            // By vector, then by channel
+    __m128i lowMasks[3][3];             // Same, for the low and high 8 bytes widened to 16 bits
+    __m128i highMasks[3][3];
+    __m128i minimum[3];
+    __m128i maximum[3];
+    for (int v = 0; v < 3; v++)
+    {
+        unsigned char channels[16];
+        for (int k = 0; k < 16; k++)
+        {
+            channels[k] = (unsigned char)((v * 16 + k) % 3);
+        }
+
+        __m128i channelVector = _mm_loadu_si128((const __m128i*)channels);
+        for (int c = 0; c < 3; c++)
+        {
+            byteMasks[v][c] = _mm_cmpeq_epi8(channelVector, _mm_set1_epi8((char)c));
+            lowMasks[v][c] = _mm_unpacklo_epi8(byteMasks[v][c], byteMasks[v][c]);
+            highMasks[v][c] = _mm_unpackhi_epi8(byteMasks[v][c], byteMasks[v][c]);
+        }
+
+        minimum[v] = _mm_set1_epi8((char)0xFF);
+        maximum[v] = zero;
+    }
+
+    __m128i sum[4] = { zero, zero, zero, zero };            // 64 bit lanes, channels then luma
+    __m128i squares[4] = { zero, zero, zero, zero };        // 32 bit lanes
+    __m128i lumaMinimum = _mm_set1_epi8((char)0xFF);
+    __m128i lumaMaximum = zero;
+    int blocks = 0;
+    int j = 0;
+
+    // The luma loads read one byte past their last pixel, so the last pixel is left to the scalar code
+    for (; j + 16 < width; j += 16)
+    {
+        for (int v = 0; v < 3; v++)
+        {
+            __m128i bytes = _mm_loadu_si128((const __m128i*)(row + j * 3 + v * 16));
+            __m128i low = _mm_unpacklo_epi8(bytes, zero);
+            __m128i high = _mm_unpackhi_epi8(bytes, zero);
+            minimum[v] = _mm_min_epu8(minimum[v], bytes);
+            maximum[v] = _mm_max_epu8(maximum[v], bytes);
+
+            for (int c = 0; c < 3; c++)
+            {
+                sum[c] = _mm_add_epi64(sum[c], _mm_sad_epu8(_mm_and_si128(bytes, byteMasks[v][c]), zero));
+                squares[c] = _mm_add_epi32(squares[c], _mm_madd_epi16(low, _mm_and_si128(low, lowMasks[v][c])));
+                squares[c] = _mm_add_epi32(squares[c], _mm_madd_epi16(high, _mm_and_si128(high, highMasks[v][c])));
+            }
+        }
+
+        __m128i lumaLow = LumaVectorSse2(row + j * 3);
+        __m128i lumaHigh = LumaVectorSse2(row + j * 3 + 24);
+        __m128i luma = _mm_packus_epi16(lumaLow, lumaHigh);
+        sum[3] = _mm_add_epi64(sum[3], _mm_sad_epu8(luma, zero));
+        squares[3] = _mm_add_epi32(squares[3], _mm_add_epi32(_mm_madd_epi16(lumaLow, lumaLow), _mm_madd_epi16(lumaHigh, lumaHigh)));
+        lumaMinimum = _mm_min_epu8(lumaMinimum, luma);
+        lumaMaximum = _mm_max_epu8(lumaMaximum, luma);
+
+        if (++blocks == STATISTICS_FLUSH_BLOCKS || j + 32 >= width)
+        {
+            for (int c = 0; c < 4; c++)
+            {
+                unsigned int lanes[4];
+                _mm_storeu_si128((__m128i*)lanes, squares[c]);
+                sums.sumOfSquares[colors[c]] += (unsigned long long)lanes[0] + lanes[1] + lanes[2] + lanes[3];
+                squares[c] = zero;
+            }
+            blocks = 0;
+        }
+    }
+
+    if (j > 0)
+    {
+        for (int c = 0; c < 4; c++)
+        {
+            unsigned long long lanes[2];
+            _mm_storeu_si128((__m128i*)lanes, sum[c]);
+            sums.sum[colors[c]] += lanes[0] + lanes[1];
+        }
+
+        unsigned char low[48];
+        unsigned char high[48];
+        for (int v = 0; v < 3; v++)
+        {
+            _mm_storeu_si128((__m128i*)(low + v * 16), minimum[v]);
+            _mm_storeu_si128((__m128i*)(high + v * 16), maximum[v]);
+        }
+        MergeStatisticsLanes(low, high, 48, true, sums);
+
+        _mm_storeu_si128((__m128i*)low, lumaMinimum);
+        _mm_storeu_si128((__m128i*)high, lumaMaximum);
+        MergeStatisticsLanes(low, high, 16, false, sums);
+
+        sums.count += j;
+    }
+
+    ScalarStatisticsPixels(row + j * 3, width - j, sums);
+}
+
+//******************************************************************************************
+// @name                    : AddChannelsSse2
+//
+// @description             : This is a static function. Adds loaded pixels to sums of blue
+//                            and red (16 bit halves of 32 bit lanes) and of green.
+//
+// @returns                 : Nothing
+//********************************************************************************************
+static inline void AddChannelsSse2(__m128i pixels, __m128i &blueRed, __m128i &green)
+{
+    blueRed = _mm_add_epi32(blueRed, _mm_and_si128(pixels, _mm_set1_epi32(0x00FF00FF)));
+    green = _mm_add_epi32(green, _mm_and_si128(_mm_srli_epi32(pixels, 8), _mm_set1_epi32(0xFF)));
+}
+
+//******************************************************************************************
+// @name                    : ChromaSse2
+//
+// @description             : This is a static function. Cb or Cr of 4 sums of 1 << SUM_SHIFT
+//                            pixels, as ChromaFromRGBSums works it out, before clamping.
+//
+// @returns                 : 32 bit values
+//********************************************************************************************
+template<int SUM_SHIFT>
+static inline __m128i ChromaSse2(__m128i blueRed, __m128i green, int blueRedWeights, int greenWeights)
+{
+    const int shift = CHROMA_WEIGHT_SHIFT + SUM_SHIFT;
+
+    __m128i sum = _mm_add_epi32(_mm_madd_epi16(blueRed, _mm_set1_epi32(blueRedWeights)),
+                                _mm_madd_epi16(green, _mm_set1_epi32(greenWeights)));
+    sum = _mm_srai_epi32(_mm_add_epi32(sum, _mm_set1_epi32(1 << (shift - 1))), shift);
+
+    return _mm_add_epi32(sum, _mm_set1_epi32(128));
+}
+
+//******************************************************************************************
+// @name                    : ClampChromaSse2
+//
+// @description             : This is a static function. Clamps bytes to [C_MIN, C_MAX].
+//
+// @returns                 : Clamped bytes
+//********************************************************************************************
+static inline __m128i ClampChromaSse2(__m128i chroma)
+{
+    return _mm_min_epu8(_mm_max_epu8(chroma, _mm_set1_epi8(C_MIN)), _mm_set1_epi8((char)C_MAX));
+}
+
+//******************************************************************************************
+// @name                    : YCbCr420RowSse2
+//
+// @description             : This is a static function. Converts two rows to Y, and their
+//                            2x2 blocks to Cb and Cr, in one pass.
+//
+// @returns                 : Nothing
+//********************************************************************************************
+static void YCbCr420RowSse2(const unsigned char *top, const unsigned char *bottom, int width,
+                            unsigned char *yTop, unsigned char *yBottom, unsigned char *cb, unsigned char *cr,
+                            int chromaStep)
+{
+    const __m128i zero = _mm_setzero_si128();
+    int j = 0;
+
+    // The loads read one byte past their last pixel, so the last pixel is left to the scalar code
+    for (; j + SSE2_LUMA_PIXELS < width; j += SSE2_LUMA_PIXELS)
+    {
+        const unsigned char *rows[2] = { top + j * 3, bottom + j * 3 };
+
+        // Even and odd pixels of both rows add up to the 4 blocks
+        __m128i blueRed = zero;
+        __m128i green = zero;
+        for (int n = 0; n < 2; n++)
+        {
+            AddChannelsSse2(LoadPixelsSse2(rows[n], 6), blueRed, green);
+            AddChannelsSse2(LoadPixelsSse2(rows[n] + 3, 6), blueRed, green);
+        }
+
+        __m128i cbValues = ChromaSse2<2>(blueRed, green, CB_BLUE_RED_WEIGHTS, CB_GREEN_WEIGHTS);
+        __m128i crValues = ChromaSse2<2>(blueRed, green, CR_BLUE_RED_WEIGHTS, CR_GREEN_WEIGHTS);
+        __m128i chroma = ClampChromaSse2(_mm_packus_epi16(_mm_packs_epi32(cbValues, crValues), zero));
+
+        int k = j / 2;
+        if (chromaStep == 1)
+        {
+            int values = _mm_cvtsi128_si32(chroma);
+            memcpy(cb + k, &values, sizeof(int));
+            values = _mm_cvtsi128_si32(_mm_srli_si128(chroma, 4));
+            memcpy(cr + k, &values, sizeof(int));
+        }
+        else
+        {
+            _mm_storel_epi64((__m128i*)(cb + k * 2), _mm_unpacklo_epi8(chroma, _mm_srli_si128(chroma, 4)));
+        }
+
+        _mm_storel_epi64((__m128i*)(yTop + j), _mm_packus_epi16(LumaVectorSse2(rows[0]), zero));
+        if (yBottom != nullptr)
+        {
+            _mm_storel_epi64((__m128i*)(yBottom + j), _mm_packus_epi16(LumaVectorSse2(rows[1]), zero));
+        }
+    }
+
+    YCbCr420Pixels<Bgr24Format>(top, bottom, j, width, yTop, yBottom, cb, cr, chromaStep);
+}
+
+//******************************************************************************************
+// @name                    : YCbCr444RowSse2
+//
+// @description             : This is a static function. Converts a row to Y, Cb and Cr.
+//
+// @returns                 : Nothing
+//********************************************************************************************
+static void YCbCr444RowSse2(const unsigned char *src, int width, unsigned char *y, unsigned char *cb, unsigned char *cr)
+{
+    const __m128i zero = _mm_setzero_si128();
+    int j = 0;
+
+    for (; j + SSE2_LUMA_PIXELS < width; j += SSE2_LUMA_PIXELS)
+    {
+        const unsigned char *in = src + j * 3;
+        __m128i cbValues[2];
+        __m128i crValues[2];
+        for (int h = 0; h < 2; h++)
+        {
+            __m128i blueRed = zero;
+            __m128i green = zero;
+            AddChannelsSse2(LoadPixelsSse2(in + h * 12), blueRed, green);
+            cbValues[h] = ChromaSse2<0>(blueRed, green, CB_BLUE_RED_WEIGHTS, CB_GREEN_WEIGHTS);
+            crValues[h] = ChromaSse2<0>(blueRed, green, CR_BLUE_RED_WEIGHTS, CR_GREEN_WEIGHTS);
+        }
+
+        __m128i chroma = ClampChromaSse2(_mm_packus_epi16(_mm_packs_epi32(cbValues[0], cbValues[1]),
+                                                          _mm_packs_epi32(crValues[0], crValues[1])));
+        _mm_storel_epi64((__m128i*)(cb + j), chroma);
+        _mm_storel_epi64((__m128i*)(cr + j), _mm_srli_si128(chroma, 8));
+        _mm_storel_epi64((__m128i*)(y + j), _mm_packus_epi16(LumaVectorSse2(in), zero));
+    }
+
+    YCbCr444Pixels<Bgr24Format>(src, j, width, y, cb, cr);
+}
+
+//******************************************************************************************
+// @name                    : LumaRowSse2
+//
+// @description             : This is a static function. Luma of every pixel of a row.
+//
+// @returns                 : Nothing
+//********************************************************************************************
+static void LumaRowSse2(const unsigned char *src, unsigned char *luma, int width)
+{
+    int j = 0;
+
+    for (; j + SSE2_LUMA_PIXELS < width; j += SSE2_LUMA_PIXELS)
+    {
+        _mm_storel_epi64((__m128i*)(luma + j), _mm_packus_epi16(LumaVectorSse2(src + j * 3), _mm_setzero_si128()));
+    }
+
+    for (src += j * 3; j < width; j++, src += 3)
+    {
+        luma[j] = LumaFromRGB(src[2], src[1], src[0]);
+    }
+}
+
+//******************************************************************************************
+// @name                    : OrderedDitherRowSse2
+//
+// @description             : This is a static function. Ordered dithering of a row to gray
+//                            palette indices, 8 pixels (one threshold row) at a time.
+//
+// @returns                 : Nothing
+//********************************************************************************************
+static void OrderedDitherRowSse2(const unsigned char *src, int width, const unsigned char *thresholds,
+                                 int bitsPerPixel, unsigned char *dst)
+{
+    const __m128i zero = _mm_setzero_si128();
+    const __m128i one = _mm_set1_epi16(1);
+    const __m128i bitWeights = _mm_setr_epi16(128, 64, 32, 16, 8, 4, 2, 1);  // First pixel in the high bit
+    const __m128i nibbleWeights = _mm_set1_epi32(16 | (1 << 16));           // First pixel in the high nibble
+    __m128i threshold = _mm_unpacklo_epi8(_mm_loadl_epi64((const __m128i*)thresholds), zero);
+    __m128i maxIndex = _mm_set1_epi16((short)((1 << bitsPerPixel) - 1));
+    int j = 0;
+
+    for (; j + SSE2_LUMA_PIXELS < width; j += SSE2_LUMA_PIXELS)
+    {
+        // OrderedDitherLevel in unsigned 16 bit lanes: n is at most 65279
+        __m128i n = _mm_add_epi16(_mm_mullo_epi16(GrayVectorSse2(src + j * 3), maxIndex), threshold);
+        __m128i level = _mm_srli_epi16(_mm_add_epi16(_mm_add_epi16(n, one), _mm_srli_epi16(n, 8)), 8);
+
+        if (bitsPerPixel == MONOCHROME)
+        {
+            __m128i bits = _mm_sad_epu8(_mm_packus_epi16(_mm_mullo_epi16(level, bitWeights), zero), zero);
+            dst[j / 8] = (unsigned char)_mm_cvtsi128_si32(bits);
+        }
+        else if (bitsPerPixel == BITS_4_PALLETIZED)
+        {
+            __m128i pairs = _mm_madd_epi16(level, nibbleWeights);
+            int packed = _mm_cvtsi128_si32(_mm_packus_epi16(_mm_packs_epi32(pairs, zero), zero));
+            memcpy(dst + j / 2, &packed, sizeof(int));
+        }
+        else
+        {
+            _mm_storel_epi64((__m128i*)(dst + j), _mm_packus_epi16(level, zero));
+        }
+    }
+
+    OrderedDitherPixels<Bgr24Format>(src, j, width, thresholds, bitsPerPixel, dst);
+}
+
+//******************************************************************************************
+// @name                    : ResizeHorizontalPixelsSse2
+//
+// @description             : This is a static function. Resamples a row along x. Gray rows
+//                            take 8 taps per multiply-add; color rows take 2, with channel c
+//                            of both pixels side by side in 32 bit lane c. The taps left over
+//                            are added by ScalarResizeTaps.
+//
+// @returns                 : Nothing
+//********************************************************************************************
+template<int BYTES_PER_PIXEL>
+static void ResizeHorizontalPixelsSse2(const unsigned char *src, unsigned char *dst,
+                                       const resize_weights_t &resizeWeights)
+{
+    const __m128i zero = _mm_setzero_si128();
+    int dstWidth = (int)resizeWeights.contributions.size();
+    for (int x = 0; x < dstWidth; x++, dst += BYTES_PER_PIXEL)
+    {
+        const resize_contribution_t &contribution = resizeWeights.contributions[x];
+        const short *weights = &resizeWeights.weights[(size_t)x * resizeWeights.maxTaps];
+        const unsigned char *pixel = &src[contribution.first * BYTES_PER_PIXEL];
+
+        __m128i acc = zero;
+        int k = 0;
+        if (BYTES_PER_PIXEL == 1)
+        {
+            for (; k + 8 <= contribution.count; k += 8)
+            {
+                __m128i values = _mm_unpacklo_epi8(_mm_loadl_epi64((const __m128i*)(pixel + k)), zero);
+                acc = _mm_add_epi32(acc, _mm_madd_epi16(values, _mm_loadu_si128((const __m128i*)(weights + k))));
+            }
+            acc = _mm_add_epi32(acc, _mm_srli_si128(acc, 8));
+            acc = _mm_add_epi32(acc, _mm_srli_si128(acc, 4));
+        }
+        else
+        {
+            for (; k + 2 <= contribution.count; k += 2)
+            {
+                long long bytes = 0;
+                memcpy(&bytes, pixel + k * BYTES_PER_PIXEL, 2 * BYTES_PER_PIXEL);
+                __m128i pair = _mm_loadl_epi64((const __m128i*)&bytes);
+                if (BYTES_PER_PIXEL == 3)
+                {
+                    // Second pixel from byte 4, as with 4 bytes per pixel. Lane 3 is not used.
+                    pair = _mm_unpacklo_epi32(pair, _mm_srli_si128(pair, 3));
+                }
+
+                __m128i values = _mm_unpacklo_epi8(pair, zero);
+                values = _mm_unpacklo_epi16(values, _mm_srli_si128(values, 8));
+
+                int weightPair;
+                memcpy(&weightPair, weights + k, sizeof(int));
+                acc = _mm_add_epi32(acc, _mm_madd_epi16(values, _mm_set1_epi32(weightPair)));
+            }
+        }
+
+        int sums[4];
+        _mm_storeu_si128((__m128i*)sums, _mm_add_epi32(acc, _mm_set1_epi32(1 << (RESIZE_WEIGHT_BITS - 1))));
+        ScalarResizeTaps(pixel, weights, BYTES_PER_PIXEL, k, contribution.count, sums);
+        for (int c = 0; c < BYTES_PER_PIXEL; c++)
+        {
+            dst[c] = ResizeSumToByte(sums[c]);
+        }
+    }
+}
+
+//******************************************************************************************
+// @name                    : ResizeHorizontalRowSse2
+//
+// @description             : This is a static function. Resamples a row along x.
+//
+// @returns                 : Nothing
+//********************************************************************************************
+static void ResizeHorizontalRowSse2(const unsigned char *src, unsigned char *dst, int bytesPerPixel,
+                                    const resize_weights_t &resizeWeights)
+{
+    if (bytesPerPixel == 1)
+        ResizeHorizontalPixelsSse2<1>(src, dst, resizeWeights);
+    else if (bytesPerPixel == 3)
+        ResizeHorizontalPixelsSse2<3>(src, dst, resizeWeights);
+    else
+        ResizeHorizontalPixelsSse2<4>(src, dst, resizeWeights);
+}
+
+//******************************************************************************************
+// @name                    : ResizeVerticalRowSse2
+//
+// @description             : This is a static function. Produces one row of a vertical
+//                            resize, 16 bytes at a time. Rows are taken in pairs so that
+//                            _mm_madd_epi16 applies both weights with one instruction.
+//
+// @returns                 : Nothing
+//********************************************************************************************
+static void ResizeVerticalRowSse2(const unsigned char *rows, size_t rowStride, const short *weights, int count,
+                                  unsigned char *dst, int rowBytes)
+{
+    const __m128i zero = _mm_setzero_si128();
+    const __m128i rounding = _mm_set1_epi32(1 << (RESIZE_WEIGHT_BITS - 1));
+    int x = 0;
+    for (; x + 16 <= rowBytes; x += 16)
+    {
+        __m128i acc0 = rounding;
+        __m128i acc1 = rounding;
+        __m128i acc2 = rounding;
+        __m128i acc3 = rounding;
+
+        for (int k = 0; k < count; k += 2)
+        {
+            __m128i rowA = _mm_loadu_si128((const __m128i*)&rows[rowStride * k + x]);
+            __m128i rowB = zero;
+            int weightB = 0;
+            if (k + 1 < count)
+            {
+                rowB = _mm_loadu_si128((const __m128i*)&rows[rowStride * (k + 1) + x]);
+                weightB = weights[k + 1];
+            }
+
+            __m128i weightPair = _mm_set1_epi32((weightB << 16) | (weights[k] & 0xFFFF));
+
+            __m128i rowALow  = _mm_unpacklo_epi8(rowA, zero);
+            __m128i rowAHigh = _mm_unpackhi_epi8(rowA, zero);
+            __m128i rowBLow  = _mm_unpacklo_epi8(rowB, zero);
+            __m128i rowBHigh = _mm_unpackhi_epi8(rowB, zero);
+
+            acc0 = _mm_add_epi32(acc0, _mm_madd_epi16(_mm_unpacklo_epi16(rowALow, rowBLow), weightPair));
+            acc1 = _mm_add_epi32(acc1, _mm_madd_epi16(_mm_unpackhi_epi16(rowALow, rowBLow), weightPair));
+            acc2 = _mm_add_epi32(acc2, _mm_madd_epi16(_mm_unpacklo_epi16(rowAHigh, rowBHigh), weightPair));
+            acc3 = _mm_add_epi32(acc3, _mm_madd_epi16(_mm_unpackhi_epi16(rowAHigh, rowBHigh), weightPair));
+        }
+
+        acc0 = _mm_srai_epi32(acc0, RESIZE_WEIGHT_BITS);
+        acc1 = _mm_srai_epi32(acc1, RESIZE_WEIGHT_BITS);
+        acc2 = _mm_srai_epi32(acc2, RESIZE_WEIGHT_BITS);
+        acc3 = _mm_srai_epi32(acc3, RESIZE_WEIGHT_BITS);
+
+        __m128i packed = _mm_packus_epi16(_mm_packs_epi32(acc0, acc1), _mm_packs_epi32(acc2, acc3));
+        _mm_storeu_si128((__m128i*)&dst[x], packed);
+    }
+
+    ScalarResizeVerticalBytes(rows, rowStride, weights, count, dst, x, rowBytes);
+}
+
+//******************************************************************************************
+// @name                    : BoxSumRowSse2
+//
+// @description             : This is a static function. Sums factor rows, 16 bytes at a time.
+//
+// @returns                 : Nothing
+//********************************************************************************************
+static void BoxSumRowSse2(const unsigned char *src, size_t srcStride, int factor, int rowBytes,
+                          unsigned short *rowSum)
+{
+    const __m128i zero = _mm_setzero_si128();
+    int x = 0;
+    for (; x + 16 <= rowBytes; x += 16)
+    {
+        __m128i sumLow = zero;
+        __m128i sumHigh = zero;
+        for (int k = 0; k < factor; k++)
+        {
+            __m128i row = _mm_loadu_si128((const __m128i*)&src[srcStride * k + x]);
+            sumLow = _mm_add_epi16(sumLow, _mm_unpacklo_epi8(row, zero));
+            sumHigh = _mm_add_epi16(sumHigh, _mm_unpackhi_epi8(row, zero));
+        }
+
+        _mm_storeu_si128((__m128i*)&rowSum[x], sumLow);
+        _mm_storeu_si128((__m128i*)&rowSum[x + 8], sumHigh);
+    }
+
+    ScalarBoxSumBytes(src, srcStride, factor, rowSum, x, rowBytes);
+}
+
+static const kernel_table_t SSE2_KERNELS =
+{
+    SIMD_SSE2,
+    GrayscaleRowSse2,
+    HistogramRowSse2,
+    LookupRowSse2,
+    BlurRowSse2,
+    StatisticsRowSse2,
+    YCbCr420RowSse2,
+    YCbCr444RowSse2,
+    LumaRowSse2,
+    OrderedDitherRowSse2,
+    ResizeHorizontalRowSse2,
+    ResizeVerticalRowSse2,
+    BoxSumRowSse2
+};
+
+const kernel_table_t* GetSse2KernelTable()
+{
+    return &SSE2_KERNELS;
+}
+#else
+const kernel_table_t* GetSse2KernelTable()
+{
+    return nullptr;
+}
+#endif
@@ -1,19 +1,157 @@
 #include<iostream>
+#include<new>
 #include<stdio.h>
 #include<assert.h>
+#include<stdlib.h>
+#include<string.h>
 #include "bmp.h"
+#include "image_server.h"
+#include "kernel_registry.h"
 
 using namespace std;
 
 const char* INPUT_IMAGE_PATH = "C:\\Users\\m0pxnn\\Desktop\\ImageTestFiles\\img2.bmp";
 const char* OUTPUT_IMAGE_PATH = "C:\\Users\\m0pxnn\\Desktop\\ImageTestFiles\\img2_modified.bmp";
 
+//******************************************************************************************
+// @name                    : CompareFiles
+//
+// @description             : Command "compare <first.bmp> <second.bmp> [min PSNR]". Prints how
+//                            much two images differ. Scripts checking outputs against a
+//                            reference can pass a minimum PSNR to accept small differences.
+//
+// @returns                 : 0 if the images are identical or close enough, 1 if they differ,
+//                            2 on error, including files that are missing or not bitmaps
+//********************************************************************************************
+static int CompareFiles(int argc, char *argv[])
+{
+    // Only uncompressed images are decoded. Checking the headers first keeps the loader
+    // from seeing anything else.
+    for (int i = 2; i <= 3; i++)
+    {
+        bitmap_file_header_t fileHeader;
+        bitmap_info_header_t infoHeader;
+        probe_status_t status = BitmapImage::ProbeBitmapHeader(argv[i], &fileHeader, &infoHeader);
+        if (status != PROBE_OK)
+        {
+            printf("ERROR: Cannot compare [%s]: %s!\n", argv[i], BitmapImage::getProbeStatusName(status));
+            return 2;
+        }
+
+        if (infoHeader.compressionType != COMPRESSION_RGB)
+        {
+            printf("ERROR: Cannot compare [%s]: compressed images are not supported!\n", argv[i]);
+            return 2;
+        }
+    }
+
+    image_comparison_t comparison;
+    try
+    {
+        BitmapImage first(argv[2]);
+        BitmapImage second(argv[3]);
+
+        if (first.compareWith(second, comparison) != 0)
+        {
+            return 2;
+        }
+    }
+    catch (const char *exception)
+    {
+        printf("ERROR: Cannot compare [%s] and [%s]: %s\n", argv[2], argv[3], exception);
+        return 2;
+    }
+    catch (const std::bad_alloc &)
+    {
+        printf("ERROR: Not enough memory to compare [%s] and [%s]!\n", argv[2], argv[3]);
+        return 2;
+    }
+
+    printf("identical: %s\n", comparison.identical ? "yes" : "no");
+    printf("max abs diff: %d\n", comparison.maxAbsDifference);
+    printf("mse: %.6f\n", comparison.meanSquaredError);
+    printf("psnr: %.4f dB\n", comparison.psnr);
+    printf("ssim: %.6f (r %.6f, g %.6f, b %.6f)\n", comparison.ssim,
+           comparison.channelSsim[RED], comparison.channelSsim[GREEN], comparison.channelSsim[BLUE]);
+
+    if (comparison.identical)
+    {
+        return 0;
+    }
+
+    return (argc > 4 && comparison.psnr >= atof(argv[4])) ? 0 : 1;
+}
+
+//******************************************************************************************
+// @name                    : SelfTest
+//
+// @description             : Command "selftest". Checks that the SIMD kernels of every level
+//                            the CPU supports give exactly the output of the scalar kernels,
+//                            so a deployment can verify a new machine or compiler before use.
+//
+// @returns                 : 0 if all levels agree, 1 on a mismatch
+//********************************************************************************************
+static int SelfTest()
+{
+    bool passed = KernelRegistry::runSelfTest();
+
+    printf("kernel self test (up to %s): %s\n",
+           GetSimdLevelName(KernelRegistry::getSupportedSimdLevel()), passed ? "passed" : "FAILED");
+
+    return passed ? 0 : 1;
+}
+
+//******************************************************************************************
+// @name                    : ServeJobs
+//
+// @description             : Command "serve [socket path|-] [memory budget MiB] [cache directory]".
+//                            Runs as a server taking jobs as lines of JSON, from stdin ("-"
+//                            or no path) or from clients of a Unix domain socket, so an
+//                            orchestrator does not start a process per image. Jobs run
+//                            concurrently while their images fit the memory budget. With
+//                            a cache directory, repeated jobs copy their earlier output.
+//
+// @returns                 : 0 if SUCCESS
+//********************************************************************************************
+static int ServeJobs(int argc, char *argv[])
+{
+    unsigned long long memoryBudget = SCHEDULER_DEFAULT_MEMORY_BUDGET;
+    if (argc > 3 && atoi(argv[3]) > 0)
+    {
+        memoryBudget = (unsigned long long)atoi(argv[3]) << 20;
+    }
+
+    ImageServer server(memoryBudget, 0, (argc > 4) ? argv[4] : nullptr);
+
+    if (argc > 2 && strcmp(argv[2], "-") != 0)
+    {
+        return (server.serveSocket(argv[2]) == 0) ? 0 : 2;
+    }
+
+    return (server.serveStdio() == 0) ? 0 : 2;
+}
+
 //******************************************************************************************
 // M A I N - for testing purpose.
 //******************************************************************************************
-int main()
+int main(int argc, char *argv[])
 {
     int retval = -1;
+
+    if (argc >= 4 && strcmp(argv[1], "compare") == 0)
+    {
+        return CompareFiles(argc, argv);
+    }
+
+    if (argc >= 2 && strcmp(argv[1], "serve") == 0)
+    {
+        return ServeJobs(argc, argv);
+    }
+
+    if (argc >= 2 && strcmp(argv[1], "selftest") == 0)
+    {
+        return SelfTest();
+    }
     
     {
         BitmapImage bmpImage(INPUT_IMAGE_PATH);
@@ -28,6 +166,9 @@ int main()
         //retval = bmpImage.ConvertToGrayScale();
         //bmpImage.displayHistogram();
         //bmpImage.DoImageBlur();
+        //bmpImage.ResizeImage(160, 120, RESIZE_AREA_AVERAGE);
+        //bmpImage.DoMedianFilter(1);
+        //bmpImage.TransformImage(TRANSFORM_ROTATE_90);
         
         printf("\nWriting to file...\n");
         retval = bmpImage.writeModifiedImageDataToFile(OUTPUT_IMAGE_PATH);
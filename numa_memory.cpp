@@ -0,0 +1,368 @@
+#include"numa_memory.h"
+#include"thread_pool.h"
+#include<stdio.h>
+#include<stdlib.h>
+#include<string.h>
+#include<map>
+#include<mutex>
+#include<vector>
+
+#ifdef USE_NUMA_PLACEMENT
+#include<pthread.h>
+#include<sched.h>
+#include<sys/mman.h>
+#endif
+
+// CPUs of every node, indexed by node number. Empty lists for missing node numbers.
+static std::vector<std::vector<int> > s_nodeCpus;
+static std::once_flag s_topologyOnce;
+
+static std::mutex s_memoryMutex;                    // Guards everything below
+static huge_page_mode_t s_hugePageMode = HUGE_PAGES_TRANSPARENT;
+static bool s_hugePageModeRead = false;             // BMP_HUGE_PAGES was looked at
+static std::map<unsigned char*, size_t> s_mappedBuffers;    // Explicit huge page buffers and their sizes
+
+//******************************************************************************************
+// @name                    : ParseCpuList
+//
+// @description             : This is a static function. Reads a sysfs list such as
+//                            "0-3,8-11" into the numbers it holds.
+//
+// @returns                 : Nothing
+//********************************************************************************************
+static void ParseCpuList(const char *text, std::vector<int> &values)
+{
+    const char *p = text;
+    while (*p != '\0' && *p != '\n')
+    {
+        char *end = nullptr;
+        long first = strtol(p, &end, 10);
+        if (end == p)
+        {
+            break;
+        }
+
+        long last = first;
+        p = end;
+        if (*p == '-')
+        {
+            last = strtol(p + 1, &end, 10);
+            p = end;
+        }
+
+        for (long value = first; value <= last; value++)
+        {
+            values.push_back((int)value);
+        }
+
+        if (*p == ',')
+        {
+            p++;
+        }
+    }
+}
+
+//******************************************************************************************
+// @name                    : ReadSysfsList
+//
+// @description             : This is a static function. Reads a list file of sysfs.
+//
+// @returns                 : false if the file cannot be read
+//********************************************************************************************
+static bool ReadSysfsList(const char *path, std::vector<int> &values)
+{
+    FILE *file = fopen(path, "r");
+    if (file == nullptr)
+    {
+        return false;
+    }
+
+    char text[4096];
+    bool read = (fgets(text, sizeof(text), file) != nullptr);
+    fclose(file);
+
+    if (read)
+    {
+        ParseCpuList(text, values);
+    }
+    return read;
+}
+
+//******************************************************************************************
+// @name                    : LoadTopology
+//
+// @description             : This is a static function. Reads the online nodes and their
+//                            CPUs, once.
+//
+// @returns                 : Nothing
+//********************************************************************************************
+static void LoadTopology()
+{
+    std::call_once(s_topologyOnce, []
+    {
+#ifdef USE_NUMA_PLACEMENT
+        std::vector<int> nodes;
+        if (ReadSysfsList("/sys/devices/system/node/online", nodes))
+        {
+            for (size_t i = 0; i < nodes.size(); i++)
+            {
+                char path[128];
+                snprintf(path, sizeof(path), "/sys/devices/system/node/node%d/cpulist", nodes[i]);
+
+                std::vector<int> cpus;
+                if (ReadSysfsList(path, cpus) && !cpus.empty())
+                {
+                    if ((int)s_nodeCpus.size() <= nodes[i])
+                    {
+                        s_nodeCpus.resize(nodes[i] + 1);
+                    }
+                    s_nodeCpus[nodes[i]] = cpus;
+                }
+            }
+        }
+#endif
+    });
+}
+
+//******************************************************************************************
+// @name                    : GetNumaNodeCount
+//
+// @description             : Number of NUMA nodes, counting up to the highest online node
+//
+// @returns                 : Node count, 1 without NUMA
+//********************************************************************************************
+int GetNumaNodeCount()
+{
+    LoadTopology();
+    return s_nodeCpus.empty() ? 1 : (int)s_nodeCpus.size();
+}
+
+//******************************************************************************************
+// @name                    : PinCurrentThreadToNumaNode
+//
+// @description             : Lets the calling thread run only on the CPUs of a node. The
+//                            thread may still move between them.
+//
+// @param node              : Node, 0 to GetNumaNodeCount() - 1
+//
+// @returns                 : true if the thread is pinned
+//********************************************************************************************
+bool PinCurrentThreadToNumaNode(int node)
+{
+    LoadTopology();
+    if (node < 0 || node >= (int)s_nodeCpus.size() || s_nodeCpus[node].empty())
+    {
+        return false;
+    }
+
+#ifdef USE_NUMA_PLACEMENT
+    cpu_set_t cpus;
+    CPU_ZERO(&cpus);
+    for (size_t i = 0; i < s_nodeCpus[node].size(); i++)
+    {
+        if (s_nodeCpus[node][i] < CPU_SETSIZE)
+        {
+            CPU_SET(s_nodeCpus[node][i], &cpus);
+        }
+    }
+
+    return pthread_setaffinity_np(pthread_self(), sizeof(cpus), &cpus) == 0;
+#else
+    return false;
+#endif
+}
+
+//******************************************************************************************
+// @name                    : IsThreadPinningEnabled
+//
+// @description             : Whether the pool pins its threads to nodes. It does on machines
+//                            with more than one node, unless BMP_PIN_THREADS is "0".
+//
+// @returns                 : true if threads are pinned
+//********************************************************************************************
+bool IsThreadPinningEnabled()
+{
+    const char *value = getenv(PIN_THREADS_ENVIRONMENT_VARIABLE);
+    if (value != nullptr && strcmp(value, "0") == 0)
+    {
+        return false;
+    }
+
+    return GetNumaNodeCount() > 1;
+}
+
+//******************************************************************************************
+// @name                    : GetHugePageMode
+//
+// @description             : Pages of new large pixel buffers. BMP_HUGE_PAGES sets the mode
+//                            until SetHugePageMode changes it.
+//
+// @returns                 : Mode
+//********************************************************************************************
+huge_page_mode_t GetHugePageMode()
+{
+    std::unique_lock<std::mutex> lock(s_memoryMutex);
+    if (!s_hugePageModeRead)
+    {
+        s_hugePageModeRead = true;
+
+        const char *name = getenv(HUGE_PAGES_ENVIRONMENT_VARIABLE);
+        if (name != nullptr && name[0] != '\0' && !ParseHugePageMode(name, &s_hugePageMode))
+        {
+            printf("WARNING: Unknown %s value [%s]\n", HUGE_PAGES_ENVIRONMENT_VARIABLE, name);
+        }
+    }
+
+    return s_hugePageMode;
+}
+
+//******************************************************************************************
+// @name                    : SetHugePageMode
+//
+// @description             : Sets the pages of pixel buffers allocated from now on
+//
+// @returns                 : Nothing
+//********************************************************************************************
+void SetHugePageMode(huge_page_mode_t mode)
+{
+    std::unique_lock<std::mutex> lock(s_memoryMutex);
+    s_hugePageMode = mode;
+    s_hugePageModeRead = true;
+}
+
+//******************************************************************************************
+// @name                    : ParseHugePageMode
+//
+// @description             : Reads a mode name: "none", "transparent" or "explicit"
+//
+// @returns                 : false if the name is unknown
+//********************************************************************************************
+bool ParseHugePageMode(const char *name, huge_page_mode_t *mode)
+{
+    if (strcmp(name, "none") == 0)
+    {
+        *mode = HUGE_PAGES_NONE;
+    }
+    else if (strcmp(name, "transparent") == 0)
+    {
+        *mode = HUGE_PAGES_TRANSPARENT;
+    }
+    else if (strcmp(name, "explicit") == 0)
+    {
+        *mode = HUGE_PAGES_EXPLICIT;
+    }
+    else
+    {
+        return false;
+    }
+
+    return true;
+}
+
+//******************************************************************************************
+// @name                    : AllocatePixelMemory
+//
+// @description             : Allocates a zero filled pixel buffer. Rows are zeroed in the
+//                            bands the thread pool hands out, so on first touch the pages of a
+//                            band land on the node whose threads will process it. Large
+//                            buffers get huge pages as GetHugePageMode() says.
+//
+// @param paddedWidth       : Bytes per row
+// @param height            : Rows
+//
+// @returns                 : Buffer, to be freed with FreePixelMemory. nullptr on failure.
+//********************************************************************************************
+unsigned char* AllocatePixelMemory(size_t paddedWidth, int height)
+{
+    size_t bytes = paddedWidth * height;
+    unsigned char *pixels = nullptr;
+
+#ifdef USE_NUMA_PLACEMENT
+    huge_page_mode_t mode = GetHugePageMode();
+    if (bytes >= HUGE_PAGE_MIN_BYTES && mode != HUGE_PAGES_NONE)
+    {
+        size_t rounded = (bytes + HUGE_PAGE_SIZE - 1) / HUGE_PAGE_SIZE * HUGE_PAGE_SIZE;
+
+        if (mode == HUGE_PAGES_EXPLICIT)
+        {
+            void *mapped = mmap(nullptr, rounded, PROT_READ | PROT_WRITE, MAP_PRIVATE | MAP_ANONYMOUS | MAP_HUGETLB, -1, 0);
+            if (mapped != MAP_FAILED)
+            {
+                pixels = (unsigned char *)mapped;
+                std::unique_lock<std::mutex> lock(s_memoryMutex);
+                s_mappedBuffers[pixels] = rounded;
+            }
+        }
+
+        void *aligned = nullptr;
+        if (pixels == nullptr && posix_memalign(&aligned, HUGE_PAGE_SIZE, rounded) == 0)
+        {
+            pixels = (unsigned char *)aligned;
+            madvise(pixels, rounded, MADV_HUGEPAGE);
+        }
+    }
+#endif
+
+    if (pixels == nullptr)
+    {
+        pixels = (unsigned char *)malloc(bytes);
+        if (pixels == nullptr)
+        {
+            return nullptr;
+        }
+    }
+
+    ClearPixelMemory(pixels, paddedWidth, height);
+    return pixels;
+}
+
+//******************************************************************************************
+// @name                    : ClearPixelMemory
+//
+// @description             : Zeroes a pixel buffer, band by band on the thread pool
+//
+// @returns                 : Nothing
+//********************************************************************************************
+void ClearPixelMemory(unsigned char *pixels, size_t paddedWidth, int height)
+{
+    ThreadPool::getInstance().parallelFor(height, DEFAULT_ROWS_PER_TASK, [&](int begin, int end)
+    {
+        memset(pixels + paddedWidth * begin, 0, paddedWidth * (end - begin));
+    });
+}
+
+//******************************************************************************************
+// @name                    : FreePixelMemory
+//
+// @description             : Frees a buffer of AllocatePixelMemory, if not already freed
+//
+// @returns                 : Nothing
+//********************************************************************************************
+void FreePixelMemory(unsigned char *pixels)
+{
+    if (pixels == nullptr)
+    {
+        return;
+    }
+
+#ifdef USE_NUMA_PLACEMENT
+    size_t mappedBytes = 0;
+    {
+        std::unique_lock<std::mutex> lock(s_memoryMutex);
+        std::map<unsigned char*, size_t>::iterator found = s_mappedBuffers.find(pixels);
+        if (found != s_mappedBuffers.end())
+        {
+            mappedBytes = found->second;
+            s_mappedBuffers.erase(found);
+        }
+    }
+
+    if (mappedBytes > 0)
+    {
+        munmap(pixels, mappedBytes);
+        return;
+    }
+#endif
+
+    free(pixels);
+}
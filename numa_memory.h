@@ -0,0 +1,44 @@
+#ifndef _NUMA_MEMORY_H_
+#define _NUMA_MEMORY_H_
+#include<stddef.h>
+
+// The NUMA topology comes from sysfs, threads are pinned with the pthread affinity calls and
+// huge pages are requested with madvise and mmap, so all of it is Linux only. Elsewhere there
+// is one node, nothing is pinned and pixel buffers come from malloc.
+#if defined(__linux__)
+#define USE_NUMA_PLACEMENT
+#endif
+
+// ==================================================================================================
+// Constants
+// ==================================================================================================
+const size_t HUGE_PAGE_SIZE = 2 << 20;
+const size_t HUGE_PAGE_MIN_BYTES = 8 << 20;         // Smaller pixel buffers use normal pages
+const char* const HUGE_PAGES_ENVIRONMENT_VARIABLE = "BMP_HUGE_PAGES";  // "none", "transparent" or "explicit"
+const char* const PIN_THREADS_ENVIRONMENT_VARIABLE = "BMP_PIN_THREADS"; // "0" leaves the pool threads unpinned
+
+// ==================================================================================================
+// Enums
+// ==================================================================================================
+// Pages of large pixel buffers. Huge pages cut the TLB misses of passes over whole images.
+typedef enum huge_page_mode_tag
+{
+    HUGE_PAGES_NONE,
+    HUGE_PAGES_TRANSPARENT,     // Aligned to huge pages and advised (MADV_HUGEPAGE); the kernel uses them when it can
+    HUGE_PAGES_EXPLICIT         // From the reserved pool (vm.nr_hugepages), transparent if the pool is empty
+}huge_page_mode_t;
+
+// ==================================================================================================
+// Functions
+// ==================================================================================================
+int GetNumaNodeCount();
+bool PinCurrentThreadToNumaNode(int node);
+bool IsThreadPinningEnabled();
+huge_page_mode_t GetHugePageMode();
+void SetHugePageMode(huge_page_mode_t mode);
+bool ParseHugePageMode(const char *name, huge_page_mode_t *mode);
+unsigned char* AllocatePixelMemory(size_t paddedWidth, int height);
+void ClearPixelMemory(unsigned char *pixels, size_t paddedWidth, int height);
+void FreePixelMemory(unsigned char *pixels);
+
+#endif
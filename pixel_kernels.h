@@ -0,0 +1,900 @@
+#ifndef _PIXEL_KERNELS_H_
+#define _PIXEL_KERNELS_H_
+#include"bmp.h"
+#include"kernel_registry.h"
+#include<algorithm>
+
+// Pixel operations are written once as templates over the pixel format and the processing
+// mode. Every combination is instantiated at compile time, and the BitmapImage operations
+// pick one with a single runtime dispatch, so the inner loops carry no format branches.
+// The 24 bit per channel kernels are specialized to the SIMD row kernels picked at run time
+// for the CPU (see kernel_registry.h).
+
+// ==================================================================================================
+// Color conversion
+// ==================================================================================================
+//******************************************************************************************
+// @name                    : LumaFromRGB
+//
+// @description             : Brightness (Y of YCbCr) of a pixel. Integer arithmetic, so
+//                            every kernel gets exactly the same value.
+//
+// @returns                 : Y in [Y_MIN, Y_MAX]
+//********************************************************************************************
+inline unsigned char LumaFromRGB(int red, int green, int blue)
+{
+    int y = Y_MIN + (LUMA_RED_WEIGHT * red + LUMA_GREEN_WEIGHT * green + LUMA_BLUE_WEIGHT * blue) / LUMA_WEIGHT_SCALE;
+
+    return (unsigned char)((y > Y_MAX) ? Y_MAX : y);
+}
+
+//******************************************************************************************
+// @name                    : GrayLevelFromRGB
+//
+// @description             : Brightness of a pixel on the full 0 to 255 scale, so black and
+//                            white stay at the ends. Integer arithmetic, so every kernel gets
+//                            exactly the same value.
+//
+// @returns                 : Gray level
+//********************************************************************************************
+inline int GrayLevelFromRGB(int red, int green, int blue)
+{
+    return (GRAY_RED_WEIGHT * red + GRAY_GREEN_WEIGHT * green + GRAY_BLUE_WEIGHT * blue +
+            (1 << (GRAY_WEIGHT_SHIFT - 1))) >> GRAY_WEIGHT_SHIFT;
+}
+
+//******************************************************************************************
+// @name                    : OrderedDitherLevel
+//
+// @description             : Palette level of a gray under an ordered dither threshold:
+//                            (gray * maxIndex + threshold) / 255. The division is done as
+//                            (n + 1 + (n >> 8)) >> 8, exact for n < 65535, so that the SIMD
+//                            kernels can do it in 16 bit lanes.
+//
+// @param maxIndex          : Highest palette index, at most 255
+// @param threshold         : 0 to 254
+//
+// @returns                 : Level, 0 to maxIndex
+//********************************************************************************************
+inline int OrderedDitherLevel(int gray, int maxIndex, int threshold)
+{
+    int n = gray * maxIndex + threshold;
+
+    return (n + 1 + (n >> 8)) >> 8;
+}
+
+//******************************************************************************************
+// @name                    : ChromaFromRGBSums
+//
+// @description             : Cb and Cr of 1 << sumShift pixels from the sums of their
+//                            channels: sumShift is 0 for one pixel and 2 for a 2x2 block.
+//                            Integer arithmetic, so every kernel gets exactly the same value.
+//
+// @returns                 : Nothing
+//********************************************************************************************
+inline void ChromaFromRGBSums(int red, int green, int blue, int sumShift, unsigned char &cb, unsigned char &cr)
+{
+    int shift = CHROMA_WEIGHT_SHIFT + sumShift;
+    int rounding = 1 << (shift - 1);
+    int b = 128 + ((CB_RED_WEIGHT * red + CB_GREEN_WEIGHT * green + CB_BLUE_WEIGHT * blue + rounding) >> shift);
+    int r = 128 + ((CR_RED_WEIGHT * red + CR_GREEN_WEIGHT * green + CR_BLUE_WEIGHT * blue + rounding) >> shift);
+
+    cb = (unsigned char)std::min(std::max(b, C_MIN), C_MAX);
+    cr = (unsigned char)std::min(std::max(r, C_MIN), C_MAX);
+}
+
+//******************************************************************************************
+// @name                    : RGBToYCbCr
+//
+// @description             : Convert from RGB to YCbCr
+//
+// @returns                 : Clamped YCbCr components
+//********************************************************************************************
+inline pixel_value_ycbcr_t RGBToYCbCr(int r, int g, int b)
+{
+    pixel_value_ycbcr_t pixelYCbCr;
+
+#ifdef USE_ITU_CONVERSION_FOR_YCBCR
+    // As per Recommendation ITU-R BT.601
+    int Cb = 128 + ((-0.148 * r) - (0.291 * g) + (0.439 * b));
+    int Cr = 128 + ((0.439 * r) - (0.368 * g) - (0.071 * b));
+#else
+    // As per http://www.mir.com/DMG/ycbcr.html
+    int Cb = 128 + ((-0.168736 * r) - (0.331364 * g) + (0.5 * b));
+    int Cr = 128 + ((0.5 * r) - (0.418688 * g) - (0.081312 * b));
+#endif
+
+    // Clamping on CbCr values
+    if (Cb > C_MAX)
+        Cb = C_MAX;
+
+    if (Cb < C_MIN)
+        Cb = C_MIN;
+
+    if (Cr > C_MAX)
+        Cr = C_MAX;
+
+    if (Cr < C_MIN)
+        Cr = C_MIN;
+
+    pixelYCbCr.y = LumaFromRGB(r, g, b);
+    pixelYCbCr.Cb = Cb;
+    pixelYCbCr.Cr = Cr;
+
+    return pixelYCbCr;
+}
+
+//******************************************************************************************
+// @name                    : YCbCrToRGB
+//
+// @description             : Convert from YCbCr to RGB
+//
+// @returns                 : Clamped RGB components
+//********************************************************************************************
+inline pixel_value_rgb_t YCbCrToRGB(int y, int Cb, int Cr)
+{
+    pixel_value_rgb_t pixelValue;
+
+#ifdef USE_ITU_CONVERSION_FOR_YCBCR
+    // As per Recommendation ITU-R BT.601
+    int r = (1.164 * (y - 16)) + (1.596 * (Cr - 128));
+    int g = (1.164 * (y - 16)) + (-0.392 * (Cb - 128)) + (-0.813 * (Cr - 128));
+    int b = (1.164 * (y - 16)) + (2.017 * (Cb - 128));
+#else
+    // As per http://www.mir.com/DMG/ycbcr.html
+    int r = y + (1.402 * Cr);
+    int g = y - (0.344136 * Cb) - (0.714136 * Cr);
+    int b = y + (1.772 * Cb);
+#endif
+
+    // Clamping on RGB values
+    if (r > MAX_COLORS - 1)
+        r = MAX_COLORS - 1;
+
+    if (r < MIN_COLORS)
+        r = MIN_COLORS;
+
+    if (g > MAX_COLORS - 1)
+        g = MAX_COLORS - 1;
+
+    if (g < MIN_COLORS)
+        g = MIN_COLORS;
+
+    if (b > MAX_COLORS - 1)
+        b = MAX_COLORS - 1;
+
+    if (b < MIN_COLORS)
+        b = MIN_COLORS;
+
+    pixelValue.red = r;
+    pixelValue.green = g;
+    pixelValue.blue = b;
+
+    return pixelValue;
+}
+
+// ==================================================================================================
+// Summed-area tables
+// ==================================================================================================
+//******************************************************************************************
+// @name                    : IntegralRectSum
+//
+// @description             : Sum of the pixels of memory rows [bottom, top) and columns
+//                            [left, right) from a summed-area table. Partial differences of
+//                            32 bit entries may wrap around, the rectangle sum does not.
+//
+// @returns                 : Sum
+//********************************************************************************************
+inline unsigned long long IntegralRectSum(const integral_image_t &table, int left, int bottom, int right, int top)
+{
+    size_t above = (size_t)table.stride * top;
+    size_t below = (size_t)table.stride * bottom;
+
+    if (!table.sums64.empty())
+    {
+        const unsigned long long *sums = &table.sums64[0];
+        return sums[above + right] - sums[above + left] - sums[below + right] + sums[below + left];
+    }
+
+    const unsigned int *sums = &table.sums32[0];
+    return (unsigned int)(sums[above + right] - sums[above + left] - sums[below + right] + sums[below + left]);
+}
+
+// ==================================================================================================
+// Resize
+// ==================================================================================================
+//******************************************************************************************
+// @name                    : ResizeSumToByte
+//
+// @description             : Removes the fixed point scaling from a sum of pixels times resize
+//                            weights and clamps it to a byte, as the SIMD kernels' saturating
+//                            packs do.
+//
+// @param value             : Accumulated value, already rounded
+//
+// @returns                 : Pixel value
+//********************************************************************************************
+inline unsigned char ResizeSumToByte(int value)
+{
+    value >>= RESIZE_WEIGHT_BITS;
+    if (value > MAX_COLORS - 1)
+        value = MAX_COLORS - 1;
+
+    if (value < MIN_COLORS)
+        value = MIN_COLORS;
+
+    return (unsigned char)value;
+}
+
+// ==================================================================================================
+// Pixel formats
+// ==================================================================================================
+// 8 bit grayscale. All three color channels alias the single byte.
+struct Gray8Format
+{
+    static const int BYTES_PER_PIXEL = 1;
+    static const int CHANNELS = 1;
+    static const int BLUE_OFFSET = 0;
+    static const int GREEN_OFFSET = 0;
+    static const int RED_OFFSET = 0;
+};
+
+// 24 bit, stored as blue, green, red
+struct Bgr24Format
+{
+    static const int BYTES_PER_PIXEL = 3;
+    static const int CHANNELS = 3;
+    static const int BLUE_OFFSET = 0;
+    static const int GREEN_OFFSET = 1;
+    static const int RED_OFFSET = 2;
+};
+
+// 32 bit, stored as blue, green, red, alpha. Alpha is never modified.
+struct Bgra32Format
+{
+    static const int BYTES_PER_PIXEL = 4;
+    static const int CHANNELS = 3;
+    static const int BLUE_OFFSET = 0;
+    static const int GREEN_OFFSET = 1;
+    static const int RED_OFFSET = 2;
+};
+
+// Processing mode as a type, so that it can be dispatched like a pixel format
+template<processing_mode_t MODE>
+struct ProcessingModeTag
+{
+    static constexpr processing_mode_t value = MODE;
+};
+
+//******************************************************************************************
+// @name                    : DispatchPixelFormat
+//
+// @description             : Calls functor with the pixel format matching bitsPerPixel
+//
+// @returns                 : false if the format has no kernels
+//********************************************************************************************
+template<typename Functor>
+bool DispatchPixelFormat(short bitsPerPixel, Functor &&functor)
+{
+    switch (bitsPerPixel)
+    {
+    case BITS_8_PALLETIZED:
+        functor(Gray8Format());
+        return true;
+    case BITS_24_RGB:
+        functor(Bgr24Format());
+        return true;
+    case BITS_32_RGBA:
+        functor(Bgra32Format());
+        return true;
+    default:
+        return false;
+    }
+}
+
+//******************************************************************************************
+// @name                    : IsSupportedPixelFormat
+//
+// @description             : Tells whether DispatchPixelFormat has kernels for bitsPerPixel
+//
+// @returns                 : true if supported
+//********************************************************************************************
+inline bool IsSupportedPixelFormat(short bitsPerPixel)
+{
+    return bitsPerPixel == BITS_8_PALLETIZED || bitsPerPixel == BITS_24_RGB || bitsPerPixel == BITS_32_RGBA;
+}
+
+//******************************************************************************************
+// @name                    : DispatchProcessingMode
+//
+// @description             : Calls functor with the ProcessingModeTag matching mode
+//
+// @returns                 : Nothing
+//********************************************************************************************
+template<typename Functor>
+void DispatchProcessingMode(processing_mode_t mode, Functor &&functor)
+{
+    if (mode == PROCESS_LUMA)
+    {
+        functor(ProcessingModeTag<PROCESS_LUMA>());
+    }
+    else
+    {
+        functor(ProcessingModeTag<PROCESS_PER_CHANNEL>());
+    }
+}
+
+// ==================================================================================================
+// Kernels. Each one processes rows [rowBegin, rowEnd) so that it can run on a band of rows.
+// ==================================================================================================
+//******************************************************************************************
+// @name                    : HistogramRows
+//
+// @description             : Adds the pixels of the rows to the histograms
+//
+// @returns                 : Nothing
+//********************************************************************************************
+template<typename Format>
+void HistogramRows(const pixel_buffer_t &image, int rowBegin, int rowEnd, histogram_table_t &histogram)
+{
+    for (int i = rowBegin; i < rowEnd; i++)
+    {
+        const unsigned char *pixel = &image.pixels[(size_t)image.paddedWidth * i];
+        for (int j = 0; j < image.width; j++, pixel += Format::BYTES_PER_PIXEL)
+        {
+            unsigned char blue  = pixel[Format::BLUE_OFFSET];
+            unsigned char green = pixel[Format::GREEN_OFFSET];
+            unsigned char red   = pixel[Format::RED_OFFSET];
+
+            histogram.red[red]++;
+            histogram.green[green]++;
+            histogram.blue[blue]++;
+            histogram.brightness[LumaFromRGB(red, green, blue)]++;
+        }
+    }
+}
+
+//******************************************************************************************
+// @name                    : SampleOffset
+//
+// @description             : Pseudo-random offset, 0 to step - 1, of the sampled row of a
+//                            band of rows (block = -1) or of the sampled pixel of a block
+//
+// @returns                 : Offset
+//********************************************************************************************
+inline int SampleOffset(int band, int block, int step)
+{
+    unsigned int h = (unsigned int)band * 0x9E3779B1u ^ ((unsigned int)block + 0x7F4A7C15u) * 0x85EBCA77u;
+    h ^= h >> 15;
+    h *= 0x2C1B3C6Du;
+    h ^= h >> 12;
+    h *= 0x297A2D39u;
+    h ^= h >> 15;
+
+    return (int)(h % (unsigned int)step);
+}
+
+//******************************************************************************************
+// @name                    : HistogramSampleRows
+//
+// @description             : Adds a stratified sample of the pixels of the rows to the
+//                            histograms: one pixel of every step x step block of the image,
+//                            at a pseudo-random place, so that patterns with a period of step
+//                            pixels do not alias. Blocks of a band of rows share the sampled
+//                            row, so the other rows are never read. The sample depends only
+//                            on the position of a pixel in the image, so a rectangle of it
+//                            counts the same pixels as the whole image does.
+//
+// @param originX           : Image column of the first column of the buffer
+// @param originRow         : Image memory row of the first row of the buffer
+//
+// @returns                 : Nothing
+//********************************************************************************************
+template<typename Format>
+void HistogramSampleRows(const pixel_buffer_t &image, int rowBegin, int rowEnd, int step, int originX, int originRow,
+                         histogram_table_t &histogram)
+{
+    for (int i = rowBegin; i < rowEnd; i++)
+    {
+        int band = (originRow + i) / step;
+        if ((originRow + i) % step != SampleOffset(band, -1, step))
+        {
+            continue;
+        }
+
+        const unsigned char *row = &image.pixels[(size_t)image.paddedWidth * i];
+        for (int block = originX / step; block * step < originX + image.width; block++)
+        {
+            // Blocks cut by the edges are sampled in proportion to the part inside
+            int j = block * step + SampleOffset(band, block, step) - originX;
+            if (j < 0 || j >= image.width)
+            {
+                continue;
+            }
+
+            const unsigned char *pixel = row + (size_t)j * Format::BYTES_PER_PIXEL;
+            unsigned char blue  = pixel[Format::BLUE_OFFSET];
+            unsigned char green = pixel[Format::GREEN_OFFSET];
+            unsigned char red   = pixel[Format::RED_OFFSET];
+
+            histogram.red[red]++;
+            histogram.green[green]++;
+            histogram.blue[blue]++;
+            histogram.brightness[LumaFromRGB(red, green, blue)]++;
+        }
+    }
+}
+
+//******************************************************************************************
+// @name                    : StatisticsRows
+//
+// @description             : Adds the pixels of the rows to the sums, minima and maxima of
+//                            every channel and the brightness
+//
+// @returns                 : Nothing
+//********************************************************************************************
+template<typename Format>
+void StatisticsRows(const pixel_buffer_t &image, int rowBegin, int rowEnd, statistics_sums_t &sums)
+{
+    for (int i = rowBegin; i < rowEnd; i++)
+    {
+        const unsigned char *pixel = &image.pixels[(size_t)image.paddedWidth * i];
+        for (int j = 0; j < image.width; j++, pixel += Format::BYTES_PER_PIXEL)
+        {
+            unsigned char values[4];
+            values[RED]   = pixel[Format::RED_OFFSET];
+            values[GREEN] = pixel[Format::GREEN_OFFSET];
+            values[BLUE]  = pixel[Format::BLUE_OFFSET];
+            values[BRIGHTNESS] = LumaFromRGB(values[RED], values[GREEN], values[BLUE]);
+
+            for (int c = 0; c < 4; c++)
+            {
+                sums.sum[c] += values[c];
+                sums.sumOfSquares[c] += values[c] * values[c];
+                sums.minimum[c] = std::min(sums.minimum[c], values[c]);
+                sums.maximum[c] = std::max(sums.maximum[c], values[c]);
+            }
+        }
+        sums.count += image.width;
+    }
+}
+
+//******************************************************************************************
+// @name                    : GrayscaleRows
+//
+// @description             : Replaces every color channel with the brightness of the pixel
+//
+// @returns                 : Nothing
+//********************************************************************************************
+template<typename Format>
+void GrayscaleRows(const pixel_buffer_t &src, pixel_buffer_t &dst, int rowBegin, int rowEnd)
+{
+    for (int i = rowBegin; i < rowEnd; i++)
+    {
+        const unsigned char *in = &src.pixels[(size_t)src.paddedWidth * i];
+        unsigned char *out = &dst.pixels[(size_t)dst.paddedWidth * i];
+        for (int j = 0; j < src.width; j++, in += Format::BYTES_PER_PIXEL, out += Format::BYTES_PER_PIXEL)
+        {
+            unsigned char y = LumaFromRGB(in[Format::RED_OFFSET], in[Format::GREEN_OFFSET], in[Format::BLUE_OFFSET]);
+            out[Format::BLUE_OFFSET]  = y;
+            out[Format::GREEN_OFFSET] = y;
+            out[Format::RED_OFFSET]   = y;
+        }
+    }
+}
+
+//******************************************************************************************
+// @name                    : ApplyLookupRows
+//
+// @description             : Maps every pixel through lookup tables. Per channel mode maps
+//                            red, green and blue through their own table. Luma mode maps
+//                            the brightness and keeps the chroma. A grayscale pixel has no
+//                            chroma, so it is always mapped through the red table.
+//
+// @param lut               : Tables indexed by color_t, then by intensity
+//
+// @returns                 : Nothing
+//********************************************************************************************
+template<typename Format, processing_mode_t MODE>
+void ApplyLookupRows(const pixel_buffer_t &src, pixel_buffer_t &dst, const unsigned char lut[4][MAX_COLORS],
+                     int rowBegin, int rowEnd)
+{
+    for (int i = rowBegin; i < rowEnd; i++)
+    {
+        const unsigned char *in = &src.pixels[(size_t)src.paddedWidth * i];
+        unsigned char *out = &dst.pixels[(size_t)dst.paddedWidth * i];
+        for (int j = 0; j < src.width; j++, in += Format::BYTES_PER_PIXEL, out += Format::BYTES_PER_PIXEL)
+        {
+            if (Format::CHANNELS == 1)
+            {
+                out[0] = lut[RED][in[0]];
+            }
+            else if (MODE == PROCESS_LUMA)
+            {
+                pixel_value_ycbcr_t ycbcr = RGBToYCbCr(in[Format::RED_OFFSET], in[Format::GREEN_OFFSET], in[Format::BLUE_OFFSET]);
+                pixel_value_rgb_t rgb = YCbCrToRGB(lut[BRIGHTNESS][ycbcr.y], ycbcr.Cb, ycbcr.Cr);
+                out[Format::BLUE_OFFSET]  = rgb.blue;
+                out[Format::GREEN_OFFSET] = rgb.green;
+                out[Format::RED_OFFSET]   = rgb.red;
+            }
+            else
+            {
+                out[Format::BLUE_OFFSET]  = lut[BLUE][in[Format::BLUE_OFFSET]];
+                out[Format::GREEN_OFFSET] = lut[GREEN][in[Format::GREEN_OFFSET]];
+                out[Format::RED_OFFSET]   = lut[RED][in[Format::RED_OFFSET]];
+            }
+        }
+    }
+}
+
+//******************************************************************************************
+// @name                    : BlurRows
+//
+// @description             : Replaces every pixel with the mean of its (up to 8) neighbours.
+//                            Per channel mode averages red, green and blue. Luma mode
+//                            averages the brightness and keeps the chroma of the pixel.
+//
+// @returns                 : Nothing
+//********************************************************************************************
+template<typename Format, processing_mode_t MODE>
+void BlurRows(const pixel_buffer_t &src, pixel_buffer_t &dst, int rowBegin, int rowEnd)
+{
+    for (int i = rowBegin; i < rowEnd; i++)
+    {
+        int top = (i > 0) ? i - 1 : i;
+        int bottom = (i < src.height - 1) ? i + 1 : i;
+        unsigned char *out = &dst.pixels[(size_t)dst.paddedWidth * i];
+
+        for (int j = 0; j < src.width; j++, out += Format::BYTES_PER_PIXEL)
+        {
+            int left = (j > 0) ? j - 1 : j;
+            int right = (j < src.width - 1) ? j + 1 : j;
+            int neighbours = (bottom - top + 1) * (right - left + 1) - 1;
+            if (neighbours == 0)
+            {
+                continue;
+            }
+
+            unsigned long blue = 0;
+            unsigned long green = 0;
+            unsigned long red = 0;
+            unsigned long brightness = 0;
+            for (int k = top; k <= bottom; k++)
+            {
+                const unsigned char *in = &src.pixels[(size_t)src.paddedWidth * k + left * Format::BYTES_PER_PIXEL];
+                for (int l = left; l <= right; l++, in += Format::BYTES_PER_PIXEL)
+                {
+                    if (k == i && l == j)
+                    {
+                        continue;
+                    }
+
+                    if (MODE == PROCESS_LUMA && Format::CHANNELS == 3)
+                    {
+                        brightness += LumaFromRGB(in[Format::RED_OFFSET], in[Format::GREEN_OFFSET], in[Format::BLUE_OFFSET]);
+                    }
+                    else
+                    {
+                        blue  += in[Format::BLUE_OFFSET];
+                        green += in[Format::GREEN_OFFSET];
+                        red   += in[Format::RED_OFFSET];
+                    }
+                }
+            }
+
+            if (MODE == PROCESS_LUMA && Format::CHANNELS == 3)
+            {
+                const unsigned char *in = &src.pixels[(size_t)src.paddedWidth * i + j * Format::BYTES_PER_PIXEL];
+                pixel_value_ycbcr_t ycbcr = RGBToYCbCr(in[Format::RED_OFFSET], in[Format::GREEN_OFFSET], in[Format::BLUE_OFFSET]);
+                pixel_value_rgb_t rgb = YCbCrToRGB(brightness / neighbours, ycbcr.Cb, ycbcr.Cr);
+                out[Format::BLUE_OFFSET]  = rgb.blue;
+                out[Format::GREEN_OFFSET] = rgb.green;
+                out[Format::RED_OFFSET]   = rgb.red;
+            }
+            else
+            {
+                out[Format::BLUE_OFFSET]  = (unsigned char)(blue / neighbours);
+                out[Format::GREEN_OFFSET] = (unsigned char)(green / neighbours);
+                out[Format::RED_OFFSET]   = (unsigned char)(red / neighbours);
+            }
+        }
+    }
+}
+
+//******************************************************************************************
+// @name                    : LumaRows
+//
+// @description             : Brightness of every pixel of the rows, one byte per pixel
+//
+// @param luma              : Plane of the whole image, width bytes per row, rows in image order
+//
+// @returns                 : Nothing
+//********************************************************************************************
+template<typename Format>
+void LumaRows(const pixel_buffer_t &image, unsigned char *luma, int rowBegin, int rowEnd)
+{
+    for (int i = rowBegin; i < rowEnd; i++)
+    {
+        const unsigned char *in = &image.pixels[(size_t)image.paddedWidth * i];
+        unsigned char *out = luma + (size_t)image.width * i;
+        for (int j = 0; j < image.width; j++, in += Format::BYTES_PER_PIXEL)
+        {
+            out[j] = LumaFromRGB(in[Format::RED_OFFSET], in[Format::GREEN_OFFSET], in[Format::BLUE_OFFSET]);
+        }
+    }
+}
+
+//******************************************************************************************
+// @name                    : OrderedDitherPixels
+//
+// @description             : Ordered dithering of pixels [first, width) of a row to gray
+//                            palette indices, packed bitsPerPixel to a byte with the first
+//                            pixel in the high bits
+//
+// @param first             : Multiple of ORDERED_DITHER_SIZE
+// @param thresholds        : Row of the threshold matrix, ORDERED_DITHER_SIZE entries
+// @param bitsPerPixel      : 1, 4 or 8
+//
+// @returns                 : Nothing
+//********************************************************************************************
+template<typename Format>
+void OrderedDitherPixels(const unsigned char *src, int first, int width, const unsigned char *thresholds,
+                         int bitsPerPixel, unsigned char *dst)
+{
+    int maxIndex = (1 << bitsPerPixel) - 1;
+    int pixelsPerByte = 8 / bitsPerPixel;
+
+    src += first * Format::BYTES_PER_PIXEL;
+    for (int j = first; j < width; j++, src += Format::BYTES_PER_PIXEL)
+    {
+        int gray = GrayLevelFromRGB(src[Format::RED_OFFSET], src[Format::GREEN_OFFSET], src[Format::BLUE_OFFSET]);
+        int level = OrderedDitherLevel(gray, maxIndex, thresholds[j % ORDERED_DITHER_SIZE]);
+        int shift = 8 - bitsPerPixel * (1 + j % pixelsPerByte);
+
+        // The first pixel of a byte clears the rest of it
+        unsigned char &out = dst[j / pixelsPerByte];
+        out = (unsigned char)(((j % pixelsPerByte == 0) ? 0 : out) | (level << shift));
+    }
+}
+
+//******************************************************************************************
+// @name                    : OrderedDitherRows
+//
+// @description             : Ordered dithering of rows to gray palette indices
+//
+// @param thresholds        : Threshold matrix, ORDERED_DITHER_SIZE rows of ORDERED_DITHER_SIZE
+// @param dst               : Palettized image of bitsPerPixel
+//
+// @returns                 : Nothing
+//********************************************************************************************
+template<typename Format>
+void OrderedDitherRows(const pixel_buffer_t &src, pixel_buffer_t &dst, const unsigned char *thresholds,
+                       int rowBegin, int rowEnd)
+{
+    for (int i = rowBegin; i < rowEnd; i++)
+    {
+        OrderedDitherPixels<Format>(&src.pixels[(size_t)src.paddedWidth * i], 0, src.width,
+                                    thresholds + (i % ORDERED_DITHER_SIZE) * ORDERED_DITHER_SIZE,
+                                    dst.bitsPerPixel, &dst.pixels[(size_t)dst.paddedWidth * i]);
+    }
+}
+
+//******************************************************************************************
+// @name                    : YCbCr420Pixels
+//
+// @description             : Converts pixels [first, width) of two rows to Y, and each 2x2
+//                            block of them to one Cb and Cr. first is even. A last odd column
+//                            counts twice in its block.
+//
+// @param bottom            : Row below top, or top itself if there is none
+// @param yBottom           : Y of the bottom row, nullptr if there is none
+//
+// @returns                 : Nothing
+//********************************************************************************************
+template<typename Format>
+void YCbCr420Pixels(const unsigned char *top, const unsigned char *bottom, int first, int width,
+                    unsigned char *yTop, unsigned char *yBottom, unsigned char *cb, unsigned char *cr, int chromaStep)
+{
+    for (int j = first; j < width; j += 2)
+    {
+        int columns[2] = { j, std::min(j + 1, width - 1) };
+        int red = 0;
+        int green = 0;
+        int blue = 0;
+
+        for (int k = 0; k < 2; k++)
+        {
+            const unsigned char *in[2] = { top + columns[k] * Format::BYTES_PER_PIXEL, bottom + columns[k] * Format::BYTES_PER_PIXEL };
+            for (int n = 0; n < 2; n++)
+            {
+                red += in[n][Format::RED_OFFSET];
+                green += in[n][Format::GREEN_OFFSET];
+                blue += in[n][Format::BLUE_OFFSET];
+            }
+
+            yTop[columns[k]] = LumaFromRGB(in[0][Format::RED_OFFSET], in[0][Format::GREEN_OFFSET], in[0][Format::BLUE_OFFSET]);
+            if (yBottom != nullptr)
+            {
+                yBottom[columns[k]] = LumaFromRGB(in[1][Format::RED_OFFSET], in[1][Format::GREEN_OFFSET], in[1][Format::BLUE_OFFSET]);
+            }
+        }
+
+        ChromaFromRGBSums(red, green, blue, 2, cb[(j / 2) * chromaStep], cr[(j / 2) * chromaStep]);
+    }
+}
+
+//******************************************************************************************
+// @name                    : YCbCr444Pixels
+//
+// @description             : Converts pixels [first, width) of a row to Y, Cb and Cr
+//
+// @returns                 : Nothing
+//********************************************************************************************
+template<typename Format>
+void YCbCr444Pixels(const unsigned char *src, int first, int width, unsigned char *y, unsigned char *cb, unsigned char *cr)
+{
+    for (int j = first; j < width; j++)
+    {
+        const unsigned char *in = src + j * Format::BYTES_PER_PIXEL;
+        y[j] = LumaFromRGB(in[Format::RED_OFFSET], in[Format::GREEN_OFFSET], in[Format::BLUE_OFFSET]);
+        ChromaFromRGBSums(in[Format::RED_OFFSET], in[Format::GREEN_OFFSET], in[Format::BLUE_OFFSET], 0, cb[j], cr[j]);
+    }
+}
+
+//******************************************************************************************
+// @name                    : YCbCr420Rows
+//
+// @description             : Converts the image to Y planes and 2x2 subsampled Cb and Cr
+//                            planes. Works on chroma rows [rowBegin, rowEnd), each made of
+//                            two image rows. A last odd row counts twice in its blocks.
+//
+// @returns                 : Nothing
+//********************************************************************************************
+template<typename Format>
+void YCbCr420Rows(const pixel_buffer_t &image, const ycbcr_planes_t &planes, int rowBegin, int rowEnd)
+{
+    for (int i = rowBegin; i < rowEnd; i++)
+    {
+        // Planes are top-down, image rows bottom-up
+        int row = image.height - 1 - 2 * i;
+        const unsigned char *top = &image.pixels[(size_t)image.paddedWidth * row];
+        unsigned char *yTop = planes.y + (size_t)planes.yStride * 2 * i;
+
+        YCbCr420Pixels<Format>(top, (row > 0) ? top - image.paddedWidth : top, 0, image.width,
+                               yTop, (row > 0) ? yTop + planes.yStride : nullptr,
+                               planes.cb + (size_t)planes.chromaStride * i, planes.cr + (size_t)planes.chromaStride * i,
+                               planes.chromaStep);
+    }
+}
+
+//******************************************************************************************
+// @name                    : YCbCr444Rows
+//
+// @description             : Converts rows [rowBegin, rowEnd) of the image, counted from the
+//                            top, to full resolution Y, Cb and Cr planes
+//
+// @returns                 : Nothing
+//********************************************************************************************
+template<typename Format>
+void YCbCr444Rows(const pixel_buffer_t &image, const ycbcr_planes_t &planes, int rowBegin, int rowEnd)
+{
+    for (int i = rowBegin; i < rowEnd; i++)
+    {
+        YCbCr444Pixels<Format>(&image.pixels[(size_t)image.paddedWidth * (image.height - 1 - i)], 0, image.width,
+                               planes.y + (size_t)planes.yStride * i, planes.cb + (size_t)planes.chromaStride * i,
+                               planes.cr + (size_t)planes.chromaStride * i);
+    }
+}
+
+// ==================================================================================================
+// 24 bit per channel kernels, bound at run time to the widest SIMD level of the CPU
+// ==================================================================================================
+template<>
+inline void HistogramRows<Bgr24Format>(const pixel_buffer_t &image, int rowBegin, int rowEnd, histogram_table_t &histogram)
+{
+    histogram_row_fn histogramRow = KernelRegistry::getKernels().histogramRow;
+    for (int i = rowBegin; i < rowEnd; i++)
+    {
+        histogramRow(&image.pixels[(size_t)image.paddedWidth * i], image.width, histogram);
+    }
+}
+
+template<>
+inline void StatisticsRows<Bgr24Format>(const pixel_buffer_t &image, int rowBegin, int rowEnd, statistics_sums_t &sums)
+{
+    statistics_row_fn statisticsRow = KernelRegistry::getKernels().statisticsRow;
+    for (int i = rowBegin; i < rowEnd; i++)
+    {
+        statisticsRow(&image.pixels[(size_t)image.paddedWidth * i], image.width, sums);
+    }
+}
+
+template<>
+inline void GrayscaleRows<Bgr24Format>(const pixel_buffer_t &src, pixel_buffer_t &dst, int rowBegin, int rowEnd)
+{
+    grayscale_row_fn grayscaleRow = KernelRegistry::getKernels().grayscaleRow;
+    for (int i = rowBegin; i < rowEnd; i++)
+    {
+        grayscaleRow(&src.pixels[(size_t)src.paddedWidth * i], &dst.pixels[(size_t)dst.paddedWidth * i], src.width);
+    }
+}
+
+template<>
+inline void ApplyLookupRows<Bgr24Format, PROCESS_PER_CHANNEL>(const pixel_buffer_t &src, pixel_buffer_t &dst,
+                                                             const unsigned char lut[4][MAX_COLORS],
+                                                             int rowBegin, int rowEnd)
+{
+    lookup_row_fn lookupRow = KernelRegistry::getKernels().lookupRow;
+    for (int i = rowBegin; i < rowEnd; i++)
+    {
+        lookupRow(&src.pixels[(size_t)src.paddedWidth * i], &dst.pixels[(size_t)dst.paddedWidth * i], src.width, lut);
+    }
+}
+
+template<>
+inline void BlurRows<Bgr24Format, PROCESS_PER_CHANNEL>(const pixel_buffer_t &src, pixel_buffer_t &dst,
+                                                      int rowBegin, int rowEnd)
+{
+    blur_row_fn blurRow = KernelRegistry::getKernels().blurRow;
+    for (int i = rowBegin; i < rowEnd; i++)
+    {
+        const unsigned char *row = &src.pixels[(size_t)src.paddedWidth * i];
+        const unsigned char *above = (i > 0) ? row - src.paddedWidth : nullptr;
+        const unsigned char *below = (i < src.height - 1) ? row + src.paddedWidth : nullptr;
+        blurRow(above, row, below, &dst.pixels[(size_t)dst.paddedWidth * i], src.width);
+    }
+}
+
+template<>
+inline void LumaRows<Bgr24Format>(const pixel_buffer_t &image, unsigned char *luma, int rowBegin, int rowEnd)
+{
+    luma_row_fn lumaRow = KernelRegistry::getKernels().lumaRow;
+    for (int i = rowBegin; i < rowEnd; i++)
+    {
+        lumaRow(&image.pixels[(size_t)image.paddedWidth * i], luma + (size_t)image.width * i, image.width);
+    }
+}
+
+template<>
+inline void YCbCr420Rows<Bgr24Format>(const pixel_buffer_t &image, const ycbcr_planes_t &planes, int rowBegin, int rowEnd)
+{
+    ycbcr420_row_fn ycbcr420Row = KernelRegistry::getKernels().ycbcr420Row;
+    for (int i = rowBegin; i < rowEnd; i++)
+    {
+        int row = image.height - 1 - 2 * i;
+        const unsigned char *top = &image.pixels[(size_t)image.paddedWidth * row];
+        unsigned char *yTop = planes.y + (size_t)planes.yStride * 2 * i;
+
+        ycbcr420Row(top, (row > 0) ? top - image.paddedWidth : top, image.width,
+                    yTop, (row > 0) ? yTop + planes.yStride : nullptr,
+                    planes.cb + (size_t)planes.chromaStride * i, planes.cr + (size_t)planes.chromaStride * i,
+                    planes.chromaStep);
+    }
+}
+
+template<>
+inline void YCbCr444Rows<Bgr24Format>(const pixel_buffer_t &image, const ycbcr_planes_t &planes, int rowBegin, int rowEnd)
+{
+    ycbcr444_row_fn ycbcr444Row = KernelRegistry::getKernels().ycbcr444Row;
+    for (int i = rowBegin; i < rowEnd; i++)
+    {
+        ycbcr444Row(&image.pixels[(size_t)image.paddedWidth * (image.height - 1 - i)], image.width,
+                    planes.y + (size_t)planes.yStride * i, planes.cb + (size_t)planes.chromaStride * i,
+                    planes.cr + (size_t)planes.chromaStride * i);
+    }
+}
+
+template<>
+inline void OrderedDitherRows<Bgr24Format>(const pixel_buffer_t &src, pixel_buffer_t &dst, const unsigned char *thresholds,
+                                           int rowBegin, int rowEnd)
+{
+    ordered_dither_row_fn orderedDitherRow = KernelRegistry::getKernels().orderedDitherRow;
+    for (int i = rowBegin; i < rowEnd; i++)
+    {
+        orderedDitherRow(&src.pixels[(size_t)src.paddedWidth * i], src.width,
+                         thresholds + (i % ORDERED_DITHER_SIZE) * ORDERED_DITHER_SIZE,
+                         dst.bitsPerPixel, &dst.pixels[(size_t)dst.paddedWidth * i]);
+    }
+}
+
+#endif
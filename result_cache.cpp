@@ -0,0 +1,699 @@
+#include"result_cache.h"
+#include"bmp.h"
+#include<algorithm>
+#include<errno.h>
+#include<stdio.h>
+#include<string.h>
+
+#if defined(_WIN32)
+#include<direct.h>
+#include<windows.h>
+#else
+#include<fcntl.h>
+#include<unistd.h>
+#include<sys/ioctl.h>
+#include<sys/stat.h>
+#if defined(__linux__)
+#include<linux/fs.h>
+#endif
+#endif
+
+const size_t CACHE_COPY_CHUNK_SIZE = 1 << 20;
+
+// ==================================================================================================
+// Helpers
+// ==================================================================================================
+//******************************************************************************************
+// @name                    : Hash64
+//
+// @description             : This is a static function. Fast 64 bit hash (the xxHash64
+//                            construction): four independent multiply-rotate lanes over
+//                            32 byte stripes, so it runs at memory speed on large inputs.
+//
+// @param seed              : Chains hashes. Different seeds give unrelated hashes.
+//
+// @returns                 : Hash
+//********************************************************************************************
+static unsigned long long Hash64(const unsigned char *data, size_t size, unsigned long long seed)
+{
+    const unsigned long long PRIME1 = 0x9E3779B185EBCA87ULL;
+    const unsigned long long PRIME2 = 0xC2B2AE3D27D4EB4FULL;
+    const unsigned long long PRIME3 = 0x165667B19E3779F9ULL;
+    const unsigned long long PRIME4 = 0x85EBCA77C2B2AE63ULL;
+    const unsigned long long PRIME5 = 0x27D4EB2F165667C5ULL;
+
+    auto rotate = [](unsigned long long x, int bits) { return (x << bits) | (x >> (64 - bits)); };
+    auto read64 = [](const unsigned char *p) { unsigned long long v; memcpy(&v, p, 8); return v; };
+    auto round = [&](unsigned long long acc, unsigned long long input)
+    {
+        return rotate(acc + input * PRIME2, 31) * PRIME1;
+    };
+
+    const unsigned char *p = data;
+    const unsigned char *end = data + size;
+    unsigned long long hash;
+
+    if (size >= 32)
+    {
+        unsigned long long lane[4] = { seed + PRIME1 + PRIME2, seed + PRIME2, seed, seed - PRIME1 };
+        for (; p + 32 <= end; p += 32)
+        {
+            for (int k = 0; k < 4; k++)
+            {
+                lane[k] = round(lane[k], read64(p + k * 8));
+            }
+        }
+
+        hash = rotate(lane[0], 1) + rotate(lane[1], 7) + rotate(lane[2], 12) + rotate(lane[3], 18);
+        for (int k = 0; k < 4; k++)
+        {
+            hash = (hash ^ round(0, lane[k])) * PRIME1 + PRIME4;
+        }
+    }
+    else
+    {
+        hash = seed + PRIME5;
+    }
+
+    hash += size;
+    for (; p + 8 <= end; p += 8)
+    {
+        hash = rotate(hash ^ round(0, read64(p)), 27) * PRIME1 + PRIME4;
+    }
+
+    for (; p < end; p++)
+    {
+        hash = rotate(hash ^ (*p * PRIME5), 11) * PRIME1;
+    }
+
+    hash ^= hash >> 33;
+    hash *= PRIME2;
+    hash ^= hash >> 29;
+    hash *= PRIME3;
+    hash ^= hash >> 32;
+
+    return hash;
+}
+
+//******************************************************************************************
+// @name                    : ReadFileContents
+//
+// @description             : This is a static function. Reads a whole file.
+//
+// @returns                 : 0 if SUCCESS
+//********************************************************************************************
+static int ReadFileContents(const char *path, std::vector<unsigned char> &data)
+{
+    FILE *fp = fopen(path, "rb");
+    if (fp == nullptr)
+    {
+        return -1;
+    }
+
+    fseek(fp, 0, SEEK_END);
+    long size = ftell(fp);
+    fseek(fp, 0, SEEK_SET);
+
+    data.resize(size > 0 ? (size_t)size : 0);
+    size_t bytesRead = data.empty() ? 0 : fread(&data[0], 1, data.size(), fp);
+    fclose(fp);
+
+    return (size >= 0 && bytesRead == data.size()) ? 0 : -1;
+}
+
+//******************************************************************************************
+// @name                    : WriteFileContents
+//
+// @description             : This is a static function. Writes a whole file.
+//
+// @returns                 : 0 if SUCCESS
+//********************************************************************************************
+static int WriteFileContents(const char *path, const unsigned char *data, size_t size)
+{
+    FILE *fp = fopen(path, "wb");
+    if (fp == nullptr)
+    {
+        return -1;
+    }
+
+    size_t written = (size > 0) ? fwrite(data, 1, size, fp) : 0;
+    int closed = fclose(fp);
+
+    return (written == size && closed == 0) ? 0 : -1;
+}
+
+//******************************************************************************************
+// @name                    : ReflinkFile
+//
+// @description             : This is a static function. Clones a file on file systems with
+//                            copy on write extents (Btrfs, XFS). Costs no data copy, and the
+//                            clone can be modified without affecting the source.
+//
+// @returns                 : 0 if SUCCESS
+//********************************************************************************************
+static int ReflinkFile(const char *sourcePath, const char *destinationPath)
+{
+#if defined(__linux__) && defined(FICLONE)
+    int source = open(sourcePath, O_RDONLY);
+    if (source < 0)
+    {
+        return -1;
+    }
+
+    int destination = open(destinationPath, O_WRONLY | O_CREAT | O_TRUNC, 0644);
+    if (destination < 0)
+    {
+        close(source);
+        return -1;
+    }
+
+    int retval = ioctl(destination, FICLONE, source);
+    close(source);
+    close(destination);
+
+    if (retval != 0)
+    {
+        remove(destinationPath);
+        return -1;
+    }
+
+    return 0;
+#else
+    (void)sourcePath;
+    (void)destinationPath;
+    return -1;
+#endif
+}
+
+//******************************************************************************************
+// @name                    : HardlinkFile
+//
+// @description             : This is a static function. Adds a directory entry for the
+//                            cached file. Only works within one file system.
+//
+// @returns                 : 0 if SUCCESS
+//********************************************************************************************
+static int HardlinkFile(const char *sourcePath, const char *destinationPath)
+{
+#if defined(_WIN32)
+    return CreateHardLinkA(destinationPath, sourcePath, nullptr) ? 0 : -1;
+#else
+    return link(sourcePath, destinationPath);
+#endif
+}
+
+//******************************************************************************************
+// @name                    : CopyFileContents
+//
+// @description             : This is a static function. Plain copy, the last resort.
+//
+// @returns                 : 0 if SUCCESS
+//********************************************************************************************
+static int CopyFileContents(const char *sourcePath, const char *destinationPath)
+{
+    FILE *source = fopen(sourcePath, "rb");
+    if (source == nullptr)
+    {
+        return -1;
+    }
+
+    FILE *destination = fopen(destinationPath, "wb");
+    if (destination == nullptr)
+    {
+        fclose(source);
+        return -1;
+    }
+
+    std::vector<unsigned char> buffer(CACHE_COPY_CHUNK_SIZE);
+    int retval = 0;
+    size_t bytesRead = 0;
+    while ((bytesRead = fread(&buffer[0], 1, buffer.size(), source)) > 0)
+    {
+        if (fwrite(&buffer[0], 1, bytesRead, destination) != bytesRead)
+        {
+            retval = -1;
+            break;
+        }
+    }
+
+    if (ferror(source))
+    {
+        retval = -1;
+    }
+
+    fclose(source);
+    if (fclose(destination) != 0)
+    {
+        retval = -1;
+    }
+
+    if (retval != 0)
+    {
+        remove(destinationPath);
+    }
+
+    return retval;
+}
+
+// ==================================================================================================
+// ResultCache
+// ==================================================================================================
+//******************************************************************************************
+// @name                    : ResultCache
+//
+// @description             : Constructor. Creates the cache directory if needed and loads
+//                            the index of cached results.
+//
+// @param directory         : Cache directory. Only one process should use it at a time.
+// @param maxBytes          : Size cap of the cached results
+// @param linkMode          : How outputs are made from cached results
+//
+// @returns                 : Nothing
+//********************************************************************************************
+ResultCache::ResultCache(const char *directory, unsigned long long maxBytes, result_cache_link_t linkMode)
+{
+    m_directory = (directory != nullptr) ? directory : ".";
+    m_maxBytes = maxBytes;
+    m_linkMode = linkMode;
+    m_useCounter = 0;
+    memset(&m_stats, 0, sizeof(m_stats));
+    m_index = nullptr;
+    m_indexRecords = 0;
+
+#if defined(_WIN32)
+    _mkdir(m_directory.c_str());
+#else
+    mkdir(m_directory.c_str(), 0755);
+#endif
+
+    // The index is compacted once on opening, then only appended to
+    this->loadIndex();
+    this->saveIndex();
+    this->evict();
+}
+
+//******************************************************************************************
+// @name                    : ~ResultCache
+//
+// @description             : Destructor. Leaves a compacted index.
+//
+// @returns                 : Nothing
+//********************************************************************************************
+ResultCache::~ResultCache()
+{
+    std::unique_lock<std::mutex> lock(m_mutex);
+    this->saveIndex();
+    if (m_index != nullptr)
+    {
+        fclose(m_index);
+    }
+}
+
+//******************************************************************************************
+// @name                    : MakeKey
+//
+// @description             : This is a static function. Key of the result of applying
+//                            operations to an input file. The whole file is hashed, since
+//                            besides the pixels its header and palette decide the output.
+//
+// @param fileData          : Contents of the input file
+// @param fileSize          : Size of the input file
+// @param operations        : Operations and their parameters, e.g. "blur(mode=0)". Must
+//                            name everything that changes the output.
+//
+// @returns                 : Key, usable as a file name
+//********************************************************************************************
+std::string ResultCache::MakeKey(const unsigned char *fileData, size_t fileSize, const std::string &operations)
+{
+    std::string description = std::string(RESULT_CACHE_VERSION) + ":" + operations;
+    unsigned long long contentHash = Hash64(fileData, fileSize, 0);
+    unsigned long long operationHash = Hash64((const unsigned char *)description.c_str(), description.size(), contentHash);
+
+    char key[64];
+    snprintf(key, sizeof(key), "%016llx%016llx", contentHash, operationHash);
+    return key;
+}
+
+//******************************************************************************************
+// @name                    : getEntryPath
+//
+// @description             : Path of the cached result of a key
+//
+// @returns                 : Path
+//********************************************************************************************
+std::string ResultCache::getEntryPath(const std::string &key)
+{
+    return m_directory + "/" + key + ".bmp";
+}
+
+//******************************************************************************************
+// @name                    : lookup
+//
+// @description             : Makes outputPath a copy of the cached result of key, if there
+//                            is one: a reflink, a hard link (if allowed) or a copy, in that
+//                            order of preference.
+//
+// @returns                 : true on a hit
+//********************************************************************************************
+bool ResultCache::lookup(const std::string &key, const char *outputPath)
+{
+    {
+        std::unique_lock<std::mutex> lock(m_mutex);
+        if (m_entries.find(key) == m_entries.end())
+        {
+            m_stats.misses++;
+            return false;
+        }
+    }
+
+    // The file is linked or copied without holding the lock
+    std::string entryPath = this->getEntryPath(key);
+    remove(outputPath);
+
+    bool linked = (ReflinkFile(entryPath.c_str(), outputPath) == 0) ||
+                  (m_linkMode == CACHE_LINK_ALLOW_HARDLINK && HardlinkFile(entryPath.c_str(), outputPath) == 0) ||
+                  (CopyFileContents(entryPath.c_str(), outputPath) == 0);
+
+    std::unique_lock<std::mutex> lock(m_mutex);
+    std::map<std::string, result_cache_entry_t>::iterator entry = m_entries.find(key);
+    if (!linked)
+    {
+        // Deleted from under the cache. Forget it.
+        if (entry != m_entries.end())
+        {
+            m_stats.bytes -= entry->second.size;
+            m_entries.erase(entry);
+            this->appendIndexRecord(key, nullptr);
+        }
+        m_stats.misses++;
+        return false;
+    }
+
+    if (entry != m_entries.end())
+    {
+        entry->second.lastUse = ++m_useCounter;
+        this->appendIndexRecord(key, &entry->second);
+    }
+    m_stats.hits++;
+
+    return true;
+}
+
+//******************************************************************************************
+// @name                    : store
+//
+// @description             : Adds a result to the cache, then evicts the least recently
+//                            used results while the cache is over its size cap.
+//
+// @param key               : Key from MakeKey
+// @param resultData        : Contents of the output file
+//
+// @returns                 : 0 if SUCCESS
+//********************************************************************************************
+int ResultCache::store(const std::string &key, const unsigned char *resultData, size_t resultSize)
+{
+    if (resultSize > m_maxBytes)
+    {
+        return -1;
+    }
+
+    // Written under a temporary name and renamed, so that a result is never seen half written
+    std::string entryPath = this->getEntryPath(key);
+    char suffix[32];
+    {
+        std::unique_lock<std::mutex> lock(m_mutex);
+        snprintf(suffix, sizeof(suffix), ".tmp%llu", ++m_useCounter);
+    }
+
+    std::string temporaryPath = entryPath + suffix;
+    if (WriteFileContents(temporaryPath.c_str(), resultData, resultSize) != 0)
+    {
+        remove(temporaryPath.c_str());
+        printf("ERROR: Could not write cache entry [%s]!\n", temporaryPath.c_str());
+        return -1;
+    }
+
+    std::unique_lock<std::mutex> lock(m_mutex);
+    remove(entryPath.c_str());
+    if (rename(temporaryPath.c_str(), entryPath.c_str()) != 0)
+    {
+        remove(temporaryPath.c_str());
+        printf("ERROR: Could not write cache entry [%s]!\n", entryPath.c_str());
+        return -1;
+    }
+
+    result_cache_entry_t &entry = m_entries[key];
+    m_stats.bytes -= entry.size;
+    entry.size = resultSize;
+    entry.lastUse = ++m_useCounter;
+    m_stats.bytes += resultSize;
+    m_stats.stores++;
+    this->appendIndexRecord(key, &entry);
+
+    this->evict();
+
+    return 0;
+}
+
+//******************************************************************************************
+// @name                    : process
+//
+// @description             : Produces outputPath by applying operation to inputPath, or
+//                            from the cache if the same input went through the same
+//                            operations before. On a miss the result is cached.
+//
+// @param operations        : Description of what operation does, see MakeKey
+// @param operation         : Processes the image, e.g. calls DoImageBlur. Returns 0 if
+//                            SUCCESS.
+//
+// @returns                 : 0 if SUCCESS
+//********************************************************************************************
+int ResultCache::process(const char *inputPath, const char *outputPath, const std::string &operations,
+                         const std::function<int(BitmapImage &image)> &operation)
+{
+    std::vector<unsigned char> input;
+    if (ReadFileContents(inputPath, input) != 0)
+    {
+        printf("File [%s] not found!\n", inputPath);
+        return -1;
+    }
+
+    std::string key = MakeKey(input.empty() ? nullptr : &input[0], input.size(), operations);
+    if (this->lookup(key, outputPath))
+    {
+        return 0;
+    }
+
+    BitmapImage image(input.empty() ? nullptr : &input[0], input.size(), inputPath);
+    int retval = operation(image);
+    if (retval != 0)
+    {
+        return retval;
+    }
+
+    std::vector<unsigned char> output;
+    image.getModifiedImageFileData(output);
+    if (WriteFileContents(outputPath, &output[0], output.size()) != 0)
+    {
+        printf("Cannot create file [%s]\n", outputPath);
+        return -1;
+    }
+
+    this->store(key, &output[0], output.size());
+
+    return 0;
+}
+
+//******************************************************************************************
+// @name                    : getStats
+//
+// @description             : Hit, miss and size counters
+//
+// @returns                 : Counters
+//********************************************************************************************
+result_cache_stats_t ResultCache::getStats()
+{
+    std::unique_lock<std::mutex> lock(m_mutex);
+    result_cache_stats_t stats = m_stats;
+    stats.entries = m_entries.size();
+
+    return stats;
+}
+
+//******************************************************************************************
+// @name                    : evict
+//
+// @description             : Deletes the least recently used results until the cache is
+//                            within its size cap. Called with the lock held (or from the
+//                            constructor).
+//
+// @returns                 : Nothing
+//********************************************************************************************
+void ResultCache::evict()
+{
+    if (m_stats.bytes <= m_maxBytes)
+    {
+        return;
+    }
+
+    std::vector<std::pair<unsigned long long, std::string> > byAge;
+    for (std::map<std::string, result_cache_entry_t>::iterator it = m_entries.begin(); it != m_entries.end(); ++it)
+    {
+        byAge.push_back(std::make_pair(it->second.lastUse, it->first));
+    }
+    std::sort(byAge.begin(), byAge.end());
+
+    for (size_t i = 0; i < byAge.size() && m_stats.bytes > m_maxBytes; i++)
+    {
+        const std::string &key = byAge[i].second;
+        remove(this->getEntryPath(key).c_str());
+        m_stats.bytes -= m_entries[key].size;
+        m_entries.erase(key);
+        m_stats.evictions++;
+        this->appendIndexRecord(key, nullptr);
+    }
+}
+
+//******************************************************************************************
+// @name                    : loadIndex
+//
+// @description             : Reads the index: one record per line with a key, a size and a
+//                            last use, added as results are stored and used. A key preceded
+//                            by '-' records an eviction. Later records of a key replace
+//                            earlier ones. Results whose file has gone are dropped.
+//
+// @returns                 : Nothing
+//********************************************************************************************
+void ResultCache::loadIndex()
+{
+    std::string indexPath = m_directory + "/" + RESULT_CACHE_INDEX_FILE;
+    FILE *fp = fopen(indexPath.c_str(), "r");
+    if (fp == nullptr)
+    {
+        return;
+    }
+
+    // Records are applied in order; the entry files are checked once at the end
+    char key[64];
+    unsigned long long size = 0;
+    unsigned long long lastUse = 0;
+    while (fscanf(fp, "%63s %llu %llu", key, &size, &lastUse) == 3)
+    {
+        m_indexRecords++;
+        if (key[0] == '-')
+        {
+            m_entries.erase(key + 1);
+            continue;
+        }
+
+        result_cache_entry_t &entry = m_entries[key];
+        entry.size = size;
+        entry.lastUse = lastUse;
+        m_useCounter = std::max(m_useCounter, lastUse);
+    }
+
+    fclose(fp);
+
+    for (std::map<std::string, result_cache_entry_t>::iterator it = m_entries.begin(); it != m_entries.end();)
+    {
+        FILE *entryFile = fopen(this->getEntryPath(it->first).c_str(), "rb");
+        if (entryFile == nullptr)
+        {
+            it = m_entries.erase(it);
+            continue;
+        }
+        fclose(entryFile);
+
+        m_stats.bytes += it->second.size;
+        ++it;
+    }
+}
+
+//******************************************************************************************
+// @name                    : saveIndex
+//
+// @description             : Rewrites the index with one record per result, under a
+//                            temporary name first so that a crash leaves the previous
+//                            index, and reopens it for appending. Called with the lock
+//                            held (or from the constructor).
+//
+// @returns                 : Nothing
+//********************************************************************************************
+void ResultCache::saveIndex()
+{
+    std::string indexPath = m_directory + "/" + RESULT_CACHE_INDEX_FILE;
+    std::string temporaryPath = indexPath + ".tmp";
+
+    if (m_index != nullptr)
+    {
+        fclose(m_index);
+        m_index = nullptr;
+    }
+
+    FILE *fp = fopen(temporaryPath.c_str(), "w");
+    if (fp == nullptr)
+    {
+        printf("ERROR: Could not write cache index [%s]!\n", temporaryPath.c_str());
+    }
+    else
+    {
+        for (std::map<std::string, result_cache_entry_t>::iterator it = m_entries.begin(); it != m_entries.end(); ++it)
+        {
+            fprintf(fp, "%s %llu %llu\n", it->first.c_str(), it->second.size, it->second.lastUse);
+        }
+
+        if (fclose(fp) != 0)
+        {
+            remove(temporaryPath.c_str());
+        }
+        else
+        {
+            remove(indexPath.c_str());
+            rename(temporaryPath.c_str(), indexPath.c_str());
+            m_indexRecords = m_entries.size();
+        }
+    }
+
+    m_index = fopen(indexPath.c_str(), "a");
+    if (m_index == nullptr)
+    {
+        printf("ERROR: Could not open cache index [%s]!\n", indexPath.c_str());
+    }
+}
+
+//******************************************************************************************
+// @name                    : appendIndexRecord
+//
+// @description             : Appends the record of a stored or used result, or of an
+//                            eviction, to the index. Flushed right away, so a crash loses
+//                            at most the record being written. Once the records outgrow
+//                            the entries the index is compacted. Called with the lock held.
+//
+// @param entry             : Result, nullptr for an eviction
+//
+// @returns                 : Nothing
+//********************************************************************************************
+void ResultCache::appendIndexRecord(const std::string &key, const result_cache_entry_t *entry)
+{
+    if (m_indexRecords > 2 * m_entries.size() + RESULT_CACHE_COMPACT_RECORDS)
+    {
+        this->saveIndex();
+        return;
+    }
+
+    if (m_index == nullptr)
+    {
+        return;
+    }
+
+    if (entry != nullptr)
+    {
+        fprintf(m_index, "%s %llu %llu\n", key.c_str(), entry->size, entry->lastUse);
+    }
+    else
+    {
+        fprintf(m_index, "-%s 0 0\n", key.c_str());
+    }
+    fflush(m_index);
+    m_indexRecords++;
+}
@@ -0,0 +1,84 @@
+#ifndef _RESULT_CACHE_H_
+#define _RESULT_CACHE_H_
+#include<functional>
+#include<map>
+#include<mutex>
+#include<stdio.h>
+#include<string>
+#include<vector>
+
+class BitmapImage;
+
+// ==================================================================================================
+// Constants
+// ==================================================================================================
+const unsigned long long RESULT_CACHE_DEFAULT_MAX_BYTES = 1ULL << 30;   // 1 GiB
+const char* const RESULT_CACHE_INDEX_FILE = "index";
+const unsigned long long RESULT_CACHE_COMPACT_RECORDS = 1024;  // Index records beyond twice the entries
+                                                               // that trigger a rewrite of the index
+const char* const RESULT_CACHE_VERSION = "1";   // Part of every key. Bump when an operation's output changes.
+
+// ==================================================================================================
+// Enums and structures
+// ==================================================================================================
+// How a cached result is turned into an output file
+typedef enum result_cache_link_tag
+{
+    CACHE_LINK_REFLINK_OR_COPY = 0,     // Copy on write clone where the file system has it, else a copy
+    CACHE_LINK_ALLOW_HARDLINK           // Also try a hard link. Outputs must then never be modified in place.
+}result_cache_link_t;
+
+typedef struct result_cache_stats_tag
+{
+    unsigned long long hits;
+    unsigned long long misses;
+    unsigned long long stores;
+    unsigned long long evictions;
+    unsigned long long entries;
+    unsigned long long bytes;           // Size of all cached results
+}result_cache_stats_t;
+
+// One cached result
+typedef struct result_cache_entry_tag
+{
+    unsigned long long size;
+    unsigned long long lastUse;         // Sequence number of the last lookup or store
+}result_cache_entry_t;
+
+// ==================================================================================================
+// ResultCache class definition
+// ==================================================================================================
+// On-disk cache of processed images, keyed by a hash of the input file and of the operations
+// applied to it. Bounded in size, least recently used results are evicted first.
+class ResultCache
+{
+private:
+    std::string m_directory;                              // Cache directory
+    unsigned long long m_maxBytes;                        // Size cap of the cached results
+    result_cache_link_t m_linkMode;
+    std::map<std::string, result_cache_entry_t> m_entries;    // Cached results by key
+    unsigned long long m_useCounter;                      // Source of lastUse values
+    result_cache_stats_t m_stats;
+    FILE *m_index;                                        // Index, open for appending records
+    unsigned long long m_indexRecords;                    // Records in the index
+    std::mutex m_mutex;                                   // Guards everything above
+
+    std::string getEntryPath(const std::string &key);
+    void loadIndex();
+    void saveIndex();
+    void appendIndexRecord(const std::string &key, const result_cache_entry_t *entry);
+    void evict();
+
+public:
+    ResultCache(const char *directory, unsigned long long maxBytes = RESULT_CACHE_DEFAULT_MAX_BYTES,
+                result_cache_link_t linkMode = CACHE_LINK_REFLINK_OR_COPY);
+    ~ResultCache();
+    static std::string MakeKey(const unsigned char *fileData, size_t fileSize, const std::string &operations);
+    bool lookup(const std::string &key, const char *outputPath);
+    int store(const std::string &key, const unsigned char *resultData, size_t resultSize);
+    int process(const char *inputPath, const char *outputPath, const std::string &operations,
+                const std::function<int(BitmapImage &image)> &operation);
+    result_cache_stats_t getStats();
+};
+
+#endif
@@ -0,0 +1,28 @@
+#ifndef _SIMD_H_
+#define _SIMD_H_
+
+// SSE2 is part of every x86-64 target, so the SIMD kernels are enabled whenever the
+// compiler is building for one. Other targets use the scalar code paths.
+#if defined(__SSE2__) || defined(_M_X64) || defined(_M_AMD64) || (defined(_M_IX86_FP) && (_M_IX86_FP >= 2))
+#define USE_SSE2_KERNELS
+#include<emmintrin.h>
+#endif
+
+// AVX2 and AVX-512 kernels are compiled into every x86-64 build and only selected at
+// run time on CPUs that have them (see kernel_registry.h). GCC and Clang need the
+// instruction set enabled per function; MSVC accepts the intrinsics anywhere.
+#if defined(USE_SSE2_KERNELS) && (defined(__GNUC__) || defined(__clang__))
+#define USE_AVX2_KERNELS
+#define USE_AVX512_KERNELS
+#define TARGET_AVX2 __attribute__((target("avx2")))
+#define TARGET_AVX512 __attribute__((target("avx2,avx512f,avx512bw")))
+#include<immintrin.h>
+#elif defined(USE_SSE2_KERNELS) && defined(_MSC_VER) && (defined(_M_X64) || defined(_M_AMD64))
+#define USE_AVX2_KERNELS
+#define USE_AVX512_KERNELS
+#define TARGET_AVX2
+#define TARGET_AVX512
+#include<immintrin.h>
+#endif
+
+#endif
@@ -0,0 +1,47 @@
+#!/bin/sh
+# Builds the library once and runs every tests/test_*.cpp against it, followed
+# by the kernel self test of bmpapp. Usage: tests/run_tests.sh [test name ...]
+# Set CXX or CXXFLAGS to test another compiler or optimization level.
+
+cd "$(dirname "$0")/.." || exit 2
+
+CXX=${CXX:-g++}
+CXXFLAGS=${CXXFLAGS:-"-std=c++17 -O2 -pthread"}
+BUILD_DIR=${BUILD_DIR:-_test_build}
+mkdir -p "$BUILD_DIR" || exit 2
+
+# Library objects older than their source or any header, compiled in parallel
+for source in *.cpp; do
+    object="$BUILD_DIR/$(basename "$source" .cpp).o"
+    [ -f "$object" ] && [ -z "$(find "$source" *.h -newer "$object")" ] && continue
+    echo "$source"
+done | xargs -P "$(nproc 2>/dev/null || echo 4)" -I{} sh -c \
+    "$CXX $CXXFLAGS -c {} -o \"$BUILD_DIR/\$(basename {} .cpp).o\"" || exit 2
+
+LIBRARY_OBJECTS=$(ls "$BUILD_DIR"/*.o | grep -v "/main.o$")
+$CXX $CXXFLAGS -o "$BUILD_DIR/bmpapp" "$BUILD_DIR/main.o" $LIBRARY_OBJECTS || exit 2
+
+if [ $# -gt 0 ]; then
+    TESTS="$*"
+else
+    TESTS=$(ls tests/test_*.cpp | sed 's#tests/##; s#\.cpp$##')
+fi
+
+failed=0
+for test in $TESTS; do
+    $CXX $CXXFLAGS -I. -o "$BUILD_DIR/$test" "tests/$test.cpp" $LIBRARY_OBJECTS || { failed=$((failed + 1)); continue; }
+    # Once on a single thread and once with more threads than bands in the small test images.
+    # The library prints its progress, so only the results are shown and the rest is kept in a log.
+    for threads in 1 4; do
+        log="$BUILD_DIR/$test.$threads.log"
+        (cd "$BUILD_DIR" && BMP_THREADS=$threads BMPAPP="$PWD/bmpapp" "./$test" > "$(basename "$log")" 2>&1)
+        status=$?
+        grep -E "^(FAILED|tests/)" "$log" | sed "s/\$/ ($threads threads)/"
+        [ $status -eq 0 ] || { echo "$test: exit status $status, see $log"; failed=$((failed + 1)); }
+    done
+done
+
+"$BUILD_DIR/bmpapp" selftest || failed=$((failed + 1))
+
+echo "$failed failed"
+[ $failed -eq 0 ]
@@ -0,0 +1,155 @@
+// Smoke test of AsyncFileIO: both backends, failing files, and the fallback when the
+// kernel stops taking io_uring operations.
+#include"test_util.h"
+#include"../async_io.h"
+#include<stdlib.h>
+#include<string>
+
+#if defined(__linux__)
+#include<errno.h>
+#include<stddef.h>
+#include<unistd.h>
+#include<linux/filter.h>
+#include<linux/seccomp.h>
+#include<sys/prctl.h>
+#include<sys/syscall.h>
+#endif
+
+//******************************************************************************************
+// @name                    : CheckRoundTrip
+//
+// @description             : Writes files of awkward sizes, more than the queue depth, and
+//                            reads them back together with a missing file.
+//
+// @returns                 : Nothing
+//********************************************************************************************
+static void CheckRoundTrip(AsyncFileIO &io, const std::string &directory, const char *name)
+{
+    const size_t sizes[] = { 0, 1, 4095, 4096, 4097, 100000, 1 << 20, 3, 77, 65536, 12345, 2, 999 };
+    const int fileCount = (int)(sizeof(sizes) / sizeof(sizes[0]));
+    unsigned int seed = 7;
+
+    vector<vector<unsigned char> > contents(fileCount);
+    vector<async_write_request_t> requests(fileCount);
+    for (int i = 0; i < fileCount; i++)
+    {
+        contents[i].resize(sizes[i]);
+        for (size_t k = 0; k < sizes[i]; k++)
+        {
+            contents[i][k] = (unsigned char)TestRandom(seed);
+        }
+        requests[i].path = directory + "/" + name + std::to_string(i);
+        requests[i].data = contents[i].empty() ? nullptr : &contents[i][0];
+        requests[i].size = sizes[i];
+    }
+
+    vector<int> written(fileCount, 0);
+    CHECK(io.writeFiles(requests, [&](int index, int status) { written[index] += (status == 0) ? 1 : 100; }) == 0);
+    for (int i = 0; i < fileCount; i++)
+    {
+        CHECK(written[i] == 1);
+    }
+
+    vector<std::string> paths;
+    for (int i = 0; i < fileCount; i++)
+    {
+        paths.push_back(requests[i].path);
+    }
+    paths.push_back(directory + "/missing");
+
+    vector<int> calls(paths.size(), 0);
+    vector<int> statuses(paths.size(), 0);
+    int failures = io.readFiles(paths, [&](int index, int status, vector<unsigned char> &data)
+    {
+        calls[index]++;
+        statuses[index] = status;
+        if (index < fileCount)
+        {
+            CHECK(data == contents[index]);
+        }
+    });
+
+    CHECK(failures == 1);
+    for (size_t i = 0; i < paths.size(); i++)
+    {
+        CHECK(calls[i] == 1);
+        CHECK((statuses[i] != 0) == (i == paths.size() - 1));
+    }
+
+    // A file in a missing directory cannot be written
+    vector<async_write_request_t> bad(1);
+    bad[0].path = directory + "/missing/file";
+    bad[0].data = &contents[1][0];
+    bad[0].size = 1;
+    int badStatus = 0;
+    CHECK(io.writeFiles(bad, [&](int, int status) { badStatus = status; }) == 1);
+    CHECK(badStatus != 0);
+}
+
+#if defined(__linux__) && defined(USE_IO_URING)
+//******************************************************************************************
+// @name                    : BlockRingEnter
+//
+// @description             : Makes io_uring_enter fail with EPERM in this thread from now
+//                            on, as a seccomp policy applied to a running process would.
+//
+// @returns                 : true if the filter is installed
+//********************************************************************************************
+static bool BlockRingEnter()
+{
+    struct sock_filter filter[] =
+    {
+        BPF_STMT(BPF_LD | BPF_W | BPF_ABS, offsetof(struct seccomp_data, nr)),
+        BPF_JUMP(BPF_JMP | BPF_JEQ | BPF_K, __NR_io_uring_enter, 0, 1),
+        BPF_STMT(BPF_RET | BPF_K, SECCOMP_RET_ERRNO | EPERM),
+        BPF_STMT(BPF_RET | BPF_K, SECCOMP_RET_ALLOW),
+    };
+    struct sock_fprog program = { (unsigned short)(sizeof(filter) / sizeof(filter[0])), filter };
+
+    return prctl(PR_SET_NO_NEW_PRIVS, 1, 0, 0, 0) == 0 &&
+           prctl(PR_SET_SECCOMP, SECCOMP_MODE_FILTER, &program) == 0;
+}
+#endif
+
+int main()
+{
+    char directoryTemplate[] = "/tmp/async_io_test.XXXXXX";
+    const char *directory = mkdtemp(directoryTemplate);
+    CHECK(directory != nullptr);
+    if (directory == nullptr)
+    {
+        return TEST_RESULT();
+    }
+
+    {
+        AsyncFileIO io(ASYNC_IO_THREAD_POOL, 4);
+        CHECK(io.getBackend() == ASYNC_IO_THREAD_POOL);
+        CheckRoundTrip(io, directory, "pool");
+    }
+
+    {
+        AsyncFileIO io(ASYNC_IO_AUTO, 4);
+        printf("backend: %s\n", io.getBackend() == ASYNC_IO_URING ? "io_uring" : "thread pool");
+        CheckRoundTrip(io, directory, "auto");
+    }
+
+#if defined(__linux__) && defined(USE_IO_URING)
+    {
+        AsyncFileIO io(ASYNC_IO_URING, 4);
+        if (io.getBackend() == ASYNC_IO_URING && BlockRingEnter())
+        {
+            CheckRoundTrip(io, directory, "fallback");
+            CHECK(io.getBackend() == ASYNC_IO_THREAD_POOL);
+        }
+        else
+        {
+            printf("io_uring fallback not tested\n");
+        }
+    }
+#endif
+
+    std::string command = std::string("rm -rf ") + directory;
+    CHECK(system(command.c_str()) == 0);
+
+    return TEST_RESULT();
+}
@@ -0,0 +1,239 @@
+// Compares compareWith() with PSNR and SSIM computed window by window, and checks that
+// "bmpapp compare" fails cleanly on files it cannot read.
+#include"test_util.h"
+#include<math.h>
+#include<stdlib.h>
+#include<string>
+#include<sys/wait.h>
+
+//******************************************************************************************
+// @name                    : ReferenceSsim
+//
+// @description             : SSIM of one channel: mean over 8x8 windows placed every 4
+//                            pixels from the first stored (bottom) row, with sample
+//                            variances and the usual constants.
+//
+// @returns                 : SSIM, -1 if there are no windows
+//********************************************************************************************
+static double ReferenceSsim(const test_image_t &a, const test_image_t &b, int channel)
+{
+    const double c1 = (0.01 * 255) * (0.01 * 255);
+    const double c2 = (0.03 * 255) * (0.03 * 255);
+    int bytesPerPixel = TestBytesPerPixel(a.bitsPerPixel);
+    int windowColumns = a.width / 4 - 1;
+    int windowRows = a.height / 4 - 1;
+    if (windowColumns <= 0 || windowRows <= 0)
+    {
+        return -1.0;
+    }
+
+    double total = 0.0;
+    for (int wy = 0; wy < windowRows; wy++)
+    {
+        for (int wx = 0; wx < windowColumns; wx++)
+        {
+            double sumA = 0, sumB = 0;
+            for (int i = 0; i < 8; i++)
+            {
+                for (int j = 0; j < 8; j++)
+                {
+                    int y = a.height - 1 - (wy * 4 + i);
+                    sumA += TestPixel(a, wx * 4 + j, y)[channel];
+                    sumB += TestPixel(b, wx * 4 + j, y)[channel];
+                }
+            }
+
+            double meanA = sumA / 64, meanB = sumB / 64;
+            double varianceA = 0, varianceB = 0, covariance = 0;
+            for (int i = 0; i < 8; i++)
+            {
+                for (int j = 0; j < 8; j++)
+                {
+                    int y = a.height - 1 - (wy * 4 + i);
+                    double da = TestPixel(a, wx * 4 + j, y)[channel] - meanA;
+                    double db = TestPixel(b, wx * 4 + j, y)[channel] - meanB;
+                    varianceA += da * da;
+                    varianceB += db * db;
+                    covariance += da * db;
+                }
+            }
+            varianceA /= 63;
+            varianceB /= 63;
+            covariance /= 63;
+
+            total += (2 * meanA * meanB + c1) * (2 * covariance + c2) /
+                     ((meanA * meanA + meanB * meanB + c1) * (varianceA + varianceB + c2));
+        }
+    }
+
+    return total / ((double)windowRows * windowColumns);
+}
+
+//******************************************************************************************
+// @name                    : CheckCompare
+//
+// @description             : Compares a random image with a noisy copy of itself.
+//
+// @param noise             : Largest change of a byte, 0 for identical images
+//
+// @returns                 : Nothing
+//********************************************************************************************
+static void CheckCompare(int width, int height, short bitsPerPixel, int noise)
+{
+    test_image_t a = MakeTestImage(width, height, bitsPerPixel, width * 17 + height + noise);
+    test_image_t b = a;
+    unsigned int seed = 99;
+    for (size_t i = 0; i < b.pixels.size(); i++)
+    {
+        if (noise > 0)
+        {
+            int value = b.pixels[i] + TestRandom(seed) % (2 * noise + 1) - noise;
+            b.pixels[i] = (unsigned char)std::min(std::max(value, 0), 255);
+        }
+    }
+
+    vector<unsigned char> fileA = EncodeTestImage(a);
+    vector<unsigned char> fileB = EncodeTestImage(b);
+    BitmapImage bitmapA(&fileA[0], fileA.size(), "a.bmp");
+    BitmapImage bitmapB(&fileB[0], fileB.size(), "b.bmp");
+
+    image_comparison_t comparison;
+    CHECK(bitmapA.compareWith(bitmapB, comparison) == 0);
+
+    unsigned long long squaredError = 0;
+    int maxAbsDifference = 0;
+    for (size_t i = 0; i < a.pixels.size(); i++)
+    {
+        int difference = abs((int)a.pixels[i] - (int)b.pixels[i]);
+        squaredError += difference * difference;
+        maxAbsDifference = std::max(maxAbsDifference, difference);
+    }
+
+    double meanSquaredError = (double)squaredError / a.pixels.size();
+    CHECK(comparison.identical == (squaredError == 0));
+    CHECK(comparison.maxAbsDifference == maxAbsDifference);
+    CHECK(fabs(comparison.meanSquaredError - meanSquaredError) < 1e-9);
+    if (squaredError == 0)
+    {
+        CHECK(isinf(comparison.psnr));
+    }
+    else
+    {
+        CHECK(fabs(comparison.psnr - 10.0 * log10(255.0 * 255.0 / meanSquaredError)) < 1e-9);
+    }
+
+    // Bytes of a pixel are blue, green, red
+    const color_t colors[3] = { BLUE, GREEN, RED };
+    int channels = std::min(TestBytesPerPixel(bitsPerPixel), 3);
+    double mean = 0.0;
+    for (int c = 0; c < 3; c++)
+    {
+        double ssim = ReferenceSsim(a, b, std::min(c, channels - 1));
+        if (ssim < 0)
+        {
+            ssim = (squaredError == 0) ? 1.0 : 0.0;
+        }
+
+        if (fabs(comparison.channelSsim[colors[c]] - ssim) > 1e-9)
+        {
+            printf("ssim of channel %d of %dx%d, %d bpp, noise %d: %.12f, expected %.12f\n",
+                   c, width, height, bitsPerPixel, noise, comparison.channelSsim[colors[c]], ssim);
+        }
+        CHECK(fabs(comparison.channelSsim[colors[c]] - ssim) < 1e-9);
+        mean += ssim / 3;
+    }
+    CHECK(fabs(comparison.ssim - mean) < 1e-9);
+}
+
+//******************************************************************************************
+// @name                    : RunCompare
+//
+// @description             : Runs "bmpapp compare" on two files.
+//
+// @returns                 : Exit status, -1 if it did not exit normally
+//********************************************************************************************
+static int RunCompare(const char *bmpapp, const std::string &first, const std::string &second)
+{
+    std::string command = std::string(bmpapp) + " compare " + first + " " + second + " > /dev/null 2>&1";
+    int status = system(command.c_str());
+    return WIFEXITED(status) ? WEXITSTATUS(status) : -1;
+}
+
+//******************************************************************************************
+// @name                    : WriteTestFile
+//
+// @description             : Replaces a file.
+//
+// @returns                 : Nothing
+//********************************************************************************************
+static void WriteTestFile(const std::string &path, const vector<unsigned char> &data)
+{
+    FILE *fp = fopen(path.c_str(), "wb");
+    CHECK(fp != nullptr);
+    if (fp != nullptr)
+    {
+        CHECK(fwrite(&data[0], 1, data.size(), fp) == data.size());
+        fclose(fp);
+    }
+}
+
+int main()
+{
+    const short formats[] = { 8, 24, 32 };
+    const int sizes[][2] = { { 7, 5 }, { 8, 8 }, { 9, 12 }, { 37, 29 }, { 64, 70 }, { 13, 200 } };
+
+    for (short bitsPerPixel : formats)
+    {
+        for (size_t s = 0; s < sizeof(sizes) / sizeof(sizes[0]); s++)
+        {
+            CheckCompare(sizes[s][0], sizes[s][1], bitsPerPixel, 0);
+            CheckCompare(sizes[s][0], sizes[s][1], bitsPerPixel, 3);
+            CheckCompare(sizes[s][0], sizes[s][1], bitsPerPixel, 60);
+        }
+    }
+
+    // Images of different sizes cannot be compared
+    {
+        vector<unsigned char> fileA = EncodeTestImage(MakeTestImage(8, 8, 24, 1));
+        vector<unsigned char> fileB = EncodeTestImage(MakeTestImage(8, 9, 24, 1));
+        BitmapImage a(&fileA[0], fileA.size(), "a.bmp");
+        BitmapImage b(&fileB[0], fileB.size(), "b.bmp");
+        image_comparison_t comparison;
+        CHECK(a.compareWith(b, comparison) != 0);
+    }
+
+    const char *bmpapp = getenv("BMPAPP");
+    if (bmpapp == nullptr)
+    {
+        printf("BMPAPP not set, command line not tested\n");
+        return TEST_RESULT();
+    }
+
+    char directoryTemplate[] = "/tmp/compare_test.XXXXXX";
+    std::string directory = mkdtemp(directoryTemplate);
+    std::string good = directory + "/good.bmp";
+    std::string noisy = directory + "/noisy.bmp";
+    std::string bitfields = directory + "/bitfields.bmp";
+    std::string rle = directory + "/rle.bmp";
+    std::string text = directory + "/text.bmp";
+
+    test_image_t image = MakeTestImage(16, 16, 32, 5);
+    WriteTestFile(good, EncodeTestImage(image));
+    image.pixels[0] ^= 0xFF;
+    WriteTestFile(noisy, EncodeTestImage(image));
+    WriteTestFile(bitfields, EncodeTestImage(image, 3));
+    WriteTestFile(rle, EncodeTestImage(MakeTestImage(16, 16, 8, 5), COMPRESSION_RLE8));
+    WriteTestFile(text, vector<unsigned char>(100, 'x'));
+
+    CHECK(RunCompare(bmpapp, good, good) == 0);
+    CHECK(RunCompare(bmpapp, good, noisy) == 1);
+    CHECK(RunCompare(bmpapp, "/nonexistent.bmp", good) == 2);
+    CHECK(RunCompare(bmpapp, good, "/nonexistent.bmp") == 2);
+    CHECK(RunCompare(bmpapp, bitfields, good) == 2);
+    CHECK(RunCompare(bmpapp, good, rle) == 2);
+    CHECK(RunCompare(bmpapp, text, good) == 2);
+
+    CHECK(system(("rm -rf " + directory).c_str()) == 0);
+
+    return TEST_RESULT();
+}
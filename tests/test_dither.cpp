@@ -0,0 +1,215 @@
+// Compares DitherImage() with dithering the image pixel by pixel, one row after the other:
+// error diffusion with the errors kept for the whole image, ordered dithering with the Bayer
+// matrix built recursively.
+#include"test_util.h"
+#include"../pixel_kernels.h"
+#include<algorithm>
+
+//******************************************************************************************
+// @name                    : ReferenceGray
+//
+// @description             : Gray level of a pixel, 77/150/29 of red, green and blue.
+//
+// @returns                 : 0 to 255
+//********************************************************************************************
+static int ReferenceGray(const test_image_t &image, int x, int y)
+{
+    const unsigned char *p = TestPixel(image, x, y);
+    if (image.bitsPerPixel == 8)
+    {
+        return p[0];
+    }
+    return (77 * p[2] + 150 * p[1] + 29 * p[0] + 128) >> 8;
+}
+
+//******************************************************************************************
+// @name                    : ReferenceBayer
+//
+// @description             : Rank of a cell of the size x size Bayer matrix, from the 2x2
+//                            matrix 0 2 / 3 1: every quarter of the matrix of twice the size
+//                            is four times the matrix of half the size plus its 2x2 rank.
+//
+// @returns                 : 0 to size * size - 1
+//********************************************************************************************
+static int ReferenceBayer(int size, int x, int y)
+{
+    const int base[2][2] = { { 0, 2 }, { 3, 1 } };
+    if (size == 2)
+    {
+        return base[y][x];
+    }
+    int half = size / 2;
+    return 4 * ReferenceBayer(half, x % half, y % half) + base[y / half][x / half];
+}
+
+//******************************************************************************************
+// @name                    : ReferenceDither
+//
+// @description             : Palette indices of every pixel, top row first. The ordered
+//                            matrix starts at the bottom row, as the rows are stored. Error
+//                            diffusion truncates the diffused error like C division, and drops
+//                            errors passed outside the image.
+//
+// @returns                 : The indices
+//********************************************************************************************
+static vector<unsigned char> ReferenceDither(const test_image_t &image, dither_method_t method, int bitsPerPixel)
+{
+    int width = image.width;
+    int height = image.height;
+    int maxIndex = (1 << bitsPerPixel) - 1;
+    vector<unsigned char> indices((size_t)width * height);
+
+    if (method == DITHER_ORDERED)
+    {
+        const int cells = ORDERED_DITHER_SIZE * ORDERED_DITHER_SIZE;
+        for (int y = 0; y < height; y++)
+        {
+            for (int x = 0; x < width; x++)
+            {
+                int rank = ReferenceBayer(ORDERED_DITHER_SIZE, x % ORDERED_DITHER_SIZE, (height - 1 - y) % ORDERED_DITHER_SIZE);
+                int threshold = ((2 * rank + 1) * 255) / (2 * cells);
+                indices[(size_t)y * width + x] = (unsigned char)((ReferenceGray(image, x, y) * maxIndex + threshold) / 255);
+            }
+        }
+        return indices;
+    }
+
+    // Two rows and two columns either side of margin for the errors which fall outside
+    bool atkinson = (method == DITHER_ATKINSON);
+    int divisor = atkinson ? 8 : 16;
+    int stride = width + 4;
+    vector<int> errors((size_t)stride * (height + 2), 0);
+    for (int y = 0; y < height; y++)
+    {
+        for (int x = 0; x < width; x++)
+        {
+            int *error = &errors[(size_t)y * stride + x + 2];
+            int gray = std::min(std::max(ReferenceGray(image, x, y) + error[0] / divisor, 0), 255);
+            int level = (gray * maxIndex + 127) / 255;
+            int difference = gray - (level * 255) / maxIndex;
+            indices[(size_t)y * width + x] = (unsigned char)level;
+
+            if (atkinson)
+            {
+                error[1] += difference;
+                error[2] += difference;
+                error[stride - 1] += difference;
+                error[stride] += difference;
+                error[stride + 1] += difference;
+                error[2 * stride] += difference;
+            }
+            else
+            {
+                error[1] += difference * 7;
+                error[stride - 1] += difference * 3;
+                error[stride] += difference * 5;
+                error[stride + 1] += difference;
+            }
+        }
+    }
+
+    return indices;
+}
+
+//******************************************************************************************
+// @name                    : MakeGradient
+//
+// @description             : Gray ramps across the image with a little noise, where errors
+//                            add up over many pixels before a level changes.
+//
+// @returns                 : The image
+//********************************************************************************************
+static test_image_t MakeGradient(int width, int height, short bitsPerPixel, unsigned int seed)
+{
+    test_image_t image = MakeTestImage(width, height, bitsPerPixel, seed);
+    int bytesPerPixel = TestBytesPerPixel(bitsPerPixel);
+    for (int y = 0; y < height; y++)
+    {
+        for (int x = 0; x < width; x++)
+        {
+            unsigned char *p = TestPixel(image, x, y);
+            for (int c = 0; c < std::min(bytesPerPixel, 3); c++)
+            {
+                p[c] = (unsigned char)std::min(255, (x * 255) / std::max(width - 1, 1) + (int)(TestRandom(seed) % (3 + c)));
+            }
+        }
+    }
+    return image;
+}
+
+//******************************************************************************************
+// @name                    : CheckDither
+//
+// @description             : Dithers an image and compares the indices and the gray palette
+//                            with the reference.
+//
+// @returns                 : Nothing
+//********************************************************************************************
+static void CheckDither(const test_image_t &image, dither_method_t method, short bitsPerPixel)
+{
+    vector<unsigned char> file = EncodeTestImage(image);
+    BitmapImage bitmap(&file[0], file.size(), "dither.bmp");
+    CHECK(bitmap.DitherImage(method, bitsPerPixel) == 0);
+
+    test_image_t result;
+    CHECK(ModifiedTestImage(bitmap, result));
+    CHECK(result.bitsPerPixel == bitsPerPixel);
+
+    int maxIndex = (1 << bitsPerPixel) - 1;
+    int paletteMismatches = (result.palette.size() < (size_t)(maxIndex + 1) * 4);
+    for (int i = 0; i <= maxIndex && paletteMismatches == 0; i++)
+    {
+        int gray = (i * 255) / maxIndex;
+        paletteMismatches += (result.palette[i * 4] != gray || result.palette[i * 4 + 1] != gray ||
+                              result.palette[i * 4 + 2] != gray);
+    }
+
+    vector<unsigned char> expected = ReferenceDither(image, method, bitsPerPixel);
+    int pixelMismatches = (result.pixels.size() != expected.size());
+    for (size_t i = 0; i < result.pixels.size() && i < expected.size(); i++)
+    {
+        pixelMismatches += (result.pixels[i] != expected[i]);
+    }
+
+    if (paletteMismatches != 0 || pixelMismatches != 0)
+    {
+        printf("dither %d of %dx%d, %d bpp, to %d bpp: %d palette and %d pixel mismatches\n", method,
+               image.width, image.height, image.bitsPerPixel, bitsPerPixel, paletteMismatches, pixelMismatches);
+    }
+    CHECK(paletteMismatches == 0);
+    CHECK(pixelMismatches == 0);
+}
+
+int main()
+{
+    const short formats[] = { 8, 24, 32 };
+    const short outputs[] = { MONOCHROME, BITS_4_PALLETIZED, BITS_8_PALLETIZED };
+    const dither_method_t methods[] = { DITHER_FLOYD_STEINBERG, DITHER_ATKINSON, DITHER_ORDERED };
+    // Narrow and short images, rows longer than a wavefront publish step, and more rows than
+    // error slots
+    const int sizes[][2] = { { 1, 1 }, { 1, 40 }, { 37, 29 }, { 300, 7 }, { 130, 90 } };
+
+    for (short bitsPerPixel : formats)
+    {
+        for (size_t s = 0; s < sizeof(sizes) / sizeof(sizes[0]); s++)
+        {
+            test_image_t noise = MakeTestImage(sizes[s][0], sizes[s][1], bitsPerPixel, (unsigned int)s * 11 + bitsPerPixel);
+            test_image_t gradient = MakeGradient(sizes[s][0], sizes[s][1], bitsPerPixel, (unsigned int)s + 1);
+            for (dither_method_t method : methods)
+            {
+                for (short output : outputs)
+                {
+                    CheckDither(noise, method, output);
+                    CheckDither(gradient, method, output);
+                }
+            }
+        }
+    }
+
+    vector<unsigned char> file = EncodeTestImage(MakeTestImage(8, 8, 24, 1));
+    BitmapImage bitmap(&file[0], file.size(), "dither.bmp");
+    CHECK(bitmap.DitherImage(DITHER_FLOYD_STEINBERG, 2) != 0);
+    CHECK(bitmap.DitherImage(DITHER_ORDERED, 24) != 0);
+
+    return TEST_RESULT();
+}
@@ -0,0 +1,216 @@
+// Smoke test of ImageServer: good jobs, inputs the loader must reject without ending the
+// server, and repeated jobs served from the result cache.
+#include"test_util.h"
+#include"../image_server.h"
+#include<stdlib.h>
+#include<string>
+
+//******************************************************************************************
+// @name                    : ReadTestFile
+//
+// @description             : Contents of a file, empty if it cannot be read.
+//
+// @returns                 : Contents
+//********************************************************************************************
+static vector<unsigned char> ReadTestFile(const std::string &path)
+{
+    vector<unsigned char> data;
+    FILE *fp = fopen(path.c_str(), "rb");
+    if (fp != nullptr)
+    {
+        int c;
+        while ((c = fgetc(fp)) != EOF)
+        {
+            data.push_back((unsigned char)c);
+        }
+        fclose(fp);
+    }
+    return data;
+}
+
+//******************************************************************************************
+// @name                    : WriteTestFile
+//
+// @description             : Replaces a file.
+//
+// @returns                 : Nothing
+//********************************************************************************************
+static void WriteTestFile(const std::string &path, const vector<unsigned char> &data)
+{
+    FILE *fp = fopen(path.c_str(), "wb");
+    CHECK(fp != nullptr);
+    if (fp != nullptr)
+    {
+        CHECK(data.empty() || fwrite(&data[0], 1, data.size(), fp) == data.size());
+        fclose(fp);
+    }
+}
+
+//******************************************************************************************
+// @name                    : FindReply
+//
+// @description             : The reply line to the job of an id. Replies come in completion
+//                            order, so they are looked up rather than taken in turn.
+//
+// @returns                 : The line, empty if there is none
+//********************************************************************************************
+static std::string FindReply(const std::string &replies, int id)
+{
+    std::string prefix = "{\"id\":" + std::to_string(id) + ",";
+    size_t start = replies.find(prefix);
+    if (start == std::string::npos)
+    {
+        return "";
+    }
+    return replies.substr(start, replies.find('\n', start) - start);
+}
+
+//******************************************************************************************
+// @name                    : Serve
+//
+// @description             : Runs job lines through a server and collects its replies.
+//
+// @returns                 : The reply lines
+//********************************************************************************************
+static std::string Serve(ImageServer &server, const std::string &jobs)
+{
+    FILE *input = tmpfile();
+    FILE *output = tmpfile();
+    fputs(jobs.c_str(), input);
+    rewind(input);
+
+    CHECK(server.serveStream(input, output) == 0);
+
+    std::string replies;
+    rewind(output);
+    int c;
+    while ((c = fgetc(output)) != EOF)
+    {
+        replies += (char)c;
+    }
+    fclose(input);
+    fclose(output);
+    return replies;
+}
+
+//******************************************************************************************
+// @name                    : Job
+//
+// @description             : A job line.
+//
+// @returns                 : JSON text with its newline
+//********************************************************************************************
+static std::string Job(int id, const std::string &input, const std::string &output, const std::string &operation)
+{
+    return "{\"id\": " + std::to_string(id) + ", \"input\": \"" + input + "\", \"output\": \"" + output +
+           "\", \"operations\": [\"" + operation + "\"]}\n";
+}
+
+//******************************************************************************************
+// @name                    : LoaderRejects
+//
+// @description             : Tells whether the loader throws on a file, rather than
+//                            asserting or loading it.
+//
+// @returns                 : true if it throws
+//********************************************************************************************
+static bool LoaderRejects(const vector<unsigned char> &file)
+{
+    try
+    {
+        BitmapImage image(&file[0], file.size(), "bad.bmp");
+    }
+    catch (const char *)
+    {
+        return true;
+    }
+    return false;
+}
+
+int main()
+{
+    char directoryTemplate[] = "/tmp/image_server_test.XXXXXX";
+    const char *created = mkdtemp(directoryTemplate);
+    CHECK(created != nullptr);
+    if (created == nullptr)
+    {
+        return TEST_RESULT();
+    }
+    std::string directory = created;
+
+    test_image_t image = MakeTestImage(17, 9, 24, 11);
+    vector<unsigned char> good = EncodeTestImage(image);
+
+    // Uncompressed headers whose pixels are missing
+    vector<unsigned char> truncated(good.begin(), good.end() - 10);
+    vector<unsigned char> huge = EncodeTestImage(MakeTestImage(4, 4, 24, 1));
+    PutLittleEndian(huge, 18, 100000, 4);
+    PutLittleEndian(huge, 22, 100000, 4);
+
+    WriteTestFile(directory + "/good.bmp", good);
+    WriteTestFile(directory + "/bitfields.bmp", EncodeTestImage(MakeTestImage(8, 8, 32, 2), 3));
+    WriteTestFile(directory + "/rle.bmp", EncodeTestImage(MakeTestImage(8, 8, 8, 3), COMPRESSION_RLE8));
+    WriteTestFile(directory + "/huge.bmp", huge);
+    WriteTestFile(directory + "/truncated.bmp", truncated);
+    WriteTestFile(directory + "/text.bmp", vector<unsigned char>(100, 'x'));
+
+    CHECK(LoaderRejects(truncated));
+    CHECK(LoaderRejects(huge));
+    CHECK(LoaderRejects(EncodeTestImage(MakeTestImage(8, 8, 8, 3), COMPRESSION_RLE8)));
+    CHECK(!LoaderRejects(good));
+
+    {
+        ImageServer server(SCHEDULER_DEFAULT_MEMORY_BUDGET, 2, (directory + "/cache").c_str());
+        std::string replies = Serve(server,
+            Job(1, directory + "/good.bmp", directory + "/out1.bmp", "rotate90") +
+            Job(2, directory + "/bitfields.bmp", directory + "/out2.bmp", "rotate90") +
+            Job(3, directory + "/rle.bmp", directory + "/out3.bmp", "rotate90") +
+            Job(4, directory + "/huge.bmp", directory + "/out4.bmp", "rotate90") +
+            Job(5, directory + "/truncated.bmp", directory + "/out5.bmp", "rotate90") +
+            Job(6, directory + "/text.bmp", directory + "/out6.bmp", "rotate90") +
+            Job(7, directory + "/missing.bmp", directory + "/out7.bmp", "rotate90") +
+            Job(8, directory + "/good.bmp", directory + "/out8.bmp", "grayscale"));
+
+        CHECK(FindReply(replies, 1).find("\"status\":\"ok\"") != std::string::npos);
+        CHECK(FindReply(replies, 8).find("\"status\":\"ok\"") != std::string::npos);
+        for (int id = 2; id <= 7; id++)
+        {
+            CHECK(FindReply(replies, id).find("\"status\":\"error\"") != std::string::npos);
+        }
+        CHECK(server.getJobCount() == 8);
+
+        // The output is the rotated image
+        test_image_t rotated;
+        CHECK(DecodeTestImage(ReadTestFile(directory + "/out1.bmp"), rotated));
+        CHECK(rotated.width == image.height && rotated.height == image.width);
+
+        // Once more: served from the cache, with the same output
+        replies = Serve(server, Job(9, directory + "/good.bmp", directory + "/out9.bmp", "rotate90"));
+        CHECK(FindReply(replies, 9).find("\"cached\":true") != std::string::npos);
+        CHECK(ReadTestFile(directory + "/out9.bmp") == ReadTestFile(directory + "/out1.bmp"));
+    }
+
+    // Resize sizes out of range are refused per job, and the jobs after them still run
+    {
+        ImageServer server(SCHEDULER_DEFAULT_MEMORY_BUDGET, 2);
+        std::string replies = Serve(server,
+            Job(10, directory + "/good.bmp", directory + "/out10.bmp", "resize:100000000x1") +
+            Job(11, directory + "/good.bmp", directory + "/out11.bmp", "resize:1x-5") +
+            Job(12, directory + "/good.bmp", directory + "/out12.bmp", "resize:70000x70000000") +
+            Job(13, directory + "/good.bmp", directory + "/out13.bmp", "resize:34x18:bilinear"));
+
+        for (int id = 10; id <= 12; id++)
+        {
+            CHECK(FindReply(replies, id).find("\"status\":\"error\"") != std::string::npos);
+        }
+        CHECK(FindReply(replies, 13).find("\"status\":\"ok\"") != std::string::npos);
+
+        test_image_t resized;
+        CHECK(DecodeTestImage(ReadTestFile(directory + "/out13.bmp"), resized));
+        CHECK(resized.width == 34 && resized.height == 18);
+    }
+
+    CHECK(system(("rm -rf " + directory).c_str()) == 0);
+
+    return TEST_RESULT();
+}
@@ -0,0 +1,142 @@
+// Checks that an operation run again after writePixelRect() edits, which reprocesses only the
+// edited tiles when it can, gives exactly what the same operation gives on a fresh load of the
+// edited image.
+#include"test_util.h"
+#include<algorithm>
+
+// An operation which can be brought up to date incrementally
+typedef struct incremental_case_tag
+{
+    const char *name;
+    int (*run)(BitmapImage &bitmap);
+}incremental_case_t;
+
+const incremental_case_t CASES[] =
+{
+    { "grayscale", [](BitmapImage &bitmap) { return bitmap.ConvertToGrayScale(); } },
+    { "blur", [](BitmapImage &bitmap) { return bitmap.DoImageBlur(PROCESS_PER_CHANNEL); } },
+    { "luma blur", [](BitmapImage &bitmap) { return bitmap.DoImageBlur(PROCESS_LUMA); } },
+    { "equalization", [](BitmapImage &bitmap) { return bitmap.doHistogramEqualization(PROCESS_PER_CHANNEL); } },
+    { "luma equalization", [](BitmapImage &bitmap) { return bitmap.doHistogramEqualization(PROCESS_LUMA); } },
+};
+
+//******************************************************************************************
+// @name                    : EditPixels
+//
+// @description             : Writes a rectangle of pixels to a bitmap and to the image it
+//                            was loaded from.
+//
+// @param patch             : Rows of the rectangle, top first, unpadded
+//
+// @returns                 : Nothing
+//********************************************************************************************
+static void EditPixels(BitmapImage &bitmap, test_image_t &image, int x, int y, int width, int height,
+                       const vector<unsigned char> &patch)
+{
+    int rowBytes = width * TestBytesPerPixel(image.bitsPerPixel);
+    CHECK(bitmap.writePixelRect(x, y, width, height, &patch[0], rowBytes) == 0);
+    CHECK(bitmap.getDirtyTileCount() > 0);
+    for (int row = 0; row < height; row++)
+    {
+        memcpy(TestPixel(image, x, y + row), &patch[(size_t)rowBytes * row], rowBytes);
+    }
+}
+
+//******************************************************************************************
+// @name                    : MirroredPatch
+//
+// @description             : The pixels of a rectangle, upside down. The histograms, and so
+//                            the equalization tables, stay as they are.
+//
+// @returns                 : Rows of the rectangle, top first
+//********************************************************************************************
+static vector<unsigned char> MirroredPatch(const test_image_t &image, int x, int y, int width, int height)
+{
+    int rowBytes = width * TestBytesPerPixel(image.bitsPerPixel);
+    vector<unsigned char> patch((size_t)rowBytes * height);
+    for (int row = 0; row < height; row++)
+    {
+        memcpy(&patch[(size_t)rowBytes * row], TestPixel(image, x, y + height - 1 - row), rowBytes);
+    }
+    return patch;
+}
+
+//******************************************************************************************
+// @name                    : CheckAgainstFullRun
+//
+// @description             : Compares the modified image of a bitmap with a fresh load of
+//                            the image run through the operation.
+//
+// @returns                 : Nothing
+//********************************************************************************************
+static void CheckAgainstFullRun(BitmapImage &bitmap, const test_image_t &image, const incremental_case_t &operation,
+                                const char *step)
+{
+    vector<unsigned char> file = EncodeTestImage(image);
+    BitmapImage fresh(&file[0], file.size(), "fresh.bmp");
+    CHECK(operation.run(fresh) == 0);
+
+    vector<unsigned char> expected;
+    vector<unsigned char> actual;
+    CHECK(fresh.getModifiedImageFileData(expected) == 0);
+    CHECK(bitmap.getModifiedImageFileData(actual) == 0);
+    if (actual != expected)
+    {
+        printf("%s of %dx%d, %d bpp, %s: differs from a full run\n", operation.name, image.width, image.height,
+               image.bitsPerPixel, step);
+    }
+    CHECK(actual == expected);
+}
+
+int main()
+{
+    const short formats[] = { 8, 24, 32 };
+
+    for (short bitsPerPixel : formats)
+    {
+        int bytesPerPixel = TestBytesPerPixel(bitsPerPixel);
+        for (const incremental_case_t &operation : CASES)
+        {
+            // 3 x 3 tiles, the last ones partial
+            test_image_t image = MakeTestImage(150, 140, bitsPerPixel, 9 + bitsPerPixel);
+            vector<unsigned char> file = EncodeTestImage(image);
+            BitmapImage bitmap(&file[0], file.size(), "incremental.bmp");
+            CHECK(operation.run(bitmap) == 0);
+
+            // Across tile borders, with the same histograms: the tables stay, so only the
+            // edited tiles are reprocessed
+            EditPixels(bitmap, image, 55, 50, 20, 30, MirroredPatch(image, 55, 50, 20, 30));
+            CHECK(operation.run(bitmap) == 0);
+            CHECK(bitmap.getDirtyTileCount() == 0);
+            CheckAgainstFullRun(bitmap, image, operation, "mirrored rectangle");
+
+            // A corner and a single pixel of new values
+            vector<unsigned char> corner(7 * 5 * bytesPerPixel);
+            unsigned int seed = 5;
+            for (unsigned char &value : corner)
+            {
+                value = (unsigned char)TestRandom(seed);
+            }
+            EditPixels(bitmap, image, image.width - 7, image.height - 5, 7, 5, corner);
+            EditPixels(bitmap, image, 0, 0, 1, 1, vector<unsigned char>(bytesPerPixel, 255));
+            CHECK(operation.run(bitmap) == 0);
+            CheckAgainstFullRun(bitmap, image, operation, "corners");
+
+            // A large flat block, which changes the equalization tables
+            EditPixels(bitmap, image, 10, 20, 120, 90, vector<unsigned char>((size_t)120 * 90 * bytesPerPixel, 30));
+            CHECK(operation.run(bitmap) == 0);
+            CheckAgainstFullRun(bitmap, image, operation, "flat block");
+
+            // An edit followed by another operation, and this one again
+            const incremental_case_t &other = CASES[(&operation - CASES + 1) % (sizeof(CASES) / sizeof(CASES[0]))];
+            EditPixels(bitmap, image, 64, 64, 64, 64, MirroredPatch(image, 0, 0, 64, 64));
+            CHECK(other.run(bitmap) == 0);
+            CheckAgainstFullRun(bitmap, image, other, "other operation");
+            EditPixels(bitmap, image, 100, 3, 9, 9, MirroredPatch(image, 100, 3, 9, 9));
+            CHECK(operation.run(bitmap) == 0);
+            CheckAgainstFullRun(bitmap, image, operation, "after another operation");
+        }
+    }
+
+    return TEST_RESULT();
+}
@@ -0,0 +1,166 @@
+// Compares getRectSum() and getRectMean() with adding up the pixels of every rectangle.
+#include"test_util.h"
+#include"../pixel_kernels.h"
+#include<math.h>
+
+//******************************************************************************************
+// @name                    : ChannelValue
+//
+// @description             : Value of a channel of a pixel as the summed-area tables count
+//                            it. Gray images have the same value in every color channel.
+//
+// @returns                 : Value
+//********************************************************************************************
+static int ChannelValue(const test_image_t &image, int x, int y, color_t channel)
+{
+    const unsigned char *pixel = TestPixel(image, x, y);
+    if (image.bitsPerPixel == 8)
+    {
+        return (channel == BRIGHTNESS) ? LumaFromRGB(pixel[0], pixel[0], pixel[0]) : pixel[0];
+    }
+
+    switch (channel)
+    {
+    case RED:   return pixel[2];
+    case GREEN: return pixel[1];
+    case BLUE:  return pixel[0];
+    default:    return LumaFromRGB(pixel[2], pixel[1], pixel[0]);
+    }
+}
+
+//******************************************************************************************
+// @name                    : ReferenceRectSum
+//
+// @description             : Sum of a channel over a rectangle, y counted from the top.
+//
+// @returns                 : Sum
+//********************************************************************************************
+static unsigned long long ReferenceRectSum(const test_image_t &image, color_t channel, int x, int y, int width, int height)
+{
+    unsigned long long sum = 0;
+    for (int row = y; row < y + height; row++)
+    {
+        for (int column = x; column < x + width; column++)
+        {
+            sum += ChannelValue(image, column, row, channel);
+        }
+    }
+    return sum;
+}
+
+//******************************************************************************************
+// @name                    : CheckRect
+//
+// @description             : Compares the sum and the mean of one rectangle.
+//
+// @returns                 : false if they differ
+//********************************************************************************************
+static bool CheckRect(BitmapImage &bitmap, const test_image_t &image, color_t channel, int x, int y, int width, int height)
+{
+    unsigned long long sum = 0;
+    double mean = 0.0;
+    unsigned long long expected = ReferenceRectSum(image, channel, x, y, width, height);
+
+    bool good = bitmap.getRectSum(channel, x, y, width, height, sum) == 0 && sum == expected &&
+                bitmap.getRectMean(channel, x, y, width, height, mean) == 0 &&
+                fabs(mean - (double)expected / ((double)width * height)) < 1e-9;
+    if (!good)
+    {
+        printf("channel %d, rectangle %d,%d %dx%d of %dx%d, %d bpp: sum %llu, expected %llu\n",
+               channel, x, y, width, height, image.width, image.height, image.bitsPerPixel, sum, expected);
+    }
+    return good;
+}
+
+//******************************************************************************************
+// @name                    : CheckIntegral
+//
+// @description             : Every 1x1 and full-row rectangle, and random rectangles, of
+//                            every channel of a random image.
+//
+// @returns                 : Nothing
+//********************************************************************************************
+static void CheckIntegral(int width, int height, short bitsPerPixel)
+{
+    test_image_t image = MakeTestImage(width, height, bitsPerPixel, width * 13 + height);
+    vector<unsigned char> file = EncodeTestImage(image);
+    BitmapImage bitmap(&file[0], file.size(), "integral.bmp");
+    CHECK(bitmap.buildIntegralImages() == 0);
+
+    unsigned int seed = 3;
+    int failures = 0;
+    for (int c = RED; c <= BRIGHTNESS; c++)
+    {
+        color_t channel = (color_t)c;
+        failures += !CheckRect(bitmap, image, channel, 0, 0, width, height);
+        for (int y = 0; y < height; y++)
+        {
+            failures += !CheckRect(bitmap, image, channel, 0, y, width, 1);
+            for (int x = 0; x < width && width * height <= 4096; x++)
+            {
+                failures += !CheckRect(bitmap, image, channel, x, y, 1, 1);
+            }
+        }
+
+        for (int i = 0; i < 200; i++)
+        {
+            int x = TestRandom(seed) % width;
+            int y = TestRandom(seed) % height;
+            int rectWidth = 1 + TestRandom(seed) % (width - x);
+            int rectHeight = 1 + TestRandom(seed) % (height - y);
+            failures += !CheckRect(bitmap, image, channel, x, y, rectWidth, rectHeight);
+        }
+    }
+    CHECK(failures == 0);
+
+    // Rectangles reaching outside the image are refused
+    unsigned long long sum = 0;
+    CHECK(bitmap.getRectSum(RED, 0, 0, width + 1, 1, sum) != 0);
+    CHECK(bitmap.getRectSum(RED, 0, height - 1, 1, 2, sum) != 0);
+    CHECK(bitmap.getRectSum(RED, -1, 0, 1, 1, sum) != 0);
+    CHECK(bitmap.getRectSum(RED, 0, 0, 0, 1, sum) != 0);
+}
+
+int main()
+{
+    const short formats[] = { 8, 24, 32 };
+    const int sizes[][2] = { { 1, 1 }, { 7, 5 }, { 64, 64 }, { 37, 29 }, { 3, 200 }, { 1500, 11 } };
+
+    for (short bitsPerPixel : formats)
+    {
+        for (size_t s = 0; s < sizeof(sizes) / sizeof(sizes[0]); s++)
+        {
+            CheckIntegral(sizes[s][0], sizes[s][1], bitsPerPixel);
+        }
+    }
+
+    // Too many pixels for 32 bit sums: the tables switch to 64 bits
+    {
+        test_image_t image = MakeTestImage(4200, 4100, 8, 9);
+        vector<unsigned char> file = EncodeTestImage(image);
+        BitmapImage bitmap(&file[0], file.size(), "integral.bmp");
+        CHECK(CheckRect(bitmap, image, RED, 0, 0, image.width, image.height));
+        CHECK(CheckRect(bitmap, image, RED, 1, 2, image.width - 3, image.height - 5));
+        CHECK(CheckRect(bitmap, image, BRIGHTNESS, 100, 0, 3000, image.height));
+        CHECK(bitmap.getIntegralImage(RED) != nullptr && !bitmap.getIntegralImage(RED)->sums64.empty());
+    }
+
+    // Tables follow edits of the original image
+    {
+        test_image_t image = MakeTestImage(20, 20, 24, 4);
+        vector<unsigned char> file = EncodeTestImage(image);
+        BitmapImage bitmap(&file[0], file.size(), "integral.bmp");
+        CHECK(CheckRect(bitmap, image, GREEN, 0, 0, 20, 20));
+
+        vector<unsigned char> patch(5 * 4 * 3, 200);
+        CHECK(bitmap.writePixelRect(3, 6, 5, 4, &patch[0], 5 * 3) == 0);
+        for (int y = 6; y < 10; y++)
+        {
+            memset(TestPixel(image, 3, y), 200, 5 * 3);
+        }
+        CHECK(CheckRect(bitmap, image, GREEN, 0, 0, 20, 20));
+        CHECK(CheckRect(bitmap, image, BRIGHTNESS, 2, 5, 10, 10));
+    }
+
+    return TEST_RESULT();
+}
@@ -0,0 +1,145 @@
+// Smoke test of JobScheduler: every job runs once on a worker of its own, the memory of the
+// jobs running at once stays within the budget, and jobs larger than the budget run alone.
+#include"test_util.h"
+#include"../job_scheduler.h"
+#include<chrono>
+#include<thread>
+
+const int TEST_WORKERS = 4;
+
+// What the jobs saw while they ran
+typedef struct scheduler_observation_tag
+{
+    std::mutex mutex;
+    unsigned long long bytesRunning;    // Memory of the jobs running now
+    unsigned long long peakBytesRunning;
+    int jobsRunning;
+    int peakJobsRunning;
+    int oversizedWithOthers;            // Jobs larger than the budget which did not run alone
+    vector<int> workerBusy;             // Jobs running on each worker
+    int workerClashes;                  // Jobs started on a worker which was running another
+    vector<int> runs;                   // Times each job ran
+}scheduler_observation_t;
+
+//******************************************************************************************
+// @name                    : RunJobs
+//
+// @description             : Submits jobs of the given sizes and waits for them.
+//
+// @returns                 : Nothing
+//********************************************************************************************
+static void RunJobs(JobScheduler &scheduler, const vector<unsigned long long> &sizes, unsigned long long budget,
+                    scheduler_observation_t &seen)
+{
+    seen.bytesRunning = seen.peakBytesRunning = 0;
+    seen.jobsRunning = seen.peakJobsRunning = 0;
+    seen.oversizedWithOthers = seen.workerClashes = 0;
+    seen.workerBusy.assign(scheduler.getWorkerCount(), 0);
+    seen.runs.assign(sizes.size(), 0);
+
+    for (size_t i = 0; i < sizes.size(); i++)
+    {
+        unsigned long long bytes = sizes[i];
+        scheduler.submit([&seen, i, bytes, budget](int worker)
+        {
+            {
+                std::lock_guard<std::mutex> lock(seen.mutex);
+                seen.runs[i]++;
+                seen.workerClashes += (worker < 0 || worker >= (int)seen.workerBusy.size() || seen.workerBusy[worker]++ != 0);
+                seen.bytesRunning += bytes;
+                seen.jobsRunning++;
+                seen.peakBytesRunning = std::max(seen.peakBytesRunning, seen.bytesRunning);
+                seen.peakJobsRunning = std::max(seen.peakJobsRunning, seen.jobsRunning);
+            }
+
+            std::this_thread::sleep_for(std::chrono::microseconds(200 + (i % 7) * 100));
+
+            std::lock_guard<std::mutex> lock(seen.mutex);
+            seen.oversizedWithOthers += (bytes > budget && seen.jobsRunning != 1);
+            if (worker >= 0 && worker < (int)seen.workerBusy.size())
+            {
+                seen.workerBusy[worker]--;
+            }
+            seen.bytesRunning -= bytes;
+            seen.jobsRunning--;
+        }, bytes);
+    }
+
+    scheduler.waitIdle();
+}
+
+int main()
+{
+    const unsigned long long budget = 1000;
+    unsigned int seed = 5;
+
+    // Sizes from a tenth of the budget to all of it, and a few larger than the budget
+    vector<unsigned long long> sizes;
+    for (int i = 0; i < 300; i++)
+    {
+        sizes.push_back(100 + TestRandom(seed) % 900);
+        if (i % 50 == 25)
+        {
+            sizes.push_back(budget * 3);
+        }
+    }
+
+    {
+        JobScheduler scheduler(budget, TEST_WORKERS, 500);
+        CHECK(scheduler.getWorkerCount() == TEST_WORKERS);
+
+        scheduler_observation_t seen;
+        RunJobs(scheduler, sizes, budget, seen);
+
+        for (size_t i = 0; i < sizes.size(); i++)
+        {
+            CHECK(seen.runs[i] == 1);
+        }
+        CHECK(seen.workerClashes == 0);
+        CHECK(seen.oversizedWithOthers == 0);
+        CHECK(seen.peakBytesRunning <= budget * 3);
+        CHECK(seen.peakJobsRunning <= TEST_WORKERS);
+
+        unsigned long long largeJobs = 0;
+        for (size_t i = 0; i < sizes.size(); i++)
+        {
+            largeJobs += (sizes[i] >= 500);
+        }
+
+        scheduler_stats_t stats = scheduler.getStats();
+        CHECK(stats.submitted == sizes.size());
+        CHECK(stats.completed == sizes.size());
+        CHECK(stats.largeJobs == largeJobs);
+        CHECK(stats.bytesInUse == 0);
+        CHECK(stats.pendingJobs == 0);
+        CHECK(stats.peakBytesInUse <= budget * 3);
+    }
+
+    // Jobs that fit: the memory running at once never exceeds the budget
+    {
+        vector<unsigned long long> small;
+        for (int i = 0; i < 200; i++)
+        {
+            small.push_back(50 + TestRandom(seed) % 400);
+        }
+
+        JobScheduler scheduler(budget, TEST_WORKERS);
+        scheduler_observation_t seen;
+        RunJobs(scheduler, small, budget, seen);
+        CHECK(seen.peakBytesRunning <= budget);
+        CHECK(scheduler.getStats().peakBytesInUse <= budget);
+        CHECK(scheduler.getStats().completed == small.size());
+    }
+
+    // More jobs than may wait for memory: submit() holds back and nothing is lost
+    {
+        vector<unsigned long long> many(SCHEDULER_MAX_PENDING_JOBS * 2, budget);
+        JobScheduler scheduler(budget, 2);
+        scheduler_observation_t seen;
+        RunJobs(scheduler, many, budget, seen);
+        CHECK(seen.peakJobsRunning == 1);
+        CHECK(scheduler.getStats().completed == many.size());
+    }
+
+    return TEST_RESULT();
+}
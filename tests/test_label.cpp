@@ -0,0 +1,206 @@
+// Compares LabelConnectedComponents() with flood filling the threshold mask pixel by pixel.
+#include"test_util.h"
+#include"../pixel_kernels.h"
+#include<math.h>
+
+//******************************************************************************************
+// @name                    : ReferenceComponents
+//
+// @description             : Components of the mask of pixels at or below the threshold (or
+//                            above it), flood filled from their first pixel in raster order,
+//                            top row first. label holds the component of every pixel, 0 for
+//                            background and for components dropped for their area.
+//
+// @returns                 : Components in label order
+//********************************************************************************************
+static vector<connected_component_t> ReferenceComponents(const test_image_t &image, const labeling_options_t &options,
+                                                         vector<int> &label)
+{
+    int width = image.width;
+    int height = image.height;
+    vector<unsigned char> mask((size_t)width * height);
+    for (int y = 0; y < height; y++)
+    {
+        for (int x = 0; x < width; x++)
+        {
+            const unsigned char *p = TestPixel(image, x, y);
+            int luma = (image.bitsPerPixel == 8) ? LumaFromRGB(p[0], p[0], p[0]) : LumaFromRGB(p[2], p[1], p[0]);
+            mask[(size_t)y * width + x] = options.darkForeground ? (luma <= options.threshold) : (luma > options.threshold);
+        }
+    }
+
+    vector<connected_component_t> components;
+    vector<int> seen((size_t)width * height, 0);
+    label.assign((size_t)width * height, 0);
+    for (int start = 0; start < width * height; start++)
+    {
+        if (!mask[start] || seen[start])
+        {
+            continue;
+        }
+
+        vector<int> pixels(1, start);
+        seen[start] = 1;
+        for (size_t i = 0; i < pixels.size(); i++)
+        {
+            int x = pixels[i] % width;
+            int y = pixels[i] / width;
+            for (int dy = -1; dy <= 1; dy++)
+            {
+                for (int dx = -1; dx <= 1; dx++)
+                {
+                    int nx = x + dx;
+                    int ny = y + dy;
+                    bool neighbour = options.eightConnected ? (dx != 0 || dy != 0) : (abs(dx) + abs(dy) == 1);
+                    if (!neighbour || nx < 0 || nx >= width || ny < 0 || ny >= height)
+                    {
+                        continue;
+                    }
+                    int n = ny * width + nx;
+                    if (mask[n] && !seen[n])
+                    {
+                        seen[n] = 1;
+                        pixels.push_back(n);
+                    }
+                }
+            }
+        }
+
+        if (pixels.size() < options.minimumArea)
+        {
+            continue;
+        }
+
+        connected_component_t component;
+        component.label = (int)components.size() + 1;
+        int left = width, right = -1, top = height, bottom = -1;
+        double sumX = 0, sumY = 0;
+        for (size_t i = 0; i < pixels.size(); i++)
+        {
+            int x = pixels[i] % width;
+            int y = pixels[i] / width;
+            left = std::min(left, x);
+            right = std::max(right, x);
+            top = std::min(top, y);
+            bottom = std::max(bottom, y);
+            sumX += x;
+            sumY += y;
+            label[pixels[i]] = component.label;
+        }
+        component.left = left;
+        component.top = top;
+        component.width = right - left + 1;
+        component.height = bottom - top + 1;
+        component.area = pixels.size();
+        component.centroidX = sumX / pixels.size();
+        component.centroidY = sumY / pixels.size();
+        components.push_back(component);
+    }
+
+    return components;
+}
+
+//******************************************************************************************
+// @name                    : MakeSpeckles
+//
+// @description             : Random image where a pixel is dark with the given chance in
+//                            percent, so that components of every shape appear.
+//
+// @returns                 : The image
+//********************************************************************************************
+static test_image_t MakeSpeckles(int width, int height, short bitsPerPixel, int percent, unsigned int seed)
+{
+    test_image_t image = MakeTestImage(width, height, bitsPerPixel, seed);
+    int bytesPerPixel = TestBytesPerPixel(bitsPerPixel);
+    for (int i = 0; i < width * height; i++)
+    {
+        unsigned char value = (TestRandom(seed) % 100 < percent) ? (unsigned char)(TestRandom(seed) % 100)
+                                                                 : (unsigned char)(156 + TestRandom(seed) % 100);
+        memset(&image.pixels[(size_t)i * bytesPerPixel], value, std::min(bytesPerPixel, 3));
+    }
+    return image;
+}
+
+//******************************************************************************************
+// @name                    : CheckLabels
+//
+// @description             : Labels an image and compares components and drawn labels with
+//                            the flood fill.
+//
+// @returns                 : Nothing
+//********************************************************************************************
+static void CheckLabels(const test_image_t &image, const labeling_options_t &options)
+{
+    vector<unsigned char> file = EncodeTestImage(image);
+    BitmapImage bitmap(&file[0], file.size(), "label.bmp");
+    vector<connected_component_t> components;
+    CHECK(bitmap.LabelConnectedComponents(components, &options) == 0);
+
+    vector<int> label;
+    vector<connected_component_t> expected = ReferenceComponents(image, options, label);
+
+    int mismatches = (components.size() != expected.size());
+    for (size_t i = 0; i < components.size() && i < expected.size(); i++)
+    {
+        const connected_component_t &a = components[i];
+        const connected_component_t &b = expected[i];
+        mismatches += (a.label != b.label || a.left != b.left || a.top != b.top || a.width != b.width ||
+                       a.height != b.height || a.area != b.area || fabs(a.centroidX - b.centroidX) > 1e-9 ||
+                       fabs(a.centroidY - b.centroidY) > 1e-9);
+    }
+
+    if (options.drawLabels)
+    {
+        test_image_t drawn;
+        CHECK(ModifiedTestImage(bitmap, drawn));
+        for (size_t i = 0; i < label.size() && i < drawn.pixels.size(); i++)
+        {
+            int index = (label[i] == 0) ? 0 : 1 + (label[i] - 1) % (MAX_COLORS - 1);
+            mismatches += (drawn.pixels[i] != index);
+        }
+    }
+
+    if (mismatches != 0)
+    {
+        printf("labels of %dx%d, %d bpp, %s, %d connected, minimum area %llu: %zu components, expected %zu, %d mismatches\n",
+               image.width, image.height, image.bitsPerPixel, options.darkForeground ? "dark" : "light",
+               options.eightConnected ? 8 : 4, options.minimumArea, components.size(), expected.size(), mismatches);
+    }
+    CHECK(mismatches == 0);
+}
+
+int main()
+{
+    const short formats[] = { 8, 24, 32 };
+    const int densities[] = { 10, 45, 60, 90 };
+    const int sizes[][2] = { { 37, 29 }, { 1, 50 }, { 50, 1 }, { 200, 90 } };
+
+    for (short bitsPerPixel : formats)
+    {
+        for (int percent : densities)
+        {
+            for (size_t s = 0; s < sizeof(sizes) / sizeof(sizes[0]); s++)
+            {
+                test_image_t image = MakeSpeckles(sizes[s][0], sizes[s][1], bitsPerPixel, percent, percent + (unsigned int)s);
+                for (int connectivity = 0; connectivity < 2; connectivity++)
+                {
+                    labeling_options_t options = { 127, true, connectivity == 1, 0, true };
+                    CheckLabels(image, options);
+
+                    options.darkForeground = false;
+                    options.minimumArea = 3;
+                    CheckLabels(image, options);
+                }
+            }
+        }
+    }
+
+    // More components than label colors: the colors repeat
+    {
+        test_image_t image = MakeSpeckles(300, 120, 8, 20, 4);
+        labeling_options_t options = { 127, true, false, 0, true };
+        CheckLabels(image, options);
+    }
+
+    return TEST_RESULT();
+}
@@ -0,0 +1,132 @@
+// Compares DoMedianFilter() with sorting every window.
+#include"test_util.h"
+#include"../pixel_kernels.h"
+#include<algorithm>
+
+//******************************************************************************************
+// @name                    : WindowMedian
+//
+// @description             : Median of a plane over the window around (x, y), with the
+//                            edges of the plane replicated.
+//
+// @returns                 : Median
+//********************************************************************************************
+static unsigned char WindowMedian(const vector<unsigned char> &plane, int width, int height, int x, int y, int radius)
+{
+    vector<unsigned char> window;
+    for (int dy = -radius; dy <= radius; dy++)
+    {
+        for (int dx = -radius; dx <= radius; dx++)
+        {
+            int row = std::min(std::max(y + dy, 0), height - 1);
+            int column = std::min(std::max(x + dx, 0), width - 1);
+            window.push_back(plane[(size_t)row * width + column]);
+        }
+    }
+
+    std::nth_element(window.begin(), window.begin() + window.size() / 2, window.end());
+    return window[window.size() / 2];
+}
+
+//******************************************************************************************
+// @name                    : CheckMedian
+//
+// @description             : Filters a random image and compares every channel with the
+//                            brute force median.
+//
+// @returns                 : Nothing
+//********************************************************************************************
+static void CheckMedian(int width, int height, short bitsPerPixel, int radius, processing_mode_t mode)
+{
+    test_image_t image = MakeTestImage(width, height, bitsPerPixel, width * 31 + height + radius);
+    vector<unsigned char> file = EncodeTestImage(image);
+    BitmapImage bitmap(&file[0], file.size(), "median.bmp");
+    CHECK(bitmap.DoMedianFilter(radius, mode) == 0);
+
+    test_image_t result;
+    CHECK(ModifiedTestImage(bitmap, result));
+    if (result.pixels.size() != image.pixels.size())
+    {
+        CHECK(result.pixels.size() == image.pixels.size());
+        return;
+    }
+
+    int bytesPerPixel = TestBytesPerPixel(bitsPerPixel);
+    int mismatches = 0;
+    if (mode == PROCESS_LUMA && bytesPerPixel > 1)
+    {
+        vector<unsigned char> luma((size_t)width * height);
+        for (int y = 0; y < height; y++)
+        {
+            for (int x = 0; x < width; x++)
+            {
+                const unsigned char *in = TestPixel(image, x, y);
+                luma[(size_t)y * width + x] = RGBToYCbCr(in[2], in[1], in[0]).y;
+            }
+        }
+
+        for (int y = 0; y < height; y++)
+        {
+            for (int x = 0; x < width; x++)
+            {
+                const unsigned char *in = TestPixel(image, x, y);
+                pixel_value_ycbcr_t ycbcr = RGBToYCbCr(in[2], in[1], in[0]);
+                pixel_value_rgb_t rgb = YCbCrToRGB(WindowMedian(luma, width, height, x, y, radius), ycbcr.Cb, ycbcr.Cr);
+                const unsigned char *out = TestPixel(result, x, y);
+                mismatches += (out[0] != rgb.blue || out[1] != rgb.green || out[2] != rgb.red);
+            }
+        }
+    }
+    else
+    {
+        int channels = std::min(bytesPerPixel, 3);
+        for (int c = 0; c < channels; c++)
+        {
+            vector<unsigned char> plane((size_t)width * height);
+            for (size_t i = 0; i < plane.size(); i++)
+            {
+                plane[i] = image.pixels[i * bytesPerPixel + c];
+            }
+
+            for (int y = 0; y < height; y++)
+            {
+                for (int x = 0; x < width; x++)
+                {
+                    mismatches += (TestPixel(result, x, y)[c] != WindowMedian(plane, width, height, x, y, radius));
+                }
+            }
+        }
+    }
+
+    if (mismatches != 0)
+    {
+        printf("median %dx%d, %d bpp, radius %d, mode %d: %d mismatches\n", width, height, bitsPerPixel, radius, mode, mismatches);
+    }
+    CHECK(mismatches == 0);
+}
+
+int main()
+{
+    const short formats[] = { 8, 24, 32 };
+    const int radii[] = { 1, 2, 3, 7 };
+
+    for (short bitsPerPixel : formats)
+    {
+        for (int radius : radii)
+        {
+            CheckMedian(37, 29, bitsPerPixel, radius, PROCESS_PER_CHANNEL);
+            CheckMedian(5, 130, bitsPerPixel, radius, PROCESS_PER_CHANNEL);
+        }
+        CheckMedian(23, 19, bitsPerPixel, 2, PROCESS_LUMA);
+    }
+
+    // Windows wider than the image
+    CheckMedian(3, 4, 24, 7, PROCESS_PER_CHANNEL);
+
+    vector<unsigned char> file = EncodeTestImage(MakeTestImage(8, 8, 24, 1));
+    BitmapImage bitmap(&file[0], file.size(), "median.bmp");
+    CHECK(bitmap.DoMedianFilter(0) != 0);
+    CHECK(bitmap.DoMedianFilter(MAX_MEDIAN_RADIUS + 1) != 0);
+
+    return TEST_RESULT();
+}
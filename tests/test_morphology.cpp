@@ -0,0 +1,117 @@
+// Compares DoMorphology() with the minimum or maximum of every window, pixel by pixel.
+#include"test_util.h"
+#include<algorithm>
+
+//******************************************************************************************
+// @name                    : ReferenceErodeOrDilate
+//
+// @description             : Minimum (or maximum) of every channel over a width x height
+//                            window. Even sizes reach one pixel further left and up.
+//                            Pixels outside the image do not count; alpha is kept.
+//
+// @returns                 : The result
+//********************************************************************************************
+static test_image_t ReferenceErodeOrDilate(const test_image_t &image, bool isMax, int width, int height)
+{
+    test_image_t result = image;
+    int bytesPerPixel = TestBytesPerPixel(image.bitsPerPixel);
+    int channels = std::min(bytesPerPixel, 3);
+
+    for (int y = 0; y < image.height; y++)
+    {
+        for (int x = 0; x < image.width; x++)
+        {
+            for (int c = 0; c < channels; c++)
+            {
+                int value = isMax ? 0 : 255;
+                for (int row = y - height / 2; row <= y + (height - 1) / 2; row++)
+                {
+                    for (int column = x - width / 2; column <= x + (width - 1) / 2; column++)
+                    {
+                        if (row < 0 || row >= image.height || column < 0 || column >= image.width)
+                        {
+                            continue;
+                        }
+                        int pixel = TestPixel(image, column, row)[c];
+                        value = isMax ? std::max(value, pixel) : std::min(value, pixel);
+                    }
+                }
+                TestPixel(result, x, y)[c] = (unsigned char)value;
+            }
+        }
+    }
+
+    return result;
+}
+
+//******************************************************************************************
+// @name                    : CheckMorphology
+//
+// @description             : Runs one operation on a random image and compares it with the
+//                            brute force result.
+//
+// @returns                 : Nothing
+//********************************************************************************************
+static void CheckMorphology(int imageWidth, int imageHeight, short bitsPerPixel, morphology_operation_t operation,
+                            int width, int height)
+{
+    test_image_t image = MakeTestImage(imageWidth, imageHeight, bitsPerPixel, imageWidth * 7 + width * 3 + height);
+    vector<unsigned char> file = EncodeTestImage(image);
+    BitmapImage bitmap(&file[0], file.size(), "morphology.bmp");
+    CHECK(bitmap.DoMorphology(operation, width, height) == 0);
+
+    test_image_t expected;
+    switch (operation)
+    {
+    case MORPHOLOGY_ERODE:
+        expected = ReferenceErodeOrDilate(image, false, width, height);
+        break;
+    case MORPHOLOGY_DILATE:
+        expected = ReferenceErodeOrDilate(image, true, width, height);
+        break;
+    case MORPHOLOGY_OPEN:
+        expected = ReferenceErodeOrDilate(ReferenceErodeOrDilate(image, false, width, height), true, width, height);
+        break;
+    default:
+        expected = ReferenceErodeOrDilate(ReferenceErodeOrDilate(image, true, width, height), false, width, height);
+        break;
+    }
+
+    test_image_t result;
+    CHECK(ModifiedTestImage(bitmap, result));
+    if (result.pixels != expected.pixels)
+    {
+        printf("morphology %d on %dx%d, %d bpp, element %dx%d differs\n",
+               operation, imageWidth, imageHeight, bitsPerPixel, width, height);
+    }
+    CHECK(result.pixels == expected.pixels);
+}
+
+int main()
+{
+    const short formats[] = { 8, 24, 32 };
+    const morphology_operation_t operations[] = { MORPHOLOGY_ERODE, MORPHOLOGY_DILATE, MORPHOLOGY_OPEN, MORPHOLOGY_CLOSE };
+    const int elements[][2] = { { 1, 1 }, { 3, 3 }, { 2, 4 }, { 5, 1 }, { 1, 6 }, { 7, 3 }, { 16, 9 } };
+
+    for (short bitsPerPixel : formats)
+    {
+        for (morphology_operation_t operation : operations)
+        {
+            for (size_t e = 0; e < sizeof(elements) / sizeof(elements[0]); e++)
+            {
+                CheckMorphology(37, 29, bitsPerPixel, operation, elements[e][0], elements[e][1]);
+            }
+        }
+
+        // Tall images span several bands; elements larger than the image cover all of it
+        CheckMorphology(6, 150, bitsPerPixel, MORPHOLOGY_ERODE, 3, 11);
+        CheckMorphology(5, 4, bitsPerPixel, MORPHOLOGY_DILATE, 40, 40);
+    }
+
+    vector<unsigned char> file = EncodeTestImage(MakeTestImage(8, 8, 24, 1));
+    BitmapImage bitmap(&file[0], file.size(), "morphology.bmp");
+    CHECK(bitmap.DoMorphology(MORPHOLOGY_ERODE, 0, 3) != 0);
+    CHECK(bitmap.DoMorphology(MORPHOLOGY_ERODE, 3, -1) != 0);
+
+    return TEST_RESULT();
+}
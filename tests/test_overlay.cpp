@@ -0,0 +1,160 @@
+// Compares overlayImage() with blending every pixel on its own, and checks that an overlay
+// edited with writePixelRect() is drawn with its new pixels.
+#include"test_util.h"
+#include<algorithm>
+
+//******************************************************************************************
+// @name                    : RoundDiv255
+//
+// @description             : x / 255 rounded to the nearest integer
+//
+// @returns                 : Quotient
+//********************************************************************************************
+static int RoundDiv255(int x)
+{
+    return (2 * x + 255) / 510;
+}
+
+//******************************************************************************************
+// @name                    : ReferenceOverlay
+//
+// @description             : Draws an overlay at x, y over a target: the overlay color times
+//                            its alpha and the opacity, plus the target times the rest. A 32
+//                            bit overlay brings its alpha, a 24 bit one is opaque and an 8 bit
+//                            one is a mask of maskColor. 8 bit targets get the overlay as
+//                            gray; the alpha of 32 bit targets is kept.
+//
+// @returns                 : Nothing
+//********************************************************************************************
+static void ReferenceOverlay(test_image_t &target, const test_image_t &overlay, int x, int y, double opacity,
+                             pixel_value_rgb_t maskColor)
+{
+    int opacityLevel = (int)(std::min(std::max(opacity, 0.0), 1.0) * 255 + 0.5);
+    const int weights = LUMA_RED_WEIGHT + LUMA_GREEN_WEIGHT + LUMA_BLUE_WEIGHT;
+
+    for (int row = 0; row < overlay.height; row++)
+    {
+        for (int column = 0; column < overlay.width; column++)
+        {
+            int tx = x + column;
+            int ty = y + row;
+            if (tx < 0 || tx >= target.width || ty < 0 || ty >= target.height)
+            {
+                continue;
+            }
+
+            const unsigned char *in = TestPixel(overlay, column, row);
+            int color[3] = { in[0], in[1], in[2] };
+            int alpha = 255;
+            if (overlay.bitsPerPixel == 32)
+            {
+                alpha = in[3];
+            }
+            else if (overlay.bitsPerPixel == 8)
+            {
+                alpha = in[0];
+                color[0] = maskColor.blue;
+                color[1] = maskColor.green;
+                color[2] = maskColor.red;
+            }
+            alpha = RoundDiv255(alpha * opacityLevel);
+
+            unsigned char *out = TestPixel(target, tx, ty);
+            if (target.bitsPerPixel == 8)
+            {
+                int gray = (LUMA_RED_WEIGHT * color[2] + LUMA_GREEN_WEIGHT * color[1] + LUMA_BLUE_WEIGHT * color[0] +
+                            weights / 2) / weights;
+                out[0] = (unsigned char)(RoundDiv255(gray * alpha) + RoundDiv255(out[0] * (255 - alpha)));
+                continue;
+            }
+            for (int c = 0; c < 3; c++)
+            {
+                out[c] = (unsigned char)(RoundDiv255(color[c] * alpha) + RoundDiv255(out[c] * (255 - alpha)));
+            }
+        }
+    }
+}
+
+//******************************************************************************************
+// @name                    : CheckOverlay
+//
+// @description             : Draws an overlay on a random image and compares the result
+//                            with the reference.
+//
+// @returns                 : Nothing
+//********************************************************************************************
+static void CheckOverlay(short targetBitsPerPixel, BitmapImage &overlay, const test_image_t &overlayImage,
+                         int x, int y, double opacity, pixel_value_rgb_t maskColor)
+{
+    test_image_t target = MakeTestImage(45, 31, targetBitsPerPixel, targetBitsPerPixel + x * 3 + y);
+    vector<unsigned char> file = EncodeTestImage(target);
+    BitmapImage bitmap(&file[0], file.size(), "target.bmp");
+    CHECK(bitmap.overlayImage(overlay, x, y, opacity, maskColor) == 0);
+
+    test_image_t expected = target;
+    ReferenceOverlay(expected, overlayImage, x, y, opacity, maskColor);
+
+    test_image_t result;
+    CHECK(ModifiedTestImage(bitmap, result));
+    if (result.pixels != expected.pixels)
+    {
+        printf("overlay of %d bpp on %d bpp at %d,%d, opacity %.2f differs\n",
+               overlayImage.bitsPerPixel, targetBitsPerPixel, x, y, opacity);
+    }
+    CHECK(result.pixels == expected.pixels);
+}
+
+int main()
+{
+    const short formats[] = { 8, 24, 32 };
+    const double opacities[] = { 1.0, 0.6, 0.0 };
+    // Inside, clipped on every side, and entirely outside
+    const int positions[][2] = { { 5, 3 }, { -7, -4 }, { 30, 20 }, { -2, 25 }, { 50, 0 } };
+    const pixel_value_rgb_t maskColor = { 200, 40, 90 };
+
+    for (short overlayBitsPerPixel : formats)
+    {
+        test_image_t overlayImage = MakeTestImage(21, 13, overlayBitsPerPixel, 17 + overlayBitsPerPixel);
+        vector<unsigned char> file = EncodeTestImage(overlayImage);
+        BitmapImage overlay(&file[0], file.size(), "overlay.bmp");
+
+        for (short targetBitsPerPixel : formats)
+        {
+            for (double opacity : opacities)
+            {
+                for (size_t p = 0; p < sizeof(positions) / sizeof(positions[0]); p++)
+                {
+                    CheckOverlay(targetBitsPerPixel, overlay, overlayImage, positions[p][0], positions[p][1], opacity, maskColor);
+                }
+            }
+        }
+    }
+
+    // Editing the overlay prepares it again: a logo of 100 drawn once, set to 200 and drawn
+    // on a fresh target in the same layout draws 200
+    {
+        test_image_t logo = MakeTestImage(6, 5, 24, 3);
+        std::fill(logo.pixels.begin(), logo.pixels.end(), 100);
+        vector<unsigned char> file = EncodeTestImage(logo);
+        BitmapImage overlay(&file[0], file.size(), "logo.bmp");
+
+        const pixel_value_rgb_t white = { 255, 255, 255 };
+        CheckOverlay(24, overlay, logo, 2, 2, 1.0, white);
+
+        vector<unsigned char> patch(6 * 5 * 3, 200);
+        CHECK(overlay.writePixelRect(0, 0, 6, 5, &patch[0], 6 * 3) == 0);
+        std::fill(logo.pixels.begin(), logo.pixels.end(), 200);
+        CheckOverlay(24, overlay, logo, 2, 2, 1.0, white);
+
+        // Part of it, drawn translucent
+        vector<unsigned char> corner(2 * 3 * 3, 10);
+        CHECK(overlay.writePixelRect(4, 2, 2, 3, &corner[0], 2 * 3) == 0);
+        for (int y = 2; y < 5; y++)
+        {
+            memset(TestPixel(logo, 4, y), 10, 2 * 3);
+        }
+        CheckOverlay(24, overlay, logo, -1, 3, 0.5, white);
+    }
+
+    return TEST_RESULT();
+}
@@ -0,0 +1,163 @@
+// Compares getPlanarImageData() with converting every pixel on its own into planes laid out
+// by hand: I420, NV12 and 4:4:4, rows top-down, at odd widths and heights, from bottom-up and
+// top-down files and from a modified image written top-down.
+#include"test_util.h"
+#include"../pixel_kernels.h"
+#include<algorithm>
+
+//******************************************************************************************
+// @name                    : ReferenceChannels
+//
+// @description             : Red, green and blue of a pixel. 8 bit images are gray.
+//
+// @returns                 : Nothing
+//********************************************************************************************
+static void ReferenceChannels(const test_image_t &image, int x, int y, int rgb[3])
+{
+    const unsigned char *p = TestPixel(image, x, y);
+    bool gray = (image.bitsPerPixel == 8);
+    rgb[0] = gray ? p[0] : p[2];
+    rgb[1] = gray ? p[0] : p[1];
+    rgb[2] = p[0];
+}
+
+//******************************************************************************************
+// @name                    : ReferencePlanes
+//
+// @description             : Y of every pixel, then Cb and Cr. 4:2:0 chroma is taken from the
+//                            sums of each 2x2 block, a last odd column or row counting twice;
+//                            I420 has a Cb plane then a Cr plane, NV12 one plane of Cb, Cr
+//                            pairs.
+//
+// @returns                 : The planes
+//********************************************************************************************
+static vector<unsigned char> ReferencePlanes(const test_image_t &image, planar_format_t format)
+{
+    int width = image.width;
+    int height = image.height;
+    size_t lumaBytes = (size_t)width * height;
+    int rgb[3];
+
+    if (format == PLANAR_YUV444)
+    {
+        vector<unsigned char> planes(lumaBytes * 3);
+        for (int y = 0; y < height; y++)
+        {
+            for (int x = 0; x < width; x++)
+            {
+                size_t i = (size_t)y * width + x;
+                ReferenceChannels(image, x, y, rgb);
+                planes[i] = LumaFromRGB(rgb[0], rgb[1], rgb[2]);
+                ChromaFromRGBSums(rgb[0], rgb[1], rgb[2], 0, planes[lumaBytes + i], planes[lumaBytes * 2 + i]);
+            }
+        }
+        return planes;
+    }
+
+    int chromaWidth = (width + 1) / 2;
+    int chromaHeight = (height + 1) / 2;
+    size_t chromaBytes = (size_t)chromaWidth * chromaHeight;
+    vector<unsigned char> planes(lumaBytes + chromaBytes * 2);
+    for (int y = 0; y < height; y++)
+    {
+        for (int x = 0; x < width; x++)
+        {
+            ReferenceChannels(image, x, y, rgb);
+            planes[(size_t)y * width + x] = LumaFromRGB(rgb[0], rgb[1], rgb[2]);
+        }
+    }
+
+    for (int cy = 0; cy < chromaHeight; cy++)
+    {
+        for (int cx = 0; cx < chromaWidth; cx++)
+        {
+            int sums[3] = { 0, 0, 0 };
+            for (int k = 0; k < 4; k++)
+            {
+                ReferenceChannels(image, std::min(cx * 2 + k % 2, width - 1), std::min(cy * 2 + k / 2, height - 1), rgb);
+                for (int c = 0; c < 3; c++)
+                {
+                    sums[c] += rgb[c];
+                }
+            }
+
+            size_t i = (size_t)cy * chromaWidth + cx;
+            unsigned char *cb = &planes[lumaBytes + ((format == PLANAR_NV12) ? i * 2 : i)];
+            unsigned char *cr = (format == PLANAR_NV12) ? cb + 1 : cb + chromaBytes;
+            ChromaFromRGBSums(sums[0], sums[1], sums[2], 2, *cb, *cr);
+        }
+    }
+    return planes;
+}
+
+//******************************************************************************************
+// @name                    : CheckPlanes
+//
+// @description             : Converts an image, original or modified, and compares the
+//                            planes and their size with the reference.
+//
+// @returns                 : Nothing
+//********************************************************************************************
+static void CheckPlanes(BitmapImage &bitmap, const test_image_t &image, planar_format_t format, bool modified,
+                        const char *source)
+{
+    vector<unsigned char> expected = ReferencePlanes(image, format);
+    vector<unsigned char> planes;
+    CHECK(BitmapImage::getPlanarImageSize(format, image.width, image.height) == expected.size());
+    CHECK(bitmap.getPlanarImageData(format, planes, modified) == 0);
+
+    int mismatches = (planes.size() != expected.size());
+    for (size_t i = 0; i < planes.size() && i < expected.size(); i++)
+    {
+        mismatches += (planes[i] != expected[i]);
+    }
+    if (mismatches != 0)
+    {
+        printf("planar %d of %dx%d, %d bpp, %s: %d mismatches\n", format, image.width, image.height,
+               image.bitsPerPixel, source, mismatches);
+    }
+    CHECK(mismatches == 0);
+
+    // A buffer one byte short is refused
+    vector<unsigned char> buffer(expected.size());
+    CHECK(bitmap.getPlanarImageData(format, &buffer[0], buffer.size() - 1, modified) != 0);
+}
+
+int main()
+{
+    const short formats[] = { 8, 24, 32 };
+    const planar_format_t layouts[] = { PLANAR_I420, PLANAR_NV12, PLANAR_YUV444 };
+    // Odd widths and heights, single rows and columns, and rows longer than a SIMD step
+    const int sizes[][2] = { { 1, 1 }, { 2, 2 }, { 3, 1 }, { 1, 4 }, { 5, 7 }, { 17, 9 }, { 64, 3 }, { 65, 12 } };
+
+    for (short bitsPerPixel : formats)
+    {
+        for (size_t s = 0; s < sizeof(sizes) / sizeof(sizes[0]); s++)
+        {
+            test_image_t image = MakeTestImage(sizes[s][0], sizes[s][1], bitsPerPixel, (unsigned int)s * 3 + bitsPerPixel);
+            vector<unsigned char> bottomUp = EncodeTestImage(image);
+            vector<unsigned char> topDown = EncodeTopDown(image);
+            BitmapImage fromBottomUp(&bottomUp[0], bottomUp.size(), "planar.bmp");
+            BitmapImage fromTopDown(&topDown[0], topDown.size(), "planar.bmp");
+
+            // Flipped by writing the rows top-down: the planes are of the flipped image
+            test_image_t flipped = image;
+            size_t rowBytes = (size_t)image.width * TestBytesPerPixel(bitsPerPixel);
+            for (int row = 0; row < image.height; row++)
+            {
+                memcpy(&flipped.pixels[rowBytes * row], &image.pixels[rowBytes * (image.height - 1 - row)], rowBytes);
+            }
+            BitmapImage flippedByHeader(&bottomUp[0], bottomUp.size(), "planar.bmp");
+            CHECK(flippedByHeader.TransformImage(TRANSFORM_FLIP_VERTICAL, true) == 0);
+
+            for (planar_format_t layout : layouts)
+            {
+                CheckPlanes(fromBottomUp, image, layout, false, "bottom-up file");
+                CheckPlanes(fromTopDown, image, layout, false, "top-down file");
+                CheckPlanes(flippedByHeader, flipped, layout, true, "flipped by header");
+            }
+        }
+    }
+
+    return TEST_RESULT();
+}
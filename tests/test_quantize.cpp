@@ -0,0 +1,430 @@
+// Compares QuantizeImage() with a serial median cut: the same palette, every pixel mapped to
+// the palette entry nearest the center of its inverse color cube cell, and Floyd-Steinberg
+// dithering run pixel by pixel.
+#include"test_util.h"
+#include<limits.h>
+#include<map>
+#include<set>
+
+const int TEST_HISTOGRAM_BITS = QUANTIZE_HISTOGRAM_BITS;
+const int TEST_HISTOGRAM_SIDE = 1 << TEST_HISTOGRAM_BITS;
+const int TEST_INVERSE_SHIFT = 8 - QUANTIZE_INVERSE_BITS;
+
+// Pixels of a histogram cell and their sums, indexed red, green, blue
+typedef struct test_cell_tag
+{
+    unsigned long long count;
+    unsigned long long sum[3];
+}test_cell_t;
+
+// Box of cells, inclusive bounds
+typedef struct test_box_tag
+{
+    int low[3];
+    int high[3];
+    unsigned long long count;
+    unsigned long long sum[3];
+    double channelError[3];
+    double error;
+}test_box_t;
+
+//******************************************************************************************
+// @name                    : Rgb
+//
+// @description             : Red, green and blue of a pixel of a test image.
+//
+// @returns                 : Nothing
+//********************************************************************************************
+static void Rgb(const test_image_t &image, int x, int y, int rgb[3])
+{
+    const unsigned char *p = TestPixel(image, x, y);
+    bool gray = (image.bitsPerPixel == 8);
+    rgb[0] = gray ? p[0] : p[2];
+    rgb[1] = gray ? p[0] : p[1];
+    rgb[2] = p[0];
+}
+
+//******************************************************************************************
+// @name                    : Cell
+//
+// @description             : The histogram cell of cell coordinates.
+//
+// @returns                 : Reference to the cell
+//********************************************************************************************
+static test_cell_t& Cell(vector<test_cell_t> &cells, int r, int g, int b)
+{
+    return cells[((size_t)r * TEST_HISTOGRAM_SIDE + g) * TEST_HISTOGRAM_SIDE + b];
+}
+
+//******************************************************************************************
+// @name                    : ShrinkTestBox
+//
+// @description             : Shrinks a box to its cells holding pixels, and works out its
+//                            sums and squared errors with cells counted as their means.
+//
+// @returns                 : Nothing
+//********************************************************************************************
+static void ShrinkTestBox(test_box_t &box, vector<test_cell_t> &cells)
+{
+    int low[3] = { TEST_HISTOGRAM_SIDE, TEST_HISTOGRAM_SIDE, TEST_HISTOGRAM_SIDE };
+    int high[3] = { -1, -1, -1 };
+    double squares[3] = { 0.0, 0.0, 0.0 };
+    box.count = 0;
+    memset(box.sum, 0, sizeof(box.sum));
+
+    for (int r = box.low[0]; r <= box.high[0]; r++)
+    {
+        for (int g = box.low[1]; g <= box.high[1]; g++)
+        {
+            for (int b = box.low[2]; b <= box.high[2]; b++)
+            {
+                const test_cell_t &cell = Cell(cells, r, g, b);
+                if (cell.count == 0)
+                {
+                    continue;
+                }
+                int index[3] = { r, g, b };
+                for (int c = 0; c < 3; c++)
+                {
+                    low[c] = std::min(low[c], index[c]);
+                    high[c] = std::max(high[c], index[c]);
+                    box.sum[c] += cell.sum[c];
+                    squares[c] += (double)cell.sum[c] * cell.sum[c] / cell.count;
+                }
+                box.count += cell.count;
+            }
+        }
+    }
+
+    box.error = 0.0;
+    for (int c = 0; c < 3; c++)
+    {
+        box.low[c] = low[c];
+        box.high[c] = high[c];
+        box.channelError[c] = (box.count > 0) ? squares[c] - (double)box.sum[c] * box.sum[c] / box.count : 0.0;
+        box.error += box.channelError[c];
+    }
+}
+
+//******************************************************************************************
+// @name                    : ReferencePalette
+//
+// @description             : Median cut: splits the box of largest error across its channel
+//                            of largest error, at the median pixel, until there are
+//                            colorCount boxes or every box is one cell. Images of at most
+//                            colorCount colors keep them, sorted.
+//
+// @param exact             : true on return if the palette holds every color
+//
+// @returns                 : 0xRRGGBB entries
+//********************************************************************************************
+static vector<unsigned int> ReferencePalette(const test_image_t &image, int colorCount, bool &exact)
+{
+    std::set<unsigned int> colors;
+    vector<test_cell_t> cells((size_t)TEST_HISTOGRAM_SIDE * TEST_HISTOGRAM_SIDE * TEST_HISTOGRAM_SIDE);
+    memset(&cells[0], 0, sizeof(test_cell_t) * cells.size());
+
+    for (int y = 0; y < image.height; y++)
+    {
+        for (int x = 0; x < image.width; x++)
+        {
+            int rgb[3];
+            Rgb(image, x, y, rgb);
+            colors.insert(((unsigned int)rgb[0] << 16) | (rgb[1] << 8) | rgb[2]);
+            test_cell_t &cell = Cell(cells, rgb[0] >> (8 - TEST_HISTOGRAM_BITS), rgb[1] >> (8 - TEST_HISTOGRAM_BITS),
+                                     rgb[2] >> (8 - TEST_HISTOGRAM_BITS));
+            cell.count++;
+            for (int c = 0; c < 3; c++)
+            {
+                cell.sum[c] += rgb[c];
+            }
+        }
+    }
+
+    exact = ((int)colors.size() <= colorCount);
+    if (exact)
+    {
+        return vector<unsigned int>(colors.begin(), colors.end());
+    }
+
+    vector<test_box_t> boxes(1);
+    for (int c = 0; c < 3; c++)
+    {
+        boxes[0].low[c] = 0;
+        boxes[0].high[c] = TEST_HISTOGRAM_SIDE - 1;
+    }
+    ShrinkTestBox(boxes[0], cells);
+
+    while ((int)boxes.size() < colorCount)
+    {
+        int largest = -1;
+        for (int k = 0; k < (int)boxes.size(); k++)
+        {
+            bool oneCell = boxes[k].low[0] == boxes[k].high[0] && boxes[k].low[1] == boxes[k].high[1] &&
+                           boxes[k].low[2] == boxes[k].high[2];
+            if (!oneCell && (largest < 0 || boxes[k].error > boxes[largest].error))
+            {
+                largest = k;
+            }
+        }
+        if (largest < 0)
+        {
+            break;
+        }
+
+        test_box_t box = boxes[largest];
+        int axis = -1;
+        for (int c = 0; c < 3; c++)
+        {
+            if (box.high[c] > box.low[c] && (axis < 0 || box.channelError[c] > box.channelError[axis]))
+            {
+                axis = c;
+            }
+        }
+
+        // Pixels up to and including each slice across the axis
+        unsigned long long below = 0;
+        int cut = box.low[axis];
+        while (true)
+        {
+            for (int r = box.low[0]; r <= box.high[0]; r++)
+            {
+                for (int g = box.low[1]; g <= box.high[1]; g++)
+                {
+                    for (int b = box.low[2]; b <= box.high[2]; b++)
+                    {
+                        int index[3] = { r, g, b };
+                        below += (index[axis] == cut) ? Cell(cells, r, g, b).count : 0;
+                    }
+                }
+            }
+            if (cut + 1 >= box.high[axis] || below * 2 >= box.count)
+            {
+                break;
+            }
+            cut++;
+        }
+
+        test_box_t second = box;
+        box.high[axis] = cut;
+        second.low[axis] = cut + 1;
+        ShrinkTestBox(box, cells);
+        ShrinkTestBox(second, cells);
+        boxes[largest] = box;
+        boxes.push_back(second);
+    }
+
+    vector<unsigned int> palette;
+    for (size_t k = 0; k < boxes.size(); k++)
+    {
+        unsigned int color = 0;
+        for (int c = 0; c < 3; c++)
+        {
+            color = (color << 8) | (unsigned int)((boxes[k].sum[c] + boxes[k].count / 2) / boxes[k].count);
+        }
+        palette.push_back(color);
+    }
+    return palette;
+}
+
+//******************************************************************************************
+// @name                    : NearestToCell
+//
+// @description             : Palette entry nearest the center of the inverse color cube cell
+//                            of a color, the first of equally near ones.
+//
+// @returns                 : Index
+//********************************************************************************************
+static int NearestToCell(const vector<unsigned int> &palette, const int rgb[3])
+{
+    int best = 0;
+    int bestDistance = INT_MAX;
+    for (size_t k = 0; k < palette.size(); k++)
+    {
+        int distance = 0;
+        for (int c = 0; c < 3; c++)
+        {
+            int center = ((rgb[c] >> TEST_INVERSE_SHIFT) << TEST_INVERSE_SHIFT) + (1 << TEST_INVERSE_SHIFT) / 2;
+            int d = center - (int)((palette[k] >> (16 - 8 * c)) & 0xFF);
+            distance += d * d;
+        }
+        if (distance < bestDistance)
+        {
+            bestDistance = distance;
+            best = (int)k;
+        }
+    }
+    return best;
+}
+
+//******************************************************************************************
+// @name                    : ReferenceIndices
+//
+// @description             : Palette index of every pixel, top row first. Exact palettes
+//                            hold every color; otherwise pixels go to the entry nearest their
+//                            cell, after adding the errors diffused to them when dithering.
+//
+// @returns                 : Indices
+//********************************************************************************************
+static vector<unsigned char> ReferenceIndices(const test_image_t &image, const vector<unsigned int> &palette,
+                                              bool exact, bool dither)
+{
+    vector<unsigned char> indices((size_t)image.width * image.height);
+    int stride = image.width + 2;
+    vector<int> errors((size_t)(image.height + 1) * stride * 3, 0);
+    std::map<unsigned int, int> exactIndex;
+    for (size_t k = 0; k < palette.size(); k++)
+    {
+        exactIndex[palette[k]] = (int)k;
+    }
+
+    for (int y = 0; y < image.height; y++)
+    {
+        for (int x = 0; x < image.width; x++)
+        {
+            int rgb[3];
+            Rgb(image, x, y, rgb);
+            if (exact)
+            {
+                indices[(size_t)y * image.width + x] = (unsigned char)exactIndex[((unsigned int)rgb[0] << 16) | (rgb[1] << 8) | rgb[2]];
+                continue;
+            }
+
+            int *error = &errors[((size_t)y * stride + x + 1) * 3];
+            for (int c = 0; c < 3 && dither; c++)
+            {
+                rgb[c] = std::min(std::max(rgb[c] + error[c] / 16, 0), 255);
+            }
+
+            int index = NearestToCell(palette, rgb);
+            indices[(size_t)y * image.width + x] = (unsigned char)index;
+            if (!dither)
+            {
+                continue;
+            }
+
+            // 7/16 right, 3/16 below left, 5/16 below, 1/16 below right
+            int *below = error + (size_t)stride * 3;
+            for (int c = 0; c < 3; c++)
+            {
+                int difference = rgb[c] - (int)((palette[index] >> (16 - 8 * c)) & 0xFF);
+                error[3 + c] += difference * 7;
+                below[c - 3] += difference * 3;
+                below[c] += difference * 5;
+                below[3 + c] += difference;
+            }
+        }
+    }
+
+    return indices;
+}
+
+//******************************************************************************************
+// @name                    : CheckQuantize
+//
+// @description             : Quantizes an image and compares palette and indices with the
+//                            reference.
+//
+// @returns                 : Nothing
+//********************************************************************************************
+static void CheckQuantize(const test_image_t &image, int colorCount, bool dither)
+{
+    vector<unsigned char> file = EncodeTestImage(image);
+    BitmapImage bitmap(&file[0], file.size(), "quantize.bmp");
+    CHECK(bitmap.QuantizeImage(colorCount, dither) == 0);
+
+    test_image_t result;
+    CHECK(ModifiedTestImage(bitmap, result));
+    CHECK(result.bitsPerPixel == 8 && result.width == image.width && result.height == image.height);
+
+    bool exact = false;
+    vector<unsigned int> palette = ReferencePalette(image, colorCount, exact);
+    CHECK((int)palette.size() <= colorCount);
+    CHECK(result.palette.size() >= palette.size() * 4);
+
+    int paletteMismatches = 0;
+    for (size_t k = 0; k < palette.size() && k * 4 + 2 < result.palette.size(); k++)
+    {
+        unsigned int color = ((unsigned int)result.palette[k * 4 + 2] << 16) | (result.palette[k * 4 + 1] << 8) | result.palette[k * 4];
+        paletteMismatches += (color != palette[k]);
+    }
+
+    vector<unsigned char> indices = ReferenceIndices(image, palette, exact, dither);
+    int pixelMismatches = 0;
+    for (size_t i = 0; i < indices.size() && i < result.pixels.size(); i++)
+    {
+        pixelMismatches += (indices[i] != result.pixels[i]);
+    }
+
+    if (paletteMismatches != 0 || pixelMismatches != 0)
+    {
+        printf("quantize %dx%d, %d bpp, %d colors%s: %d palette and %d pixel mismatches\n", image.width, image.height,
+               image.bitsPerPixel, colorCount, dither ? ", dithered" : "", paletteMismatches, pixelMismatches);
+    }
+    CHECK(paletteMismatches == 0);
+    CHECK(pixelMismatches == 0);
+}
+
+//******************************************************************************************
+// @name                    : MakeGradient
+//
+// @description             : Smooth colors with a little noise, as in a photograph.
+//
+// @returns                 : The image
+//********************************************************************************************
+static test_image_t MakeGradient(int width, int height, short bitsPerPixel)
+{
+    test_image_t image = MakeTestImage(width, height, bitsPerPixel, 17);
+    unsigned int seed = 23;
+    int bytesPerPixel = TestBytesPerPixel(bitsPerPixel);
+    for (int y = 0; y < height; y++)
+    {
+        for (int x = 0; x < width; x++)
+        {
+            unsigned char *p = TestPixel(image, x, y);
+            for (int c = 0; c < std::min(bytesPerPixel, 3); c++)
+            {
+                int value = (x * 255 / width) * (c != 1) + (y * 255 / height) * (c != 0) + TestRandom(seed) % 9;
+                p[c] = (unsigned char)std::min(value / 2 + (c == 2 ? 60 : 0), 255);
+            }
+        }
+    }
+    return image;
+}
+
+int main()
+{
+    const short formats[] = { 8, 24, 32 };
+    const int colorCounts[] = { 2, 16, 255, 256 };
+
+    for (short bitsPerPixel : formats)
+    {
+        for (int colorCount : colorCounts)
+        {
+            CheckQuantize(MakeTestImage(37, 29, bitsPerPixel, colorCount), colorCount, false);
+            CheckQuantize(MakeGradient(64, 150, bitsPerPixel), colorCount, false);
+            CheckQuantize(MakeGradient(45, 40, bitsPerPixel), colorCount, true);
+        }
+    }
+
+    // Few colors: kept exactly
+    {
+        test_image_t image = MakeTestImage(50, 40, 24, 8);
+        for (size_t i = 0; i < image.pixels.size(); i += 3)
+        {
+            unsigned char value = (unsigned char)((i / 3) % 7 * 40);
+            image.pixels[i] = value;
+            image.pixels[i + 1] = (unsigned char)(255 - value);
+            image.pixels[i + 2] = (unsigned char)(value / 2);
+        }
+        CheckQuantize(image, 8, false);
+        CheckQuantize(image, 8, true);
+    }
+
+    vector<unsigned char> file = EncodeTestImage(MakeTestImage(8, 8, 24, 1));
+    BitmapImage bitmap(&file[0], file.size(), "quantize.bmp");
+    CHECK(bitmap.QuantizeImage(1) != 0);
+    CHECK(bitmap.QuantizeImage(MAX_COLORS + 1) != 0);
+
+    return TEST_RESULT();
+}
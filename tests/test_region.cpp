@@ -0,0 +1,169 @@
+// Compares loading a region of interest, and shrinking while loading, with cropping and
+// block averaging the fully loaded image.
+#include"test_util.h"
+
+//******************************************************************************************
+// @name                    : LoadedTestImage
+//
+// @description             : The pixels a bitmap loaded. A vertical flip by header leaves
+//                            them as they are in the modified image, with a top-down header,
+//                            so the rows are read back in the other order.
+//
+// @returns                 : true if they could be read
+//********************************************************************************************
+static bool LoadedTestImage(BitmapImage &bitmap, test_image_t &image)
+{
+    test_image_t flipped;
+    if (bitmap.TransformImage(TRANSFORM_FLIP_VERTICAL, true) != 0 || !ModifiedTestImage(bitmap, flipped))
+    {
+        return false;
+    }
+
+    image = flipped;
+    size_t rowBytes = (size_t)image.width * TestBytesPerPixel(image.bitsPerPixel);
+    for (int row = 0; row < image.height; row++)
+    {
+        memcpy(&image.pixels[rowBytes * row], &flipped.pixels[rowBytes * (image.height - 1 - row)], rowBytes);
+    }
+    return true;
+}
+
+//******************************************************************************************
+// @name                    : ReferenceRegion
+//
+// @description             : Crops the region, clipped to the image, and averages every
+//                            shrink x shrink block of it, rounded. Columns and rows left over
+//                            at the right and bottom are dropped.
+//
+// @returns                 : The region
+//********************************************************************************************
+static test_image_t ReferenceRegion(const test_image_t &image, const bitmap_load_options_t &options)
+{
+    int shrink = (options.shrinkFactor > 1) ? options.shrinkFactor : 1;
+    int roiWidth = (options.roiWidth > 0) ? options.roiWidth : image.width - options.roiX;
+    int roiHeight = (options.roiHeight > 0) ? options.roiHeight : image.height - options.roiY;
+    roiWidth = std::min(roiWidth, image.width - options.roiX);
+    roiHeight = std::min(roiHeight, image.height - options.roiY);
+
+    int bytesPerPixel = TestBytesPerPixel(image.bitsPerPixel);
+    test_image_t region;
+    region.width = roiWidth / shrink;
+    region.height = roiHeight / shrink;
+    region.bitsPerPixel = image.bitsPerPixel;
+    region.pixels.resize((size_t)region.width * region.height * bytesPerPixel);
+
+    for (int y = 0; y < region.height; y++)
+    {
+        for (int x = 0; x < region.width; x++)
+        {
+            for (int c = 0; c < bytesPerPixel; c++)
+            {
+                int sum = 0;
+                for (int dy = 0; dy < shrink; dy++)
+                {
+                    for (int dx = 0; dx < shrink; dx++)
+                    {
+                        sum += TestPixel(image, options.roiX + x * shrink + dx, options.roiY + y * shrink + dy)[c];
+                    }
+                }
+                TestPixel(region, x, y)[c] = (unsigned char)((sum + shrink * shrink / 2) / (shrink * shrink));
+            }
+        }
+    }
+
+    return region;
+}
+
+//******************************************************************************************
+// @name                    : CheckRegion
+//
+// @description             : Loads a region of a file and compares it with the reference,
+//                            and with the same region of the fully loaded file.
+//
+// @returns                 : Nothing
+//********************************************************************************************
+static void CheckRegion(const vector<unsigned char> &file, const test_image_t &image, int x, int y, int width, int height,
+                        int shrink)
+{
+    bitmap_load_options_t options = { x, y, width, height, shrink, 0.0 };
+    test_image_t expected = ReferenceRegion(image, options);
+
+    BitmapImage bitmap(&file[0], file.size(), "region.bmp", &options);
+    test_image_t loaded;
+    CHECK(LoadedTestImage(bitmap, loaded));
+
+    bool same = loaded.width == expected.width && loaded.height == expected.height && loaded.pixels == expected.pixels;
+    if (!same)
+    {
+        printf("region %d,%d %dx%d, shrink %d of %dx%d, %d bpp: loaded %dx%d, expected %dx%d\n", x, y, width, height,
+               shrink, image.width, image.height, image.bitsPerPixel, loaded.width, loaded.height,
+               expected.width, expected.height);
+    }
+    CHECK(same);
+
+    // Without shrinking, the region is a crop of the full load
+    if (shrink == 1)
+    {
+        BitmapImage full(&file[0], file.size(), "region.bmp");
+        test_image_t fullImage;
+        CHECK(LoadedTestImage(full, fullImage));
+        CHECK(ReferenceRegion(fullImage, options).pixels == loaded.pixels);
+    }
+}
+
+//******************************************************************************************
+// @name                    : LoaderRejects
+//
+// @description             : Tells whether loading a region of a file throws.
+//
+// @returns                 : true if it throws
+//********************************************************************************************
+static bool LoaderRejects(const vector<unsigned char> &file, const bitmap_load_options_t &options)
+{
+    try
+    {
+        BitmapImage image(&file[0], file.size(), "region.bmp", &options);
+    }
+    catch (const char *)
+    {
+        return true;
+    }
+    return false;
+}
+
+int main()
+{
+    const short formats[] = { 8, 24, 32 };
+    // x, y, width, height, shrink: whole image, inner regions, regions clipped at the right
+    // and bottom, and blocks with rows and columns left over
+    const int regions[][5] = { { 0, 0, 0, 0, 1 }, { 5, 3, 20, 11, 1 }, { 40, 30, 50, 50, 1 }, { 0, 17, 0, 0, 1 },
+                               { 0, 0, 0, 0, 3 }, { 2, 1, 31, 20, 3 }, { 10, 4, 0, 0, 2 }, { 7, 9, 100, 100, 4 },
+                               { 46, 34, 1, 1, 1 } };
+
+    for (short bitsPerPixel : formats)
+    {
+        test_image_t image = MakeTestImage(47, 35, bitsPerPixel, 21 + bitsPerPixel);
+        vector<unsigned char> bottomUp = EncodeTestImage(image);
+        vector<unsigned char> topDown = EncodeTopDown(image);
+
+        for (size_t r = 0; r < sizeof(regions) / sizeof(regions[0]); r++)
+        {
+            const int *region = regions[r];
+            CheckRegion(bottomUp, image, region[0], region[1], region[2], region[3], region[4]);
+            CheckRegion(topDown, image, region[0], region[1], region[2], region[3], region[4]);
+        }
+
+        // Regions outside the image, or smaller than one block, are refused
+        bitmap_load_options_t outside = { 47, 0, 0, 0, 1, 0.0 };
+        bitmap_load_options_t belowBlock = { 45, 0, 0, 0, 3, 0.0 };
+        CHECK(LoaderRejects(bottomUp, outside));
+        CHECK(LoaderRejects(bottomUp, belowBlock));
+
+        // Missing rows are an error, not a region of fewer rows
+        vector<unsigned char> truncated(bottomUp.begin(), bottomUp.end() - 200);
+        bitmap_load_options_t shrunk = { 0, 0, 0, 0, 2, 0.0 };
+        CHECK(LoaderRejects(truncated, shrunk));
+    }
+
+    return TEST_RESULT();
+}
@@ -0,0 +1,261 @@
+// Compares ResizeImage() with resampling every output pixel from the source directly: block
+// averages for exact 2x and 4x reductions, and the area, bilinear and Lanczos filters in
+// floating point. Also checks the header and row layout of the resized file.
+#include"test_util.h"
+#include<algorithm>
+#include<math.h>
+
+//******************************************************************************************
+// @name                    : ReferenceWeights
+//
+// @description             : Weight of every source pixel along one axis for an output
+//                            pixel, normalized to sum to 1. The area filter weighs a source
+//                            pixel by its overlap with the output pixel; bilinear and Lanczos
+//                            are widened by the scale when reducing.
+//
+// @returns                 : srcSize weights
+//********************************************************************************************
+static vector<double> ReferenceWeights(int srcSize, int dstSize, int i, resize_filter_t filter)
+{
+    double scale = (double)srcSize / dstSize;
+    double filterScale = std::max(scale, 1.0);
+    double center = (i + 0.5) * scale;
+    vector<double> weights(srcSize, 0.0);
+    double total = 0.0;
+
+    for (int k = 0; k < srcSize; k++)
+    {
+        if (filter == RESIZE_AREA_AVERAGE)
+        {
+            weights[k] = std::max(0.0, std::min(k + 1.0, (i + 1) * scale) - std::max((double)k, i * scale));
+        }
+        else
+        {
+            double x = fabs((k + 0.5 - center) / filterScale);
+            if (filter == RESIZE_LANCZOS)
+            {
+                double px = M_PI * x;
+                double sinc = (x == 0.0) ? 1.0 : sin(px) / px;
+                double window = (x == 0.0) ? 1.0 : sin(px / LANCZOS_SUPPORT) / (px / LANCZOS_SUPPORT);
+                weights[k] = (x < LANCZOS_SUPPORT) ? sinc * window : 0.0;
+            }
+            else
+            {
+                weights[k] = (x < BILINEAR_SUPPORT) ? 1.0 - x : 0.0;
+            }
+        }
+        total += weights[k];
+    }
+
+    for (int k = 0; k < srcSize; k++)
+    {
+        weights[k] /= total;
+    }
+    return weights;
+}
+
+//******************************************************************************************
+// @name                    : ReferenceResize
+//
+// @description             : Resamples along x, clamping to 0..255 as the rows are kept in
+//                            bytes, then along y, and rounds.
+//
+// @returns                 : The resized image
+//********************************************************************************************
+static test_image_t ReferenceResize(const test_image_t &image, int width, int height, resize_filter_t filter)
+{
+    int bytesPerPixel = TestBytesPerPixel(image.bitsPerPixel);
+    vector<double> rows((size_t)image.height * width * bytesPerPixel);
+    for (int x = 0; x < width; x++)
+    {
+        vector<double> weights = ReferenceWeights(image.width, width, x, filter);
+        for (int y = 0; y < image.height; y++)
+        {
+            for (int c = 0; c < bytesPerPixel; c++)
+            {
+                double sum = 0.0;
+                for (int k = 0; k < image.width; k++)
+                {
+                    sum += weights[k] * TestPixel(image, k, y)[c];
+                }
+                rows[((size_t)y * width + x) * bytesPerPixel + c] = std::min(std::max(sum, 0.0), 255.0);
+            }
+        }
+    }
+
+    test_image_t resized = image;
+    resized.width = width;
+    resized.height = height;
+    resized.pixels.resize((size_t)width * height * bytesPerPixel);
+    for (int y = 0; y < height; y++)
+    {
+        vector<double> weights = ReferenceWeights(image.height, height, y, filter);
+        for (int x = 0; x < width; x++)
+        {
+            for (int c = 0; c < bytesPerPixel; c++)
+            {
+                double sum = 0.0;
+                for (int k = 0; k < image.height; k++)
+                {
+                    sum += weights[k] * rows[((size_t)k * width + x) * bytesPerPixel + c];
+                }
+                TestPixel(resized, x, y)[c] = (unsigned char)std::min(std::max(floor(sum + 0.5), 0.0), 255.0);
+            }
+        }
+    }
+
+    return resized;
+}
+
+//******************************************************************************************
+// @name                    : ReferenceBlockAverage
+//
+// @description             : Rounded average of every factor x factor block.
+//
+// @returns                 : The reduced image
+//********************************************************************************************
+static test_image_t ReferenceBlockAverage(const test_image_t &image, int factor)
+{
+    int bytesPerPixel = TestBytesPerPixel(image.bitsPerPixel);
+    test_image_t reduced = image;
+    reduced.width = image.width / factor;
+    reduced.height = image.height / factor;
+    reduced.pixels.resize((size_t)reduced.width * reduced.height * bytesPerPixel);
+
+    for (int y = 0; y < reduced.height; y++)
+    {
+        for (int x = 0; x < reduced.width; x++)
+        {
+            for (int c = 0; c < bytesPerPixel; c++)
+            {
+                int sum = 0;
+                for (int dy = 0; dy < factor; dy++)
+                {
+                    for (int dx = 0; dx < factor; dx++)
+                    {
+                        sum += TestPixel(image, x * factor + dx, y * factor + dy)[c];
+                    }
+                }
+                TestPixel(reduced, x, y)[c] = (unsigned char)((sum + factor * factor / 2) / (factor * factor));
+            }
+        }
+    }
+
+    return reduced;
+}
+
+//******************************************************************************************
+// @name                    : ResizedTestImage
+//
+// @description             : Resizes an image and decodes the result, after checking the
+//                            header sizes against rows padded to 4 bytes.
+//
+// @returns                 : true if it could be resized and read
+//********************************************************************************************
+static bool ResizedTestImage(const test_image_t &image, int width, int height, resize_filter_t filter,
+                             test_image_t &resized)
+{
+    vector<unsigned char> file = EncodeTestImage(image);
+    BitmapImage bitmap(&file[0], file.size(), "resize.bmp");
+    vector<unsigned char> result;
+    if (bitmap.ResizeImage(width, height, filter) != 0 || bitmap.getModifiedImageFileData(result) != 0 ||
+        !DecodeTestImage(result, resized))
+    {
+        return false;
+    }
+
+    size_t paddedRowBytes = ((size_t)width * image.bitsPerPixel + 31) / 32 * 4;
+    size_t imageBytes = paddedRowBytes * height;
+    size_t dataOffset = GetLittleEndian(result, 10, 4);
+    CHECK(resized.width == width && resized.height == height && resized.bitsPerPixel == image.bitsPerPixel);
+    CHECK(result.size() == dataOffset + imageBytes);
+    CHECK(GetLittleEndian(result, 2, 4) == result.size());
+    CHECK(GetLittleEndian(result, 34, 4) == imageBytes);
+    CHECK(resized.palette == image.palette);
+    return true;
+}
+
+//******************************************************************************************
+// @name                    : CheckResize
+//
+// @description             : Resizes an image and compares it with the reference. The
+//                            library rounds the rows between the passes and its weights to
+//                            14 bits, so pixels may be off by one.
+//
+// @returns                 : Nothing
+//********************************************************************************************
+static void CheckResize(const test_image_t &image, int width, int height, resize_filter_t filter)
+{
+    test_image_t resized;
+    CHECK(ResizedTestImage(image, width, height, filter, resized));
+    if (resized.pixels.size() != (size_t)width * height * TestBytesPerPixel(image.bitsPerPixel))
+    {
+        return;
+    }
+
+    test_image_t expected = ReferenceResize(image, width, height, filter);
+    int worst = 0;
+    for (size_t i = 0; i < expected.pixels.size(); i++)
+    {
+        worst = std::max(worst, abs(resized.pixels[i] - expected.pixels[i]));
+    }
+
+    if (worst > 1)
+    {
+        printf("resize %d of %dx%d, %d bpp, to %dx%d: off by %d\n", filter, image.width, image.height,
+               image.bitsPerPixel, width, height, worst);
+    }
+    CHECK(worst <= 1);
+}
+
+int main()
+{
+    const short formats[] = { 8, 24, 32 };
+    const resize_filter_t filters[] = { RESIZE_AREA_AVERAGE, RESIZE_BILINEAR, RESIZE_LANCZOS };
+    // Reductions, enlargements, one axis only, and down to a single pixel
+    const int sizes[][2] = { { 20, 15 }, { 13, 29 }, { 100, 70 }, { 47, 9 }, { 1, 1 }, { 3, 35 } };
+
+    for (short bitsPerPixel : formats)
+    {
+        test_image_t image = MakeTestImage(47, 35, bitsPerPixel, 5 + bitsPerPixel);
+
+        for (resize_filter_t filter : filters)
+        {
+            for (size_t s = 0; s < sizeof(sizes) / sizeof(sizes[0]); s++)
+            {
+                CheckResize(image, sizes[s][0], sizes[s][1], filter);
+            }
+
+            // The same size is the image itself, and a flat image stays flat
+            test_image_t same;
+            CHECK(ResizedTestImage(image, image.width, image.height, filter, same));
+            CHECK(same.pixels == image.pixels);
+
+            test_image_t flat = image;
+            std::fill(flat.pixels.begin(), flat.pixels.end(), 77);
+            test_image_t flatResized;
+            CHECK(ResizedTestImage(flat, 31, 52, filter, flatResized));
+            CHECK(std::count(flatResized.pixels.begin(), flatResized.pixels.end(), 77) == (long)flatResized.pixels.size());
+        }
+
+        // Exact 2x and 4x area reductions are block averages, with wide enough rows for
+        // every SIMD width
+        for (int factor = 2; factor <= 4; factor += 2)
+        {
+            test_image_t wide = MakeTestImage(76 * factor, 6 * factor, bitsPerPixel, factor + bitsPerPixel);
+            test_image_t reduced;
+            CHECK(ResizedTestImage(wide, wide.width / factor, wide.height / factor, RESIZE_AREA_AVERAGE, reduced));
+            CHECK(reduced.pixels == ReferenceBlockAverage(wide, factor).pixels);
+        }
+
+        // Sizes out of range are refused, not allocated
+        vector<unsigned char> file = EncodeTestImage(image);
+        BitmapImage bitmap(&file[0], file.size(), "resize.bmp");
+        CHECK(bitmap.ResizeImage(0, 10, RESIZE_BILINEAR) != 0);
+        CHECK(bitmap.ResizeImage(10, -1, RESIZE_BILINEAR) != 0);
+        CHECK(bitmap.ResizeImage(MAX_IMAGE_DIMENSION + 1, 1, RESIZE_BILINEAR) != 0);
+        CHECK(bitmap.ResizeImage(MAX_IMAGE_DIMENSION, MAX_IMAGE_DIMENSION, RESIZE_BILINEAR) != 0);
+    }
+
+    return TEST_RESULT();
+}
@@ -0,0 +1,172 @@
+// Smoke test of ResultCache: hits and misses, LRU eviction, and reloading the appended
+// index as a crashed process leaves it.
+#include"test_util.h"
+#include"../result_cache.h"
+#include<stdlib.h>
+#include<string>
+
+//******************************************************************************************
+// @name                    : ReadTestFile
+//
+// @description             : Contents of a file, empty if it cannot be read.
+//
+// @returns                 : Contents
+//********************************************************************************************
+static vector<unsigned char> ReadTestFile(const std::string &path)
+{
+    vector<unsigned char> data;
+    FILE *fp = fopen(path.c_str(), "rb");
+    if (fp != nullptr)
+    {
+        int c;
+        while ((c = fgetc(fp)) != EOF)
+        {
+            data.push_back((unsigned char)c);
+        }
+        fclose(fp);
+    }
+    return data;
+}
+
+//******************************************************************************************
+// @name                    : WriteTestFile
+//
+// @description             : Replaces a file.
+//
+// @returns                 : true if SUCCESS
+//********************************************************************************************
+static bool WriteTestFile(const std::string &path, const vector<unsigned char> &data)
+{
+    FILE *fp = fopen(path.c_str(), "wb");
+    if (fp == nullptr)
+    {
+        return false;
+    }
+    bool written = data.empty() || fwrite(&data[0], 1, data.size(), fp) == data.size();
+    return (fclose(fp) == 0) && written;
+}
+
+//******************************************************************************************
+// @name                    : CountLines
+//
+// @description             : Lines of a text file
+//
+// @returns                 : Count
+//********************************************************************************************
+static int CountLines(const std::string &path)
+{
+    vector<unsigned char> data = ReadTestFile(path);
+    int lines = 0;
+    for (size_t i = 0; i < data.size(); i++)
+    {
+        lines += (data[i] == '\n');
+    }
+    return lines;
+}
+
+int main()
+{
+    char directoryTemplate[] = "/tmp/result_cache_test.XXXXXX";
+    const char *directory = mkdtemp(directoryTemplate);
+    CHECK(directory != nullptr);
+    if (directory == nullptr)
+    {
+        return TEST_RESULT();
+    }
+
+    std::string cacheDirectory = std::string(directory) + "/cache";
+    std::string indexPath = cacheDirectory + "/" + RESULT_CACHE_INDEX_FILE;
+    std::string outputPath = std::string(directory) + "/out.bmp";
+
+    vector<unsigned char> results[4];
+    std::string keys[4];
+    for (int i = 0; i < 4; i++)
+    {
+        results[i].assign(1000, (unsigned char)('a' + i));
+        keys[i] = ResultCache::MakeKey(&results[i][0], results[i].size(), "op" + std::to_string(i));
+    }
+
+    // Keys depend on the contents and on the operations
+    CHECK(keys[0] != ResultCache::MakeKey(&results[0][0], results[0].size(), "op1"));
+    CHECK(keys[0] != ResultCache::MakeKey(&results[1][0], results[1].size(), "op0"));
+
+    result_cache_stats_t before;
+    {
+        ResultCache cache(cacheDirectory.c_str(), 3000);
+        CHECK(cache.lookup(keys[0], outputPath.c_str()) == false);
+        CHECK(cache.store(keys[0], &results[0][0], results[0].size()) == 0);
+        CHECK(cache.store(keys[1], &results[1][0], results[1].size()) == 0);
+        CHECK(cache.lookup(keys[0], outputPath.c_str()) == true);
+        CHECK(ReadTestFile(outputPath) == results[0]);
+
+        // Over the cap: the least recently used result goes
+        CHECK(cache.store(keys[2], &results[2][0], results[2].size()) == 0);
+        CHECK(cache.store(keys[3], &results[3][0], results[3].size()) == 0);
+        CHECK(cache.lookup(keys[1], outputPath.c_str()) == false);
+        CHECK(cache.lookup(keys[0], outputPath.c_str()) == true);
+
+        before = cache.getStats();
+        CHECK(before.entries == 3);
+        CHECK(before.bytes == 3000);
+        CHECK(before.evictions == 1);
+        CHECK(before.stores == 4);
+
+        // Stores and uses are appended, the index is not rewritten each time
+        CHECK(CountLines(indexPath) == 7);
+
+        // Keep the index as a crash would leave it
+        vector<unsigned char> journal = ReadTestFile(indexPath);
+        CHECK(WriteTestFile(indexPath + ".crash", journal));
+    }
+
+    // The destructor compacted the index
+    CHECK(CountLines(indexPath) == 3);
+
+    CHECK(WriteTestFile(indexPath, ReadTestFile(indexPath + ".crash")));
+    {
+        ResultCache cache(cacheDirectory.c_str(), 3000);
+        result_cache_stats_t after = cache.getStats();
+        CHECK(after.entries == 3);
+        CHECK(after.bytes == 3000);
+        CHECK(cache.lookup(keys[1], outputPath.c_str()) == false);
+        CHECK(cache.lookup(keys[3], outputPath.c_str()) == true);
+        CHECK(ReadTestFile(outputPath) == results[3]);
+
+        // The order of use survived: key 2 is now the least recently used
+        vector<unsigned char> another(1000, 'x');
+        CHECK(cache.store("big", &another[0], another.size()) == 0);
+        CHECK(cache.lookup(keys[2], outputPath.c_str()) == false);
+        CHECK(cache.lookup(keys[0], outputPath.c_str()) == true);
+    }
+
+    // A result deleted from under the cache is a miss
+    {
+        ResultCache cache(cacheDirectory.c_str(), 3000);
+        remove((cacheDirectory + "/" + keys[3] + ".bmp").c_str());
+        CHECK(cache.lookup(keys[3], outputPath.c_str()) == false);
+        CHECK(cache.getStats().entries == 2);
+    }
+
+    // process() on a real image: the second run is a hit with the same output
+    {
+        std::string inputPath = std::string(directory) + "/in.bmp";
+        CHECK(WriteTestFile(inputPath, EncodeTestImage(MakeTestImage(17, 9, 24, 3))));
+
+        ResultCache cache(cacheDirectory.c_str());
+        int runs = 0;
+        auto rotate = [&](BitmapImage &image) { runs++; return image.TransformImage(TRANSFORM_ROTATE_90); };
+        CHECK(cache.process(inputPath.c_str(), outputPath.c_str(), "rotate90", rotate) == 0);
+        vector<unsigned char> first = ReadTestFile(outputPath);
+        remove(outputPath.c_str());
+        CHECK(cache.process(inputPath.c_str(), outputPath.c_str(), "rotate90", rotate) == 0);
+        CHECK(runs == 1);
+        CHECK(!first.empty() && ReadTestFile(outputPath) == first);
+
+        CHECK(cache.process((std::string(directory) + "/missing.bmp").c_str(), outputPath.c_str(), "rotate90", rotate) != 0);
+    }
+
+    std::string command = std::string("rm -rf ") + directory;
+    CHECK(system(command.c_str()) == 0);
+
+    return TEST_RESULT();
+}
@@ -0,0 +1,268 @@
+// Compares getImageStatistics() and getModifiedImageStatistics() with sums over every pixel:
+// of the loaded image, after writePixelRect() edits, and of modified images. With sampled
+// histograms, checks that the distribution of every channel, read back from the equalization
+// table, stays within getHistogramErrorBound() of the exact one.
+#include"test_util.h"
+#include"../pixel_kernels.h"
+#include<algorithm>
+#include<math.h>
+
+//******************************************************************************************
+// @name                    : ReferenceValues
+//
+// @description             : Red, green, blue and brightness of a pixel, indexed by color_t.
+//                            8 bit images are gray.
+//
+// @returns                 : Nothing
+//********************************************************************************************
+static void ReferenceValues(const test_image_t &image, int x, int y, int values[4])
+{
+    const unsigned char *p = TestPixel(image, x, y);
+    bool gray = (image.bitsPerPixel == 8);
+    values[RED] = gray ? p[0] : p[2];
+    values[GREEN] = gray ? p[0] : p[1];
+    values[BLUE] = p[0];
+    values[BRIGHTNESS] = LumaFromRGB(values[RED], values[GREEN], values[BLUE]);
+}
+
+//******************************************************************************************
+// @name                    : ReferenceStatistics
+//
+// @description             : Mean, population standard deviation, minimum and maximum of
+//                            every channel, summed pixel by pixel.
+//
+// @returns                 : Statistics
+//********************************************************************************************
+static image_statistics_t ReferenceStatistics(const test_image_t &image)
+{
+    image_statistics_t statistics;
+    memset(&statistics, 0, sizeof(statistics));
+    statistics.pixelCount = (unsigned long long)image.width * image.height;
+
+    for (int c = 0; c < 4; c++)
+    {
+        double sum = 0.0;
+        int minimum = 255;
+        int maximum = 0;
+        int values[4];
+        for (int y = 0; y < image.height; y++)
+        {
+            for (int x = 0; x < image.width; x++)
+            {
+                ReferenceValues(image, x, y, values);
+                sum += values[c];
+                minimum = std::min(minimum, values[c]);
+                maximum = std::max(maximum, values[c]);
+            }
+        }
+
+        double mean = sum / statistics.pixelCount;
+        double squares = 0.0;
+        for (int y = 0; y < image.height; y++)
+        {
+            for (int x = 0; x < image.width; x++)
+            {
+                ReferenceValues(image, x, y, values);
+                squares += (values[c] - mean) * (values[c] - mean);
+            }
+        }
+
+        statistics.mean[c] = mean;
+        statistics.standardDeviation[c] = sqrt(squares / statistics.pixelCount);
+        statistics.minimum[c] = (unsigned char)minimum;
+        statistics.maximum[c] = (unsigned char)maximum;
+    }
+
+    return statistics;
+}
+
+//******************************************************************************************
+// @name                    : CheckStatistics
+//
+// @description             : Compares statistics with the reference, means and deviations to
+//                            within rounding.
+//
+// @returns                 : Nothing
+//********************************************************************************************
+static void CheckStatistics(const image_statistics_t &statistics, const test_image_t &image, const char *what)
+{
+    image_statistics_t expected = ReferenceStatistics(image);
+    bool same = statistics.pixelCount == expected.pixelCount;
+    for (int c = 0; c < 4; c++)
+    {
+        same = same && fabs(statistics.mean[c] - expected.mean[c]) < 1e-9 &&
+               fabs(statistics.standardDeviation[c] - expected.standardDeviation[c]) < 1e-6 &&
+               statistics.minimum[c] == expected.minimum[c] && statistics.maximum[c] == expected.maximum[c];
+    }
+
+    if (!same)
+    {
+        printf("%s of %dx%d, %d bpp: brightness mean %f, deviation %f, %d to %d; expected %f, %f, %d to %d\n", what,
+               image.width, image.height, image.bitsPerPixel, statistics.mean[BRIGHTNESS],
+               statistics.standardDeviation[BRIGHTNESS], statistics.minimum[BRIGHTNESS], statistics.maximum[BRIGHTNESS],
+               expected.mean[BRIGHTNESS], expected.standardDeviation[BRIGHTNESS], expected.minimum[BRIGHTNESS],
+               expected.maximum[BRIGHTNESS]);
+    }
+    CHECK(same);
+}
+
+//******************************************************************************************
+// @name                    : CheckSampledHistograms
+//
+// @description             : Loads an image with sampled histograms and equalizes it. The
+//                            table maps level v to floor(255 * F(v)), F being the sampled
+//                            distribution, so F(v) is known to 1 / 255 for every level in the
+//                            image; it must be within the error bound of the exact
+//                            distribution. The mean, an integral of the distribution, is then
+//                            within 255 times the bound.
+//
+// @param sampling          : Fraction of the pixels to sample
+//
+// @returns                 : Nothing
+//********************************************************************************************
+static void CheckSampledHistograms(const test_image_t &image, double sampling)
+{
+    vector<unsigned char> file = EncodeTestImage(image);
+    bitmap_load_options_t options = { 0, 0, 0, 0, 1, sampling };
+    BitmapImage bitmap(&file[0], file.size(), "sampled.bmp", &options);
+
+    // One pixel of every step x step block, blocks cut by the edges sometimes
+    int step = std::max(1, (int)(1.0 / sqrt(sampling)));
+    double bound = bitmap.getHistogramErrorBound();
+    double least = (double)(image.width / step) * (image.height / step);
+    double most = (double)((image.width + step - 1) / step) * ((image.height + step - 1) / step);
+    double factor = log(2.0 / HISTOGRAM_ERROR_PROBABILITY) / 2.0;
+    CHECK(step > 1 && bound > 0.0);
+    CHECK(bound >= sqrt(factor / most) && bound <= sqrt(factor / least));
+
+    test_image_t equalized;
+    CHECK(bitmap.doHistogramEqualization(PROCESS_PER_CHANNEL) == 0 && ModifiedTestImage(bitmap, equalized));
+    if (equalized.pixels.size() != image.pixels.size())
+    {
+        return;
+    }
+
+    image_statistics_t statistics;
+    image_statistics_t expected = ReferenceStatistics(image);
+    CHECK(bitmap.getImageStatistics(statistics) == 0);
+    CHECK(statistics.pixelCount == expected.pixelCount);
+
+    for (int c = RED; c <= BLUE; c++)
+    {
+        // Exact distribution, and the table entry of every level in the image
+        long long counts[MAX_COLORS] = { 0 };
+        int lut[MAX_COLORS];
+        std::fill(lut, lut + MAX_COLORS, -1);
+        int values[4];
+        int mapped[4];
+        for (int y = 0; y < image.height; y++)
+        {
+            for (int x = 0; x < image.width; x++)
+            {
+                ReferenceValues(image, x, y, values);
+                ReferenceValues(equalized, x, y, mapped);
+                counts[values[c]]++;
+                lut[values[c]] = mapped[c];
+            }
+        }
+
+        double worst = 0.0;
+        long long below = 0;
+        for (int v = 0; v < MAX_COLORS; v++)
+        {
+            below += counts[v];
+            if (lut[v] < 0)
+            {
+                continue;
+            }
+
+            double exact = (double)below / expected.pixelCount;
+            double lowest = lut[v] / 255.0;
+            double highest = (lut[v] + 1) / 255.0;
+            worst = std::max(worst, std::max(lowest - exact, exact - highest));
+        }
+
+        double meanError = fabs(statistics.mean[c] - expected.mean[c]);
+        if (worst > bound + 1e-9 || meanError > 255.0 * bound + 1e-9)
+        {
+            printf("sampling %f of %dx%d, %d bpp, channel %d: distribution off by %f, mean by %f, bound %f\n",
+                   sampling, image.width, image.height, image.bitsPerPixel, c, worst, meanError, bound);
+        }
+        CHECK(worst <= bound + 1e-9);
+        CHECK(meanError <= 255.0 * bound + 1e-9);
+    }
+}
+
+int main()
+{
+    const short formats[] = { 8, 24, 32 };
+    // Rows shorter and longer than a SIMD step, and more rows than a band
+    const int sizes[][2] = { { 1, 1 }, { 5, 3 }, { 47, 35 }, { 300, 90 } };
+
+    for (short bitsPerPixel : formats)
+    {
+        for (size_t s = 0; s < sizeof(sizes) / sizeof(sizes[0]); s++)
+        {
+            test_image_t image = MakeTestImage(sizes[s][0], sizes[s][1], bitsPerPixel, (unsigned int)s * 13 + bitsPerPixel);
+            vector<unsigned char> file = EncodeTestImage(image);
+            BitmapImage bitmap(&file[0], file.size(), "statistics.bmp");
+            image_statistics_t statistics;
+
+            CHECK(bitmap.getImageStatistics(statistics) == 0);
+            CheckStatistics(statistics, image, "loaded image");
+            CHECK(bitmap.getHistogramErrorBound() == 0.0);
+            CHECK(bitmap.getModifiedImageStatistics(statistics) != 0);
+
+            // The histograms follow edits
+            int bytesPerPixel = TestBytesPerPixel(bitsPerPixel);
+            int width = std::min(image.width, 4);
+            int height = std::min(image.height, 3);
+            vector<unsigned char> patch((size_t)width * height * bytesPerPixel, 255);
+            CHECK(bitmap.writePixelRect(0, 0, width, height, &patch[0], width * bytesPerPixel) == 0);
+            for (int y = 0; y < height; y++)
+            {
+                memset(TestPixel(image, 0, y), 255, (size_t)width * bytesPerPixel);
+            }
+            CHECK(bitmap.getImageStatistics(statistics) == 0);
+            CheckStatistics(statistics, image, "edited image");
+
+            // Modified images, in one pass over their rows
+            test_image_t modified;
+            CHECK(bitmap.DoImageBlur() == 0 && ModifiedTestImage(bitmap, modified));
+            CHECK(bitmap.getModifiedImageStatistics(statistics) == 0);
+            CheckStatistics(statistics, modified, "blurred image");
+
+            CHECK(bitmap.TransformImage(TRANSFORM_ROTATE_90) == 0 && ModifiedTestImage(bitmap, modified));
+            CHECK(bitmap.getModifiedImageStatistics(statistics) == 0);
+            CheckStatistics(statistics, modified, "rotated image");
+        }
+    }
+
+    // Sampled histograms of noise, and of a gradient across the image
+    const double samplings[] = { 0.2, 0.05 };
+    for (short bitsPerPixel : formats)
+    {
+        test_image_t noise = MakeTestImage(601, 403, bitsPerPixel, 17 + bitsPerPixel);
+        test_image_t gradient = noise;
+        int bytesPerPixel = TestBytesPerPixel(bitsPerPixel);
+        for (int y = 0; y < gradient.height; y++)
+        {
+            for (int x = 0; x < gradient.width; x++)
+            {
+                for (int c = 0; c < bytesPerPixel; c++)
+                {
+                    unsigned char &value = TestPixel(gradient, x, y)[c];
+                    value = (unsigned char)std::min(x * 240 / gradient.width + y * 40 / gradient.height + value % 8, 255);
+                }
+            }
+        }
+
+        for (double sampling : samplings)
+        {
+            CheckSampledHistograms(noise, sampling);
+            CheckSampledHistograms(gradient, sampling);
+        }
+    }
+
+    return TEST_RESULT();
+}
@@ -0,0 +1,230 @@
+// Compares BinarizeImage() with thresholding every pixel on its own: Otsu's threshold found by
+// trying every level, and the adaptive threshold from the mean of the window around the pixel.
+// The bits are read straight from the 1 bit rows of the file.
+#include"test_util.h"
+#include"../pixel_kernels.h"
+#include<algorithm>
+
+//******************************************************************************************
+// @name                    : ReferenceLuma
+//
+// @description             : Brightness of every pixel, top row first.
+//
+// @returns                 : width * height values
+//********************************************************************************************
+static vector<unsigned char> ReferenceLuma(const test_image_t &image)
+{
+    vector<unsigned char> luma((size_t)image.width * image.height);
+    for (int y = 0; y < image.height; y++)
+    {
+        for (int x = 0; x < image.width; x++)
+        {
+            const unsigned char *p = TestPixel(image, x, y);
+            luma[(size_t)y * image.width + x] = (image.bitsPerPixel == 8) ? LumaFromRGB(p[0], p[0], p[0])
+                                                                         : LumaFromRGB(p[2], p[1], p[0]);
+        }
+    }
+    return luma;
+}
+
+//******************************************************************************************
+// @name                    : ReferenceOtsu
+//
+// @description             : Tries every threshold t, with the dark class at or below it, and
+//                            keeps the first with the largest variance between the classes,
+//                            n0 * n1 * (m0 - m1)^2 = (s0 * n1 - s1 * n0)^2 / (n0 * n1), compared
+//                            exactly in integers. Middle of the range if there is one class.
+//
+// @returns                 : Threshold
+//********************************************************************************************
+static int ReferenceOtsu(const vector<unsigned char> &luma)
+{
+    int threshold = (Y_MIN + Y_MAX) / 2;
+    unsigned __int128 bestNumerator = 0;
+    unsigned __int128 bestDenominator = 1;
+    bool found = false;
+
+    for (int t = 0; t < MAX_COLORS - 1; t++)
+    {
+        long long darkCount = 0, darkSum = 0, brightCount = 0, brightSum = 0;
+        for (unsigned char value : luma)
+        {
+            if (value <= t)
+            {
+                darkCount++;
+                darkSum += value;
+            }
+            else
+            {
+                brightCount++;
+                brightSum += value;
+            }
+        }
+        if (darkCount == 0 || brightCount == 0)
+        {
+            continue;
+        }
+
+        long long difference = brightSum * darkCount - darkSum * brightCount;
+        unsigned __int128 numerator = (unsigned __int128)(difference * (__int128)difference);
+        unsigned __int128 denominator = (unsigned __int128)darkCount * brightCount;
+        if (!found || numerator * bestDenominator > bestNumerator * denominator)
+        {
+            bestNumerator = numerator;
+            bestDenominator = denominator;
+            threshold = t;
+            found = true;
+        }
+    }
+
+    return threshold;
+}
+
+//******************************************************************************************
+// @name                    : ReferenceAdaptive
+//
+// @description             : Threshold of every pixel: the mean brightness of the window of
+//                            side 2 * (windowSize / 2) + 1 around it, clipped to the image and
+//                            rounded down, less the bias, clamped to 0..255.
+//
+// @returns                 : width * height thresholds
+//********************************************************************************************
+static vector<int> ReferenceAdaptive(const vector<unsigned char> &luma, int width, int height, int windowSize, int bias)
+{
+    int radius = windowSize / 2;
+    vector<int> thresholds((size_t)width * height);
+    for (int y = 0; y < height; y++)
+    {
+        for (int x = 0; x < width; x++)
+        {
+            long long sum = 0;
+            int count = 0;
+            for (int wy = std::max(y - radius, 0); wy <= std::min(y + radius, height - 1); wy++)
+            {
+                for (int wx = std::max(x - radius, 0); wx <= std::min(x + radius, width - 1); wx++)
+                {
+                    sum += luma[(size_t)wy * width + wx];
+                    count++;
+                }
+            }
+            thresholds[(size_t)y * width + x] = std::min(std::max((int)(sum / count) - bias, 0), 255);
+        }
+    }
+    return thresholds;
+}
+
+//******************************************************************************************
+// @name                    : CheckBits
+//
+// @description             : Compares the 1 bit rows of a binarized file with the reference:
+//                            bit 7 - x % 8 of byte x / 8 of a row is set for a white pixel,
+//                            and the bits after the last pixel of a row are clear.
+//
+// @returns                 : Number of wrong bits
+//********************************************************************************************
+static int CheckBits(const vector<unsigned char> &file, int width, int height, const vector<unsigned char> &luma,
+                     const vector<int> &thresholds)
+{
+    size_t dataOffset = GetLittleEndian(file, 10, 4);
+    size_t rowBytes = ((size_t)width + 31) / 32 * 4;
+    bool topDown = (int)GetLittleEndian(file, 22, 4) < 0;
+    if (file.size() < dataOffset + rowBytes * height)
+    {
+        return width * height;
+    }
+
+    int mismatches = 0;
+    for (int y = 0; y < height; y++)
+    {
+        const unsigned char *row = &file[dataOffset + rowBytes * (topDown ? y : height - 1 - y)];
+        for (int x = 0; x < (width + 7) / 8 * 8; x++)
+        {
+            bool white = (x < width) && luma[(size_t)y * width + x] > thresholds[(size_t)y * width + x];
+            bool set = (row[x / 8] & (0x80 >> (x % 8))) != 0;
+            mismatches += (white != set);
+        }
+    }
+    return mismatches;
+}
+
+//******************************************************************************************
+// @name                    : CheckBinarize
+//
+// @description             : Binarizes an image both ways and compares the threshold, the
+//                            palette and the bits with the reference.
+//
+// @returns                 : Nothing
+//********************************************************************************************
+static void CheckBinarize(const test_image_t &image, int windowSize, int bias)
+{
+    vector<unsigned char> file = EncodeTestImage(image);
+    BitmapImage bitmap(&file[0], file.size(), "threshold.bmp");
+    vector<unsigned char> luma = ReferenceLuma(image);
+
+    int otsu = ReferenceOtsu(luma);
+    CHECK(bitmap.getOtsuThreshold() == otsu);
+
+    const threshold_method_t methods[] = { THRESHOLD_OTSU, THRESHOLD_ADAPTIVE_MEAN };
+    for (threshold_method_t method : methods)
+    {
+        vector<int> thresholds = (method == THRESHOLD_OTSU) ? vector<int>(luma.size(), otsu)
+                                 : ReferenceAdaptive(luma, image.width, image.height, windowSize, bias);
+
+        vector<unsigned char> result;
+        test_image_t binarized;
+        CHECK(bitmap.BinarizeImage(method, windowSize, bias) == 0);
+        CHECK(bitmap.getModifiedImageFileData(result) == 0 && DecodeTestImage(result, binarized));
+        CHECK(binarized.bitsPerPixel == MONOCHROME && binarized.width == image.width &&
+              binarized.height == image.height);
+        CHECK(binarized.palette.size() >= 8 && binarized.palette[0] == 0 && binarized.palette[4] == 255);
+
+        int mismatches = CheckBits(result, image.width, image.height, luma, thresholds);
+        if (mismatches != 0)
+        {
+            printf("binarize %d of %dx%d, %d bpp, window %d, bias %d: %d wrong bits\n", method, image.width,
+                   image.height, image.bitsPerPixel, windowSize, bias, mismatches);
+        }
+        CHECK(mismatches == 0);
+    }
+}
+
+int main()
+{
+    const short formats[] = { 8, 24, 32 };
+    // Odd widths which end inside a byte, and rows longer than a SIMD step
+    const int sizes[][2] = { { 1, 1 }, { 7, 3 }, { 17, 5 }, { 33, 20 }, { 47, 35 } };
+    const int windows[][2] = { { 1, 0 }, { 4, 3 }, { 15, -5 }, { ADAPTIVE_THRESHOLD_WINDOW, 10 } };
+
+    for (short bitsPerPixel : formats)
+    {
+        for (size_t s = 0; s < sizeof(sizes) / sizeof(sizes[0]); s++)
+        {
+            test_image_t noise = MakeTestImage(sizes[s][0], sizes[s][1], bitsPerPixel, (unsigned int)s * 7 + bitsPerPixel);
+
+            // Dark text on a light page: two levels with a little noise
+            test_image_t page = noise;
+            unsigned int seed = (unsigned int)s + 3;
+            for (size_t i = 0; i < page.pixels.size(); i++)
+            {
+                page.pixels[i] = (unsigned char)(((i / 5) % 3 == 0 ? 40 : 200) + TestRandom(seed) % 20);
+            }
+
+            for (size_t w = 0; w < sizeof(windows) / sizeof(windows[0]); w++)
+            {
+                CheckBinarize(noise, windows[w][0], windows[w][1]);
+                CheckBinarize(page, windows[w][0], windows[w][1]);
+            }
+        }
+
+        // A single level has no second class
+        test_image_t flat = MakeTestImage(9, 4, bitsPerPixel, 1);
+        std::fill(flat.pixels.begin(), flat.pixels.end(), 90);
+        CheckBinarize(flat, 3, 0);
+    }
+
+    vector<unsigned char> file = EncodeTestImage(MakeTestImage(8, 8, 24, 1));
+    BitmapImage bitmap(&file[0], file.size(), "threshold.bmp");
+    CHECK(bitmap.BinarizeImage(THRESHOLD_ADAPTIVE_MEAN, 0, 0) != 0);
+
+    return TEST_RESULT();
+}
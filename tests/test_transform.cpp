@@ -0,0 +1,100 @@
+// Compares TransformImage() with moving every pixel to its place.
+#include"test_util.h"
+
+//******************************************************************************************
+// @name                    : SourcePixel
+//
+// @description             : Where a pixel of the result comes from. Coordinates are from
+//                            the top left corner; rotations are clockwise.
+//
+// @param width             : Source width
+// @param height            : Source height
+//
+// @returns                 : Nothing
+//********************************************************************************************
+static void SourcePixel(geometric_transform_t transform, int width, int height, int x, int y, int &sourceX, int &sourceY)
+{
+    switch (transform)
+    {
+        case TRANSFORM_ROTATE_90:       sourceX = y;                sourceY = height - 1 - x;   break;
+        case TRANSFORM_ROTATE_180:      sourceX = width - 1 - x;    sourceY = height - 1 - y;   break;
+        case TRANSFORM_ROTATE_270:      sourceX = width - 1 - y;    sourceY = x;                break;
+        case TRANSFORM_FLIP_HORIZONTAL: sourceX = width - 1 - x;    sourceY = y;                break;
+        case TRANSFORM_FLIP_VERTICAL:   sourceX = x;                sourceY = height - 1 - y;   break;
+        default:                        sourceX = y;                sourceY = x;                break;
+    }
+}
+
+//******************************************************************************************
+// @name                    : CheckTransform
+//
+// @description             : Transforms a random image and compares every pixel.
+//
+// @returns                 : Nothing
+//********************************************************************************************
+static void CheckTransform(int width, int height, short bitsPerPixel, geometric_transform_t transform, bool flipByHeader)
+{
+    test_image_t image = MakeTestImage(width, height, bitsPerPixel, width * 131 + height * 7 + transform);
+    vector<unsigned char> file = EncodeTestImage(image);
+    BitmapImage bitmap(&file[0], file.size(), "transform.bmp");
+    CHECK(bitmap.TransformImage(transform, flipByHeader) == 0);
+
+    test_image_t result;
+    CHECK(ModifiedTestImage(bitmap, result));
+
+    bool swapped = (transform == TRANSFORM_ROTATE_90 || transform == TRANSFORM_ROTATE_270 || transform == TRANSFORM_TRANSPOSE);
+    CHECK(result.width == (swapped ? height : width));
+    CHECK(result.height == (swapped ? width : height));
+    if (result.width != (swapped ? height : width) || result.height != (swapped ? width : height))
+    {
+        return;
+    }
+
+    int bytesPerPixel = TestBytesPerPixel(bitsPerPixel);
+    int mismatches = 0;
+    for (int y = 0; y < result.height; y++)
+    {
+        for (int x = 0; x < result.width; x++)
+        {
+            int sourceX = 0;
+            int sourceY = 0;
+            SourcePixel(transform, width, height, x, y, sourceX, sourceY);
+            mismatches += (memcmp(TestPixel(result, x, y), TestPixel(image, sourceX, sourceY), bytesPerPixel) != 0);
+        }
+    }
+
+    if (mismatches != 0)
+    {
+        printf("transform %d of %dx%d, %d bpp, by header %d: %d mismatches\n",
+               transform, width, height, bitsPerPixel, flipByHeader, mismatches);
+    }
+    CHECK(mismatches == 0);
+}
+
+int main()
+{
+    const short formats[] = { 8, 24, 32 };
+    const geometric_transform_t transforms[] =
+    {
+        TRANSFORM_ROTATE_90, TRANSFORM_ROTATE_180, TRANSFORM_ROTATE_270,
+        TRANSFORM_FLIP_HORIZONTAL, TRANSFORM_FLIP_VERTICAL, TRANSFORM_TRANSPOSE
+    };
+    // Sizes around the SIMD blocks and the tiles, and a few across several tiles
+    const int sizes[][2] = { { 1, 1 }, { 1, 9 }, { 7, 3 }, { 8, 8 }, { 17, 33 }, { 64, 64 }, { 65, 63 }, { 200, 131 }, { 3, 300 } };
+
+    for (short bitsPerPixel : formats)
+    {
+        for (geometric_transform_t transform : transforms)
+        {
+            for (size_t s = 0; s < sizeof(sizes) / sizeof(sizes[0]); s++)
+            {
+                CheckTransform(sizes[s][0], sizes[s][1], bitsPerPixel, transform, false);
+            }
+        }
+
+        CheckTransform(37, 21, bitsPerPixel, TRANSFORM_FLIP_VERTICAL, true);
+        CheckTransform(37, 21, bitsPerPixel, TRANSFORM_ROTATE_180, true);
+    }
+
+    return TEST_RESULT();
+}
@@ -0,0 +1,280 @@
+#ifndef TEST_UTIL_H
+#define TEST_UTIL_H
+
+#include"../bmp.h"
+#include<stdio.h>
+#include<string.h>
+#include<vector>
+
+using namespace std;
+
+const int TEST_FILE_HEADER_SIZE = 14;
+const int TEST_INFO_HEADER_SIZE = 40;
+
+// An image as the tests see it: rows top-down and unpadded. Pixels of up to
+// 8 bits per pixel are palette indices, one byte each; wider pixels are their
+// BGR or BGRA bytes.
+typedef struct test_image_tag
+{
+    int width;
+    int height;
+    short bitsPerPixel;
+    vector<unsigned char> pixels;
+    vector<unsigned char> palette;  // BGRA entries of palettized images
+}test_image_t;
+
+static int g_testFailures = 0;
+
+#define CHECK(condition) \
+    do { if (!(condition)) { printf("FAILED %s:%d: %s\n", __FILE__, __LINE__, #condition); g_testFailures++; } } while (0)
+
+#define TEST_RESULT() \
+    (printf("%s: %s\n", __FILE__, (g_testFailures == 0) ? "passed" : "FAILED"), (g_testFailures == 0) ? 0 : 1)
+
+//******************************************************************************************
+// @name                    : TestBytesPerPixel
+//
+// @description             : Bytes per pixel of test_image_t.pixels.
+//
+// @returns                 : 1, 3 or 4
+//********************************************************************************************
+static inline int TestBytesPerPixel(short bitsPerPixel)
+{
+    return (bitsPerPixel <= 8) ? 1 : bitsPerPixel / 8;
+}
+
+//******************************************************************************************
+// @name                    : TestRandom
+//
+// @description             : Linear congruential generator, so the tests are reproducible.
+//
+// @returns                 : 15 random bits
+//********************************************************************************************
+static inline int TestRandom(unsigned int &seed)
+{
+    seed = seed * 1103515245 + 12345;
+    return (int)((seed >> 16) & 0x7FFF);
+}
+
+//******************************************************************************************
+// @name                    : MakeTestImage
+//
+// @description             : Creates an image of random pixels. Images of 8 bits per pixel
+//                            get a gray palette, so the loader keeps them as grayscale.
+//
+// @returns                 : The image
+//********************************************************************************************
+static inline test_image_t MakeTestImage(int width, int height, short bitsPerPixel, unsigned int seed)
+{
+    test_image_t image;
+    image.width = width;
+    image.height = height;
+    image.bitsPerPixel = bitsPerPixel;
+    image.pixels.resize((size_t)width * height * TestBytesPerPixel(bitsPerPixel));
+    for (size_t i = 0; i < image.pixels.size(); i++)
+    {
+        image.pixels[i] = (unsigned char)TestRandom(seed);
+    }
+
+    if (bitsPerPixel == 8)
+    {
+        image.palette.resize(256 * 4);
+        for (int i = 0; i < 256; i++)
+        {
+            image.palette[i * 4] = image.palette[i * 4 + 1] = image.palette[i * 4 + 2] = (unsigned char)i;
+            image.palette[i * 4 + 3] = 0;
+        }
+    }
+
+    return image;
+}
+
+//******************************************************************************************
+// @name                    : PutLittleEndian
+//
+// @description             : Stores the low bytes of a value, least significant first.
+//
+// @returns                 : Nothing
+//********************************************************************************************
+static inline void PutLittleEndian(vector<unsigned char> &data, size_t offset, unsigned int value, int bytes)
+{
+    for (int i = 0; i < bytes; i++)
+    {
+        data[offset + i] = (unsigned char)(value >> (8 * i));
+    }
+}
+
+//******************************************************************************************
+// @name                    : GetLittleEndian
+//
+// @description             : Reads a little endian value.
+//
+// @returns                 : The value
+//********************************************************************************************
+static inline unsigned int GetLittleEndian(const vector<unsigned char> &data, size_t offset, int bytes)
+{
+    unsigned int value = 0;
+    for (int i = 0; i < bytes; i++)
+    {
+        value |= (unsigned int)data[offset + i] << (8 * i);
+    }
+    return value;
+}
+
+//******************************************************************************************
+// @name                    : EncodeTestImage
+//
+// @description             : Writes an image as a bitmap file with a 40 byte info header.
+//                            Compression is stored as given, so the tests can build files
+//                            the loader has to reject.
+//
+// @returns                 : The file
+//********************************************************************************************
+static inline vector<unsigned char> EncodeTestImage(const test_image_t &image, int compression = 0)
+{
+    int paletteBytes = (int)image.palette.size();
+    int rowBytes = BitmapImage::getPaddedRowSize(image.width, image.bitsPerPixel);
+    int dataOffset = TEST_FILE_HEADER_SIZE + TEST_INFO_HEADER_SIZE + paletteBytes;
+    vector<unsigned char> file((size_t)dataOffset + (size_t)rowBytes * image.height, 0);
+
+    file[0] = 'B';
+    file[1] = 'M';
+    PutLittleEndian(file, 2, (unsigned int)file.size(), 4);
+    PutLittleEndian(file, 10, dataOffset, 4);
+    PutLittleEndian(file, 14, TEST_INFO_HEADER_SIZE, 4);
+    PutLittleEndian(file, 18, image.width, 4);
+    PutLittleEndian(file, 22, image.height, 4);
+    PutLittleEndian(file, 26, 1, 2);
+    PutLittleEndian(file, 28, image.bitsPerPixel, 2);
+    PutLittleEndian(file, 30, compression, 4);
+    PutLittleEndian(file, 34, (unsigned int)rowBytes * image.height, 4);
+    PutLittleEndian(file, 46, paletteBytes / 4, 4);
+    if (paletteBytes > 0)
+    {
+        memcpy(&file[TEST_FILE_HEADER_SIZE + TEST_INFO_HEADER_SIZE], &image.palette[0], paletteBytes);
+    }
+
+    // Only formats of whole bytes per pixel are written
+    int lineBytes = image.width * TestBytesPerPixel(image.bitsPerPixel);
+    for (int row = 0; row < image.height; row++)
+    {
+        memcpy(&file[dataOffset + (size_t)rowBytes * (image.height - 1 - row)],
+               &image.pixels[(size_t)lineBytes * row], lineBytes);
+    }
+
+    return file;
+}
+
+//******************************************************************************************
+// @name                    : EncodeTopDown
+//
+// @description             : Writes an image as a top-down bitmap file (negative height).
+//
+// @returns                 : The file
+//********************************************************************************************
+static inline vector<unsigned char> EncodeTopDown(const test_image_t &image)
+{
+    // Bottom-up rows of the upside down image are the top-down rows of the image
+    test_image_t flipped = image;
+    size_t rowBytes = (size_t)image.width * TestBytesPerPixel(image.bitsPerPixel);
+    for (int row = 0; row < image.height; row++)
+    {
+        memcpy(&flipped.pixels[rowBytes * row], &image.pixels[rowBytes * (image.height - 1 - row)], rowBytes);
+    }
+
+    vector<unsigned char> file = EncodeTestImage(flipped);
+    PutLittleEndian(file, 22, (unsigned int)-image.height, 4);
+    return file;
+}
+
+//******************************************************************************************
+// @name                    : DecodeTestImage
+//
+// @description             : Reads an uncompressed bitmap file of 1, 4, 8, 24 or 32 bits
+//                            per pixel, stored bottom-up or top-down (negative height).
+//
+// @returns                 : true if the file could be read
+//********************************************************************************************
+static inline bool DecodeTestImage(const vector<unsigned char> &file, test_image_t &image)
+{
+    if (file.size() < (size_t)(TEST_FILE_HEADER_SIZE + TEST_INFO_HEADER_SIZE) || file[0] != 'B' || file[1] != 'M')
+    {
+        return false;
+    }
+
+    int dataOffset = (int)GetLittleEndian(file, 10, 4);
+    int infoHeaderSize = (int)GetLittleEndian(file, 14, 4);
+    image.width = (int)GetLittleEndian(file, 18, 4);
+    image.height = (int)GetLittleEndian(file, 22, 4);
+    image.bitsPerPixel = (short)GetLittleEndian(file, 28, 2);
+    bool topDown = image.height < 0;
+    image.height = topDown ? -image.height : image.height;
+    if (GetLittleEndian(file, 30, 4) != 0 || image.width <= 0 || image.height <= 0)
+    {
+        return false;
+    }
+
+    int rowBytes = BitmapImage::getPaddedRowSize(image.width, image.bitsPerPixel);
+    if ((size_t)dataOffset + (size_t)rowBytes * image.height > file.size())
+    {
+        return false;
+    }
+
+    int paletteStart = TEST_FILE_HEADER_SIZE + infoHeaderSize;
+    image.palette.assign(file.begin() + paletteStart, file.begin() + dataOffset);
+
+    int bytesPerPixel = TestBytesPerPixel(image.bitsPerPixel);
+    image.pixels.resize((size_t)image.width * image.height * bytesPerPixel);
+    for (int row = 0; row < image.height; row++)
+    {
+        const unsigned char *in = &file[dataOffset + (size_t)rowBytes * (topDown ? row : image.height - 1 - row)];
+        unsigned char *out = &image.pixels[(size_t)image.width * bytesPerPixel * row];
+        if (image.bitsPerPixel >= 8)
+        {
+            memcpy(out, in, (size_t)image.width * bytesPerPixel);
+            continue;
+        }
+
+        int perByte = 8 / image.bitsPerPixel;
+        int mask = (1 << image.bitsPerPixel) - 1;
+        for (int x = 0; x < image.width; x++)
+        {
+            int shift = 8 - image.bitsPerPixel * (x % perByte + 1);
+            out[x] = (unsigned char)((in[x / perByte] >> shift) & mask);
+        }
+    }
+
+    return true;
+}
+
+//******************************************************************************************
+// @name                    : ModifiedTestImage
+//
+// @description             : The modified image of a bitmap, decoded.
+//
+// @returns                 : true if it could be read
+//********************************************************************************************
+static inline bool ModifiedTestImage(BitmapImage &bitmap, test_image_t &image)
+{
+    vector<unsigned char> file;
+    return bitmap.getModifiedImageFileData(file) == 0 && DecodeTestImage(file, image);
+}
+
+//******************************************************************************************
+// @name                    : TestPixel
+//
+// @description             : Address of a channel of a pixel.
+//
+// @returns                 : Pointer into the pixels
+//********************************************************************************************
+static inline unsigned char* TestPixel(test_image_t &image, int x, int y)
+{
+    return &image.pixels[((size_t)y * image.width + x) * TestBytesPerPixel(image.bitsPerPixel)];
+}
+
+static inline const unsigned char* TestPixel(const test_image_t &image, int x, int y)
+{
+    return &image.pixels[((size_t)y * image.width + x) * TestBytesPerPixel(image.bitsPerPixel)];
+}
+
+#endif
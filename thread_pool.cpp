@@ -0,0 +1,330 @@
+#include"thread_pool.h"
+#include"numa_memory.h"
+#include<atomic>
+#include<stdio.h>
+#include<stdlib.h>
+
+// parallelFor calls of this thread run on it alone, see setRunInline
+static thread_local bool t_runInline = false;
+
+// NUMA node of a pool thread, whose tasks it takes first. 0 for other threads.
+static thread_local int t_node = 0;
+
+//******************************************************************************************
+// @name                    : ThreadPool
+//
+// @description             : Constructor. Starts the worker threads. On NUMA machines the
+//                            threads are spread over the nodes in equal blocks and pinned
+//                            to their node, see parallelFor.
+//
+// @param threadCount       : Number of worker threads. The thread calling parallelFor
+//                            also does work, so 0 runs everything on the caller.
+//
+// @returns                 : Nothing
+//********************************************************************************************
+ThreadPool::ThreadPool(int threadCount)
+{
+    m_stop = false;
+    m_pendingTasks = 0;
+
+    int nodeCount = GetNumaNodeCount();
+    m_tasks.resize(nodeCount);
+
+    // The calling thread counts as thread 0, on node 0
+    for (int i = 0; i < threadCount; i++)
+    {
+        int node = (int)((long long)(i + 1) * nodeCount / (threadCount + 1));
+        m_workers.push_back(std::thread(&ThreadPool::workerLoop, this, node));
+    }
+}
+
+//******************************************************************************************
+// @name                    : ~ThreadPool
+//
+// @description             : Destructor. Lets the workers finish queued tasks and joins them.
+//
+// @returns                 : Nothing
+//********************************************************************************************
+ThreadPool::~ThreadPool()
+{
+    {
+        std::unique_lock<std::mutex> lock(m_mutex);
+        m_stop = true;
+    }
+    m_condition.notify_all();
+
+    for (size_t i = 0; i < m_workers.size(); i++)
+    {
+        m_workers[i].join();
+    }
+}
+
+//******************************************************************************************
+// @name                    : GetPoolWorkerCount
+//
+// @description             : This is a static function. Workers of the shared pool: one per
+//                            hardware thread but the caller, or BMP_THREADS threads
+//                            (including the caller) when set. Setting it lets the parallel
+//                            paths be tested on small machines and pinned in benchmarks.
+//
+// @returns                 : Worker count
+//********************************************************************************************
+static int GetPoolWorkerCount()
+{
+    int threadCount = (int)std::thread::hardware_concurrency();
+
+    const char *value = getenv(THREADS_ENVIRONMENT_VARIABLE);
+    if (value != nullptr && *value != '\0')
+    {
+        int requested = atoi(value);
+        if (requested >= 1 && requested <= MAX_POOL_THREADS)
+        {
+            threadCount = requested;
+        }
+        else
+        {
+            printf("WARNING: Ignoring %s=%s\n", THREADS_ENVIRONMENT_VARIABLE, value);
+        }
+    }
+
+    return (threadCount > 1) ? threadCount - 1 : 0;
+}
+
+//******************************************************************************************
+// @name                    : getInstance
+//
+// @description             : This is a static function. Returns the process wide pool, sized
+//                            by GetPoolWorkerCount.
+//
+// @returns                 : Reference to the shared pool
+//********************************************************************************************
+ThreadPool& ThreadPool::getInstance()
+{
+    static ThreadPool pool(GetPoolWorkerCount());
+    return pool;
+}
+
+//******************************************************************************************
+// @name                    : getThreadCount
+//
+// @description             : Number of threads doing work in parallelFor, including the caller
+//
+// @returns                 : Thread count
+//********************************************************************************************
+int ThreadPool::getThreadCount()
+{
+    return (int)m_workers.size() + 1;
+}
+
+//******************************************************************************************
+// @name                    : setRunInline
+//
+// @description             : This is a static function. Makes parallelFor calls from the
+//                            calling thread run every band on that thread. For threads which
+//                            each process a different small image: splitting such an image
+//                            costs more than it saves, and the other threads are busy anyway.
+//
+// @param runInline         : true to run inline, false to use the pool again
+//
+// @returns                 : Nothing
+//********************************************************************************************
+void ThreadPool::setRunInline(bool runInline)
+{
+    t_runInline = runInline;
+}
+
+//******************************************************************************************
+// @name                    : workerLoop
+//
+// @description             : Body of every worker thread. Waits for tasks and runs them.
+//
+// @param node              : NUMA node the thread is pinned to
+//
+// @returns                 : Nothing
+//********************************************************************************************
+void ThreadPool::workerLoop(int node)
+{
+    t_node = node;
+    if (m_tasks.size() > 1 && IsThreadPinningEnabled())
+    {
+        PinCurrentThreadToNumaNode(node);
+    }
+
+    while (true)
+    {
+        std::function<void()> task;
+        {
+            std::unique_lock<std::mutex> lock(m_mutex);
+            m_condition.wait(lock, [this] { return m_stop || m_pendingTasks > 0; });
+            if (m_stop && m_pendingTasks == 0)
+            {
+                return;
+            }
+
+            this->takeTask(node, task);
+        }
+
+        task();
+    }
+}
+
+//******************************************************************************************
+// @name                    : takeTask
+//
+// @description             : Takes the oldest task of a node's queue, or else of the next
+//                            other node's queue that has one. Called with m_mutex held.
+//
+// @returns                 : true if a task was taken
+//********************************************************************************************
+bool ThreadPool::takeTask(int node, std::function<void()> &task)
+{
+    int nodeCount = (int)m_tasks.size();
+
+    for (int i = 0; i < nodeCount; i++)
+    {
+        std::deque<std::function<void()>> &queue = m_tasks[(node + i) % nodeCount];
+        if (!queue.empty())
+        {
+            task = std::move(queue.front());
+            queue.pop_front();
+            m_pendingTasks--;
+            return true;
+        }
+    }
+
+    return false;
+}
+
+//******************************************************************************************
+// @name                    : runPendingTask
+//
+// @description             : Runs one queued task on the calling thread, if there is any.
+//                            Lets a waiting thread help instead of blocking, which also
+//                            keeps nested parallelFor calls from deadlocking.
+//
+// @returns                 : true if a task was run
+//********************************************************************************************
+bool ThreadPool::runPendingTask()
+{
+    std::function<void()> task;
+    {
+        std::unique_lock<std::mutex> lock(m_mutex);
+        if (!this->takeTask(t_node, task))
+        {
+            return false;
+        }
+    }
+
+    task();
+    return true;
+}
+
+//******************************************************************************************
+// @name                    : parallelFor
+//
+// @description             : Splits [0, count) in bands of at least grainSize items and
+//                            runs func on every band. Returns when all bands are done. On
+//                            NUMA machines the bands are queued for the nodes in equal
+//                            blocks, first band to node 0, and a node's threads run its
+//                            bands unless they are idle while another node has some left.
+//                            Large images get the same bands for any grain, so the rows
+//                            whose pages a node touched first (AllocatePixelMemory) are the
+//                            rows its threads go on to process.
+//
+// @param count             : Number of items (usually image rows)
+// @param grainSize         : Minimum number of items in a band
+// @param func              : Called as func(begin, end) for every band
+//
+// @returns                 : Nothing
+//********************************************************************************************
+void ThreadPool::parallelFor(int count, int grainSize, const std::function<void(int begin, int end)> &func)
+{
+    if (count <= 0)
+    {
+        return;
+    }
+
+    if (grainSize < 1)
+    {
+        grainSize = 1;
+    }
+
+    // A few bands per thread so that uneven bands balance out
+    int bands = (count + grainSize - 1) / grainSize;
+    int maxBands = getThreadCount() * 4;
+    if (bands > maxBands)
+    {
+        bands = maxBands;
+    }
+
+    if (bands <= 1 || m_workers.empty() || t_runInline)
+    {
+        func(0, count);
+        return;
+    }
+
+    std::atomic<int> remaining(bands - 1);
+    int bandSize = (count + bands - 1) / bands;
+
+    {
+        std::unique_lock<std::mutex> lock(m_mutex);
+        for (int band = 1; band < bands; band++)
+        {
+            int begin = band * bandSize;
+            int end = (begin + bandSize < count) ? begin + bandSize : count;
+            int node = (int)((long long)band * m_tasks.size() / bands);
+            m_tasks[node].push_back([&func, &remaining, begin, end]
+            {
+                if (begin < end)
+                {
+                    func(begin, end);
+                }
+                remaining--;
+            });
+            m_pendingTasks++;
+        }
+    }
+    m_condition.notify_all();
+
+    // First band runs on the calling thread
+    func(0, (bandSize < count) ? bandSize : count);
+
+    while (remaining > 0)
+    {
+        if (!runPendingTask())
+        {
+            std::this_thread::yield();
+        }
+    }
+}
+
+//******************************************************************************************
+// @name                    : runOnThreads
+//
+// @description             : Runs func once for every thread of the pool, the calling thread
+//                            first, and returns when all the calls are done. For work the
+//                            threads share out among themselves, such as taking rows from a
+//                            counter: the calls that start late find nothing left. Runs func
+//                            once on the calling thread alone when parallelFor would.
+//
+// @param func              : Called with no arguments
+//
+// @returns                 : Nothing
+//********************************************************************************************
+void ThreadPool::runOnThreads(const std::function<void()> &func)
+{
+    if (m_workers.empty() || t_runInline)
+    {
+        func();
+        return;
+    }
+
+    // One item to a band, so every band is one call
+    parallelFor(getThreadCount(), 1, [&func](int begin, int end)
+    {
+        for (int call = begin; call < end; call++)
+        {
+            func();
+        }
+    });
+}
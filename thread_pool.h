@@ -0,0 +1,44 @@
+#ifndef _THREAD_POOL_H_
+#define _THREAD_POOL_H_
+#include<functional>
+#include<thread>
+#include<mutex>
+#include<condition_variable>
+#include<deque>
+#include<vector>
+
+// ==================================================================================================
+// Constants
+// ==================================================================================================
+const int DEFAULT_ROWS_PER_TASK = 16;       // Smallest band of rows handed to a worker
+const int MAX_POOL_THREADS = 1024;
+const char* const THREADS_ENVIRONMENT_VARIABLE = "BMP_THREADS";   // Threads of the shared pool, e.g. "8"
+
+// ==================================================================================================
+// ThreadPool class definition
+// ==================================================================================================
+class ThreadPool
+{
+private:
+    std::vector<std::thread> m_workers;               // Worker threads
+    std::vector<std::deque<std::function<void()>>> m_tasks;   // Pending tasks, by the NUMA node they should run on
+    int m_pendingTasks;                               // Tasks in all the queues
+    std::mutex m_mutex;                               // Guards m_tasks, m_pendingTasks and m_stop
+    std::condition_variable m_condition;              // Signalled when a task is queued
+    bool m_stop;                                      // Set when the pool is shutting down
+
+    void workerLoop(int node);
+    bool takeTask(int node, std::function<void()> &task);
+    bool runPendingTask();
+
+public:
+    ThreadPool(int threadCount);
+    ~ThreadPool();
+    static ThreadPool& getInstance();
+    int getThreadCount();
+    static void setRunInline(bool runInline);
+    void parallelFor(int count, int grainSize, const std::function<void(int begin, int end)> &func);
+    void runOnThreads(const std::function<void()> &func);
+};
+
+#endif